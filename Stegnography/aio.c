@@ -0,0 +1,531 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include "aio.h"
+
+/* Threads in the fallback pool, at most one per queue slot */
+#define AIO_MAX_THREADS 8
+
+/* io_uring rings, mapped from the ring fd (no liburing needed) */
+struct _AioRing
+{
+    int fd;
+    int fixed;                        // Buffers registered, use READ_FIXED
+    void *sq_ptr;
+    void *cq_ptr;
+    size_t sq_size;
+    size_t cq_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+};
+
+/* pread() thread pool: a FIFO of queued slots and a FIFO of finished ones */
+struct _AioPool
+{
+    pthread_t threads[AIO_MAX_THREADS];
+    uint nthreads;
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t done;
+    uint *pending;
+    uint pending_head;
+    uint pending_count;
+    uint *finished;
+    uint finished_head;
+    uint finished_count;
+    int stop;
+};
+
+/* ---------- io_uring ---------- */
+
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static void uring_close(struct _AioRing *ring)
+{
+    if (ring->sqes != NULL && ring->sqes != MAP_FAILED)
+    {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_ptr != NULL && ring->cq_ptr != MAP_FAILED && ring->cq_ptr != ring->sq_ptr)
+    {
+        munmap(ring->cq_ptr, ring->cq_size);
+    }
+    if (ring->sq_ptr != NULL && ring->sq_ptr != MAP_FAILED)
+    {
+        munmap(ring->sq_ptr, ring->sq_size);
+    }
+    if (ring->fd >= 0)
+    {
+        close(ring->fd);
+    }
+    free(ring);
+}
+
+static Status uring_init(AioQueue *q)
+{
+    struct io_uring_params p;
+    struct _AioRing *ring = calloc(1, sizeof(*ring));
+
+    if (ring == NULL)
+    {
+        return e_failure;
+    }
+
+    // Step 1: Create the ring
+    memset(&p, 0, sizeof(p));
+    ring->fd = (int)syscall(__NR_io_uring_setup, q->depth, &p);
+    if (ring->fd < 0)
+    {
+        free(ring);
+        return e_failure;
+    }
+
+    // Step 2: Map submission queue, completion queue and SQE array
+    ring->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        ring->sq_size = ring->cq_size = ring->sq_size > ring->cq_size ? ring->sq_size : ring->cq_size;
+    }
+    ring->sq_ptr = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED)
+    {
+        uring_close(ring);
+        return e_failure;
+    }
+    ring->cq_ptr = (p.features & IORING_FEAT_SINGLE_MMAP) ? ring->sq_ptr :
+                   mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring->fd, IORING_OFF_CQ_RING);
+    ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if (ring->cq_ptr == MAP_FAILED || ring->sqes == MAP_FAILED)
+    {
+        uring_close(ring);
+        return e_failure;
+    }
+
+    unsigned char *sq = ring->sq_ptr, *cq = ring->cq_ptr;
+    ring->sq_head = (unsigned *)(sq + p.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + p.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    // Step 3: Register the buffers; without that (e.g. RLIMIT_MEMLOCK) plain READ still works
+    struct iovec *iov = malloc(q->nbuffers * sizeof(*iov));
+    if (iov != NULL)
+    {
+        for (uint i = 0; i < q->nbuffers; i++)
+        {
+            iov[i].iov_base = q->buffers[i];
+            iov[i].iov_len = q->buf_len;
+        }
+        ring->fixed = syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS, iov, q->nbuffers) == 0;
+        free(iov);
+    }
+
+    q->ring = ring;
+    return e_success;
+}
+
+static Status uring_submit(AioQueue *q, uint slot)
+{
+    struct _AioRing *ring = q->ring;
+    AioRequest *req = &q->reqs[slot];
+    unsigned tail = *ring->sq_tail;
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    size_t left = req->len - req->done;
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = ring->fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe->fd = req->fd;
+    sqe->addr = (unsigned long)(req->buf + req->done);
+    sqe->len = left > 0x7FFFF000u ? 0x7FFFF000u : (unsigned)left;
+    sqe->off = req->offset + req->done;
+    sqe->buf_index = req->buf_index;
+    sqe->user_data = slot;
+
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    while (uring_enter(ring->fd, 1, 0, 0) < 0)
+    {
+        if (errno != EINTR)
+        {
+            printf("ERROR: io_uring submit failed: %s\n", strerror(errno));
+            return e_failure;
+        }
+    }
+    return e_success;
+}
+
+/* Next completion (blocking), short reads are resubmitted until done */
+static Status uring_complete(AioQueue *q, uint *slot)
+{
+    struct _AioRing *ring = q->ring;
+
+    while (1)
+    {
+        unsigned head = *ring->cq_head;
+        if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+        {
+            if (uring_enter(ring->fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+            {
+                printf("ERROR: io_uring wait failed: %s\n", strerror(errno));
+                return e_failure;
+            }
+            continue;
+        }
+
+        struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+        uint index = (uint)cqe->user_data;
+        int res = cqe->res;
+        __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+
+        AioRequest *req = &q->reqs[index];
+        if (res > 0 && req->done + res < req->len)
+        {
+            req->done += res;
+            if (uring_submit(q, index) == e_failure)
+            {
+                return e_failure;
+            }
+            continue;
+        }
+        req->result = res < 0 ? res : (long long)(req->done + res);
+        *slot = index;
+        return e_success;
+    }
+}
+
+/* ---------- pread() thread pool ---------- */
+
+static void *pool_worker(void *arg)
+{
+    AioQueue *q = arg;
+    struct _AioPool *pool = q->pool;
+
+    pthread_mutex_lock(&pool->lock);
+    while (1)
+    {
+        while (pool->pending_count == 0 && !pool->stop)
+        {
+            pthread_cond_wait(&pool->work, &pool->lock);
+        }
+        if (pool->stop)
+        {
+            break;
+        }
+        uint slot = pool->pending[pool->pending_head];
+        pool->pending_head = (pool->pending_head + 1) % q->depth;
+        pool->pending_count--;
+        pthread_mutex_unlock(&pool->lock);
+
+        // Blocking read without the lock, looping over short reads
+        AioRequest *req = &q->reqs[slot];
+        req->result = 0;
+        while (req->done < req->len)
+        {
+            ssize_t n = pread(req->fd, req->buf + req->done, req->len - req->done, req->offset + req->done);
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                req->result = n < 0 ? -errno : 0;
+                break;
+            }
+            req->done += n;
+        }
+        if (req->result == 0)
+        {
+            req->result = (long long)req->done;
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        pool->finished[(pool->finished_head + pool->finished_count) % q->depth] = slot;
+        pool->finished_count++;
+        pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+static void pool_close(AioQueue *q)
+{
+    struct _AioPool *pool = q->pool;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+    for (uint i = 0; i < pool->nthreads; i++)
+    {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work);
+    pthread_cond_destroy(&pool->done);
+    free(pool->pending);
+    free(pool->finished);
+    free(pool);
+}
+
+static Status pool_init(AioQueue *q)
+{
+    struct _AioPool *pool = calloc(1, sizeof(*pool));
+    if (pool == NULL)
+    {
+        return e_failure;
+    }
+    pool->pending = malloc(q->depth * sizeof(uint));
+    pool->finished = malloc(q->depth * sizeof(uint));
+    if (pool->pending == NULL || pool->finished == NULL)
+    {
+        free(pool->pending);
+        free(pool->finished);
+        free(pool);
+        return e_failure;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    q->pool = pool;
+
+    uint want = q->depth < AIO_MAX_THREADS ? q->depth : AIO_MAX_THREADS;
+    for (; pool->nthreads < want; pool->nthreads++)
+    {
+        if (pthread_create(&pool->threads[pool->nthreads], NULL, pool_worker, q) != 0)
+        {
+            break;
+        }
+    }
+    if (pool->nthreads == 0)
+    {
+        pool_close(q);
+        q->pool = NULL;
+        return e_failure;
+    }
+    return e_success;
+}
+
+static void pool_submit(AioQueue *q, uint slot)
+{
+    struct _AioPool *pool = q->pool;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->pending[(pool->pending_head + pool->pending_count) % q->depth] = slot;
+    pool->pending_count++;
+    pthread_cond_signal(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static uint pool_complete(AioQueue *q)
+{
+    struct _AioPool *pool = q->pool;
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->finished_count == 0)
+    {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    uint slot = pool->finished[pool->finished_head];
+    pool->finished_head = (pool->finished_head + 1) % q->depth;
+    pool->finished_count--;
+    pthread_mutex_unlock(&pool->lock);
+    return slot;
+}
+
+/* ---------- Queue ---------- */
+
+Status aio_init(AioQueue *q, AioBackend backend, uint depth, unsigned char **buffers, size_t buf_len, uint nbuffers)
+{
+    memset(q, 0, sizeof(*q));
+    if (depth == 0 || depth > AIO_MAX_DEPTH)
+    {
+        printf("ERROR: Queue depth must be 1 to %d.\n", AIO_MAX_DEPTH);
+        return e_failure;
+    }
+    q->depth = depth;
+    q->buffers = buffers;
+    q->buf_len = buf_len;
+    q->nbuffers = nbuffers;
+    q->reqs = calloc(depth, sizeof(*q->reqs));
+    if (q->reqs == NULL)
+    {
+        printf("ERROR: Out of memory.\n");
+        return e_failure;
+    }
+
+    // Step 1: io_uring unless threads were asked for
+    if (backend != e_aio_threads && uring_init(q) == e_success)
+    {
+        q->backend = e_aio_uring;
+        return e_success;
+    }
+    if (backend == e_aio_uring)
+    {
+        printf("ERROR: io_uring is not available on this system.\n");
+        aio_close(q);
+        return e_failure;
+    }
+
+    // Step 2: Fall back to blocking reads on worker threads
+    if (pool_init(q) == e_failure)
+    {
+        printf("ERROR: Failed to start I/O threads.\n");
+        aio_close(q);
+        return e_failure;
+    }
+    q->backend = e_aio_threads;
+    return e_success;
+}
+
+Status aio_read(AioQueue *q, int fd, uint buf_index, size_t len, off_t offset, void *tag)
+{
+    uint slot;
+
+    if (buf_index >= q->nbuffers || len > q->buf_len)
+    {
+        printf("ERROR: Read of %zu bytes does not fit buffer %u.\n", len, buf_index);
+        return e_failure;
+    }
+
+    // Step 1: Find a free slot (the caller never queues more than depth reads)
+    for (slot = 0; slot < q->depth && q->reqs[slot].busy; slot++)
+    {
+    }
+    if (slot == q->depth)
+    {
+        printf("ERROR: I/O queue is full.\n");
+        return e_failure;
+    }
+
+    AioRequest *req = &q->reqs[slot];
+    memset(req, 0, sizeof(*req));
+    req->fd = fd;
+    req->buf_index = buf_index;
+    req->buf = q->buffers[buf_index];
+    req->len = len;
+    req->offset = offset;
+    req->tag = tag;
+    req->busy = 1;
+
+    // Step 2: Hand it to the backend
+    if (q->backend == e_aio_uring)
+    {
+        if (uring_submit(q, slot) == e_failure)
+        {
+            req->busy = 0;
+            return e_failure;
+        }
+    }
+    else
+    {
+        pool_submit(q, slot);
+    }
+    q->inflight++;
+    return e_success;
+}
+
+Status aio_wait(AioQueue *q, void **tag, long long *result)
+{
+    uint slot;
+
+    if (q->inflight == 0)
+    {
+        printf("ERROR: No reads in flight.\n");
+        return e_failure;
+    }
+
+    if (q->backend == e_aio_uring)
+    {
+        if (uring_complete(q, &slot) == e_failure)
+        {
+            return e_failure;
+        }
+    }
+    else
+    {
+        slot = pool_complete(q);
+    }
+
+    *tag = q->reqs[slot].tag;
+    *result = q->reqs[slot].result;
+    q->reqs[slot].busy = 0;
+    q->inflight--;
+    return e_success;
+}
+
+void aio_close(AioQueue *q)
+{
+    if (q->ring != NULL)
+    {
+        uring_close(q->ring);
+    }
+    if (q->pool != NULL)
+    {
+        pool_close(q);
+    }
+    free(q->reqs);
+    q->ring = NULL;
+    q->pool = NULL;
+    q->reqs = NULL;
+}
+
+const char *aio_backend_name(AioBackend backend)
+{
+    switch (backend)
+    {
+        case e_aio_uring:   return "io_uring";
+        case e_aio_threads: return "pread threads";
+        default:            return "auto";
+    }
+}
+
+Status aio_parse_backend(const char *name, AioBackend *backend)
+{
+    if (strcmp(name, "auto") == 0)
+    {
+        *backend = e_aio_auto;
+    }
+    else if (strcmp(name, "uring") == 0)
+    {
+        *backend = e_aio_uring;
+    }
+    else if (strcmp(name, "threads") == 0)
+    {
+        *backend = e_aio_threads;
+    }
+    else
+    {
+        printf("ERROR: Unknown I/O backend %s (use auto, uring or threads).\n", name);
+        return e_failure;
+    }
+    return e_success;
+}
@@ -0,0 +1,71 @@
+#ifndef AIO_H
+#define AIO_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "types.h"
+
+/*
+ * Asynchronous whole-buffer reads for batch mode. Reads land in a fixed
+ * set of buffers handed over at init time; with io_uring they are
+ * registered with the kernel so the reads skip the per-request page
+ * pinning. Where io_uring is not available (old kernel, seccomp, ...)
+ * a small pool of threads does blocking pread() calls instead.
+ */
+
+#define AIO_DEFAULT_DEPTH 4
+#define AIO_MAX_DEPTH 64
+
+typedef enum
+{
+    e_aio_auto,       // io_uring if the kernel allows it, else threads
+    e_aio_uring,
+    e_aio_threads
+} AioBackend;
+
+/* One read in flight */
+typedef struct _AioRequest
+{
+    int fd;
+    uint buf_index;
+    unsigned char *buf;
+    size_t len;
+    off_t offset;
+    size_t done;          // Bytes read so far (short reads are resubmitted)
+    long long result;     // Bytes read, or -errno
+    void *tag;
+    int busy;
+} AioRequest;
+
+typedef struct _AioQueue
+{
+    AioBackend backend;   // Backend actually in use
+    uint depth;           // Reads that may be in flight at once
+    uint inflight;
+
+    unsigned char **buffers;
+    size_t buf_len;
+    uint nbuffers;
+
+    AioRequest *reqs;     // depth slots
+    struct _AioRing *ring;
+    struct _AioPool *pool;
+} AioQueue;
+
+/* Set up a queue of the given depth over nbuffers buffers of buf_len bytes */
+Status aio_init(AioQueue *q, AioBackend backend, uint depth, unsigned char **buffers, size_t buf_len, uint nbuffers);
+
+/* Queue a read of len bytes at offset into buffer buf_index */
+Status aio_read(AioQueue *q, int fd, uint buf_index, size_t len, off_t offset, void *tag);
+
+/* Wait for one read to finish; result is the byte count or -errno */
+Status aio_wait(AioQueue *q, void **tag, long long *result);
+
+void aio_close(AioQueue *q);
+
+const char *aio_backend_name(AioBackend backend);
+
+/* Parse "auto", "uring" or "threads" */
+Status aio_parse_backend(const char *name, AioBackend *backend);
+
+#endif
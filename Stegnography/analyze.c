@@ -0,0 +1,875 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include "analyze.h"
+#include "image.h"
+#include "pixel.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+/* Selected kernel pair */
+static void (*rs_impl)(const unsigned char *values, size_t n, AnalyzeCounts *counts);
+static void (*spa_impl)(const unsigned char *values, size_t n, AnalyzeCounts *counts);
+static const char *analyze_impl_name;
+static pthread_once_t analyze_once = PTHREAD_ONCE_INIT;
+
+/* Work shared by the threads counting one image */
+typedef struct _AnalyzeJob
+{
+    const Image *image;
+    const unsigned char *rows;      // Whole pixel array, top to bottom, row_alloc apart
+    uint masks[4];                  // One single-channel mask per carrier channel
+    uint nchannels;
+    uint nsegments;
+    AnalyzeCounts *counts;          // nsegments x nchannels
+    uint nthreads;
+} AnalyzeJob;
+
+typedef struct _AnalyzeThread
+{
+    AnalyzeJob *job;
+    uint index;
+    pthread_t tid;
+} AnalyzeThread;
+
+/* RS discrimination function: variation inside a group of 4 */
+static int rs_f(int a, int b, int c, int d)
+{
+    return abs(b - a) + abs(c - b) + abs(d - c);
+}
+
+/* Clipped at 0 or 255: flat saturated areas look like LSB embedding to RS and SPA */
+static int saturated(int v)
+{
+    return v == 0 || v == 255;
+}
+
+/*
+ * Portable RS counting over groups values[i .. i+3]. With s = +1 for
+ * odd and -1 for even values, the LSB flip is x - s and the shifted
+ * flip (-1 <-> 0, 1 <-> 2, ...) is x + s. Groups with a saturated
+ * value are left out.
+ */
+static void rs_scalar(const unsigned char *values, size_t n, AnalyzeCounts *counts)
+{
+    unsigned long long *rs = counts->rs;
+
+    for (size_t i = 0; i + 4 <= n; i += 4)
+    {
+        int a = values[i], b = values[i + 1], c = values[i + 2], d = values[i + 3];
+        if (saturated(a) || saturated(b) || saturated(c) || saturated(d))
+        {
+            continue;
+        }
+        counts->groups++;
+
+        int sa = 2 * (a & 1) - 1, sb = 2 * (b & 1) - 1, sc = 2 * (c & 1) - 1, sd = 2 * (d & 1) - 1;
+
+        int f0 = rs_f(a, b, c, d);
+        int fm = rs_f(a, b - sb, c - sc, d);
+        int fn = rs_f(a, b + sb, c + sc, d);
+
+        // The same with every LSB flipped first (M then flips the middle back)
+        int g0 = rs_f(a - sa, b - sb, c - sc, d - sd);
+        int gm = rs_f(a - sa, b, c, d - sd);
+        int gn = rs_f(a - sa, b - 2 * sb, c - 2 * sc, d - sd);
+
+        rs[0] += fm > f0;
+        rs[1] += fm < f0;
+        rs[2] += fn > f0;
+        rs[3] += fn < f0;
+        rs[4] += gm > g0;
+        rs[5] += gm < g0;
+        rs[6] += gn > g0;
+        rs[7] += gn < g0;
+    }
+}
+
+/* Portable SPA counting over the pairs values[i], values[i + 1], saturated ones left out */
+static void spa_scalar(const unsigned char *values, size_t n, AnalyzeCounts *counts)
+{
+    for (size_t i = 0; i + 1 < n; i++)
+    {
+        int u = values[i], v = values[i + 1];
+
+        if (saturated(u) || saturated(v))
+        {
+            continue;
+        }
+        counts->pairs++;
+        if (v & 1)
+        {
+            counts->spa_x += u > v;
+            counts->spa_y += u < v;
+        }
+        else
+        {
+            counts->spa_x += u < v;
+            counts->spa_y += u > v;
+        }
+        counts->spa_k += (u >> 1) == (v >> 1);
+    }
+}
+
+#if defined(__x86_64__)
+/* f of the two groups in 8 16-bit lanes, left in 32-bit lanes 0 and 2 */
+static inline __m128i rs_f_sse2(__m128i x, __m128i within)
+{
+    __m128i d = _mm_sub_epi16(_mm_srli_si128(x, 2), x);
+    d = _mm_and_si128(_mm_max_epi16(d, _mm_sub_epi16(_mm_setzero_si128(), d)), within);
+    d = _mm_madd_epi16(d, _mm_set1_epi16(1));
+    return _mm_add_epi32(d, _mm_srli_si128(d, 4));
+}
+
+/* SSE2 RS: two groups per step, widened to 16 bits so x + s cannot wrap */
+static void rs_sse2(const unsigned char *values, size_t n, AnalyzeCounts *counts)
+{
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i full = _mm_set1_epi16(255);
+    const __m128i middle = _mm_setr_epi16(0, -1, -1, 0, 0, -1, -1, 0);
+    const __m128i within = _mm_setr_epi16(-1, -1, -1, 0, -1, -1, -1, 0);
+    __m128i acc[9];                 // The 8 counts, then the groups
+    uint32_t lanes[4];
+    size_t i = 0;
+
+    for (int k = 0; k < 9; k++)
+    {
+        acc[k] = _mm_setzero_si128();
+    }
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i x = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(values + i)), _mm_setzero_si128());
+        __m128i s = _mm_sub_epi16(_mm_slli_epi16(_mm_and_si128(x, one), 1), one);
+
+        // Saturated values per group, summed into 32-bit lanes 0 and 2 like f
+        __m128i sat = _mm_or_si128(_mm_cmpeq_epi16(x, _mm_setzero_si128()), _mm_cmpeq_epi16(x, full));
+        sat = _mm_madd_epi16(sat, one);
+        __m128i valid = _mm_cmpeq_epi32(_mm_add_epi32(sat, _mm_srli_si128(sat, 4)), _mm_setzero_si128());
+        __m128i sm = _mm_and_si128(s, middle);
+        __m128i flipped = _mm_sub_epi16(x, s);
+
+        __m128i f0 = rs_f_sse2(x, within);
+        __m128i fm = rs_f_sse2(_mm_sub_epi16(x, sm), within);
+        __m128i fn = rs_f_sse2(_mm_add_epi16(x, sm), within);
+        __m128i g0 = rs_f_sse2(flipped, within);
+        __m128i gm = rs_f_sse2(_mm_add_epi16(flipped, sm), within);
+        __m128i gn = rs_f_sse2(_mm_sub_epi16(flipped, sm), within);
+
+        // A true compare is -1, so subtracting it counts
+        acc[0] = _mm_sub_epi32(acc[0], _mm_and_si128(_mm_cmpgt_epi32(fm, f0), valid));
+        acc[1] = _mm_sub_epi32(acc[1], _mm_and_si128(_mm_cmpgt_epi32(f0, fm), valid));
+        acc[2] = _mm_sub_epi32(acc[2], _mm_and_si128(_mm_cmpgt_epi32(fn, f0), valid));
+        acc[3] = _mm_sub_epi32(acc[3], _mm_and_si128(_mm_cmpgt_epi32(f0, fn), valid));
+        acc[4] = _mm_sub_epi32(acc[4], _mm_and_si128(_mm_cmpgt_epi32(gm, g0), valid));
+        acc[5] = _mm_sub_epi32(acc[5], _mm_and_si128(_mm_cmpgt_epi32(g0, gm), valid));
+        acc[6] = _mm_sub_epi32(acc[6], _mm_and_si128(_mm_cmpgt_epi32(gn, g0), valid));
+        acc[7] = _mm_sub_epi32(acc[7], _mm_and_si128(_mm_cmpgt_epi32(g0, gn), valid));
+        acc[8] = _mm_sub_epi32(acc[8], valid);
+    }
+    for (int k = 0; k < 9; k++)
+    {
+        _mm_storeu_si128((__m128i *)lanes, acc[k]);
+        *(k < 8 ? &counts->rs[k] : &counts->groups) += (unsigned long long)lanes[0] + lanes[2];
+    }
+
+    rs_scalar(values + i, n - i, counts);
+}
+
+/* SSE2 SPA: 16 pairs per step in byte counters, summed every 255 steps */
+static void spa_sse2(const unsigned char *values, size_t n, AnalyzeCounts *counts)
+{
+    const __m128i bias = _mm_set1_epi8((char)0x80);
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i high = _mm_set1_epi8((char)0xFE);
+    const __m128i full = _mm_set1_epi8((char)0xFF);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum_x = zero, sum_y = zero, sum_k = zero, sum_p = zero;
+    uint64_t lanes[2];
+    size_t i = 0;
+
+    while (i + 17 <= n)
+    {
+        __m128i cx = zero, cy = zero, ck = zero, cp = zero;
+
+        for (uint r = 0; r < 255 && i + 17 <= n; r++, i += 16)
+        {
+            __m128i u = _mm_loadu_si128((const __m128i *)(values + i));
+            __m128i v = _mm_loadu_si128((const __m128i *)(values + i + 1));
+            __m128i lt = _mm_cmpgt_epi8(_mm_xor_si128(v, bias), _mm_xor_si128(u, bias));
+            __m128i gt = _mm_cmpgt_epi8(_mm_xor_si128(u, bias), _mm_xor_si128(v, bias));
+            __m128i odd = _mm_cmpeq_epi8(_mm_and_si128(v, one), one);
+            __m128i sat = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(u, zero), _mm_cmpeq_epi8(u, full)),
+                                       _mm_or_si128(_mm_cmpeq_epi8(v, zero), _mm_cmpeq_epi8(v, full)));
+
+            cx = _mm_sub_epi8(cx, _mm_andnot_si128(sat, _mm_or_si128(_mm_andnot_si128(odd, lt), _mm_and_si128(odd, gt))));
+            cy = _mm_sub_epi8(cy, _mm_andnot_si128(sat, _mm_or_si128(_mm_andnot_si128(odd, gt), _mm_and_si128(odd, lt))));
+            ck = _mm_sub_epi8(ck, _mm_andnot_si128(sat, _mm_cmpeq_epi8(_mm_and_si128(_mm_xor_si128(u, v), high), zero)));
+            cp = _mm_sub_epi8(cp, _mm_cmpeq_epi8(sat, zero));
+        }
+        sum_x = _mm_add_epi64(sum_x, _mm_sad_epu8(cx, zero));
+        sum_y = _mm_add_epi64(sum_y, _mm_sad_epu8(cy, zero));
+        sum_k = _mm_add_epi64(sum_k, _mm_sad_epu8(ck, zero));
+        sum_p = _mm_add_epi64(sum_p, _mm_sad_epu8(cp, zero));
+    }
+    _mm_storeu_si128((__m128i *)lanes, sum_x);
+    counts->spa_x += lanes[0] + lanes[1];
+    _mm_storeu_si128((__m128i *)lanes, sum_y);
+    counts->spa_y += lanes[0] + lanes[1];
+    _mm_storeu_si128((__m128i *)lanes, sum_k);
+    counts->spa_k += lanes[0] + lanes[1];
+    _mm_storeu_si128((__m128i *)lanes, sum_p);
+    counts->pairs += lanes[0] + lanes[1];
+
+    spa_scalar(values + i, n - i, counts);
+}
+
+/* f of the four groups in 16 16-bit lanes, left in 32-bit lanes 0, 2, 4 and 6 */
+__attribute__((target("avx2")))
+static inline __m256i rs_f_avx2(__m256i x, __m256i within)
+{
+    __m256i d = _mm256_abs_epi16(_mm256_sub_epi16(_mm256_srli_si256(x, 2), x));
+    d = _mm256_madd_epi16(_mm256_and_si256(d, within), _mm256_set1_epi16(1));
+    return _mm256_add_epi32(d, _mm256_srli_si256(d, 4));
+}
+
+/* AVX2 RS: four groups per step (groups never straddle the 128-bit halves) */
+__attribute__((target("avx2")))
+static void rs_avx2(const unsigned char *values, size_t n, AnalyzeCounts *counts)
+{
+    const __m256i one = _mm256_set1_epi16(1);
+    const __m256i full = _mm256_set1_epi16(255);
+    const __m256i middle = _mm256_setr_epi16(0, -1, -1, 0, 0, -1, -1, 0, 0, -1, -1, 0, 0, -1, -1, 0);
+    const __m256i within = _mm256_setr_epi16(-1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1, 0);
+    __m256i acc[9];
+    uint32_t lanes[8];
+    size_t i = 0;
+
+    for (int k = 0; k < 9; k++)
+    {
+        acc[k] = _mm256_setzero_si256();
+    }
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256i x = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(values + i)));
+        __m256i s = _mm256_sub_epi16(_mm256_slli_epi16(_mm256_and_si256(x, one), 1), one);
+
+        __m256i sat = _mm256_or_si256(_mm256_cmpeq_epi16(x, _mm256_setzero_si256()), _mm256_cmpeq_epi16(x, full));
+        sat = _mm256_madd_epi16(sat, one);
+        __m256i valid = _mm256_cmpeq_epi32(_mm256_add_epi32(sat, _mm256_srli_si256(sat, 4)), _mm256_setzero_si256());
+        __m256i sm = _mm256_and_si256(s, middle);
+        __m256i flipped = _mm256_sub_epi16(x, s);
+
+        __m256i f0 = rs_f_avx2(x, within);
+        __m256i fm = rs_f_avx2(_mm256_sub_epi16(x, sm), within);
+        __m256i fn = rs_f_avx2(_mm256_add_epi16(x, sm), within);
+        __m256i g0 = rs_f_avx2(flipped, within);
+        __m256i gm = rs_f_avx2(_mm256_add_epi16(flipped, sm), within);
+        __m256i gn = rs_f_avx2(_mm256_sub_epi16(flipped, sm), within);
+
+        acc[0] = _mm256_sub_epi32(acc[0], _mm256_and_si256(_mm256_cmpgt_epi32(fm, f0), valid));
+        acc[1] = _mm256_sub_epi32(acc[1], _mm256_and_si256(_mm256_cmpgt_epi32(f0, fm), valid));
+        acc[2] = _mm256_sub_epi32(acc[2], _mm256_and_si256(_mm256_cmpgt_epi32(fn, f0), valid));
+        acc[3] = _mm256_sub_epi32(acc[3], _mm256_and_si256(_mm256_cmpgt_epi32(f0, fn), valid));
+        acc[4] = _mm256_sub_epi32(acc[4], _mm256_and_si256(_mm256_cmpgt_epi32(gm, g0), valid));
+        acc[5] = _mm256_sub_epi32(acc[5], _mm256_and_si256(_mm256_cmpgt_epi32(g0, gm), valid));
+        acc[6] = _mm256_sub_epi32(acc[6], _mm256_and_si256(_mm256_cmpgt_epi32(gn, g0), valid));
+        acc[7] = _mm256_sub_epi32(acc[7], _mm256_and_si256(_mm256_cmpgt_epi32(g0, gn), valid));
+        acc[8] = _mm256_sub_epi32(acc[8], valid);
+    }
+    for (int k = 0; k < 9; k++)
+    {
+        _mm256_storeu_si256((__m256i *)lanes, acc[k]);
+        *(k < 8 ? &counts->rs[k] : &counts->groups) += (unsigned long long)lanes[0] + lanes[2] + lanes[4] + lanes[6];
+    }
+
+    rs_scalar(values + i, n - i, counts);
+}
+
+/* AVX2 SPA: 32 pairs per step */
+__attribute__((target("avx2")))
+static void spa_avx2(const unsigned char *values, size_t n, AnalyzeCounts *counts)
+{
+    const __m256i bias = _mm256_set1_epi8((char)0x80);
+    const __m256i one = _mm256_set1_epi8(1);
+    const __m256i high = _mm256_set1_epi8((char)0xFE);
+    const __m256i full = _mm256_set1_epi8((char)0xFF);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i sum_x = zero, sum_y = zero, sum_k = zero, sum_p = zero;
+    uint64_t lanes[4];
+    size_t i = 0;
+
+    while (i + 33 <= n)
+    {
+        __m256i cx = zero, cy = zero, ck = zero, cp = zero;
+
+        for (uint r = 0; r < 255 && i + 33 <= n; r++, i += 32)
+        {
+            __m256i u = _mm256_loadu_si256((const __m256i *)(values + i));
+            __m256i v = _mm256_loadu_si256((const __m256i *)(values + i + 1));
+            __m256i lt = _mm256_cmpgt_epi8(_mm256_xor_si256(v, bias), _mm256_xor_si256(u, bias));
+            __m256i gt = _mm256_cmpgt_epi8(_mm256_xor_si256(u, bias), _mm256_xor_si256(v, bias));
+            __m256i odd = _mm256_cmpeq_epi8(_mm256_and_si256(v, one), one);
+            __m256i sat = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(u, zero), _mm256_cmpeq_epi8(u, full)),
+                                          _mm256_or_si256(_mm256_cmpeq_epi8(v, zero), _mm256_cmpeq_epi8(v, full)));
+
+            cx = _mm256_sub_epi8(cx, _mm256_andnot_si256(sat, _mm256_blendv_epi8(lt, gt, odd)));
+            cy = _mm256_sub_epi8(cy, _mm256_andnot_si256(sat, _mm256_blendv_epi8(gt, lt, odd)));
+            ck = _mm256_sub_epi8(ck, _mm256_andnot_si256(sat, _mm256_cmpeq_epi8(_mm256_and_si256(_mm256_xor_si256(u, v), high), zero)));
+            cp = _mm256_sub_epi8(cp, _mm256_cmpeq_epi8(sat, zero));
+        }
+        sum_x = _mm256_add_epi64(sum_x, _mm256_sad_epu8(cx, zero));
+        sum_y = _mm256_add_epi64(sum_y, _mm256_sad_epu8(cy, zero));
+        sum_k = _mm256_add_epi64(sum_k, _mm256_sad_epu8(ck, zero));
+        sum_p = _mm256_add_epi64(sum_p, _mm256_sad_epu8(cp, zero));
+    }
+    _mm256_storeu_si256((__m256i *)lanes, sum_x);
+    counts->spa_x += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    _mm256_storeu_si256((__m256i *)lanes, sum_y);
+    counts->spa_y += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    _mm256_storeu_si256((__m256i *)lanes, sum_k);
+    counts->spa_k += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    _mm256_storeu_si256((__m256i *)lanes, sum_p);
+    counts->pairs += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+
+    spa_scalar(values + i, n - i, counts);
+}
+#endif
+
+static const char *const analyze_variants[] = {"scalar", "sse2", "avx2"};
+
+/* Point both kernels at one variant, e_failure if it is unknown or the CPU lacks it */
+static Status analyze_use(const char *name)
+{
+    if (strcmp(name, "scalar") == 0)
+    {
+        rs_impl = rs_scalar;
+        spa_impl = spa_scalar;
+        analyze_impl_name = "scalar";
+        return e_success;
+    }
+#if defined(__x86_64__)
+    if (strcmp(name, "sse2") == 0)
+    {
+        rs_impl = rs_sse2;
+        spa_impl = spa_sse2;
+        analyze_impl_name = "sse2";
+        return e_success;
+    }
+    if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2"))
+    {
+        rs_impl = rs_avx2;
+        spa_impl = spa_avx2;
+        analyze_impl_name = "avx2";
+        return e_success;
+    }
+#endif
+    return e_failure;
+}
+
+/* Pick the widest supported kernels */
+static void analyze_select(void)
+{
+    for (int i = sizeof(analyze_variants) / sizeof(analyze_variants[0]) - 1; i >= 0; i--)
+    {
+        if (analyze_use(analyze_variants[i]) == e_success)
+        {
+            break;
+        }
+    }
+}
+
+const char *analyze_kernel_name(void)
+{
+    pthread_once(&analyze_once, analyze_select);
+    return analyze_impl_name;
+}
+
+const char *analyze_kernel_variant(unsigned int i)
+{
+    return i < sizeof(analyze_variants) / sizeof(analyze_variants[0]) ? analyze_variants[i] : NULL;
+}
+
+Status analyze_set_kernel(const char *name)
+{
+    pthread_once(&analyze_once, analyze_select);
+    return analyze_use(name);
+}
+
+void analyze_plane(const unsigned char *values, size_t npixels, AnalyzeCounts *counts)
+{
+    size_t i = 0;
+
+    pthread_once(&analyze_once, analyze_select);
+
+    // Step 1: Histogram into four tables so runs of one value do not wait on one counter
+    for (; i + 4 <= npixels; i += 4)
+    {
+        counts->hist[0][values[i]]++;
+        counts->hist[1][values[i + 1]]++;
+        counts->hist[2][values[i + 2]]++;
+        counts->hist[3][values[i + 3]]++;
+    }
+    for (; i < npixels; i++)
+    {
+        counts->hist[0][values[i]]++;
+    }
+
+    // Step 2: RS groups and sample pairs, without the saturated ones
+    rs_impl(values, npixels, counts);
+    spa_impl(values, npixels, counts);
+}
+
+/* First row of segment s */
+static uint segment_row(const AnalyzeJob *job, uint s)
+{
+    return (uint)((unsigned long long)s * job->image->height / job->nsegments);
+}
+
+static void *analyze_worker(void *arg)
+{
+    AnalyzeThread *thread = arg;
+    AnalyzeJob *job = thread->job;
+    const Image *image = job->image;
+    unsigned char *plane = malloc((size_t)image->width + PIXEL_VIEW_SLACK);
+
+    if (plane == NULL)
+    {
+        return (void *)1;
+    }
+
+    // Segments are dealt out round robin, each one counted by a single thread
+    for (uint s = thread->index; s < job->nsegments; s += job->nthreads)
+    {
+        for (uint y = segment_row(job, s); y < segment_row(job, s + 1); y++)
+        {
+            const unsigned char *row = job->rows + (size_t)y * image->row_alloc;
+
+            for (uint c = 0; c < job->nchannels; c++)
+            {
+                const PixelView *view = pixel_view(image->format, job->masks[c]);
+                const unsigned char *values = row;
+
+                if (view->gather != NULL)
+                {
+                    view->gather(plane, row, image->width);
+                    values = plane;
+                }
+                analyze_plane(values, image->width, &job->counts[(size_t)s * job->nchannels + c]);
+            }
+        }
+    }
+
+    free(plane);
+    return NULL;
+}
+
+/* Regularized lower incomplete gamma function P(a, x) */
+static double gamma_p(double a, double x)
+{
+    if (x <= 0)
+    {
+        return 0;
+    }
+
+    // Series for small x, continued fraction (modified Lentz) for the rest
+    double front = exp(-x + a * log(x) - lgamma(a));
+    if (x < a + 1)
+    {
+        double term = 1 / a, sum = term;
+        for (int n = 1; n < 1000 && term > sum * 1e-14; n++)
+        {
+            term *= x / (a + n);
+            sum += term;
+        }
+        return sum * front;
+    }
+
+    double b = x + 1 - a, c = 1e300, d = 1 / b, h = d;
+    for (int n = 1; n < 1000; n++)
+    {
+        double an = -n * (n - a);
+        b += 2;
+        d = an * d + b;
+        c = b + an / c;
+        d = 1 / (fabs(d) < 1e-300 ? 1e-300 : d);
+        c = fabs(c) < 1e-300 ? 1e-300 : c;
+        h *= d * c;
+        if (fabs(d * c - 1) < 1e-14)
+        {
+            break;
+        }
+    }
+    return 1 - front * h;
+}
+
+/* Probability that the pairs of values 2k, 2k+1 were levelled by LSB embedding */
+static double chi_square_p(const unsigned long long hist[256])
+{
+    double chi = 0;
+    int bins = 0;
+
+    for (int k = 0; k < 128; k++)
+    {
+        double expected = (hist[2 * k] + (double)hist[2 * k + 1]) / 2;
+        if (expected < 5)
+        {
+            continue;
+        }
+        double d = hist[2 * k] - expected;
+        chi += d * d / expected;
+        bins++;
+    }
+    if (bins < 2)
+    {
+        return 0;
+    }
+    return 1 - gamma_p((bins - 1) / 2.0, chi / 2);
+}
+
+static double clamp_rate(double rate)
+{
+    // NaN (no usable counts) reads as nothing embedded
+    if (!(rate > 0))
+    {
+        return 0;
+    }
+    return rate > 1 ? 1 : rate;
+}
+
+/* Embedding rate from the RS counts of one channel */
+static double rs_estimate(const AnalyzeCounts *counts)
+{
+    double n = counts->groups;
+    if (n == 0)
+    {
+        return 0;
+    }
+
+    double d0 = (counts->rs[0] - (double)counts->rs[1]) / n;
+    double dn0 = (counts->rs[2] - (double)counts->rs[3]) / n;
+    double d1 = (counts->rs[4] - (double)counts->rs[5]) / n;
+    double dn1 = (counts->rs[6] - (double)counts->rs[7]) / n;
+
+    // 2(d1 + d0) x^2 + (d-0 - d-1 - d1 - 3 d0) x + d0 - d-0 = 0, smaller root
+    double a = 2 * (d1 + d0), b = dn0 - dn1 - d1 - 3 * d0, c = d0 - dn0;
+    double x;
+    if (fabs(a) < 1e-12)
+    {
+        x = fabs(b) < 1e-12 ? 0 : -c / b;
+    }
+    else
+    {
+        double disc = b * b - 4 * a * c;
+        double root = sqrt(disc > 0 ? disc : 0);
+        double x1 = (-b + root) / (2 * a), x2 = (-b - root) / (2 * a);
+        x = fabs(x1) < fabs(x2) ? x1 : x2;
+    }
+    return clamp_rate(x / (x - 0.5));
+}
+
+/* Embedding rate from the sample pair counts */
+static double spa_estimate(double x, double y, double k, double pairs)
+{
+    // 2k b^2 + 2(2x - |P|) b + y - x = 0, smaller root; b is the share of
+    // samples changed, half of those carrying message bits
+    double a = 2 * k, b = 2 * (2 * x - pairs), c = y - x;
+    if (a == 0)
+    {
+        return 0;
+    }
+    double disc = b * b - 4 * a * c;
+    double root = sqrt(disc > 0 ? disc : 0);
+    double b1 = (-b + root) / (2 * a), b2 = (-b - root) / (2 * a);
+    return clamp_rate(2 * (b1 < b2 ? b1 : b2));
+}
+
+/* Turn the segment counts into the estimates for the image */
+static void analyze_estimate(const AnalyzeJob *job, AnalyzeResult *result)
+{
+    unsigned long long hist[256] = {0};
+    unsigned long long (*seg_hist)[256] = calloc(job->nsegments, sizeof(*seg_hist));
+
+    memset(result, 0, sizeof(*result));
+    result->nchannels = job->nchannels;
+
+    // Step 1: Sum the segments of every channel; RS and SPA estimate each channel on its own
+    for (uint c = 0; c < job->nchannels; c++)
+    {
+        AnalyzeCounts total;
+        memset(&total, 0, sizeof(total));
+        for (uint s = 0; s < job->nsegments; s++)
+        {
+            const AnalyzeCounts *counts = &job->counts[(size_t)s * job->nchannels + c];
+            for (int v = 0; v < 256; v++)
+            {
+                unsigned long long n = counts->hist[0][v] + counts->hist[1][v] + counts->hist[2][v] + counts->hist[3][v];
+                hist[v] += n;
+                if (seg_hist != NULL)
+                {
+                    seg_hist[s][v] += n;
+                }
+            }
+            total.groups += counts->groups;
+            for (int i = 0; i < 8; i++)
+            {
+                total.rs[i] += counts->rs[i];
+            }
+            total.spa_x += counts->spa_x;
+            total.spa_y += counts->spa_y;
+            total.spa_k += counts->spa_k;
+            total.pairs += counts->pairs;
+        }
+        result->rs_channels[c] = rs_estimate(&total);
+        result->spa_channels[c] = spa_estimate(total.spa_x, total.spa_y, total.spa_k, total.pairs);
+        result->rs_rate += result->rs_channels[c] / job->nchannels;
+        result->spa_rate += result->spa_channels[c] / job->nchannels;
+        result->rs_max = fmax(result->rs_max, result->rs_channels[c]);
+        result->spa_max = fmax(result->spa_max, result->spa_channels[c]);
+    }
+    result->chi_p = chi_square_p(hist);
+
+    // Step 2: Chi-square over growing prefixes from the top, then from the bottom;
+    // a sequentially embedded message tests as embedded until its end
+    for (int from_bottom = 0; seg_hist != NULL && from_bottom < 2; from_bottom++)
+    {
+        unsigned long long prefix[256] = {0};
+        for (uint i = 0; i < job->nsegments; i++)
+        {
+            uint s = from_bottom ? job->nsegments - 1 - i : i;
+            for (int v = 0; v < 256; v++)
+            {
+                prefix[v] += seg_hist[s][v];
+            }
+            if (chi_square_p(prefix) < 0.5)
+            {
+                break;
+            }
+            uint rows = from_bottom ? job->image->height - segment_row(job, s) : segment_row(job, s + 1);
+            double share = (double)rows / job->image->height;
+            if (share > result->chi_prefix)
+            {
+                result->chi_prefix = share;
+                result->chi_from_bottom = from_bottom;
+            }
+        }
+    }
+    free(seg_hist);
+
+    // Step 3: Each attack decides against its own threshold (calibrated on clean covers), the
+    // majority decides for the image; a message in one channel only is still caught by its maximum
+    result->chi_flag = result->chi_prefix >= ANALYZE_CHI_PREFIX;
+    result->rs_flag = result->rs_max >= ANALYZE_RS_THRESHOLD;
+    result->spa_flag = result->spa_max >= ANALYZE_SPA_THRESHOLD;
+    result->flagged = result->chi_flag + result->rs_flag + result->spa_flag >= ANALYZE_VOTES;
+
+    // Step 4: The median of the three rates, so one attack failing does not carry the estimate
+    // (RS loses its root close to full embedding, chi-square only sees sequential messages)
+    double lo = fmin(result->rs_rate, result->spa_rate), hi = fmax(result->rs_rate, result->spa_rate);
+    result->rate = fmax(lo, fmin(hi, result->chi_prefix));
+}
+
+/* One rate line: the mean and every channel */
+static void analyze_print_rate(const char *name, double rate, const double *channels, uint nchannels, int flag)
+{
+    printf("  %-11s rate %.4f (", name, rate);
+    for (uint c = 0; c < nchannels; c++)
+    {
+        printf("%s%.4f", c ? " " : "", channels[c]);
+    }
+    printf(")%s\n", flag ? " [flagged]" : "");
+}
+
+static double elapsed_ms(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e3 + (end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+Status analyze_image(const char *fname, uint nthreads, AnalyzeResult *result, double *bytes, double *ms)
+{
+    Image image;
+    AnalyzeJob job;
+    AnalyzeThread threads[ANALYZE_MAX_THREADS];
+    struct timespec t0, t1, t2;
+    Status status = e_success;
+
+    // Step 1: Read the whole pixel array, top row first
+    FILE *fptr = fopen(fname, "r");
+    if (fptr == NULL)
+    {
+        perror("fopen");
+        printf("ERROR: Unable to open file %s\n", fname);
+        return e_failure;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (image_open(&image, fptr, NULL, 0, 0) == e_failure)
+    {
+        fclose(fptr);
+        return e_failure;
+    }
+    unsigned char *rows = malloc((size_t)image.height * image.row_alloc + PIXEL_VIEW_SLACK);
+    if (rows == NULL || image_read_rows(&image, rows, image.height) == e_failure)
+    {
+        printf("ERROR: Failed to read the pixel array of %s\n", fname);
+        free(rows);
+        image_close(&image);
+        fclose(fptr);
+        return e_failure;
+    }
+    image_close(&image);
+    fclose(fptr);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    // Step 2: One plane per carrier channel (the header's channels, never alpha)
+    memset(&job, 0, sizeof(job));
+    job.image = &image;
+    job.rows = rows;
+    uint mask = pixel_default_mask(image.format);
+    for (uint bit = 0; bit < 4; bit++)
+    {
+        if (mask & (1u << bit))
+        {
+            job.masks[job.nchannels++] = 1u << bit;
+        }
+    }
+    job.nsegments = image.height < ANALYZE_SEGMENTS ? image.height : ANALYZE_SEGMENTS;
+    job.nthreads = nthreads < job.nsegments ? nthreads : job.nsegments;
+    job.counts = calloc((size_t)job.nsegments * job.nchannels, sizeof(AnalyzeCounts));
+    if (job.counts == NULL)
+    {
+        printf("ERROR: Out of memory for the counts of %s\n", fname);
+        free(rows);
+        return e_failure;
+    }
+
+    // Step 3: Count the segments on the thread pool
+    for (uint t = 0; t < job.nthreads; t++)
+    {
+        threads[t].job = &job;
+        threads[t].index = t;
+        if (pthread_create(&threads[t].tid, NULL, analyze_worker, &threads[t]) != 0)
+        {
+            job.nthreads = t;
+            status = e_failure;
+            break;
+        }
+    }
+    for (uint t = 0; t < job.nthreads; t++)
+    {
+        void *ret;
+        pthread_join(threads[t].tid, &ret);
+        if (ret != NULL)
+        {
+            status = e_failure;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+    if (status == e_failure)
+    {
+        printf("ERROR: Failed to count the pixels of %s\n", fname);
+        free(job.counts);
+        free(rows);
+        return e_failure;
+    }
+
+    // Step 4: Estimates, every attack on its own line with its verdict
+    analyze_estimate(&job, result);
+    *bytes = (double)image.height * image.row_bytes;
+    *ms = elapsed_ms(&t1, &t2);
+
+    printf("%s: %s %s %ux%u\n", fname, image.codec->name, pixel_format_name(image.format), image.width, image.height);
+    printf("  chi-square  p = %.4f, embedded from the %s: %.1f%% of the rows%s\n",
+           result->chi_p, result->chi_from_bottom ? "bottom" : "top", result->chi_prefix * 100,
+           result->chi_flag ? " [flagged]" : "");
+    analyze_print_rate("RS", result->rs_rate, result->rs_channels, result->nchannels, result->rs_flag);
+    analyze_print_rate("SPA", result->spa_rate, result->spa_channels, result->nchannels, result->spa_flag);
+    printf("  estimate    rate %.4f, %d of 3 attacks flag it: %s\n", result->rate,
+           result->chi_flag + result->rs_flag + result->spa_flag,
+           result->flagged ? "LSB embedding likely" : "no LSB embedding found");
+    printf("  %.1f MB read in %.2f ms, counted in %.2f ms (%.0f MB/s, %u threads, %s kernels)\n",
+           *bytes / 1e6, elapsed_ms(&t0, &t1), *ms, *ms > 0 ? *bytes / 1e3 / *ms : 0.0, job.nthreads,
+           analyze_kernel_name());
+
+    free(job.counts);
+    free(rows);
+    return e_success;
+}
+
+Status do_analysis(int argc, char *argv[])
+{
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    uint nthreads = online > 0 ? (uint)online : 1;
+    uint nimages = 0, flagged = 0, failed = 0;
+    double total_bytes = 0, total_ms = 0;
+
+    // Step 1: Options first, everything else is an image
+    for (int i = 2; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--threads=", 10) == 0)
+        {
+            char *end;
+            long n = strtol(argv[i] + 10, &end, 10);
+            if (end == argv[i] + 10 || *end != '\0' || n < 1 || n > ANALYZE_MAX_THREADS)
+            {
+                printf("ERROR: --threads must be 1 to %d.\n", ANALYZE_MAX_THREADS);
+                return e_failure;
+            }
+            nthreads = (uint)n;
+        }
+        else if (strncmp(argv[i], "--", 2) == 0)
+        {
+            printf("ERROR: Unknown option %s\n", argv[i]);
+            return e_failure;
+        }
+        else if (image_codec_for_name(argv[i]) == NULL)
+        {
+            printf("ERROR: %s is not a BMP or PNG file.\n", argv[i]);
+            return e_failure;
+        }
+        else
+        {
+            nimages++;
+        }
+    }
+    if (nimages == 0)
+    {
+        printf("ERROR: Invalid number of arguments. Usage: <Program Name> -a <Image>... [--threads=N]\n");
+        return e_failure;
+    }
+    if (nthreads > ANALYZE_MAX_THREADS)
+    {
+        nthreads = ANALYZE_MAX_THREADS;
+    }
+
+    // Step 2: Analyze the images one after the other, each one on all threads
+    // (the kernels are picked before any thread needs them)
+    analyze_kernel_name();
+    for (int i = 2; i < argc; i++)
+    {
+        AnalyzeResult result;
+        double bytes, ms;
+
+        if (strncmp(argv[i], "--", 2) == 0)
+        {
+            continue;
+        }
+        if (analyze_image(argv[i], nthreads, &result, &bytes, &ms) == e_failure)
+        {
+            failed++;
+            continue;
+        }
+        flagged += result.flagged;
+        total_bytes += bytes;
+        total_ms += ms;
+    }
+
+    printf("%u images analyzed, %u flagged, %u failed (%.0f MB/s counting)\n",
+           nimages - failed, flagged, failed, total_ms > 0 ? total_bytes / 1e3 / total_ms : 0.0);
+    return failed == 0 ? e_success : e_failure;
+}
@@ -0,0 +1,89 @@
+#ifndef ANALYZE_H
+#define ANALYZE_H
+
+#include <stddef.h>
+#include "types.h"
+
+/*
+ * Steganalysis: estimate how much of an image's LSB plane carries an
+ * embedded message, whatever tool put it there. Three classic attacks
+ * run over the carrier channels (never alpha):
+ *
+ *   chi-square  pairs of values 2k/2k+1 level out under LSB replacement;
+ *               tested on growing prefixes (from the top and from the
+ *               bottom) to find how much of the image is embedded
+ *   RS          regular/singular groups of 4 pixels under the flipping
+ *               masks M = [0 1 1 0] and -M, on the image and with all
+ *               LSBs flipped (Fridrich, Goljan, Du)
+ *   SPA         sample pair analysis over horizontally adjacent pixels
+ *               (Dumitrescu, Wu, Wang)
+ *
+ * The pixel array is split into segments of rows that are counted by a
+ * pool of threads; the counting kernels are SIMD (SSE2 or AVX2).
+ */
+
+#define ANALYZE_SEGMENTS 64         // Row segments per image (fewer for short images)
+#define ANALYZE_MAX_THREADS 64
+
+/*
+ * Each attack flags an image on its own and the majority decides. The
+ * RS and SPA thresholds sit above the largest rate either gave in any
+ * channel of 160 clean photo-like 512x384 to 1024x768 covers (0.062),
+ * where the vote flagged none of them and 78 of 80 covers with random
+ * LSBs in 10% of their carriers. Saturated samples (0, 255) are left out
+ * of RS and SPA: flat clipped areas read as embedding otherwise. Close
+ * to full embedding RS can lose its root and read 0; chi-square and SPA
+ * still carry the vote there, and the median keeps the rate.
+ */
+#define ANALYZE_CHI_PREFIX 0.10     // Chi-square flags from this share of rows embedded from one edge
+#define ANALYZE_RS_THRESHOLD 0.07   // RS and SPA flag from this rate in any channel
+#define ANALYZE_SPA_THRESHOLD 0.07
+#define ANALYZE_VOTES 2             // Attacks that have to flag an image
+
+/* Counts over one channel of some rows */
+typedef struct _AnalyzeCounts
+{
+    unsigned long long hist[4][256];  // Four sub-histograms, summed when estimating
+    unsigned long long groups;      // RS groups of 4 pixels
+    unsigned long long rs[8];       // R_M, S_M, R_-M, S_-M, then the same with all LSBs flipped
+    unsigned long long spa_x;       // Pairs (u, v): v even and u < v, or v odd and u > v
+    unsigned long long spa_y;       // v even and u > v, or v odd and u < v
+    unsigned long long spa_k;       // u and v differ at most in the LSB
+    unsigned long long pairs;
+} AnalyzeCounts;
+
+/* Estimates for one image */
+typedef struct _AnalyzeResult
+{
+    double chi_p;                   // Probability of embedding from the whole image
+    double chi_prefix;              // Share of the rows (from one edge) that test as embedded
+    int chi_from_bottom;
+    uint nchannels;
+    double rs_channels[4];          // Rate per carrier channel
+    double spa_channels[4];
+    double rs_rate, rs_max;         // Mean and largest over the channels
+    double spa_rate, spa_max;
+    int chi_flag, rs_flag, spa_flag; // Over their own thresholds
+    int flagged;                    // By at least ANALYZE_VOTES of the three
+    double rate;                    // Median of the RS, SPA and chi-square prefix rates
+} AnalyzeResult;
+
+/* -a <Image>... [--threads=N]: analyze every image and print its estimates */
+Status do_analysis(int argc, char *argv[]);
+
+/* Read one image, count it on nthreads threads and print the estimates */
+Status analyze_image(const char *fname, uint nthreads, AnalyzeResult *result, double *bytes, double *ms);
+
+/* Count one channel of one row (npixels values) into counts */
+void analyze_plane(const unsigned char *values, size_t npixels, AnalyzeCounts *counts);
+
+/* Name of the selected counting kernel */
+const char *analyze_kernel_name(void);
+
+/* Name of kernel variant i (narrowest first, whether the CPU has it or not), NULL past the last */
+const char *analyze_kernel_variant(unsigned int i);
+
+/* Switch both kernels to a variant by name, e_failure if the CPU cannot run it */
+Status analyze_set_kernel(const char *name);
+
+#endif
@@ -0,0 +1,373 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "batch.h"
+#include "encode.h"
+
+/* Buffers are page aligned and rounded up so they suit registered I/O */
+#define BATCH_BUF_ALIGN 4096
+
+#define NUM_ENCODE_ARGS (sizeof(((BatchInfo *)0)->encode_args) / sizeof(char *))
+
+Status read_and_validate_batch_args(int argc, char *argv[], BatchInfo *batchInfo)
+{
+    memset(batchInfo, 0, sizeof(*batchInfo));
+    batchInfo->queue_depth = AIO_DEFAULT_DEPTH;
+    batchInfo->backend = e_aio_auto;
+
+    // Step 1: The manifest is required
+    if (argc < 3 || strncmp(argv[2], "--", 2) == 0)
+    {
+        printf("ERROR: Usage: <Program Name> -b <Manifest> [--queue-depth=%d] [--io=auto|uring|threads] [--stats[=json]] [encode options]\n",
+               AIO_DEFAULT_DEPTH);
+        return e_failure;
+    }
+    batchInfo->manifest_fname = argv[2];
+
+    // Step 2: Batch options; everything else goes to each encode as is
+    batchInfo->encode_argc = 5;
+    for (int i = 3; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--queue-depth=", 14) == 0)
+        {
+            char *end;
+            long depth = strtol(argv[i] + 14, &end, 10);
+            if (end == argv[i] + 14 || *end != '\0' || depth < 1 || depth > AIO_MAX_DEPTH)
+            {
+                printf("ERROR: Queue depth must be 1 to %d.\n", AIO_MAX_DEPTH);
+                return e_failure;
+            }
+            batchInfo->queue_depth = (uint)depth;
+        }
+        else if (strncmp(argv[i], "--io=", 5) == 0)
+        {
+            if (aio_parse_backend(argv[i] + 5, &batchInfo->backend) == e_failure)
+            {
+                return e_failure;
+            }
+        }
+        else if (strncmp(argv[i], "--", 2) == 0 && batchInfo->encode_argc + 1 < (int)NUM_ENCODE_ARGS)
+        {
+            // --stats is counted per cover and added up here as well
+            if (strcmp(argv[i], "--stats") == 0 || strncmp(argv[i], "--stats=", 8) == 0)
+            {
+                StatsFormat format;
+                if (stats_parse_format(argv[i][7] == '=' ? argv[i] + 8 : NULL, &format) == e_failure)
+                {
+                    return e_failure;
+                }
+                stats_start(&batchInfo->stats, format);
+            }
+            batchInfo->encode_args[batchInfo->encode_argc++] = argv[i];
+        }
+        else
+        {
+            printf("ERROR: Unexpected batch argument %s\n", argv[i]);
+            return e_failure;
+        }
+    }
+    batchInfo->encode_args[0] = argv[0];
+    batchInfo->encode_args[1] = "-e";
+
+    return e_success;
+}
+
+/* Split the manifest into items, stat every cover for its size */
+static Status read_manifest(BatchInfo *batchInfo)
+{
+    // Step 1: Slurp the manifest
+    FILE *fptr = fopen(batchInfo->manifest_fname, "r");
+    if (fptr == NULL)
+    {
+        perror("fopen");
+        fprintf(stderr, "ERROR: Unable to open file %s\n", batchInfo->manifest_fname);
+        return e_failure;
+    }
+    fseek(fptr, 0L, SEEK_END);
+    long size = ftell(fptr);
+    fseek(fptr, 0L, SEEK_SET);
+    batchInfo->manifest_text = malloc(size + 1);
+    batchInfo->items = calloc(size / 6 + 1, sizeof(BatchItem));   // Shortest line is "a b c\n"
+    if (batchInfo->manifest_text == NULL || batchInfo->items == NULL ||
+        fread(batchInfo->manifest_text, 1, size, fptr) != (size_t)size)
+    {
+        printf("ERROR: Failed to read the manifest.\n");
+        fclose(fptr);
+        return e_failure;
+    }
+    fclose(fptr);
+    batchInfo->manifest_text[size] = '\0';
+
+    // Step 2: One "<Source Image> <Secret File> <Stego Image>" per line
+    uint line_no = 0;
+    for (char *line = batchInfo->manifest_text; line != NULL && *line != '\0';)
+    {
+        char *next = strchr(line, '\n');
+        if (next != NULL)
+        {
+            *next++ = '\0';
+        }
+        line_no++;
+
+        char *hash = strchr(line, '#');
+        if (hash != NULL)
+        {
+            *hash = '\0';
+        }
+        char *fields[4] = { NULL };
+        int nfields = 0;
+        for (char *tok = strtok(line, " \t\r"); tok != NULL; tok = strtok(NULL, " \t\r"))
+        {
+            fields[nfields < 3 ? nfields : 3] = tok;
+            nfields++;
+        }
+        if (nfields != 0 && nfields != 3)
+        {
+            printf("ERROR: Manifest line %u must be <Source Image> <Secret File> <Stego Image>.\n", line_no);
+            return e_failure;
+        }
+        if (nfields == 3)
+        {
+            BatchItem *item = &batchInfo->items[batchInfo->nitems++];
+            item->src_image_fname = fields[0];
+            item->secret_fname = fields[1];
+            item->stego_image_fname = fields[2];
+            item->fd = -1;
+        }
+        line = next;
+    }
+    if (batchInfo->nitems == 0)
+    {
+        printf("ERROR: Manifest lists no images.\n");
+        return e_failure;
+    }
+
+    // Step 3: Cover sizes decide the buffer size
+    for (uint i = 0; i < batchInfo->nitems; i++)
+    {
+        struct stat st;
+        BatchItem *item = &batchInfo->items[i];
+        if (stat(item->src_image_fname, &st) != 0 || !S_ISREG(st.st_mode))
+        {
+            printf("WARNING: Cannot read %s, skipping it.\n", item->src_image_fname);
+            item->size = -1;
+            continue;
+        }
+        item->size = st.st_size;
+        if ((size_t)st.st_size > batchInfo->buf_len)
+        {
+            batchInfo->buf_len = st.st_size;
+        }
+    }
+    batchInfo->buf_len = (batchInfo->buf_len + BATCH_BUF_ALIGN - 1) & ~(size_t)(BATCH_BUF_ALIGN - 1);
+    if (batchInfo->buf_len == 0)
+    {
+        printf("ERROR: None of the source images can be read.\n");
+        return e_failure;
+    }
+
+    return e_success;
+}
+
+/* Queue the read of a whole cover into buffer slot */
+static void submit_cover(AioQueue *q, BatchItem *item, uint slot)
+{
+    if (item->size < 0)
+    {
+        item->ready = 1;
+        item->result = -1;
+        return;
+    }
+
+    item->fd = open(item->src_image_fname, O_RDONLY);
+    if (item->fd < 0 || aio_read(q, item->fd, slot, item->size, 0, item) == e_failure)
+    {
+        item->ready = 1;
+        item->result = -1;
+    }
+}
+
+/* Encode one cover from its buffer; the stego image is written as usual */
+static Status encode_cover(BatchInfo *batchInfo, BatchItem *item, unsigned char *buffer)
+{
+    EncodeInfo encInfo;
+    Status status;
+
+    // Step 1: Validate the triple like a single -e run would
+    memset(&encInfo, 0, sizeof(encInfo));
+    batchInfo->encode_args[2] = item->src_image_fname;
+    batchInfo->encode_args[3] = item->secret_fname;
+    batchInfo->encode_args[4] = item->stego_image_fname;
+    if (read_and_validate_encode_args(batchInfo->encode_argc, batchInfo->encode_args, &encInfo) == e_failure)
+    {
+        return e_failure;
+    }
+
+    // Step 2: The source comes from memory instead of the file
+    encInfo.fptr_src_image = fmemopen(buffer, item->size, "r");
+    if (encInfo.fptr_src_image == NULL)
+    {
+        perror("fmemopen");
+        return e_failure;
+    }
+    status = do_encoding(&encInfo);
+    stats_end(&encInfo.stats);
+    stats_add(&batchInfo->stats, &encInfo.stats);
+
+    // Step 3: Release everything before the next cover
+    if (encInfo.carrier.rows != NULL)
+    {
+        carrier_close(&encInfo.carrier);
+    }
+    fclose(encInfo.fptr_src_image);
+    if (encInfo.fptr_secret != NULL)
+    {
+        fclose(encInfo.fptr_secret);
+    }
+    container_free(&encInfo.container);
+    if (encInfo.fptr_stego_image != NULL && fclose(encInfo.fptr_stego_image) != 0)
+    {
+        printf("ERROR: Failed to write %s\n", item->stego_image_fname);
+        status = e_failure;
+    }
+    return status;
+}
+
+static void free_batch(BatchInfo *batchInfo, uint nbuffers)
+{
+    for (uint i = 0; batchInfo->buffers != NULL && i < nbuffers; i++)
+    {
+        free(batchInfo->buffers[i]);
+    }
+    free(batchInfo->buffers);
+    free(batchInfo->items);
+    free(batchInfo->manifest_text);
+}
+
+Status do_batch_encoding(int argc, char *argv[])
+{
+    BatchInfo batchInfo;
+    AioQueue queue;
+    struct timespec start, end;
+
+    // Step 1: Arguments and manifest
+    if (read_and_validate_batch_args(argc, argv, &batchInfo) == e_failure)
+    {
+        return e_failure;
+    }
+    if (read_manifest(&batchInfo) == e_failure)
+    {
+        free_batch(&batchInfo, 0);
+        return e_failure;
+    }
+
+    // Step 2: One buffer per read in flight
+    uint depth = batchInfo.queue_depth < batchInfo.nitems ? batchInfo.queue_depth : batchInfo.nitems;
+    batchInfo.buffers = calloc(depth, sizeof(unsigned char *));
+    for (uint i = 0; batchInfo.buffers != NULL && i < depth; i++)
+    {
+        if (posix_memalign((void **)&batchInfo.buffers[i], BATCH_BUF_ALIGN, batchInfo.buf_len) != 0)
+        {
+            batchInfo.buffers[i] = NULL;
+            printf("ERROR: Out of memory for %u buffers of %zu bytes.\n", depth, batchInfo.buf_len);
+            free_batch(&batchInfo, depth);
+            return e_failure;
+        }
+    }
+    if (batchInfo.buffers == NULL ||
+        aio_init(&queue, batchInfo.backend, depth, batchInfo.buffers, batchInfo.buf_len, depth) == e_failure)
+    {
+        free_batch(&batchInfo, depth);
+        return e_failure;
+    }
+    printf("INFO: %u images, %s I/O, queue depth %u\n", batchInfo.nitems, aio_backend_name(queue.backend), depth);
+
+    // Step 3: Keep depth covers in flight ahead of the one being encoded
+    uint next = 0, encoded = 0;
+    unsigned long long bytes_read = 0;
+    Status status = e_success;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint i = 0; i < batchInfo.nitems && status == e_success; i++)
+    {
+        BatchItem *item = &batchInfo.items[i];
+
+        while (next < batchInfo.nitems && next < i + depth)
+        {
+            submit_cover(&queue, &batchInfo.items[next], next % depth);
+            next++;
+        }
+
+        // Step 3a: Completions arrive in any order, wait until this cover's is in
+        while (!item->ready)
+        {
+            void *tag;
+            long long result;
+            if (aio_wait(&queue, &tag, &result) == e_failure)
+            {
+                status = e_failure;
+                break;
+            }
+            ((BatchItem *)tag)->ready = 1;
+            ((BatchItem *)tag)->result = result;
+        }
+        if (item->fd >= 0)
+        {
+            close(item->fd);
+            item->fd = -1;
+        }
+        if (status == e_failure)
+        {
+            break;
+        }
+
+        // Step 3b: Encode it while the reads behind it proceed
+        printf("[%u/%u] %s -> %s\n", i + 1, batchInfo.nitems, item->src_image_fname, item->stego_image_fname);
+        if (item->size < 0 || item->result != item->size)
+        {
+            printf("ERROR: Failed to read %s\n", item->src_image_fname);
+            continue;
+        }
+        bytes_read += item->size;
+        if (encode_cover(&batchInfo, item, batchInfo.buffers[i % depth]) == e_success)
+        {
+            encoded++;
+        }
+        else
+        {
+            printf("ERROR: Encoding %s failed.\n", item->src_image_fname);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    // Step 4: Drain reads still in flight after an error
+    while (queue.inflight > 0)
+    {
+        void *tag;
+        long long result;
+        if (aio_wait(&queue, &tag, &result) == e_failure)
+        {
+            break;
+        }
+    }
+    for (uint i = 0; i < batchInfo.nitems; i++)
+    {
+        if (batchInfo.items[i].fd >= 0)
+        {
+            close(batchInfo.items[i].fd);
+        }
+    }
+    aio_close(&queue);
+
+    // Step 5: Summary
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("INFO: Encoded %u of %u images, %.1f MB of covers in %.3f s (%.1f MB/s)\n",
+           encoded, batchInfo.nitems, bytes_read / 1e6, seconds, seconds > 0 ? bytes_read / 1e6 / seconds : 0.0);
+    stats_report(&batchInfo.stats, "batch");
+    free_batch(&batchInfo, depth);
+
+    return (status == e_success && encoded == batchInfo.nitems) ? e_success : e_failure;
+}
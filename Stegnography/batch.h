@@ -0,0 +1,51 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "types.h"
+#include "aio.h"
+#include "stats.h"
+
+/*
+ * Batch encoding: a manifest lists one "<Source Image> <Secret File>
+ * <Stego Image>" triple per line ('#' starts a comment). While cover N
+ * is being encoded the next covers are already being read into memory
+ * through the asynchronous I/O queue, so a batch is bound by the
+ * device's bandwidth rather than by one read latency after another.
+ */
+
+typedef struct _BatchItem
+{
+    char *src_image_fname;
+    char *secret_fname;
+    char *stego_image_fname;
+    int fd;                 // Open while its read is in flight
+    long long size;
+    int ready;              // Read finished
+    long long result;       // Bytes read or -errno
+} BatchItem;
+
+typedef struct _BatchInfo
+{
+    char *manifest_fname;
+    uint queue_depth;       // --queue-depth=, covers read ahead
+    AioBackend backend;     // --io=
+    char *encode_args[16];  // "-e" argv template, options passed through
+    int encode_argc;
+
+    BatchItem *items;
+    uint nitems;
+    char *manifest_text;    // Items point into this
+
+    unsigned char **buffers;
+    size_t buf_len;
+
+    Stats stats;            // --stats=, phases of all covers added up
+} BatchInfo;
+
+/* Parse "-b <Manifest> [--queue-depth=N] [--io=auto|uring|threads] [--stats[=json]] [encode options]" */
+Status read_and_validate_batch_args(int argc, char *argv[], BatchInfo *batchInfo);
+
+/* Read the manifest, stat the covers and encode them all */
+Status do_batch_encoding(int argc, char *argv[]);
+
+#endif
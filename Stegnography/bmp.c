@@ -0,0 +1,626 @@
+#define _GNU_SOURCE     // O_DIRECT
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "bmp.h"
+#include "image.h"
+
+/* BMP fields are little endian */
+static uint read_le16(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint read_le32(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint)p[3] << 24);
+}
+
+Status read_bmp_info(FILE *fptr_image, BmpInfo *info)
+{
+    unsigned char header[BMP_HEADER_SIZE];
+
+    // Step 1: Read the file and info headers
+    fseek(fptr_image, 0L, SEEK_SET);
+    if (fread(header, 1, sizeof(header), fptr_image) != sizeof(header) ||
+        header[0] != 'B' || header[1] != 'M')
+    {
+        printf("ERROR: Not a BMP file.\n");
+        return e_failure;
+    }
+
+    // Step 2: Decode the fields we need
+    int height = (int)read_le32(header + 22);
+    info->data_offset = read_le32(header + 10);
+    info->width = read_le32(header + 18);
+    info->top_down = height < 0;
+    info->height = height < 0 ? (uint)-height : (uint)height;
+    info->bits_per_pixel = read_le16(header + 28);
+    info->compression = read_le32(header + 30);
+
+    // Step 3: Map bit depth to a pixel format (uncompressed only; bitfields are fine for 32-bit)
+    if (info->bits_per_pixel == 24 && info->compression == 0)
+    {
+        info->format = e_pixel_bgr24;
+    }
+    else if (info->bits_per_pixel == 32 && (info->compression == 0 || info->compression == 3))
+    {
+        info->format = e_pixel_bgra32;
+    }
+    else if (info->bits_per_pixel == 8 && info->compression == 0)
+    {
+        info->format = e_pixel_pal8;
+    }
+    else
+    {
+        printf("ERROR: Unsupported BMP format (%u bits per pixel, compression %u).\n",
+               info->bits_per_pixel, info->compression);
+        info->format = e_pixel_unsupported;
+        return e_failure;
+    }
+
+    // Step 4: Rows are padded to a multiple of 4 bytes, computed wide so a huge width cannot wrap
+    unsigned long long stride = (((unsigned long long)info->width * info->bits_per_pixel + 31) / 32) * 4;
+    unsigned long long row_bytes = (unsigned long long)info->width * pixel_bytes_per_pixel(info->format);
+    if (info->width == 0 || info->height == 0 || info->data_offset < BMP_HEADER_SIZE ||
+        stride > 0x7FFFFFFFu || row_bytes > stride)
+    {
+        printf("ERROR: Corrupt BMP header.\n");
+        return e_failure;
+    }
+    info->row_stride = (uint)stride;
+
+    // Step 5: The pixel array has to fit the file, where its size can be known
+    if (fseek(fptr_image, 0L, SEEK_END) == 0)
+    {
+        long size = ftell(fptr_image);
+        if (size >= 0 && info->data_offset + (unsigned long long)info->height * stride > (unsigned long long)size)
+        {
+            printf("ERROR: BMP pixel array is truncated.\n");
+            return e_failure;
+        }
+    }
+
+    return e_success;
+}
+
+Status copy_bmp_header(FILE *src_image, FILE *stego_image)
+{
+    // Step 1: Move file pointers to the start (position 0) of both files
+    fseek(src_image, 0L, SEEK_SET);  // Move to the beginning of the source image
+    fseek(stego_image, 0L, SEEK_SET);  // Move to the beginning of the stego image
+
+    // Step 2: Create a buffer to hold the BMP header (54 bytes)
+    char header[BMP_HEADER_SIZE];
+
+    // Step 3: Read 54 bytes (BMP header) from the source BMP file
+    if (fread(header, BMP_HEADER_SIZE, 1, src_image) != 1)
+    {
+        printf("ERROR: Failed to read BMP header from the source image.\n");
+        return e_failure;
+    }
+
+    // Step 4: Write the BMP header into the stego BMP file
+    if (fwrite(header, BMP_HEADER_SIZE, 1, stego_image) != 1)
+    {
+        printf("ERROR: Failed to write BMP header to the stego image.\n");
+        return e_failure;
+    }
+
+    // Step 5: Copy whatever sits between header and pixel array (palette, bit masks)
+    unsigned char *offset = (unsigned char *)header + 10;
+    long data_offset = offset[0] | (offset[1] << 8) | (offset[2] << 16) | ((long)offset[3] << 24);
+    for (long copied = BMP_HEADER_SIZE; copied < data_offset; copied += sizeof(header))
+    {
+        size_t chunk = sizeof(header);
+        if (data_offset - copied < (long)chunk)
+        {
+            chunk = data_offset - copied;
+        }
+        if (fread(header, 1, chunk, src_image) != chunk || fwrite(header, 1, chunk, stego_image) != chunk)
+        {
+            printf("ERROR: Failed to copy the BMP palette to the stego image.\n");
+            return e_failure;
+        }
+    }
+
+    // Step 6: Successful header copy
+    return e_success;
+}
+
+Status copy_remaining_img_data(FILE *fptr_src_image, FILE *fptr_stego_image)
+{
+    char buffer[1024];
+    size_t bytes_read;
+
+    // Loop to copy data from the source image to the stego image
+    while ((bytes_read = fread(buffer, sizeof(char), sizeof(buffer), fptr_src_image)) > 0)
+    {
+        if (fwrite(buffer, sizeof(char), bytes_read, fptr_stego_image) != bytes_read)
+        {
+            printf("ERROR: Failed to write remaining data to stego image.\n");
+            return e_failure;
+        }
+    }
+
+    return e_success;
+}
+
+/*
+ * BMP codec. Rows are handed out top to bottom: for bottom-up files
+ * (the usual kind) that is the reverse of storage order. The source is
+ * mapped when possible and rows are copied out of the mapping, otherwise
+ * (and always for the destination) a run of rows is moved with a single
+ * positioned vector read/write whose segments run in storage order.
+ * A source without a file descriptor (batch mode reads covers into
+ * memory) is read row by row through stdio.
+ *
+ * Under IMAGE_IO_DIRECT the files are opened a second time with
+ * O_DIRECT and a run of rows moves as the aligned blocks around it
+ * through a bounce buffer. The blocks a write shares with its
+ * neighbours are read first, or taken from the copy kept of the
+ * previous write's end blocks, which is where the next run continues in
+ * either storage order. A file system that refuses O_DIRECT gets the
+ * buffered path, a source is then dropped from the page cache as it is
+ * read.
+ */
+typedef struct _BmpState
+{
+    BmpInfo info;
+    const unsigned char *map;     // Whole source file, NULL if it could not be mapped
+    size_t map_size;
+
+    /* IMAGE_IO_DIRECT */
+    int direct_src;               // O_DIRECT descriptors, -1 when not used
+    int direct_dest;
+    int drop_src;                 // Buffered fallback: drop source pages once read
+    unsigned char *bounce;        // BMP_DIRECT_ALIGN aligned
+    size_t bounce_size;
+    unsigned char *edge;          // First and last block of the last direct write
+    off_t edge_offset[2];         // Their offsets, -1 if not held
+} BmpState;
+
+/* File offset of the row shown at height y (0 = top) */
+static off_t bmp_row_offset(const BmpInfo *info, uint y)
+{
+    uint stored = info->top_down ? y : info->height - 1 - y;
+    return (off_t)info->data_offset + (off_t)stored * info->row_stride;
+}
+
+/* Move rows y .. y+n-1 between the file and a top-to-bottom buffer */
+static Status bmp_rows_io(const BmpInfo *info, int fd, unsigned char *rows, uint y, uint n, int write)
+{
+    struct iovec iov[BMP_IOV_ROWS];
+    uint stride = info->row_stride;
+
+    for (uint done = 0; done < n;)
+    {
+        uint k = n - done < BMP_IOV_ROWS ? n - done : BMP_IOV_ROWS;
+
+        // Step 1: Segments in storage order; bottom-up files store the run reversed
+        for (uint i = 0; i < k; i++)
+        {
+            uint row = info->top_down ? done + i : done + k - 1 - i;
+            iov[i].iov_base = rows + (size_t)row * stride;
+            iov[i].iov_len = stride;
+        }
+
+        // Step 2: One syscall for the run, starting at its lowest offset
+        off_t offset = bmp_row_offset(info, info->top_down ? y + done : y + done + k - 1);
+        ssize_t moved = write ? pwritev(fd, iov, k, offset) : preadv(fd, iov, k, offset);
+        if (moved != (ssize_t)k * stride)
+        {
+            printf("ERROR: Failed to %s %u rows of the image.\n", write ? "write" : "read", k);
+            return e_failure;
+        }
+        done += k;
+    }
+    return e_success;
+}
+
+/* A second descriptor of an open file, with O_DIRECT; -1 if the file system refuses it */
+static int bmp_open_direct(FILE *fptr, int flags)
+{
+    char path[64];
+    void *probe;
+
+    if (fptr == NULL || fileno(fptr) < 0)
+    {
+        return -1;
+    }
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", fileno(fptr));
+    int fd = open(path, flags | O_DIRECT);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    // Some file systems accept the flag and fail the first transfer instead
+    if (posix_memalign(&probe, BMP_DIRECT_ALIGN, BMP_DIRECT_ALIGN) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    if (pread(fd, probe, BMP_DIRECT_ALIGN, 0) < 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+    free(probe);
+    return fd;
+}
+
+/* Bounce buffer of at least size bytes */
+static Status bmp_bounce(BmpState *bmp, size_t size)
+{
+    void *buf;
+
+    if (size <= bmp->bounce_size)
+    {
+        return e_success;
+    }
+    if (posix_memalign(&buf, size >= BMP_HUGE_PAGE ? BMP_HUGE_PAGE : BMP_DIRECT_ALIGN, size) != 0)
+    {
+        printf("ERROR: Out of memory for a %zu byte I/O buffer.\n", size);
+        return e_failure;
+    }
+#ifdef MADV_HUGEPAGE
+    if (size >= BMP_HUGE_PAGE)
+    {
+        madvise(buf, size, MADV_HUGEPAGE);
+    }
+#endif
+    free(bmp->bounce);
+    bmp->bounce = buf;
+    bmp->bounce_size = size;
+    return e_success;
+}
+
+/* Block at offset of the file into buf, from the edge copies when held (zeros past the end) */
+static Status bmp_fill_block(BmpState *bmp, int fd, off_t offset, unsigned char *buf)
+{
+    for (int k = 0; k < 2; k++)
+    {
+        if (bmp->edge_offset[k] == offset)
+        {
+            memcpy(buf, bmp->edge + k * BMP_DIRECT_ALIGN, BMP_DIRECT_ALIGN);
+            return e_success;
+        }
+    }
+    ssize_t got = pread(fd, buf, BMP_DIRECT_ALIGN, offset);
+    if (got < 0)
+    {
+        perror("pread");
+        return e_failure;
+    }
+    memset(buf + got, 0, BMP_DIRECT_ALIGN - got);
+    return e_success;
+}
+
+/* Move rows y .. y+n-1 as the aligned blocks that hold them */
+static Status bmp_rows_direct(BmpState *bmp, int fd, unsigned char *rows, uint y, uint n, int write)
+{
+    const BmpInfo *info = &bmp->info;
+    uint stride = info->row_stride;
+
+    // Step 1: The run is contiguous in the file, widen it to whole blocks
+    off_t lo = bmp_row_offset(info, info->top_down ? y : y + n - 1);
+    off_t hi = lo + (off_t)n * stride;
+    off_t first = lo & ~(off_t)(BMP_DIRECT_ALIGN - 1);
+    off_t end = (hi + BMP_DIRECT_ALIGN - 1) & ~(off_t)(BMP_DIRECT_ALIGN - 1);
+    size_t len = end - first;
+    if (bmp_bounce(bmp, len) == e_failure)
+    {
+        return e_failure;
+    }
+
+    if (!write)
+    {
+        // Step 2: One read, then the rows out in display order
+        ssize_t got = pread(fd, bmp->bounce, len, first);
+        if (got < hi - first)
+        {
+            printf("ERROR: Failed to read %u rows of the image.\n", n);
+            return e_failure;
+        }
+        for (uint i = 0; i < n; i++)
+        {
+            memcpy(rows + (size_t)i * stride, bmp->bounce + (bmp_row_offset(info, y + i) - first), stride);
+        }
+        return e_success;
+    }
+
+    // Step 2: Blocks shared with the neighbours keep their bytes
+    if (lo != first && bmp_fill_block(bmp, fd, first, bmp->bounce) == e_failure)
+    {
+        return e_failure;
+    }
+    if (hi != end && (end - BMP_DIRECT_ALIGN != first || lo == first) &&
+        bmp_fill_block(bmp, fd, end - BMP_DIRECT_ALIGN, bmp->bounce + len - BMP_DIRECT_ALIGN) == e_failure)
+    {
+        return e_failure;
+    }
+
+    // Step 3: The rows in storage order, one write
+    for (uint i = 0; i < n; i++)
+    {
+        memcpy(bmp->bounce + (bmp_row_offset(info, y + i) - first), rows + (size_t)i * stride, stride);
+    }
+    if (pwrite(fd, bmp->bounce, len, first) != (ssize_t)len)
+    {
+        printf("ERROR: Failed to write %u rows of the image.\n", n);
+        return e_failure;
+    }
+
+    // Step 4: Keep both end blocks, the next run starts in one of them
+    memcpy(bmp->edge, bmp->bounce, BMP_DIRECT_ALIGN);
+    memcpy(bmp->edge + BMP_DIRECT_ALIGN, bmp->bounce + len - BMP_DIRECT_ALIGN, BMP_DIRECT_ALIGN);
+    bmp->edge_offset[0] = first;
+    bmp->edge_offset[1] = end - BMP_DIRECT_ALIGN;
+    return e_success;
+}
+
+/* Open the O_DIRECT descriptors, falling back to buffered I/O */
+static Status bmp_open_direct_io(Image *image, BmpState *bmp, int mapped)
+{
+    void *edge;
+
+    // Step 1: The source is read through O_DIRECT unless it is already in memory
+    if (!mapped && fileno(image->fptr_src) >= 0)
+    {
+        bmp->direct_src = bmp_open_direct(image->fptr_src, O_RDONLY);
+        if (bmp->direct_src < 0)
+        {
+            printf("INFO: O_DIRECT is not supported for the source image, reading it buffered.\n");
+            bmp->drop_src = 1;
+        }
+    }
+
+    // Step 2: The destination is read back for the blocks it shares with the header
+    if (image->fptr_dest != NULL)
+    {
+        bmp->direct_dest = bmp_open_direct(image->fptr_dest, O_RDWR);
+        if (bmp->direct_dest < 0)
+        {
+            printf("INFO: O_DIRECT is not supported for the output image, writing it buffered.\n");
+        }
+    }
+    if (bmp->direct_dest < 0 && bmp->direct_src < 0)
+    {
+        return e_success;
+    }
+    if (posix_memalign(&edge, BMP_DIRECT_ALIGN, 2 * BMP_DIRECT_ALIGN) != 0)
+    {
+        printf("ERROR: Out of memory.\n");
+        return e_failure;
+    }
+    bmp->edge = edge;
+    return e_success;
+}
+
+static Status bmp_open(Image *image)
+{
+    BmpState *bmp = calloc(1, sizeof(*bmp));
+    if (bmp == NULL)
+    {
+        printf("ERROR: Out of memory.\n");
+        return e_failure;
+    }
+    image->state = bmp;
+    bmp->direct_src = bmp->direct_dest = -1;
+    bmp->edge_offset[0] = bmp->edge_offset[1] = -1;
+
+    // Step 1: Parse the header
+    BmpInfo *info = &bmp->info;
+    if (read_bmp_info(image->fptr_src, info) == e_failure)
+    {
+        return e_failure;
+    }
+
+    // Step 2: Copy header and palette to the destination, rows are written by offset after it
+    if (image->fptr_dest != NULL &&
+        (copy_bmp_header(image->fptr_src, image->fptr_dest) == e_failure || fflush(image->fptr_dest) != 0))
+    {
+        return e_failure;
+    }
+
+    // Step 3: Map the pixel array if we can (not for direct I/O), read_bmp_info made sure it is complete
+    struct stat st;
+    int fd = fileno(image->fptr_src);
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+    {
+        void *map = (image->io_flags & IMAGE_IO_DIRECT) ? MAP_FAILED :
+                    mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED)
+        {
+            bmp->map = map;
+            bmp->map_size = st.st_size;
+            madvise(map, st.st_size, info->top_down ? MADV_SEQUENTIAL : MADV_NORMAL);
+#ifdef MADV_HUGEPAGE
+            // Fewer TLB misses over a large pixel array where the file system can back it so
+            madvise(map, st.st_size, MADV_HUGEPAGE);
+#endif
+        }
+    }
+
+    // Step 3a: Direct I/O descriptors and buffers
+    if ((image->io_flags & IMAGE_IO_DIRECT) && bmp_open_direct_io(image, bmp, bmp->map != NULL) == e_failure)
+    {
+        return e_failure;
+    }
+
+    // Step 4: Rows are handed out with their padding, the caller only looks at row_bytes
+    image->width = info->width;
+    image->height = info->height;
+    image->format = info->format;
+    image->row_bytes = info->width * pixel_bytes_per_pixel(info->format);
+    image->row_alloc = info->row_stride;
+    return e_success;
+}
+
+static Status bmp_read_rows(Image *image, unsigned char *rows, uint n)
+{
+    BmpState *bmp = image->state;
+    const BmpInfo *info = &bmp->info;
+    uint y = image->rows_read;
+
+    if (bmp->direct_src >= 0)
+    {
+        return bmp_rows_direct(bmp, bmp->direct_src, rows, y, n, 0);
+    }
+    if (bmp->map == NULL && fileno(image->fptr_src) >= 0)
+    {
+        Status status = bmp_rows_io(info, fileno(image->fptr_src), rows, y, n, 0);
+        if (status == e_success && bmp->drop_src)
+        {
+            off_t lo = bmp_row_offset(info, info->top_down ? y : y + n - 1);
+            posix_fadvise(fileno(image->fptr_src), lo, (off_t)n * info->row_stride, POSIX_FADV_DONTNEED);
+        }
+        return status;
+    }
+    if (bmp->map == NULL)
+    {
+        for (uint i = 0; i < n; i++)
+        {
+            if (fseek(image->fptr_src, (long)bmp_row_offset(info, y + i), SEEK_SET) != 0 ||
+                fread(rows + (size_t)i * info->row_stride, 1, info->row_stride, image->fptr_src) != info->row_stride)
+            {
+                printf("ERROR: Failed to read %u bytes from image.\n", info->row_stride);
+                return e_failure;
+            }
+        }
+        return e_success;
+    }
+
+    // Copy out of the mapping, flipping bottom-up files as we go
+    for (uint i = 0; i < n; i++)
+    {
+        memcpy(rows + (size_t)i * info->row_stride, bmp->map + bmp_row_offset(info, y + i), info->row_stride);
+    }
+
+    // Bottom-up files are walked backwards, where kernel readahead does not help
+    if (!info->top_down && y + n < info->height)
+    {
+        uint next = info->height - (y + n) < n ? info->height - (y + n) : n;
+        off_t start = bmp_row_offset(info, y + n + next - 1) & ~(off_t)(sysconf(_SC_PAGESIZE) - 1);
+        madvise((void *)(bmp->map + start), bmp_row_offset(info, y + n) + info->row_stride - start, MADV_WILLNEED);
+    }
+    return e_success;
+}
+
+static Status bmp_write_rows(Image *image, const unsigned char *rows, uint n)
+{
+    BmpState *bmp = image->state;
+
+    if (bmp->direct_dest >= 0)
+    {
+        return bmp_rows_direct(bmp, bmp->direct_dest, (unsigned char *)rows, image->rows_written, n, 1);
+    }
+
+    // Segments only read from the buffer on a write
+    return bmp_rows_io(&bmp->info, fileno(image->fptr_dest), (unsigned char *)rows, image->rows_written, n, 1);
+}
+
+/* Rows are addressed by offset, so any row can be next */
+static Status bmp_seek_row(Image *image, uint y)
+{
+    (void)image;
+    (void)y;
+    return e_success;
+}
+
+/* Rows sit at fixed offsets, so changed ones can be written straight back */
+static Status bmp_rewrite_rows(Image *image, uint y, const unsigned char *rows, uint n)
+{
+    BmpState *bmp = image->state;
+
+    if (fileno(image->fptr_src) < 0)
+    {
+        printf("ERROR: The image is not a file that can be updated in place.\n");
+        return e_failure;
+    }
+    return bmp_rows_io(&bmp->info, fileno(image->fptr_src), (unsigned char *)rows, y, n, 1);
+}
+
+static Status bmp_finish(Image *image)
+{
+    BmpState *bmp = image->state;
+    const BmpInfo *info = &bmp->info;
+    uint window = BMP_COPY_BYTES / info->row_stride + 1;
+    Status status = e_success;
+
+    // Step 1: Rows the payload did not reach are copied unchanged, a window at a time
+    unsigned char *rows = malloc((size_t)window * info->row_stride);
+    if (rows == NULL)
+    {
+        printf("ERROR: Out of memory.\n");
+        return e_failure;
+    }
+    while (status == e_success && image->rows_written < image->height)
+    {
+        uint n = image->height - image->rows_written < window ? image->height - image->rows_written : window;
+        status = image_read_rows(image, rows, n);
+        if (status == e_success)
+        {
+            status = image_write_rows(image, rows, n);
+        }
+    }
+    free(rows);
+    if (status == e_failure)
+    {
+        return e_failure;
+    }
+
+    // Step 2: Anything stored after the pixel array is copied byte for byte
+    long end = (long)bmp_row_offset(info, info->top_down ? info->height - 1 : 0) + info->row_stride;
+    fseek(image->fptr_src, end, SEEK_SET);
+    fseek(image->fptr_dest, end, SEEK_SET);
+    if (copy_remaining_img_data(image->fptr_src, image->fptr_dest) == e_failure)
+    {
+        return e_failure;
+    }
+
+    // Step 3: Direct writes end on a block boundary, cut the file back to the source's length
+    if (bmp->direct_dest >= 0)
+    {
+        long size = ftell(image->fptr_src);
+        if (size < 0 || fflush(image->fptr_dest) != 0 || ftruncate(fileno(image->fptr_dest), size) != 0)
+        {
+            printf("ERROR: Failed to set the length of the stego image.\n");
+            return e_failure;
+        }
+    }
+    return e_success;
+}
+
+static void bmp_close(Image *image)
+{
+    BmpState *bmp = image->state;
+
+    if (bmp->map != NULL)
+    {
+        munmap((void *)bmp->map, bmp->map_size);
+    }
+    if (bmp->direct_src >= 0)
+    {
+        close(bmp->direct_src);
+    }
+    if (bmp->direct_dest >= 0)
+    {
+        close(bmp->direct_dest);
+    }
+    free(bmp->bounce);
+    free(bmp->edge);
+    free(bmp);
+}
+
+const ImageCodec bmp_codec =
+{
+    "BMP", ".bmp", bmp_open, bmp_read_rows, bmp_write_rows, bmp_finish, bmp_close, bmp_seek_row,
+    bmp_rewrite_rows
+};
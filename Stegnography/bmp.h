@@ -0,0 +1,45 @@
+#ifndef BMP_H
+#define BMP_H
+
+#include <stdio.h>
+#include "types.h"
+#include "pixel.h"
+
+/* Size of BITMAPFILEHEADER + BITMAPINFOHEADER */
+#define BMP_HEADER_SIZE 54
+
+/* Rows moved per positioned vector read/write */
+#define BMP_IOV_ROWS 64
+
+/* Window used to copy the rows the payload does not reach */
+#define BMP_COPY_BYTES (256 * 1024)
+
+/* O_DIRECT transfers are whole, aligned blocks of this size (at least the device's logical block) */
+#define BMP_DIRECT_ALIGN 4096
+
+/* Bounce buffers from this size on are asked to be backed by huge pages */
+#define BMP_HUGE_PAGE (2 * 1024 * 1024)
+
+/* Geometry and pixel layout of a BMP file */
+typedef struct _BmpInfo
+{
+    uint width;
+    uint height;            // Number of rows (sign removed)
+    int top_down;           // 1 if the first stored row is the top row
+    uint bits_per_pixel;
+    uint compression;
+    uint data_offset;       // Start of the pixel array (after header and palette)
+    uint row_stride;        // Bytes per stored row, padded to 4
+    PixelFormat format;
+} BmpInfo;
+
+/* Read and validate the BMP header, file position is left unspecified */
+Status read_bmp_info(FILE *fptr_image, BmpInfo *info);
+
+/* Copy bmp image header (and palette/bit masks up to the pixel array) */
+Status copy_bmp_header(FILE *fptr_src_image, FILE *fptr_dest_image);
+
+/* Copy remaining image bytes from src to stego image after encoding */
+Status copy_remaining_img_data(FILE *fptr_src_image, FILE *fptr_stego_image);
+
+#endif
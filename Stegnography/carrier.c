@@ -0,0 +1,685 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "carrier.h"
+#include "lsb.h"
+
+/* Row y of the window */
+#define WINDOW_ROW(cs, y) ((cs)->rows + (size_t)(y) * (cs)->image.row_alloc)
+
+/*
+ * Point the carriers at the window from first_pixel (counted across its
+ * rows) onwards. Rows are gathered back to back into one span so the
+ * kernels see whole windows, not rows; only unpadded rows under a full
+ * mask are used in place.
+ */
+static void carrier_view_window(CarrierStream *cs, size_t first_pixel)
+{
+    uint bpp = cs->view->bytes_per_pixel;
+    uint width = cs->image.width;
+    size_t n = 0;
+
+    cs->first_pixel = first_pixel;
+    cs->pos = 0;
+
+    if (cs->view->gather == NULL && cs->image.row_alloc == cs->image.row_bytes)
+    {
+        cs->carriers = cs->rows + first_pixel * bpp;
+        cs->n_carriers = ((size_t)cs->nrows * width - first_pixel) * bpp;
+        return;
+    }
+
+    for (uint y = first_pixel / width, x = first_pixel % width; y < cs->nrows; y++, x = 0)
+    {
+        const unsigned char *pixels = WINDOW_ROW(cs, y) + (size_t)x * bpp;
+        if (cs->view->gather != NULL)
+        {
+            n += cs->view->gather(cs->carrier_buf + n, pixels, width - x);
+        }
+        else
+        {
+            memcpy(cs->carrier_buf + n, pixels, (size_t)(width - x) * bpp);
+            n += (size_t)(width - x) * bpp;
+        }
+    }
+    cs->carriers = cs->carrier_buf;
+    cs->n_carriers = n;
+}
+
+/* Put gathered carriers back into the window pixels */
+static void carrier_unview_window(CarrierStream *cs)
+{
+    uint bpp = cs->view->bytes_per_pixel;
+    uint width = cs->image.width;
+    const unsigned char *carriers = cs->carrier_buf;
+
+    if ((cs->image.fptr_dest == NULL && !cs->in_place) || cs->carriers != cs->carrier_buf)
+    {
+        return;
+    }
+
+    for (uint y = cs->first_pixel / width, x = cs->first_pixel % width; y < cs->nrows; y++, x = 0)
+    {
+        unsigned char *pixels = WINDOW_ROW(cs, y) + (size_t)x * bpp;
+        if (cs->view->scatter != NULL)
+        {
+            cs->view->scatter(pixels, carriers, width - x);
+            carriers += (size_t)(width - x) * cs->view->carriers_per_pixel;
+        }
+        else
+        {
+            memcpy(pixels, carriers, (size_t)(width - x) * bpp);
+            carriers += (size_t)(width - x) * bpp;
+        }
+    }
+}
+
+/* Ordinal of carrier pos of the window, counted from the top-left pixel under the current mask */
+static unsigned long long carrier_ordinal(const CarrierStream *cs, size_t pos)
+{
+    unsigned long long pixel = (unsigned long long)(cs->image.rows_read - cs->nrows) * cs->image.width + cs->first_pixel;
+    return pixel * cs->view->carriers_per_pixel + pos;
+}
+
+/* Carriers from pos to the end of its pixel row */
+static size_t carrier_row_left(const CarrierStream *cs, size_t pos)
+{
+    uint cpp = cs->view->carriers_per_pixel;
+    size_t pixel = cs->first_pixel + pos / cpp;
+    return (size_t)(cs->image.width - pixel % cs->image.width) * cpp - pos % cpp;
+}
+
+/* Remember which pixels of the window carriers from .. to-1 belong to */
+static void carrier_touch(CarrierStream *cs, size_t from, size_t to)
+{
+    uint cpp = cs->view->carriers_per_pixel;
+    size_t first = cs->first_pixel + from / cpp;
+    size_t end = cs->first_pixel + (to + cpp - 1) / cpp;
+
+    if (cs->dirty_end == cs->dirty_first)
+    {
+        cs->dirty_first = first;
+        cs->dirty_end = end;
+        return;
+    }
+    if (first < cs->dirty_first)
+    {
+        cs->dirty_first = first;
+    }
+    if (end > cs->dirty_end)
+    {
+        cs->dirty_end = end;
+    }
+}
+
+/* Hand the current window back: all of it to dest, or only its changed rows to src */
+static Status carrier_flush_window(CarrierStream *cs)
+{
+    Image *image = &cs->image;
+    uint first_row = image->rows_read - cs->nrows;
+
+    carrier_unview_window(cs);
+    if (image->fptr_dest != NULL && image_write_rows(image, cs->rows, cs->nrows) == e_failure)
+    {
+        return e_failure;
+    }
+    if (cs->dirty_end > cs->dirty_first)
+    {
+        uint y = cs->dirty_first / image->width;
+        uint end = (cs->dirty_end - 1) / image->width + 1;
+        if (image_rewrite_rows(image, first_row + y, WINDOW_ROW(cs, y), end - y) == e_failure)
+        {
+            return e_failure;
+        }
+    }
+    cs->dirty_first = cs->dirty_end = 0;
+    cs->nrows = 0;
+    return e_success;
+}
+
+/* Write back the current window (if any) and read the next one */
+static Status carrier_next_window(CarrierStream *cs)
+{
+    Image *image = &cs->image;
+
+    // Step 1: Finish the current window
+    if (cs->nrows > 0 && carrier_flush_window(cs) == e_failure)
+    {
+        return e_failure;
+    }
+
+    // Step 2: Read as many rows as fit, one codec call for all of them
+    if (image->rows_read == image->height)
+    {
+        printf("ERROR: Image has no carrier bytes left.\n");
+        return e_failure;
+    }
+    uint n = image->height - image->rows_read;
+    if (n > cs->window_rows)
+    {
+        n = cs->window_rows;
+    }
+    if (image_read_rows(image, cs->rows, n) == e_failure)
+    {
+        return e_failure;
+    }
+    cs->nrows = n;
+
+    // Step 3: Gather their carriers
+    carrier_view_window(cs, 0);
+    return e_success;
+}
+
+Status carrier_open(CarrierStream *cs, FILE *fptr_src, FILE *fptr_dest, int level, uint io_flags)
+{
+    memset(cs, 0, sizeof(*cs));
+
+    // Step 1: Parse the header to learn the pixel layout (dest gets a copy)
+    if (image_open(&cs->image, fptr_src, fptr_dest, level, io_flags) == e_failure)
+    {
+        return e_failure;
+    }
+    cs->view = pixel_view(cs->image.format, pixel_default_mask(cs->image.format));
+
+    // Step 2: Size the window so narrow images still move a large block per read,
+    // wide ones get a single row
+    cs->window_rows = ((cs->image.io_flags & IMAGE_IO_DIRECT) ? CARRIER_DIRECT_WINDOW_BYTES : CARRIER_WINDOW_BYTES) /
+                      cs->image.row_alloc;
+    if (cs->window_rows == 0)
+    {
+        cs->window_rows = 1;
+    }
+    if (cs->window_rows > cs->image.height)
+    {
+        cs->window_rows = cs->image.height;
+    }
+
+    // Step 3: Allocate the window and one window of gathered carriers
+    cs->rows = malloc((size_t)cs->window_rows * cs->image.row_alloc + PIXEL_VIEW_SLACK);
+    cs->carrier_buf = malloc((size_t)cs->window_rows * cs->image.row_bytes + PIXEL_VIEW_SLACK);
+    if (cs->rows == NULL || cs->carrier_buf == NULL)
+    {
+        printf("ERROR: Out of memory for %u rows of %u bytes.\n", cs->window_rows, cs->image.row_alloc);
+        free(cs->rows);
+        free(cs->carrier_buf);
+        image_close(&cs->image);
+        return e_failure;
+    }
+
+    return e_success;
+}
+
+Status carrier_open_in_place(CarrierStream *cs, FILE *fptr)
+{
+    if (carrier_open(cs, fptr, NULL, 0, 0) == e_failure)
+    {
+        return e_failure;
+    }
+    if (cs->image.codec->rewrite_rows == NULL)
+    {
+        printf("ERROR: %s images cannot be updated in place.\n", cs->image.codec->name);
+        carrier_close(cs);
+        return e_failure;
+    }
+    cs->in_place = 1;
+    return e_success;
+}
+
+Status carrier_set_mask(CarrierStream *cs, uint mask)
+{
+    const PixelView *view = pixel_view(cs->image.format, mask);
+    if (view == NULL)
+    {
+        printf("ERROR: Channel mask 0x%X is not valid for %s images.\n", mask, pixel_format_name(cs->image.format));
+        return e_failure;
+    }
+
+    // The new mask starts at the first pixel not touched under the old one
+    if (cs->nrows > 0)
+    {
+        uint cpp = cs->view->carriers_per_pixel;
+        size_t next_pixel = cs->first_pixel + (cs->pos + cpp - 1) / cpp;
+
+        carrier_unview_window(cs);
+        cs->view = view;
+        carrier_view_window(cs, next_pixel);
+    }
+    else
+    {
+        cs->view = view;
+    }
+
+    return e_success;
+}
+
+Status carrier_set_matrix(CarrierStream *cs, uint p)
+{
+    if (p == 1 || p > CARRIER_MAX_MATRIX)
+    {
+        printf("ERROR: Matrix embedding takes 2 to %d bits per code block.\n", CARRIER_MAX_MATRIX);
+        return e_failure;
+    }
+    if (p != 0 && ((1u << p) - 1) > cs->image.width * cs->view->carriers_per_pixel)
+    {
+        printf("ERROR: Code blocks of %u carriers do not fit a row of the image.\n", (1u << p) - 1);
+        return e_failure;
+    }
+    cs->matrix_p = p;
+    cs->matrix_bit = 0;
+    return e_success;
+}
+
+/*
+ * Embed or extract bits through Hamming code blocks. A block starts
+ * where the last one ended unless the row has fewer than n carriers
+ * left, then it starts on the next row. Its message is its syndrome,
+ * first bit highest; embedding changes at most the one carrier in
+ * column syndrome ^ message. A block is left only once all p of its
+ * bits are through, so byte fields may share a block.
+ */
+static Status carrier_matrix(CarrierStream *cs, unsigned char *bytes, size_t len, int embed)
+{
+    uint p = cs->matrix_p;
+    uint n = (1u << p) - 1;
+    size_t bit = 0, total = len * 8;
+
+    if (!embed)
+    {
+        memset(bytes, 0, len);
+    }
+    while (bit < total)
+    {
+        if (cs->pos == cs->n_carriers || cs->nrows == 0)
+        {
+            if (carrier_next_window(cs) == e_failure)
+            {
+                return e_failure;
+            }
+            continue;
+        }
+
+        // Step 1: A new block has to fit in the rest of the row
+        if (cs->matrix_bit == 0)
+        {
+            size_t left = carrier_row_left(cs, cs->pos);
+            if (left < n)
+            {
+                cs->pos += left;
+                continue;
+            }
+
+            // Whole blocks of this call in the row go through the packed kernels
+            size_t blocks = left / n;
+            if (blocks > (total - bit) / p)
+            {
+                blocks = (total - bit) / p;
+            }
+            if (blocks > 0)
+            {
+                if (embed)
+                {
+                    lsb_matrix_embed(cs->carriers + cs->pos, blocks, p, bytes, bit,
+                                     cs->matching, cs->match_key, carrier_ordinal(cs, cs->pos));
+                    if (cs->in_place)
+                    {
+                        carrier_touch(cs, cs->pos, cs->pos + blocks * n);
+                    }
+                }
+                else
+                {
+                    lsb_matrix_extract(cs->carriers + cs->pos, blocks, p, bytes, bit);
+                }
+                cs->pos += blocks * n;
+                bit += blocks * p;
+                continue;
+            }
+        }
+
+        // Step 2: The bits of this call within the block, as a field of the syndrome
+        uint k = p - cs->matrix_bit;
+        if (k > total - bit)
+        {
+            k = (uint)(total - bit);
+        }
+        uint shift = p - cs->matrix_bit - k;
+        uint syndrome = lsb_syndrome(cs->carriers + cs->pos, n);
+
+        if (embed)
+        {
+            // Step 3: Put the message bits in, a different syndrome names the carrier to change
+            uint value = 0;
+            for (uint i = 0; i < k; i++)
+            {
+                value = (value << 1) | ((bytes[(bit + i) / 8] >> (7 - ((bit + i) & 7))) & 1);
+            }
+            uint column = (syndrome & ~(((1u << k) - 1) << shift)) ^ (value << shift) ^ syndrome;
+            if (column != 0)
+            {
+                size_t at = cs->pos + column - 1;
+                unsigned char carrier = cs->carriers[at];
+                cs->carriers[at] = cs->matching ?
+                    lsb_match_bit(carrier, ~carrier & 1, cs->match_key, carrier_ordinal(cs, at)) : carrier ^ 1;
+                if (cs->in_place)
+                {
+                    carrier_touch(cs, at, at + 1);
+                }
+            }
+        }
+        else
+        {
+            // Step 3: Read the message bits out of the syndrome
+            for (uint i = 0; i < k; i++)
+            {
+                bytes[(bit + i) / 8] |= ((syndrome >> (shift + k - 1 - i)) & 1) << (7 - ((bit + i) & 7));
+            }
+        }
+
+        // Step 4: Move past the block once all of its bits are through
+        bit += k;
+        cs->matrix_bit += k;
+        if (cs->matrix_bit == p)
+        {
+            cs->matrix_bit = 0;
+            cs->pos += n;
+        }
+    }
+
+    return e_success;
+}
+
+Status carrier_embed(CarrierStream *cs, const void *data, size_t len)
+{
+    const unsigned char *bytes = data;
+    size_t bit = 0, total = len * 8;
+
+    if (cs->matrix_p != 0)
+    {
+        return carrier_matrix(cs, (unsigned char *)data, len, 1);
+    }
+
+    while (bit < total)
+    {
+        if (cs->pos == cs->n_carriers || cs->nrows == 0)
+        {
+            if (carrier_next_window(cs) == e_failure)
+            {
+                return e_failure;
+            }
+            continue;
+        }
+
+        size_t avail = cs->n_carriers - cs->pos;
+        if ((bit & 7) == 0 && avail >= 8 && total - bit >= 8)
+        {
+            // Whole bytes: hand the run to the bulk kernel
+            size_t nbytes = avail / 8;
+            if (nbytes > (total - bit) / 8)
+            {
+                nbytes = (total - bit) / 8;
+            }
+            if (cs->matching)
+            {
+                lsb_match(cs->carriers + cs->pos, bytes + bit / 8, nbytes, cs->match_key, carrier_ordinal(cs, cs->pos));
+            }
+            else
+            {
+                lsb_embed(cs->carriers + cs->pos, bytes + bit / 8, nbytes);
+            }
+            if (cs->in_place)
+            {
+                carrier_touch(cs, cs->pos, cs->pos + nbytes * 8);
+            }
+            cs->pos += nbytes * 8;
+            bit += nbytes * 8;
+        }
+        else
+        {
+            // A byte split across windows goes one bit at a time
+            unsigned char value = (bytes[bit / 8] >> (7 - (bit & 7))) & 1;
+            if (cs->matching)
+            {
+                cs->carriers[cs->pos] = lsb_match_bit(cs->carriers[cs->pos], value, cs->match_key, carrier_ordinal(cs, cs->pos));
+            }
+            else
+            {
+                cs->carriers[cs->pos] = (cs->carriers[cs->pos] & 0xFE) | value;
+            }
+            if (cs->in_place)
+            {
+                carrier_touch(cs, cs->pos, cs->pos + 1);
+            }
+            cs->pos++;
+            bit++;
+        }
+    }
+
+    return e_success;
+}
+
+Status carrier_extract(CarrierStream *cs, void *data, size_t len)
+{
+    unsigned char *bytes = data;
+    size_t bit = 0, total = len * 8;
+
+    if (cs->matrix_p != 0)
+    {
+        return carrier_matrix(cs, bytes, len, 0);
+    }
+
+    while (bit < total)
+    {
+        if (cs->pos == cs->n_carriers || cs->nrows == 0)
+        {
+            if (carrier_next_window(cs) == e_failure)
+            {
+                return e_failure;
+            }
+            continue;
+        }
+
+        size_t avail = cs->n_carriers - cs->pos;
+        if ((bit & 7) == 0 && avail >= 8 && total - bit >= 8)
+        {
+            size_t nbytes = avail / 8;
+            if (nbytes > (total - bit) / 8)
+            {
+                nbytes = (total - bit) / 8;
+            }
+            lsb_extract(cs->carriers + cs->pos, bytes + bit / 8, nbytes);
+            cs->pos += nbytes * 8;
+            bit += nbytes * 8;
+        }
+        else
+        {
+            if ((bit & 7) == 0)
+            {
+                bytes[bit / 8] = 0;
+            }
+            bytes[bit / 8] |= (cs->carriers[cs->pos] & 1) << (7 - (bit & 7));
+            cs->pos++;
+            bit++;
+        }
+    }
+
+    return e_success;
+}
+
+Status carrier_embed_be32(CarrierStream *cs, uint value)
+{
+    unsigned char bytes[4];
+
+    bytes[0] = (value >> 24) & 0xFF;
+    bytes[1] = (value >> 16) & 0xFF;
+    bytes[2] = (value >> 8) & 0xFF;
+    bytes[3] = value & 0xFF;
+
+    return carrier_embed(cs, bytes, sizeof(bytes));
+}
+
+Status carrier_extract_be32(CarrierStream *cs, uint *value)
+{
+    unsigned char bytes[4];
+
+    if (carrier_extract(cs, bytes, sizeof(bytes)) == e_failure)
+    {
+        return e_failure;
+    }
+
+    *value = ((uint)bytes[0] << 24) | (bytes[1] << 16) | (bytes[2] << 8) | bytes[3];
+    return e_success;
+}
+
+Status carrier_span(CarrierStream *cs, unsigned char **carriers, size_t *n)
+{
+    if (cs->pos == cs->n_carriers || cs->nrows == 0)
+    {
+        if (carrier_next_window(cs) == e_failure)
+        {
+            return e_failure;
+        }
+    }
+
+    // The caller may change any of them, so all of them count as touched
+    *carriers = cs->carriers + cs->pos;
+    *n = cs->n_carriers - cs->pos;
+    if (cs->in_place)
+    {
+        carrier_touch(cs, cs->pos, cs->n_carriers);
+    }
+    cs->pos = cs->n_carriers;
+    return e_success;
+}
+
+unsigned long long carrier_tell(const CarrierStream *cs)
+{
+    unsigned long long window_pixel = (unsigned long long)(cs->image.rows_read - cs->nrows) * cs->image.width;
+
+    if (cs->nrows == 0)
+    {
+        return window_pixel;
+    }
+    return window_pixel + cs->first_pixel + cs->pos / cs->view->carriers_per_pixel;
+}
+
+Status carrier_seek(CarrierStream *cs, unsigned long long pixel, uint skip)
+{
+    uint width = cs->image.width;
+    unsigned long long first_row = cs->image.rows_read - cs->nrows;
+
+    if (pixel >= (unsigned long long)cs->image.height * width || skip >= cs->view->carriers_per_pixel)
+    {
+        printf("ERROR: Carrier position %llu.%u is outside the image.\n", pixel, skip);
+        return e_failure;
+    }
+
+    // Step 1: Outside the loaded window, move the image to the target row and load from there
+    carrier_unview_window(cs);
+    if (cs->nrows == 0 || pixel < first_row * width || pixel >= (unsigned long long)cs->image.rows_read * width)
+    {
+        if (cs->nrows > 0 && carrier_flush_window(cs) == e_failure)
+        {
+            return e_failure;
+        }
+        if (image_seek_row(&cs->image, (uint)(pixel / width)) == e_failure)
+        {
+            return e_failure;
+        }
+        cs->nrows = 0;
+        if (carrier_next_window(cs) == e_failure)
+        {
+            return e_failure;
+        }
+        first_row = pixel / width;
+    }
+
+    // Step 2: Point the carriers at the target pixel
+    carrier_view_window(cs, (size_t)(pixel - first_row * width));
+    cs->pos = skip;
+    return e_success;
+}
+
+Status carrier_seek_bit(CarrierStream *cs, unsigned long long start_pixel, unsigned long long bit)
+{
+    uint cpp = cs->view->carriers_per_pixel;
+    uint width = cs->image.width;
+
+    if (cs->matrix_p == 0)
+    {
+        return carrier_seek(cs, start_pixel + bit / cpp, (uint)(bit % cpp));
+    }
+
+    // Step 1: Blocks fill the rest of the start row, then whole rows
+    uint p = cs->matrix_p;
+    uint n = (1u << p) - 1;
+    unsigned long long block = bit / p;
+    unsigned long long first_row_blocks = (unsigned long long)(width - start_pixel % width) * cpp / n;
+    unsigned long long row = start_pixel / width;
+    unsigned long long carrier;
+    if (block < first_row_blocks)
+    {
+        carrier = (start_pixel % width) * cpp + block * n;
+    }
+    else
+    {
+        unsigned long long row_blocks = (unsigned long long)width * cpp / n;
+        block -= first_row_blocks;
+        row += 1 + block / row_blocks;
+        carrier = (block % row_blocks) * n;
+    }
+
+    // Step 2: Continue inside the block at the bit
+    if (carrier_seek(cs, row * width + carrier / cpp, (uint)(carrier % cpp)) == e_failure)
+    {
+        return e_failure;
+    }
+    cs->matrix_bit = (uint)(bit % p);
+    return e_success;
+}
+
+unsigned long long carrier_capacity_bits(uint width, uint height, uint cpp, uint p, unsigned long long start_pixel)
+{
+    unsigned long long pixels = (unsigned long long)width * height;
+
+    if (start_pixel >= pixels)
+    {
+        return 0;
+    }
+    if (p == 0)
+    {
+        return (pixels - start_pixel) * cpp;
+    }
+
+    // Whole blocks in the rest of the start row and in every row below it
+    uint n = (1u << p) - 1;
+    unsigned long long blocks = (unsigned long long)(width - start_pixel % width) * cpp / n +
+                                (height - 1 - start_pixel / width) * ((unsigned long long)width * cpp / n);
+    return blocks * p;
+}
+
+Status carrier_close(CarrierStream *cs)
+{
+    Status status = e_success;
+
+    // Step 1: The last window touched still has to reach the destination
+    if (cs->nrows > 0 && carrier_flush_window(cs) == e_failure)
+    {
+        status = e_failure;
+        cs->nrows = 0;
+    }
+
+    // Step 2: The codec passes the untouched rows and trailer through
+    if (status == e_success && cs->image.fptr_dest != NULL && cs->rows != NULL &&
+        image_finish(&cs->image) == e_failure)
+    {
+        status = e_failure;
+    }
+
+    // Step 3: Release the buffers
+    free(cs->rows);
+    free(cs->carrier_buf);
+    cs->rows = NULL;
+    cs->carrier_buf = NULL;
+    image_close(&cs->image);
+
+    return status;
+}
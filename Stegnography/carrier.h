@@ -0,0 +1,99 @@
+#ifndef CARRIER_H
+#define CARRIER_H
+
+#include <stdio.h>
+#include "types.h"
+#include "image.h"
+#include "pixel.h"
+
+/*
+ * Carrier stream over the pixel rows of an image (BMP or PNG).
+ * Rows are read top to bottom (whatever the storage orientation) a
+ * window at a time, row padding is never used. The carrier bytes of
+ * the active channel mask are gathered from all rows of the window into
+ * one span and the LSB kernels run over it. When a destination file is
+ * given every window is written back once it has been consumed; a
+ * stream opened in place writes only the rows it changed back into the
+ * source file.
+ */
+
+/* Bytes of rows read per window (at least one row) */
+#define CARRIER_WINDOW_BYTES (64 * 1024)
+
+/* Window under IMAGE_IO_DIRECT, every read and write goes to the device */
+#define CARRIER_DIRECT_WINDOW_BYTES (1024 * 1024)
+
+typedef struct _CarrierStream
+{
+    /* Source image, written through to a destination unless only extracting */
+    Image image;
+
+    /* Current window of rows, top to bottom, image.row_alloc apart */
+    unsigned char *rows;
+    uint window_rows;             // Rows the window holds
+    uint nrows;                   // Rows loaded, 0 before the first read
+
+    /* Carriers of the window under the active channel mask */
+    const PixelView *view;
+    unsigned char *carrier_buf;   // Gather target for partial masks and padded rows
+    unsigned char *carriers;      // carrier_buf, or the window itself
+    size_t first_pixel;           // First pixel of the window covered by carriers
+    size_t n_carriers;
+    size_t pos;                   // Next unused carrier
+
+    /* Updating the source in place: pixels of the window changed so far */
+    int in_place;
+    size_t dirty_first;
+    size_t dirty_end;             // Equal to dirty_first while nothing changed
+
+    /* Embedding by LSB matching (set after opening), replacement otherwise */
+    int matching;
+    unsigned long long match_key;
+
+    /* Matrix embedding: p bits per Hamming code block of 2^p - 1 carriers, 0 for one bit per carrier */
+    uint matrix_p;
+    uint matrix_bit;              // Bits of the code block at pos already passed
+} CarrierStream;
+
+/* Largest Hamming code parameter: blocks of 255 carriers */
+#define CARRIER_MAX_MATRIX 8
+
+/* Open src through its codec, copying its header to dest (NULL when only extracting); io_flags: IMAGE_IO_* */
+Status carrier_open(CarrierStream *cs, FILE *fptr_src, FILE *fptr_dest, int level, uint io_flags);
+
+/* Open an image file (opened for update) so embedding rewrites its carriers in place */
+Status carrier_open_in_place(CarrierStream *cs, FILE *fptr);
+
+/* Switch channel mask; the new mask starts at the next unused pixel */
+Status carrier_set_mask(CarrierStream *cs, uint mask);
+
+/* Embed p bits per code block from the next pixel on (0: one bit per carrier); code blocks never cross a row */
+Status carrier_set_matrix(CarrierStream *cs, uint p);
+
+/* Embed / extract len bytes, 8 bits per byte, MSB first (8 carriers, or code blocks under a matrix) */
+Status carrier_embed(CarrierStream *cs, const void *data, size_t len);
+Status carrier_extract(CarrierStream *cs, void *data, size_t len);
+
+/* Embed / extract a 32-bit field, MSB first */
+Status carrier_embed_be32(CarrierStream *cs, uint value);
+Status carrier_extract_be32(CarrierStream *cs, uint *value);
+
+/* Hand out the rest of the current window (or the next one) as n carriers the caller may read and change freely */
+Status carrier_span(CarrierStream *cs, unsigned char **carriers, size_t *n);
+
+/* Pixel holding the next unused carrier (counted from the top-left pixel) */
+unsigned long long carrier_tell(const CarrierStream *cs);
+
+/* Continue at pixel, skipping its first skip carriers (not while writing to a destination) */
+Status carrier_seek(CarrierStream *cs, unsigned long long pixel, uint skip);
+
+/* Continue at bit of a payload that started at start_pixel under the current mask and matrix */
+Status carrier_seek_bit(CarrierStream *cs, unsigned long long start_pixel, unsigned long long bit);
+
+/* Payload bits that fit from start_pixel to the end of an image (cpp carriers per pixel, matrix p) */
+unsigned long long carrier_capacity_bits(uint width, uint height, uint cpp, uint p, unsigned long long start_pixel);
+
+/* Write back the current window, finish the destination and release the buffers */
+Status carrier_close(CarrierStream *cs);
+
+#endif
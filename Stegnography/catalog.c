@@ -0,0 +1,817 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "catalog.h"
+#include "carrier.h"
+#include "common.h"
+#include "crc32c.h"
+#include "encode.h"
+#include "image.h"
+
+/* A cover while the catalog is being rebuilt */
+typedef struct _CatalogItem
+{
+    char *path;
+    CatalogEntry entry;
+    const CatalogEntry *old;        // Entry of the same path in the old catalog, NULL if new
+    int pending;                    // Has to be read
+    Status status;                  // Result of reading it
+} CatalogItem;
+
+/* Covers being read by the indexing threads */
+typedef struct _CatalogJob
+{
+    CatalogItem *items;
+    uint *pending;                  // Indices of the items to read
+    uint npending;
+    uint next;                      // Next pending index handed out
+} CatalogJob;
+
+typedef struct _CatalogThread
+{
+    CatalogJob *job;
+    pthread_t tid;
+} CatalogThread;
+
+/* Old entries by path, for finding unchanged covers */
+typedef struct _CatalogRef
+{
+    const char *path;
+    const CatalogEntry *entry;
+} CatalogRef;
+
+/* Growing list of paths */
+typedef struct _CatalogPaths
+{
+    char **paths;
+    uint n;
+    uint alloc;
+} CatalogPaths;
+
+/* Codecs fill their lookup tables on first use, headers are parsed one at a time */
+static pthread_mutex_t codec_lock = PTHREAD_MUTEX_INITIALIZER;
+
+unsigned long long catalog_capacity(uint width, uint height, PixelFormat format)
+{
+    const PixelView *view = pixel_view(format, pixel_default_mask(format));
+
+    if (view == NULL)
+    {
+        return 0;
+    }
+
+    // Step 1: The header as check_capacity counts it, with the longest extension
+    uint cpp = view->carriers_per_pixel;
+    unsigned long long header_bits = (strlen(MAGIC_STRING) + MODE_SIZE + sizeof(int) + (MAX_FILE_SUFFIX - 1) +
+                                      sizeof(int) + CRC_SIZE) * 8;
+    unsigned long long bytes = carrier_capacity_bits(width, height, cpp, 0, (header_bits + cpp - 1) / cpp) / 8;
+
+    // Step 2: Every block of payload, the last partial one too, is followed by its CRC32C
+    unsigned long long blocks = bytes / (CRC_BLOCK_SIZE + CRC_SIZE);
+    unsigned long long rest = bytes % (CRC_BLOCK_SIZE + CRC_SIZE);
+    return blocks * CRC_BLOCK_SIZE + (rest > CRC_SIZE ? rest - CRC_SIZE : 0);
+}
+
+Status catalog_open(Catalog *catalog, const char *fname, int writable)
+{
+    struct stat st;
+
+    memset(catalog, 0, sizeof(*catalog));
+    catalog->fd = open(fname, writable ? O_RDWR : O_RDONLY);
+    if (catalog->fd < 0)
+    {
+        perror("open");
+        printf("ERROR: Unable to open catalog %s\n", fname);
+        return e_failure;
+    }
+
+    // Step 1: Map the whole file, queries only touch the pages they search
+    if (fstat(catalog->fd, &st) < 0 || (size_t)st.st_size < sizeof(CatalogHeader))
+    {
+        printf("ERROR: %s is not a cover catalog.\n", fname);
+        close(catalog->fd);
+        return e_failure;
+    }
+    catalog->map_size = st.st_size;
+    catalog->map = mmap(NULL, catalog->map_size, PROT_READ | (writable ? PROT_WRITE : 0), MAP_SHARED, catalog->fd, 0);
+    if (catalog->map == MAP_FAILED)
+    {
+        perror("mmap");
+        close(catalog->fd);
+        return e_failure;
+    }
+    madvise(catalog->map, catalog->map_size, MADV_RANDOM);
+
+    // Step 2: Header, entries and paths have to fit the file
+    const CatalogHeader *header = catalog->map;
+    unsigned long long entry_bytes = header->count * sizeof(CatalogEntry);
+    if (memcmp(header->magic, CATALOG_MAGIC, sizeof(header->magic)) != 0 || header->version != CATALOG_VERSION ||
+        header->entry_size != sizeof(CatalogEntry) || header->count > catalog->map_size / sizeof(CatalogEntry) ||
+        sizeof(CatalogHeader) + entry_bytes + header->path_bytes != catalog->map_size)
+    {
+        printf("ERROR: %s is not a version %d cover catalog.\n", fname, CATALOG_VERSION);
+        catalog_close(catalog);
+        return e_failure;
+    }
+    catalog->header = header;
+    catalog->entries = (CatalogEntry *)((char *)catalog->map + sizeof(CatalogHeader));
+    catalog->paths = (const char *)(catalog->entries + header->count);
+    if (header->count > 0 && (header->path_bytes == 0 || catalog->paths[header->path_bytes - 1] != '\0'))
+    {
+        printf("ERROR: Catalog %s is truncated.\n", fname);
+        catalog_close(catalog);
+        return e_failure;
+    }
+    for (unsigned long long i = 0; i < header->count; i++)
+    {
+        if (catalog->entries[i].path >= header->path_bytes ||
+            (i > 0 && (catalog->entries[i].flags & CATALOG_USED) && !(catalog->entries[i - 1].flags & CATALOG_USED)))
+        {
+            printf("ERROR: Catalog %s is corrupt.\n", fname);
+            catalog_close(catalog);
+            return e_failure;
+        }
+    }
+
+    return e_success;
+}
+
+/* Entries before the first unused one, the used entries are all in front */
+static size_t catalog_used(const Catalog *catalog)
+{
+    size_t lo = 0, hi = catalog->header->count;
+
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (catalog->entries[mid].flags & CATALOG_USED)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+CatalogEntry *catalog_find(const Catalog *catalog, unsigned long long need)
+{
+    // Step 1: Skip the used entries, whatever their capacity
+    size_t lo = catalog_used(catalog), hi = catalog->header->count;
+
+    // Step 2: Binary search the unused ones for the first with enough capacity
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (catalog->entries[mid].capacity < need)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo < catalog->header->count ? &catalog->entries[lo] : NULL;
+}
+
+CatalogEntry *catalog_mark(Catalog *catalog, CatalogEntry *entry)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    size_t used = catalog_used(catalog);
+    CatalogEntry picked = *entry;
+
+    if (picked.flags & CATALOG_USED)
+    {
+        return entry;
+    }
+
+    // Step 1: The smaller unused entries move up by one, the picked one takes the place they leave
+    CatalogEntry *first = &catalog->entries[used];
+    memmove(first + 1, first, (size_t)(entry - first) * sizeof(CatalogEntry));
+    picked.flags |= CATALOG_USED;
+    *first = picked;
+
+    // Step 2: Push the pages out
+    uintptr_t start = (uintptr_t)first & ~(uintptr_t)(page - 1);
+    msync((void *)start, (uintptr_t)(entry + 1) - start, MS_SYNC);
+    return first;
+}
+
+const char *catalog_path(const Catalog *catalog, const CatalogEntry *entry)
+{
+    return catalog->paths + entry->path;
+}
+
+void catalog_close(Catalog *catalog)
+{
+    if (catalog->map != NULL && catalog->map != MAP_FAILED)
+    {
+        munmap(catalog->map, catalog->map_size);
+    }
+    if (catalog->fd >= 0)
+    {
+        close(catalog->fd);
+    }
+    catalog->map = NULL;
+    catalog->fd = -1;
+}
+
+static Status add_path(CatalogPaths *list, const char *path)
+{
+    if (list->n == list->alloc)
+    {
+        uint alloc = list->alloc ? list->alloc * 2 : 256;
+        char **paths = realloc(list->paths, alloc * sizeof(char *));
+        if (paths == NULL)
+        {
+            printf("ERROR: Out of memory for the cover list.\n");
+            return e_failure;
+        }
+        list->paths = paths;
+        list->alloc = alloc;
+    }
+    list->paths[list->n] = strdup(path);
+    if (list->paths[list->n] == NULL)
+    {
+        printf("ERROR: Out of memory for the cover list.\n");
+        return e_failure;
+    }
+    list->n++;
+    return e_success;
+}
+
+/* Add an image, or every image below a directory */
+static Status walk_path(CatalogPaths *list, const char *path)
+{
+    struct stat st;
+
+    if (stat(path, &st) < 0)
+    {
+        printf("WARNING: Cannot stat %s, skipping it.\n", path);
+        return e_success;
+    }
+    if (!S_ISDIR(st.st_mode))
+    {
+        return S_ISREG(st.st_mode) && image_codec_for_name(path) != NULL ? add_path(list, path) : e_success;
+    }
+
+    DIR *dir = opendir(path);
+    if (dir == NULL)
+    {
+        printf("WARNING: Cannot read directory %s, skipping it.\n", path);
+        return e_success;
+    }
+    size_t len = strlen(path);
+    struct dirent *de;
+    Status status = e_success;
+    while (status == e_success && (de = readdir(dir)) != NULL)
+    {
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+        {
+            continue;
+        }
+        char *child = malloc(len + strlen(de->d_name) + 2);
+        if (child == NULL)
+        {
+            printf("ERROR: Out of memory for the cover list.\n");
+            status = e_failure;
+            break;
+        }
+        sprintf(child, "%s%s%s", path, len > 0 && path[len - 1] == '/' ? "" : "/", de->d_name);
+
+        // Files are stat'ed once, by the incremental pass; only unknown types need it here
+        if (de->d_type == DT_REG)
+        {
+            status = image_codec_for_name(child) != NULL ? add_path(list, child) : e_success;
+        }
+        else if (de->d_type == DT_DIR || de->d_type == DT_UNKNOWN || de->d_type == DT_LNK)
+        {
+            status = walk_path(list, child);
+        }
+        free(child);
+    }
+    closedir(dir);
+    return status;
+}
+
+static int compare_paths(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static int compare_refs(const void *a, const void *b)
+{
+    return strcmp(((const CatalogRef *)a)->path, ((const CatalogRef *)b)->path);
+}
+
+static int compare_items(const void *a, const void *b)
+{
+    const CatalogItem *x = a, *y = b;
+
+    if ((x->entry.flags & CATALOG_USED) != (y->entry.flags & CATALOG_USED))
+    {
+        return x->entry.flags & CATALOG_USED ? -1 : 1;
+    }
+    if (x->entry.capacity != y->entry.capacity)
+    {
+        return x->entry.capacity < y->entry.capacity ? -1 : 1;
+    }
+    return strcmp(x->path, y->path);
+}
+
+/* Header of one cover and the CRC32C of its file */
+static Status read_cover(CatalogItem *item, unsigned char *buf)
+{
+    Image image;
+    CatalogEntry *entry = &item->entry;
+
+    FILE *fptr = fopen(item->path, "r");
+    if (fptr == NULL)
+    {
+        printf("WARNING: Cannot open %s, skipping it.\n", item->path);
+        return e_failure;
+    }
+
+    // Step 1: Format and size from the image header
+    pthread_mutex_lock(&codec_lock);
+    Status status = image_open(&image, fptr, NULL, 0, 0);
+    if (status == e_success)
+    {
+        image_close(&image);
+    }
+    pthread_mutex_unlock(&codec_lock);
+    if (status == e_failure || pixel_bytes_per_pixel(image.format) == 0)
+    {
+        printf("WARNING: %s is not a usable cover, skipping it.\n", item->path);
+        fclose(fptr);
+        return e_failure;
+    }
+    entry->width = image.width;
+    entry->height = image.height;
+    entry->format = image.format;
+    entry->capacity = catalog_capacity(image.width, image.height, image.format);
+
+    // Step 2: Content hash over the whole file
+    uint crc = 0;
+    size_t n;
+    fseek(fptr, 0L, SEEK_SET);
+    while ((n = fread(buf, 1, CATALOG_READ_BYTES, fptr)) > 0)
+    {
+        crc = crc32c_update(crc, buf, n);
+    }
+    if (ferror(fptr))
+    {
+        printf("WARNING: Failed to read %s, skipping it.\n", item->path);
+        fclose(fptr);
+        return e_failure;
+    }
+    fclose(fptr);
+    entry->crc = crc;
+
+    // Step 3: A rewritten file with the same content stays used
+    entry->flags = item->old != NULL && item->old->crc == crc ? item->old->flags : 0;
+    return e_success;
+}
+
+static void *catalog_worker(void *arg)
+{
+    CatalogJob *job = ((CatalogThread *)arg)->job;
+    unsigned char *buf = malloc(CATALOG_READ_BYTES);
+
+    if (buf == NULL)
+    {
+        return (void *)1;
+    }
+
+    // Covers differ in size, each thread takes the next one when it is done
+    for (;;)
+    {
+        uint i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (i >= job->npending)
+        {
+            break;
+        }
+        CatalogItem *item = &job->items[job->pending[i]];
+        item->status = read_cover(item, buf);
+    }
+
+    free(buf);
+    return NULL;
+}
+
+/* Write the items (sorted) next to fname and rename the result over it */
+static Status write_catalog(const char *fname, const CatalogItem *items, uint n)
+{
+    CatalogHeader header;
+    char *tmp_fname = malloc(strlen(fname) + 5);
+
+    if (tmp_fname == NULL)
+    {
+        printf("ERROR: Out of memory.\n");
+        return e_failure;
+    }
+    sprintf(tmp_fname, "%s.tmp", fname);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CATALOG_MAGIC, sizeof(header.magic));
+    header.version = CATALOG_VERSION;
+    header.entry_size = sizeof(CatalogEntry);
+    header.count = n;
+    for (uint i = 0; i < n; i++)
+    {
+        header.path_bytes += strlen(items[i].path) + 1;
+    }
+
+    FILE *fptr = fopen(tmp_fname, "w");
+    if (fptr == NULL)
+    {
+        perror("fopen");
+        printf("ERROR: Unable to create %s\n", tmp_fname);
+        free(tmp_fname);
+        return e_failure;
+    }
+
+    // Step 1: Header and entries, paths laid out in entry order
+    int ok = fwrite(&header, sizeof(header), 1, fptr) == 1;
+    unsigned long long offset = 0;
+    for (uint i = 0; ok && i < n; i++)
+    {
+        CatalogEntry entry = items[i].entry;
+        entry.path = offset;
+        offset += strlen(items[i].path) + 1;
+        ok = fwrite(&entry, sizeof(entry), 1, fptr) == 1;
+    }
+
+    // Step 2: Paths
+    for (uint i = 0; ok && i < n; i++)
+    {
+        ok = fwrite(items[i].path, strlen(items[i].path) + 1, 1, fptr) == 1;
+    }
+
+    // Step 3: On disk before it replaces the old catalog
+    ok = ok && fflush(fptr) == 0 && fsync(fileno(fptr)) == 0;
+    ok = fclose(fptr) == 0 && ok;
+    if (!ok || rename(tmp_fname, fname) < 0)
+    {
+        perror("write");
+        printf("ERROR: Failed to write catalog %s\n", fname);
+        unlink(tmp_fname);
+        free(tmp_fname);
+        return e_failure;
+    }
+    free(tmp_fname);
+    return e_success;
+}
+
+static double elapsed_s(const struct timespec *t0, const struct timespec *t1)
+{
+    return (t1->tv_sec - t0->tv_sec) + (t1->tv_nsec - t0->tv_nsec) / 1e9;
+}
+
+/* Index the images below roots into fname, reusing its unchanged entries */
+static Status catalog_index(const char *fname, char **roots, uint nroots, uint nthreads)
+{
+    Catalog old;
+    CatalogPaths list = { NULL, 0, 0 };
+    CatalogRef *refs = NULL;
+    CatalogItem *items = NULL;
+    CatalogJob job;
+    CatalogThread threads[CATALOG_MAX_THREADS];
+    uint nitems = 0, nrefs = 0, reused = 0, dropped = 0;
+    struct timespec t0, t1;
+    Status status = e_success;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    memset(&job, 0, sizeof(job));
+
+    // Step 1: The old catalog, if there is one
+    old.map = NULL;
+    old.fd = -1;
+    if (access(fname, F_OK) == 0 && catalog_open(&old, fname, 0) == e_failure)
+    {
+        return e_failure;
+    }
+    if (old.map != NULL)
+    {
+        nrefs = (uint)old.header->count;
+        refs = malloc((nrefs + 1) * sizeof(CatalogRef));
+        if (refs == NULL)
+        {
+            printf("ERROR: Out of memory for the old catalog.\n");
+            catalog_close(&old);
+            return e_failure;
+        }
+        for (uint i = 0; i < nrefs; i++)
+        {
+            refs[i].path = catalog_path(&old, &old.entries[i]);
+            refs[i].entry = &old.entries[i];
+        }
+        qsort(refs, nrefs, sizeof(CatalogRef), compare_refs);
+    }
+
+    // Step 2: Every image below the roots and every cover already catalogued, once
+    for (uint i = 0; status == e_success && i < nroots; i++)
+    {
+        status = walk_path(&list, roots[i]);
+    }
+    for (uint i = 0; status == e_success && i < nrefs; i++)
+    {
+        status = add_path(&list, refs[i].path);
+    }
+    if (status == e_success && list.n > 0)
+    {
+        qsort(list.paths, list.n, sizeof(char *), compare_paths);
+        items = calloc(list.n, sizeof(CatalogItem));
+        job.pending = malloc(list.n * sizeof(uint));
+        if (items == NULL || job.pending == NULL)
+        {
+            printf("ERROR: Out of memory for the cover list.\n");
+            status = e_failure;
+        }
+    }
+
+    // Step 3: Unchanged covers keep their entry, the others are read
+    for (uint i = 0; status == e_success && i < list.n; i++)
+    {
+        struct stat st;
+        if (i > 0 && strcmp(list.paths[i], list.paths[i - 1]) == 0)
+        {
+            continue;
+        }
+        if (stat(list.paths[i], &st) < 0 || !S_ISREG(st.st_mode))
+        {
+            dropped++;
+            continue;
+        }
+
+        CatalogItem *item = &items[nitems++];
+        CatalogRef key = { list.paths[i], NULL };
+        CatalogRef *ref = nrefs > 0 ? bsearch(&key, refs, nrefs, sizeof(CatalogRef), compare_refs) : NULL;
+        item->path = list.paths[i];
+        item->old = ref != NULL ? ref->entry : NULL;
+        item->entry.mtime_ns = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+        item->entry.file_size = st.st_size;
+        if (item->old != NULL && item->old->mtime_ns == item->entry.mtime_ns && item->old->file_size == st.st_size)
+        {
+            item->entry = *item->old;
+            reused++;
+        }
+        else
+        {
+            item->pending = 1;
+            job.pending[job.npending++] = nitems - 1;
+        }
+    }
+
+    // Step 4: Read the new and changed covers on the thread pool
+    job.items = items;
+    if (nthreads > job.npending)
+    {
+        nthreads = job.npending;
+    }
+    uint started = 0;
+    for (; status == e_success && started < nthreads; started++)
+    {
+        threads[started].job = &job;
+        if (pthread_create(&threads[started].tid, NULL, catalog_worker, &threads[started]) != 0)
+        {
+            status = e_failure;
+            break;
+        }
+    }
+    for (uint t = 0; t < started; t++)
+    {
+        void *ret;
+        pthread_join(threads[t].tid, &ret);
+        if (ret != NULL)
+        {
+            status = e_failure;
+        }
+    }
+    if (status == e_failure)
+    {
+        printf("ERROR: Failed to index the covers.\n");
+    }
+
+    // Step 5: Leave out the covers that could not be read, sort (used first, then by capacity) and write
+    uint kept = 0;
+    for (uint i = 0; status == e_success && i < nitems; i++)
+    {
+        if (items[i].pending && items[i].status == e_failure)
+        {
+            dropped++;
+            continue;
+        }
+        items[kept++] = items[i];
+    }
+    if (status == e_success)
+    {
+        qsort(items, kept, sizeof(CatalogItem), compare_items);
+        status = write_catalog(fname, items, kept);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (status == e_success)
+    {
+        printf("INFO: Catalog %s: %u covers, %u read, %u unchanged, %u dropped in %.3f s\n",
+               fname, kept, job.npending, reused, dropped, elapsed_s(&t0, &t1));
+    }
+
+    for (uint i = 0; i < list.n; i++)
+    {
+        free(list.paths[i]);
+    }
+    free(list.paths);
+    free(items);
+    free(job.pending);
+    free(refs);
+    if (old.map != NULL)
+    {
+        catalog_close(&old);
+    }
+    return status;
+}
+
+/* Size of a secret given as a byte count or as a file */
+static Status parse_need(const char *value, unsigned long long *need)
+{
+    struct stat st;
+    char *end;
+
+    *need = strtoull(value, &end, 10);
+    if (end != value && *end == '\0')
+    {
+        return e_success;
+    }
+    if (stat(value, &st) < 0 || !S_ISREG(st.st_mode))
+    {
+        printf("ERROR: --pick needs a byte count or a secret file, %s is neither.\n", value);
+        return e_failure;
+    }
+    *need = st.st_size;
+    return e_success;
+}
+
+Status do_catalog(int argc, char *argv[])
+{
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    uint nthreads = online > 0 ? (uint)online : 1;
+    const char *pick = NULL, *used = NULL;
+    int mark = 0, list = 0;
+    char *roots[argc];
+    uint nroots = 0;
+    Catalog catalog;
+    Status status = e_success;
+
+    // Step 1: Options first, everything after the catalog is an image or directory to index
+    if (argc < 3 || strncmp(argv[2], "--", 2) == 0)
+    {
+        printf("ERROR: Invalid number of arguments. Usage: <Program Name> -c <Catalog> [<Image or Directory>...] "
+               "[--threads=N] [--pick=<Bytes or Secret File>] [--mark] [--used=<Image>] [--list]\n");
+        return e_failure;
+    }
+    for (int i = 3; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--threads=", 10) == 0)
+        {
+            char *end;
+            long n = strtol(argv[i] + 10, &end, 10);
+            if (end == argv[i] + 10 || *end != '\0' || n < 1 || n > CATALOG_MAX_THREADS)
+            {
+                printf("ERROR: --threads must be 1 to %d.\n", CATALOG_MAX_THREADS);
+                return e_failure;
+            }
+            nthreads = (uint)n;
+        }
+        else if (strncmp(argv[i], "--pick=", 7) == 0)
+        {
+            pick = argv[i] + 7;
+        }
+        else if (strcmp(argv[i], "--mark") == 0)
+        {
+            mark = 1;
+        }
+        else if (strncmp(argv[i], "--used=", 7) == 0)
+        {
+            used = argv[i] + 7;
+        }
+        else if (strcmp(argv[i], "--list") == 0)
+        {
+            list = 1;
+        }
+        else if (strncmp(argv[i], "--", 2) == 0)
+        {
+            printf("ERROR: Unknown option %s\n", argv[i]);
+            return e_failure;
+        }
+        else
+        {
+            roots[nroots++] = argv[i];
+        }
+    }
+    if (nthreads > CATALOG_MAX_THREADS)
+    {
+        nthreads = CATALOG_MAX_THREADS;
+    }
+    if (mark && pick == NULL)
+    {
+        printf("ERROR: --mark marks the cover picked by --pick.\n");
+        return e_failure;
+    }
+    if (nroots == 0 && pick == NULL && used == NULL && !list)
+    {
+        printf("ERROR: Nothing to do, give images or directories to index, --pick=, --used= or --list.\n");
+        return e_failure;
+    }
+
+    // Step 2: Bring the catalog up to date with the files
+    if (nroots > 0 && catalog_index(argv[2], roots, nroots, nthreads) == e_failure)
+    {
+        return e_failure;
+    }
+    if (pick == NULL && used == NULL && !list)
+    {
+        return e_success;
+    }
+    if (catalog_open(&catalog, argv[2], mark || used != NULL) == e_failure)
+    {
+        return e_failure;
+    }
+
+    // Step 3: Smallest unused cover the secret fits in
+    if (pick != NULL)
+    {
+        unsigned long long need;
+        CatalogEntry *entry = NULL;
+        if (parse_need(pick, &need) == e_success)
+        {
+            entry = catalog_find(&catalog, need);
+            if (entry == NULL)
+            {
+                printf("ERROR: No unused cover in the catalog holds %llu bytes.\n", need);
+            }
+        }
+        if (entry != NULL)
+        {
+            printf("Cover: %s\n", catalog_path(&catalog, entry));
+            printf("INFO: %ux%u %s, %llu of %llu bytes%s\n", entry->width, entry->height,
+                   pixel_format_name(entry->format), need, entry->capacity, mark ? ", marked used" : "");
+            if (mark)
+            {
+                catalog_mark(&catalog, entry);
+            }
+        }
+        else
+        {
+            status = e_failure;
+        }
+    }
+
+    // Step 4: A cover used by hand
+    if (used != NULL)
+    {
+        unsigned long long i;
+        for (i = 0; i < catalog.header->count; i++)
+        {
+            if (strcmp(catalog_path(&catalog, &catalog.entries[i]), used) == 0)
+            {
+                catalog_mark(&catalog, &catalog.entries[i]);
+                printf("INFO: %s marked used.\n", used);
+                break;
+            }
+        }
+        if (i == catalog.header->count)
+        {
+            printf("ERROR: %s is not in the catalog.\n", used);
+            status = e_failure;
+        }
+    }
+
+    // Step 5: Everything, the used covers first, then the unused ones smallest first
+    if (list)
+    {
+        unsigned long long unused = 0;
+        for (unsigned long long i = 0; i < catalog.header->count; i++)
+        {
+            const CatalogEntry *entry = &catalog.entries[i];
+            printf("%12llu  %5ux%-5u %-18s %08x  %s  %s\n", entry->capacity, entry->width, entry->height,
+                   pixel_format_name(entry->format), entry->crc, entry->flags & CATALOG_USED ? "used" : "free",
+                   catalog_path(&catalog, entry));
+            unused += !(entry->flags & CATALOG_USED);
+        }
+        printf("%llu covers, %llu unused\n", catalog.header->count, unused);
+    }
+
+    catalog_close(&catalog);
+    return status;
+}
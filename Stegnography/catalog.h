@@ -0,0 +1,92 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <stddef.h>
+#include "types.h"
+#include "pixel.h"
+
+/*
+ * Cover catalog: a persistent index of cover images, so a cover large
+ * enough for a payload is picked without opening a single image. The
+ * file is
+ *
+ *   CatalogHeader | count x CatalogEntry | NUL-terminated paths
+ *
+ * with the used entries first and the unused ones after them, sorted by
+ * capacity (then path). It is mapped and used in place: a capacity
+ * query is a binary search for the end of the used entries and one for
+ * the first unused entry large enough, so covers already picked are
+ * never walked over. Marking a cover used moves its entry to the end of
+ * the used entries, shifting the smaller unused entries up by one.
+ *
+ * Indexing stats every image listed (directories are walked) and keeps
+ * the entries whose mtime and size did not change. Only new and changed
+ * covers are read, on a pool of threads: the image header for format
+ * and size, the whole file for its CRC32C. Covers that disappeared are
+ * dropped. The new catalog is written next to the old one and renamed
+ * over it.
+ */
+
+#define CATALOG_MAGIC "STEGCAT1"
+#define CATALOG_VERSION 2                   // 2: used entries kept before the unused ones
+#define CATALOG_MAX_THREADS 64
+#define CATALOG_READ_BYTES (1024 * 1024)    // Read size while hashing a cover
+
+/* Entry flags */
+#define CATALOG_USED 0x1                    // Picked for a payload already
+
+typedef struct _CatalogHeader
+{
+    char magic[8];                  // CATALOG_MAGIC, not NUL-terminated
+    uint version;
+    uint entry_size;                // sizeof(CatalogEntry)
+    unsigned long long count;
+    unsigned long long path_bytes;  // Size of the path area after the entries
+} CatalogHeader;
+
+typedef struct _CatalogEntry
+{
+    unsigned long long capacity;    // Largest secret file in bytes, see catalog_capacity
+    long long mtime_ns;             // Modification time of the file when it was read
+    long long file_size;
+    unsigned long long path;        // Offset of the path in the path area
+    uint width;
+    uint height;
+    uint format;                    // PixelFormat
+    uint crc;                       // CRC32C of the whole file
+    uint flags;
+    uint reserved;
+} CatalogEntry;
+
+/* A mapped catalog */
+typedef struct _Catalog
+{
+    int fd;
+    void *map;
+    size_t map_size;
+    const CatalogHeader *header;
+    CatalogEntry *entries;          // Writable only when opened for marking
+    const char *paths;
+} Catalog;
+
+/* -c <Catalog> [<Image or Directory>...] [--threads=N] [--pick=<Bytes or Secret File>] [--mark] [--used=<Image>] [--list] */
+Status do_catalog(int argc, char *argv[]);
+
+/* Bytes of secret file that fit with the default channels, one bit per carrier and the longest extension */
+unsigned long long catalog_capacity(uint width, uint height, PixelFormat format);
+
+/* Map a catalog file, writable to mark covers used */
+Status catalog_open(Catalog *catalog, const char *fname, int writable);
+
+/* Smallest unused cover holding need bytes, NULL if none does */
+CatalogEntry *catalog_find(const Catalog *catalog, unsigned long long need);
+
+/* Mark an unused entry used in a writable catalog, where the entry ends up */
+CatalogEntry *catalog_mark(Catalog *catalog, CatalogEntry *entry);
+
+/* Path of an entry */
+const char *catalog_path(const Catalog *catalog, const CatalogEntry *entry);
+
+void catalog_close(Catalog *catalog);
+
+#endif
@@ -4,4 +4,26 @@
 /* Magic string to identify whether stegged or not */
 #define MAGIC_STRING "#*"
 
+/* Embedding mode word, stored right after the magic string */
+#define MODE_SIZE 4
+#define MODE_CHANNEL_MASK 0x0000000Fu  // Pixel bytes carrying the payload (bit i = byte i)
+#define MODE_CONTAINER    0x00000010u  // Payload is a container: index of named files, then the files
+#define MODE_MATCHING     0x00000020u  // Carriers were changed by LSB matching (+-1), extraction is the same
+#define MODE_MATRIX_MASK  0x00000F00u  // Hamming code parameter p of the payload, 0 for one bit per carrier
+#define MODE_MATRIX_SHIFT 8
+#define MODE_VERSION_MASK 0xF0000000u  // Format version of the payload layout
+#define MODE_VERSION_SHIFT 28
+
+/* Format version written into the mode word. Mode words from before the
+   field read as version 0 and have the same layout. Images from before
+   the mode word (no checksums, file bytes from offset 54 on) are still
+   decoded as the legacy layout. */
+#define FORMAT_VERSION 1
+
+/* Payload is checksummed in blocks of this many bytes (CRC32C per block) */
+#define CRC_BLOCK_SIZE 4096
+
+/* Size of a stored CRC32C in bytes */
+#define CRC_SIZE 4
+
 #endif
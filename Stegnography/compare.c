@@ -0,0 +1,495 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "compare.h"
+#include "image.h"
+#include "pixel.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+/* Selected kernel: compares from the start of a row, returns how far it got */
+static size_t (*diff_impl)(const unsigned char *a, const unsigned char *b, size_t n, uint bpp,
+                           CompareCounts *counts, size_t *first, size_t *last);
+static const char *compare_impl_name;
+
+/* Portable comparison of bytes i .. n-1 of a row (a row starts on channel 0) */
+static size_t diff_scalar_from(const unsigned char *a, const unsigned char *b, size_t i, size_t n, uint bpp,
+                               CompareCounts *counts, size_t *first, size_t *last)
+{
+    for (; i < n; i++)
+    {
+        if (a[i] != b[i])
+        {
+            uint c = i % bpp;
+            int d = a[i] - b[i];
+            counts->changed[c]++;
+            counts->bits[c] += __builtin_popcount(a[i] ^ b[i]);
+            counts->sse[c] += (unsigned long long)(d * d);
+            if (*first == SIZE_MAX)
+            {
+                *first = i;
+            }
+            *last = i;
+        }
+    }
+    return n;
+}
+
+static size_t diff_scalar(const unsigned char *a, const unsigned char *b, size_t n, uint bpp,
+                          CompareCounts *counts, size_t *first, size_t *last)
+{
+    return diff_scalar_from(a, b, 0, n, bpp, counts, first, last);
+}
+
+/* Lane l of a period is byte l of it, channel l % bpp since a period holds whole pixels */
+static void add_lanes(CompareCounts *counts, uint bpp, uint nlanes,
+                      const uint16_t *changed, const uint16_t *bits, const uint32_t *sse)
+{
+    for (uint l = 0; l < nlanes; l++)
+    {
+        uint c = l % bpp;
+        counts->changed[c] += changed[l];
+        counts->bits[c] += bits[l];
+        counts->sse[c] += sse[l];
+    }
+}
+
+#if defined(__x86_64__)
+/* SSE2: periods of 48 bytes */
+static size_t diff_sse2(const unsigned char *a, const unsigned char *b, size_t n, uint bpp,
+                        CompareCounts *counts, size_t *first, size_t *last)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i m55 = _mm_set1_epi8(0x55), m33 = _mm_set1_epi8(0x33), m0f = _mm_set1_epi8(0x0F);
+    uint16_t changed[48], bits[48];
+    uint32_t sse[48];
+    size_t i = 0;
+
+    while (i + 48 <= n)
+    {
+        __m128i changed16[6], bits16[6], sse32[12];
+        size_t end = n - i > (size_t)48 * COMPARE_CHUNK ? i + (size_t)48 * COMPARE_CHUNK : n;
+
+        for (int k = 0; k < 6; k++)
+        {
+            changed16[k] = bits16[k] = zero;
+        }
+        for (int k = 0; k < 12; k++)
+        {
+            sse32[k] = zero;
+        }
+
+        // Step 1: Byte counters for up to 31 periods (at most 8 bits a byte), then 16-bit ones
+        while (i + 48 <= end)
+        {
+            __m128i changed8[3] = { zero, zero, zero }, bits8[3] = { zero, zero, zero };
+
+            for (uint r = 0; r < 31 && i + 48 <= end; r++, i += 48)
+            {
+                __m128i x[3], y[3], d[3];
+                for (int v = 0; v < 3; v++)
+                {
+                    x[v] = _mm_loadu_si128((const __m128i *)(a + i + 16 * v));
+                    y[v] = _mm_loadu_si128((const __m128i *)(b + i + 16 * v));
+                    d[v] = _mm_xor_si128(x[v], y[v]);
+                }
+                unsigned long long same = (unsigned long long)_mm_movemask_epi8(_mm_cmpeq_epi8(d[0], zero)) |
+                                          (unsigned long long)_mm_movemask_epi8(_mm_cmpeq_epi8(d[1], zero)) << 16 |
+                                          (unsigned long long)_mm_movemask_epi8(_mm_cmpeq_epi8(d[2], zero)) << 32;
+                if (same == 0xFFFFFFFFFFFFULL)
+                {
+                    continue;
+                }
+                unsigned long long differ = ~same & 0xFFFFFFFFFFFFULL;
+                if (*first == SIZE_MAX)
+                {
+                    *first = i + __builtin_ctzll(differ);
+                }
+                *last = i + 63 - __builtin_clzll(differ);
+
+                // Step 2: Changed flag, popcount and squared difference of every byte
+                for (int v = 0; v < 3; v++)
+                {
+                    __m128i p = _mm_sub_epi8(d[v], _mm_and_si128(_mm_srli_epi16(d[v], 1), m55));
+                    p = _mm_add_epi8(_mm_and_si128(p, m33), _mm_and_si128(_mm_srli_epi16(p, 2), m33));
+                    p = _mm_and_si128(_mm_add_epi8(p, _mm_srli_epi16(p, 4)), m0f);
+                    changed8[v] = _mm_add_epi8(changed8[v], _mm_min_epu8(d[v], one));
+                    bits8[v] = _mm_add_epi8(bits8[v], p);
+
+                    __m128i ad = _mm_or_si128(_mm_subs_epu8(x[v], y[v]), _mm_subs_epu8(y[v], x[v]));
+                    __m128i lo = _mm_unpacklo_epi8(ad, zero), hi = _mm_unpackhi_epi8(ad, zero);
+                    lo = _mm_mullo_epi16(lo, lo);
+                    hi = _mm_mullo_epi16(hi, hi);
+                    sse32[4 * v] = _mm_add_epi32(sse32[4 * v], _mm_unpacklo_epi16(lo, zero));
+                    sse32[4 * v + 1] = _mm_add_epi32(sse32[4 * v + 1], _mm_unpackhi_epi16(lo, zero));
+                    sse32[4 * v + 2] = _mm_add_epi32(sse32[4 * v + 2], _mm_unpacklo_epi16(hi, zero));
+                    sse32[4 * v + 3] = _mm_add_epi32(sse32[4 * v + 3], _mm_unpackhi_epi16(hi, zero));
+                }
+            }
+            for (int v = 0; v < 3; v++)
+            {
+                changed16[2 * v] = _mm_add_epi16(changed16[2 * v], _mm_unpacklo_epi8(changed8[v], zero));
+                changed16[2 * v + 1] = _mm_add_epi16(changed16[2 * v + 1], _mm_unpackhi_epi8(changed8[v], zero));
+                bits16[2 * v] = _mm_add_epi16(bits16[2 * v], _mm_unpacklo_epi8(bits8[v], zero));
+                bits16[2 * v + 1] = _mm_add_epi16(bits16[2 * v + 1], _mm_unpackhi_epi8(bits8[v], zero));
+            }
+        }
+
+        // Step 3: Lanes of the chunk into the channel totals
+        for (int k = 0; k < 6; k++)
+        {
+            _mm_storeu_si128((__m128i *)(changed + 8 * k), changed16[k]);
+            _mm_storeu_si128((__m128i *)(bits + 8 * k), bits16[k]);
+        }
+        for (int k = 0; k < 12; k++)
+        {
+            _mm_storeu_si128((__m128i *)(sse + 4 * k), sse32[k]);
+        }
+        add_lanes(counts, bpp, 48, changed, bits, sse);
+    }
+
+    return i;
+}
+
+/* AVX2: periods of 96 bytes, widened with cvtepu so lanes stay in byte order */
+__attribute__((target("avx2")))
+static size_t diff_avx2(const unsigned char *a, const unsigned char *b, size_t n, uint bpp,
+                        CompareCounts *counts, size_t *first, size_t *last)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi8(1);
+    const __m256i m0f = _mm256_set1_epi8(0x0F);
+    const __m256i popcount4 = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                               0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    uint16_t changed[96], bits[96];
+    uint32_t sse[96];
+    size_t i = 0;
+
+    while (i + 96 <= n)
+    {
+        __m256i changed16[6], bits16[6], sse32[12];
+        size_t end = n - i > (size_t)96 * COMPARE_CHUNK ? i + (size_t)96 * COMPARE_CHUNK : n;
+
+        for (int k = 0; k < 6; k++)
+        {
+            changed16[k] = bits16[k] = zero;
+        }
+        for (int k = 0; k < 12; k++)
+        {
+            sse32[k] = zero;
+        }
+
+        // Step 1: Byte counters for up to 31 periods, then 16-bit ones
+        while (i + 96 <= end)
+        {
+            __m256i changed8[3] = { zero, zero, zero }, bits8[3] = { zero, zero, zero };
+
+            for (uint r = 0; r < 31 && i + 96 <= end; r++, i += 96)
+            {
+                __m256i x[3], y[3], d[3];
+                for (int v = 0; v < 3; v++)
+                {
+                    x[v] = _mm256_loadu_si256((const __m256i *)(a + i + 32 * v));
+                    y[v] = _mm256_loadu_si256((const __m256i *)(b + i + 32 * v));
+                    d[v] = _mm256_xor_si256(x[v], y[v]);
+                }
+                __m256i any = _mm256_or_si256(_mm256_or_si256(d[0], d[1]), d[2]);
+                if (_mm256_testz_si256(any, any))
+                {
+                    continue;
+                }
+                for (int v = 0; v < 3; v++)
+                {
+                    unsigned long long differ = ~(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(d[v], zero)) &
+                                                0xFFFFFFFFULL;
+                    if (differ != 0)
+                    {
+                        if (*first == SIZE_MAX)
+                        {
+                            *first = i + 32 * v + __builtin_ctzll(differ);
+                        }
+                        *last = i + 32 * v + 63 - __builtin_clzll(differ);
+                    }
+                }
+
+                // Step 2: Changed flag, popcount and squared difference of every byte
+                for (int v = 0; v < 3; v++)
+                {
+                    __m256i p = _mm256_add_epi8(_mm256_shuffle_epi8(popcount4, _mm256_and_si256(d[v], m0f)),
+                                                _mm256_shuffle_epi8(popcount4, _mm256_and_si256(_mm256_srli_epi16(d[v], 4), m0f)));
+                    changed8[v] = _mm256_add_epi8(changed8[v], _mm256_min_epu8(d[v], one));
+                    bits8[v] = _mm256_add_epi8(bits8[v], p);
+
+                    __m256i ad = _mm256_or_si256(_mm256_subs_epu8(x[v], y[v]), _mm256_subs_epu8(y[v], x[v]));
+                    __m256i lo = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(ad));
+                    __m256i hi = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(ad, 1));
+                    lo = _mm256_mullo_epi16(lo, lo);
+                    hi = _mm256_mullo_epi16(hi, hi);
+                    sse32[4 * v] = _mm256_add_epi32(sse32[4 * v], _mm256_cvtepu16_epi32(_mm256_castsi256_si128(lo)));
+                    sse32[4 * v + 1] = _mm256_add_epi32(sse32[4 * v + 1], _mm256_cvtepu16_epi32(_mm256_extracti128_si256(lo, 1)));
+                    sse32[4 * v + 2] = _mm256_add_epi32(sse32[4 * v + 2], _mm256_cvtepu16_epi32(_mm256_castsi256_si128(hi)));
+                    sse32[4 * v + 3] = _mm256_add_epi32(sse32[4 * v + 3], _mm256_cvtepu16_epi32(_mm256_extracti128_si256(hi, 1)));
+                }
+            }
+            for (int v = 0; v < 3; v++)
+            {
+                changed16[2 * v] = _mm256_add_epi16(changed16[2 * v], _mm256_cvtepu8_epi16(_mm256_castsi256_si128(changed8[v])));
+                changed16[2 * v + 1] = _mm256_add_epi16(changed16[2 * v + 1], _mm256_cvtepu8_epi16(_mm256_extracti128_si256(changed8[v], 1)));
+                bits16[2 * v] = _mm256_add_epi16(bits16[2 * v], _mm256_cvtepu8_epi16(_mm256_castsi256_si128(bits8[v])));
+                bits16[2 * v + 1] = _mm256_add_epi16(bits16[2 * v + 1], _mm256_cvtepu8_epi16(_mm256_extracti128_si256(bits8[v], 1)));
+            }
+        }
+
+        // Step 3: Lanes of the chunk into the channel totals
+        for (int k = 0; k < 6; k++)
+        {
+            _mm256_storeu_si256((__m256i *)(changed + 16 * k), changed16[k]);
+            _mm256_storeu_si256((__m256i *)(bits + 16 * k), bits16[k]);
+        }
+        for (int k = 0; k < 12; k++)
+        {
+            _mm256_storeu_si256((__m256i *)(sse + 8 * k), sse32[k]);
+        }
+        add_lanes(counts, bpp, 96, changed, bits, sse);
+    }
+
+    return i;
+}
+#endif
+
+/* Pick the widest supported kernel */
+static void compare_select(void)
+{
+    diff_impl = diff_scalar;
+    compare_impl_name = "scalar";
+
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("avx2"))
+    {
+        diff_impl = diff_avx2;
+        compare_impl_name = "avx2";
+    }
+    else
+    {
+        diff_impl = diff_sse2;
+        compare_impl_name = "sse2";
+    }
+#endif
+}
+
+const char *compare_kernel_name(void)
+{
+    if (compare_impl_name == NULL)
+    {
+        compare_select();
+    }
+    return compare_impl_name;
+}
+
+size_t compare_row(const unsigned char *a, const unsigned char *b, size_t n, uint bpp,
+                   CompareCounts *counts, size_t *first, size_t *last)
+{
+    size_t lo = SIZE_MAX, hi = 0;
+    unsigned long long before = counts->changed[0] + counts->changed[1] + counts->changed[2] + counts->changed[3];
+
+    if (diff_impl == NULL)
+    {
+        compare_select();
+    }
+
+    // The kernel stops at its last whole period, which ends on a pixel
+    size_t i = diff_impl(a, b, n, bpp, counts, &lo, &hi);
+    diff_scalar_from(a, b, i, n, bpp, counts, &lo, &hi);
+    if (lo != SIZE_MAX)
+    {
+        *first = lo;
+        *last = hi;
+    }
+    return counts->changed[0] + counts->changed[1] + counts->changed[2] + counts->changed[3] - before;
+}
+
+static double elapsed_ms(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e3 + (end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+/* MSE and PSNR of a squared error sum over count values */
+static void print_quality(const char *name, unsigned long long changed, unsigned long long bits,
+                          unsigned long long sse, unsigned long long count)
+{
+    double mse = count > 0 ? (double)sse / count : 0;
+
+    if (mse > 0)
+    {
+        printf("  %-7s changed %llu, bits %llu, MSE %.6f, PSNR %.2f dB\n",
+               name, changed, bits, mse, 10 * log10(255.0 * 255.0 / mse));
+    }
+    else
+    {
+        printf("  %-7s changed %llu, bits %llu, MSE 0, PSNR inf\n", name, changed, bits);
+    }
+}
+
+Status do_compare(int argc, char *argv[])
+{
+    Image cover, stego;
+    FILE *fptr_cover, *fptr_stego;
+    CompareCounts counts;
+    struct timespec t0, t1, t2;
+    double compare_ms = 0;
+    Status status = e_success;
+
+    // Step 1: Two images, same geometry and pixel format
+    if (argc != 4)
+    {
+        printf("ERROR: Invalid number of arguments. Usage: <Program Name> -m <Cover Image> <Stego Image>\n");
+        return e_failure;
+    }
+    fptr_cover = fopen(argv[2], "r");
+    if (fptr_cover == NULL)
+    {
+        perror("fopen");
+        printf("ERROR: Unable to open file %s\n", argv[2]);
+        return e_failure;
+    }
+    fptr_stego = fopen(argv[3], "r");
+    if (fptr_stego == NULL)
+    {
+        perror("fopen");
+        printf("ERROR: Unable to open file %s\n", argv[3]);
+        fclose(fptr_cover);
+        return e_failure;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (image_open(&cover, fptr_cover, NULL, 0, 0) == e_failure)
+    {
+        fclose(fptr_cover);
+        fclose(fptr_stego);
+        return e_failure;
+    }
+    if (image_open(&stego, fptr_stego, NULL, 0, 0) == e_failure)
+    {
+        image_close(&cover);
+        fclose(fptr_cover);
+        fclose(fptr_stego);
+        return e_failure;
+    }
+    uint bpp = pixel_bytes_per_pixel(cover.format);
+    if (cover.width != stego.width || cover.height != stego.height || cover.format != stego.format || bpp == 0)
+    {
+        printf("ERROR: %s is %ux%u %s, %s is %ux%u %s: nothing to compare pixel by pixel.\n",
+               argv[2], cover.width, cover.height, pixel_format_name(cover.format),
+               argv[3], stego.width, stego.height, pixel_format_name(stego.format));
+        image_close(&cover);
+        image_close(&stego);
+        fclose(fptr_cover);
+        fclose(fptr_stego);
+        return e_failure;
+    }
+
+    // Step 2: One window of rows from each image at a time
+    uint window_rows = COMPARE_WINDOW_BYTES / cover.row_alloc;
+    if (window_rows == 0)
+    {
+        window_rows = 1;
+    }
+    if (window_rows > cover.height)
+    {
+        window_rows = cover.height;
+    }
+    size_t window_bytes = (size_t)window_rows * cover.row_alloc + PIXEL_VIEW_SLACK;
+    unsigned char *rows_cover = malloc(window_bytes);
+    unsigned char *rows_stego = malloc(window_bytes);
+    if (rows_cover == NULL || rows_stego == NULL)
+    {
+        printf("ERROR: Out of memory for the row windows.\n");
+        status = e_failure;
+    }
+
+    // Step 3: Compare row by row, remembering the first and last changed byte
+    unsigned long long first = 0, last = 0, changed_rows = 0;
+    int any = 0;
+    memset(&counts, 0, sizeof(counts));
+    compare_kernel_name();
+    for (uint y = 0; status == e_success && y < cover.height; y += window_rows)
+    {
+        uint n = cover.height - y < window_rows ? cover.height - y : window_rows;
+        if (image_read_rows(&cover, rows_cover, n) == e_failure || image_read_rows(&stego, rows_stego, n) == e_failure)
+        {
+            printf("ERROR: Failed to read rows %u to %u.\n", y, y + n - 1);
+            status = e_failure;
+            break;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        for (uint r = 0; r < n; r++)
+        {
+            size_t row_first, row_last;
+            size_t offset = (size_t)r * cover.row_alloc;
+            if (compare_row(rows_cover + offset, rows_stego + offset, cover.row_bytes, bpp,
+                            &counts, &row_first, &row_last) > 0)
+            {
+                unsigned long long base = (unsigned long long)(y + r) * cover.row_bytes;
+                if (!any)
+                {
+                    first = base + row_first;
+                    any = 1;
+                }
+                last = base + row_last;
+                changed_rows++;
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t2);
+        compare_ms += elapsed_ms(&t1, &t2);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+
+    // Step 4: Report, per channel and over all of them
+    if (status == e_success)
+    {
+        const char *names = pixel_channel_names(cover.format);
+        unsigned long long pixels = (unsigned long long)cover.width * cover.height;
+        unsigned long long bytes = pixels * bpp;
+        unsigned long long changed = 0, bits = 0, sse = 0;
+        char name[16];
+
+        printf("%s vs %s: %s %s %ux%u\n", argv[2], argv[3], cover.codec->name, pixel_format_name(cover.format),
+               cover.width, cover.height);
+        for (uint c = 0; c < bpp; c++)
+        {
+            snprintf(name, sizeof(name), "%c", names[c]);
+            print_quality(name, counts.changed[c], counts.bits[c], counts.sse[c], pixels);
+            changed += counts.changed[c];
+            bits += counts.bits[c];
+            sse += counts.sse[c];
+        }
+        print_quality("all", changed, bits, sse, bytes);
+        printf("  changed %.4f%% of %llu bytes, %.3f bits per changed byte\n",
+               bytes > 0 ? 100.0 * changed / bytes : 0.0, bytes, changed > 0 ? (double)bits / changed : 0.0);
+        if (any)
+        {
+            printf("  modified span: byte %llu (pixel %llu, row %llu) to byte %llu (pixel %llu, row %llu), %llu rows changed\n",
+                   first, first / bpp, first / cover.row_bytes, last, last / bpp, last / cover.row_bytes, changed_rows);
+        }
+        else
+        {
+            printf("  modified span: none, the pixels are identical\n");
+        }
+        printf("  %.1f MB compared in %.2f ms (%.0f MB/s, %s kernel), %.2f ms with reading\n",
+               2.0 * bytes / 1e6, compare_ms, compare_ms > 0 ? 2.0 * bytes / 1e3 / compare_ms : 0.0,
+               compare_kernel_name(), elapsed_ms(&t0, &t2));
+    }
+
+    free(rows_cover);
+    free(rows_stego);
+    image_close(&cover);
+    image_close(&stego);
+    fclose(fptr_cover);
+    fclose(fptr_stego);
+    return status;
+}
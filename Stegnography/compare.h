@@ -0,0 +1,47 @@
+#ifndef COMPARE_H
+#define COMPARE_H
+
+#include <stddef.h>
+#include "types.h"
+
+/*
+ * Cover against stego comparison: how many bytes and bits the embedding
+ * changed, the mean squared error and PSNR of every channel (alpha
+ * included) and the span of pixels it touched. Both images are read a
+ * window of rows at a time through their codecs, so memory stays at two
+ * windows whatever the image size.
+ *
+ * The kernels (SSE2 or AVX2) walk a row in periods of 3 vectors, which
+ * is a whole number of pixels of every format, so each byte lane stays
+ * on one channel: byte counters every 31 periods, 16-bit counters and
+ * 32-bit squared error sums per lane, added into the channel totals
+ * every COMPARE_CHUNK periods. Periods without a difference are skipped
+ * after one test.
+ */
+
+#define COMPARE_CHUNK 4096          // Periods per lane total, keeps 32-bit squared error sums exact
+#define COMPARE_WINDOW_BYTES (1024 * 1024)  // Rows of each image read per window (at least one row)
+
+/* Differences of some rows, per channel */
+typedef struct _CompareCounts
+{
+    unsigned long long changed[4];  // Bytes that differ
+    unsigned long long bits[4];     // Bits that differ
+    unsigned long long sse[4];      // Sum of squared differences
+} CompareCounts;
+
+/* -m <Cover Image> <Stego Image>: compare the pixels of both and print the metrics */
+Status do_compare(int argc, char *argv[]);
+
+/*
+ * Compare one row of n bytes of bpp-byte pixels (1 to 4) into counts.
+ * Returns the number of differing bytes; *first and *last get the
+ * offsets of the first and last of them (untouched when there is none).
+ */
+size_t compare_row(const unsigned char *a, const unsigned char *b, size_t n, uint bpp,
+                   CompareCounts *counts, size_t *first, size_t *last);
+
+/* Name of the selected kernel */
+const char *compare_kernel_name(void);
+
+#endif
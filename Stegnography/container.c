@@ -0,0 +1,304 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "container.h"
+#include "crc32c.h"
+
+/* A stored name must not reach outside the directory it is extracted to */
+static int valid_name(const char *name, uint len)
+{
+    if (len == 0 || memchr(name, '/', len) != NULL || memchr(name, '\0', len) != NULL)
+    {
+        return 0;
+    }
+    return !(len == 1 && name[0] == '.') && !(len == 2 && name[0] == '.' && name[1] == '.');
+}
+
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp((*(const ContainerEntry *const *)a)->name, (*(const ContainerEntry *const *)b)->name);
+}
+
+/* The first name held by more than one entry, NULL if all differ: sorted once, so O(n log n) for any index */
+static const char *duplicate_name(const Container *c, Status *status)
+{
+    const ContainerEntry **sorted = malloc((c->count ? c->count : 1) * sizeof(*sorted));
+    const char *name = NULL;
+
+    *status = e_success;
+    if (sorted == NULL)
+    {
+        printf("ERROR: Out of memory for %u container entries.\n", c->count);
+        *status = e_failure;
+        return NULL;
+    }
+    for (uint i = 0; i < c->count; i++)
+    {
+        sorted[i] = &c->entries[i];
+    }
+    qsort(sorted, c->count, sizeof(*sorted), compare_names);
+    for (uint i = 1; i < c->count && name == NULL; i++)
+    {
+        if (strcmp(sorted[i - 1]->name, sorted[i]->name) == 0)
+        {
+            name = sorted[i]->name;
+        }
+    }
+    free(sorted);
+    return name;
+}
+
+Status container_create(Container *c, char **paths, uint count)
+{
+    unsigned long long total;
+
+    memset(c, 0, sizeof(*c));
+    c->entries = calloc(count, sizeof(ContainerEntry));
+    if (c->entries == NULL)
+    {
+        printf("ERROR: Out of memory for %u container entries.\n", count);
+        return e_failure;
+    }
+    c->count = count;
+
+    // Step 1: Name each entry after its path and size it
+    total = CONTAINER_HEAD_SIZE;
+    for (uint i = 0; i < count; i++)
+    {
+        ContainerEntry *entry = &c->entries[i];
+        const char *name = strrchr(paths[i], '/') ? strrchr(paths[i], '/') + 1 : paths[i];
+
+        entry->path = paths[i];
+        if (!valid_name(name, strlen(name)) || strlen(name) > CONTAINER_MAX_NAME)
+        {
+            printf("ERROR: %s cannot be stored under the name \"%s\".\n", paths[i], name);
+            return e_failure;
+        }
+        strcpy(entry->name, name);
+
+        FILE *fptr = fopen(entry->path, "r");
+        if (fptr == NULL)
+        {
+            perror("fopen");
+            printf("ERROR: Unable to open file %s\n", entry->path);
+            return e_failure;
+        }
+        fseek(fptr, 0L, SEEK_END);
+        long size = ftell(fptr);
+        fclose(fptr);
+        if (size < 0)
+        {
+            printf("ERROR: Unable to size file %s\n", entry->path);
+            return e_failure;
+        }
+        entry->size = (uint)size;
+        total += CONTAINER_ENTRY_SIZE + strlen(name);
+    }
+    if (total > CONTAINER_MAX_INDEX)
+    {
+        printf("ERROR: Container index of %llu bytes is too large.\n", total);
+        return e_failure;
+    }
+    c->index_size = (uint)total;
+
+    // Step 1a: Names have to be unique
+    Status status;
+    const char *duplicate = duplicate_name(c, &status);
+    if (status == e_failure || duplicate != NULL)
+    {
+        if (duplicate != NULL)
+        {
+            printf("ERROR: More than one file named %s.\n", duplicate);
+        }
+        return e_failure;
+    }
+
+    // Step 2: Entries follow the index in order
+    for (uint i = 0; i < count; i++)
+    {
+        c->entries[i].offset = (uint)total;
+        total += c->entries[i].size;
+    }
+    if (total > 0x7FFFFFFF)
+    {
+        printf("ERROR: Container payload of %llu bytes is too large.\n", total);
+        return e_failure;
+    }
+    c->total_size = (uint)total;
+
+    // Step 3: Serialize the index
+    c->index = malloc(c->index_size);
+    if (c->index == NULL)
+    {
+        printf("ERROR: Out of memory for the container index.\n");
+        return e_failure;
+    }
+    unsigned char *p = c->index;
+    put_be32(p, count);
+    put_be32(p + 4, c->index_size);
+    p += CONTAINER_HEAD_SIZE;
+    for (uint i = 0; i < count; i++)
+    {
+        uint len = strlen(c->entries[i].name);
+
+        put_be32(p, c->entries[i].offset);
+        put_be32(p + 4, c->entries[i].size);
+        p[8] = (unsigned char)len;
+        memcpy(p + CONTAINER_ENTRY_SIZE, c->entries[i].name, len);
+        p += CONTAINER_ENTRY_SIZE + len;
+    }
+
+    return e_success;
+}
+
+Status container_read(Container *c, char *buf, uint len)
+{
+    while (len > 0)
+    {
+        uint n;
+
+        // Step 1: The index comes first
+        if (c->pos < c->index_size)
+        {
+            n = c->index_size - c->pos < len ? c->index_size - c->pos : len;
+            memcpy(buf, c->index + c->pos, n);
+        }
+        else
+        {
+            // Step 2: Then each entry, opened when its first byte is needed
+            if (c->cur >= c->count)
+            {
+                printf("ERROR: Read past the end of the container.\n");
+                return e_failure;
+            }
+            ContainerEntry *entry = &c->entries[c->cur];
+            uint left = entry->offset + entry->size - c->pos;
+            if (left == 0)
+            {
+                if (c->fptr != NULL)
+                {
+                    fclose(c->fptr);
+                    c->fptr = NULL;
+                }
+                c->cur++;
+                continue;
+            }
+            if (c->fptr == NULL && (c->fptr = fopen(entry->path, "r")) == NULL)
+            {
+                perror("fopen");
+                printf("ERROR: Unable to open file %s\n", entry->path);
+                return e_failure;
+            }
+            n = left < len ? left : len;
+            if (fread(buf, 1, n, c->fptr) != n)
+            {
+                printf("ERROR: %s changed size while being encoded.\n", entry->path);
+                return e_failure;
+            }
+        }
+        c->pos += n;
+        buf += n;
+        len -= n;
+    }
+    return e_success;
+}
+
+Status container_read_head(const unsigned char *head, uint payload_size, uint *count, uint *index_size)
+{
+    *count = get_be32(head);
+    *index_size = get_be32(head + 4);
+
+    if (*index_size < CONTAINER_HEAD_SIZE || *index_size > payload_size || *index_size > CONTAINER_MAX_INDEX ||
+        *count > (*index_size - CONTAINER_HEAD_SIZE) / (CONTAINER_ENTRY_SIZE + 1))
+    {
+        printf("ERROR: Container index (%u entries, %u bytes) does not fit the %u byte payload.\n",
+               *count, *index_size, payload_size);
+        return e_failure;
+    }
+    return e_success;
+}
+
+Status container_parse_index(Container *c, const unsigned char *index, uint index_size, uint payload_size)
+{
+    uint count, size;
+    const unsigned char *p = index + CONTAINER_HEAD_SIZE;
+    const unsigned char *end = index + index_size;
+
+    memset(c, 0, sizeof(*c));
+    if (index_size < CONTAINER_HEAD_SIZE || container_read_head(index, payload_size, &count, &size) == e_failure)
+    {
+        return e_failure;
+    }
+    if (size != index_size)
+    {
+        printf("ERROR: Container index size changed from %u to %u bytes.\n", size, index_size);
+        return e_failure;
+    }
+    c->entries = calloc(count ? count : 1, sizeof(ContainerEntry));
+    if (c->entries == NULL)
+    {
+        printf("ERROR: Out of memory for %u container entries.\n", count);
+        return e_failure;
+    }
+    c->index_size = index_size;
+    c->total_size = payload_size;
+
+    for (uint i = 0; i < count; i++)
+    {
+        ContainerEntry *entry = &c->entries[i];
+
+        // Step 1: Each entry has to be complete inside the index
+        if (end - p < CONTAINER_ENTRY_SIZE || end - p < CONTAINER_ENTRY_SIZE + p[8])
+        {
+            printf("ERROR: Container index entry %u is truncated.\n", i);
+            return e_failure;
+        }
+        entry->offset = get_be32(p);
+        entry->size = get_be32(p + 4);
+        memcpy(entry->name, p + CONTAINER_ENTRY_SIZE, p[8]);
+        entry->name[p[8]] = '\0';
+
+        // Step 2: Its data has to lie in the payload, after the index
+        if (!valid_name((const char *)p + CONTAINER_ENTRY_SIZE, p[8]) || entry->offset < index_size ||
+            entry->offset > payload_size || entry->size > payload_size - entry->offset)
+        {
+            printf("ERROR: Container index entry %u is invalid.\n", i);
+            return e_failure;
+        }
+        p += CONTAINER_ENTRY_SIZE + p[8];
+        c->count = i + 1;
+    }
+
+    // Step 3: Names have to be unique
+    Status status;
+    const char *duplicate = duplicate_name(c, &status);
+    if (duplicate != NULL)
+    {
+        printf("ERROR: Container holds more than one entry named %s.\n", duplicate);
+        return e_failure;
+    }
+    return status;
+}
+
+const ContainerEntry *container_find(const Container *c, const char *name)
+{
+    for (uint i = 0; i < c->count; i++)
+    {
+        if (strcmp(c->entries[i].name, name) == 0)
+        {
+            return &c->entries[i];
+        }
+    }
+    return NULL;
+}
+
+void container_free(Container *c)
+{
+    if (c->fptr != NULL)
+    {
+        fclose(c->fptr);
+    }
+    free(c->entries);
+    free(c->index);
+    memset(c, 0, sizeof(*c));
+}
@@ -0,0 +1,63 @@
+#ifndef CONTAINER_H
+#define CONTAINER_H
+
+#include <stdio.h>
+#include "types.h"
+
+/*
+ * Container payload: several named files in one embedding. The payload
+ * starts with an index and the entries follow it back to back:
+ *
+ *   count (be32) | index size (be32, whole index) |
+ *   count x [ offset (be32) | size (be32) | name length (1 byte) | name ]
+ *
+ * Offsets are payload byte offsets, so an entry can be read without
+ * decoding anything but the index and the blocks it lies in. Names are
+ * plain file names (no directories), unique within the container.
+ */
+
+#define CONTAINER_HEAD_SIZE 8
+#define CONTAINER_ENTRY_SIZE 9     // Fixed part of an index entry
+#define CONTAINER_MAX_NAME 255
+#define CONTAINER_MAX_INDEX (16 * 1024 * 1024)
+
+typedef struct _ContainerEntry
+{
+    const char *path;             // File to read (encoding only)
+    char name[CONTAINER_MAX_NAME + 1];
+    uint offset;
+    uint size;
+} ContainerEntry;
+
+typedef struct _Container
+{
+    ContainerEntry *entries;
+    uint count;
+    unsigned char *index;         // Serialized index (encoding only)
+    uint index_size;
+    uint total_size;              // Index plus all entries
+
+    /* Position while streaming the payload out (encoding only) */
+    uint pos;
+    uint cur;
+    FILE *fptr;
+} Container;
+
+/* Size the given files and build the index, entries named after their paths */
+Status container_create(Container *c, char **paths, uint count);
+
+/* Read the next len payload bytes: the index, then every entry in turn */
+Status container_read(Container *c, char *buf, uint len);
+
+/* Entry count and index size from the first CONTAINER_HEAD_SIZE payload bytes */
+Status container_read_head(const unsigned char *head, uint payload_size, uint *count, uint *index_size);
+
+/* Parse and check a whole index against the payload size */
+Status container_parse_index(Container *c, const unsigned char *index, uint index_size, uint payload_size);
+
+/* Entry with the given name, NULL if there is none */
+const ContainerEntry *container_find(const Container *c, const char *name);
+
+void container_free(Container *c);
+
+#endif
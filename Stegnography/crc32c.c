@@ -0,0 +1,147 @@
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include "crc32c.h"
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+/* Reflected Castagnoli polynomial */
+#define CRC32C_POLY 0x82F63B78u
+
+/* Slicing-by-8 tables, built on first use */
+static uint crc32c_table[8][256];
+
+/* Selected implementation (hardware or slicing-by-8), set exactly once even with threads calling in */
+static uint (*crc32c_impl)(uint crc, const unsigned char *buf, size_t len);
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+
+/* Build the 8 lookup tables for the software path */
+static void crc32c_init_tables(void)
+{
+    // Step 1: Byte-wise table for the reflected polynomial
+    for (uint i = 0; i < 256; i++)
+    {
+        uint crc = i;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : (crc >> 1);
+        }
+        crc32c_table[0][i] = crc;
+    }
+
+    // Step 2: Each further table advances the CRC by one more zero byte
+    for (uint i = 0; i < 256; i++)
+    {
+        for (int k = 1; k < 8; k++)
+        {
+            uint prev = crc32c_table[k - 1][i];
+            crc32c_table[k][i] = (prev >> 8) ^ crc32c_table[0][prev & 0xFF];
+        }
+    }
+}
+
+/* Software path: 8 bytes per iteration using the sliced tables */
+static uint crc32c_sw(uint crc, const unsigned char *buf, size_t len)
+{
+    while (len >= 8)
+    {
+        uint32_t lo, hi;
+        memcpy(&lo, buf, 4);
+        memcpy(&hi, buf + 4, 4);
+        lo ^= crc;
+        crc = crc32c_table[7][lo & 0xFF] ^
+              crc32c_table[6][(lo >> 8) & 0xFF] ^
+              crc32c_table[5][(lo >> 16) & 0xFF] ^
+              crc32c_table[4][lo >> 24] ^
+              crc32c_table[3][hi & 0xFF] ^
+              crc32c_table[2][(hi >> 8) & 0xFF] ^
+              crc32c_table[1][(hi >> 16) & 0xFF] ^
+              crc32c_table[0][hi >> 24];
+        buf += 8;
+        len -= 8;
+    }
+
+    while (len--)
+    {
+        crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *buf++) & 0xFF];
+    }
+
+    return crc;
+}
+
+#if defined(__x86_64__)
+/* Hardware path: SSE4.2 crc32 instruction, 8 bytes at a time */
+__attribute__((target("sse4.2")))
+static uint crc32c_hw(uint crc, const unsigned char *buf, size_t len)
+{
+    uint64_t crc64 = crc;
+
+    while (len >= 8)
+    {
+        uint64_t word;
+        memcpy(&word, buf, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+        buf += 8;
+        len -= 8;
+    }
+
+    crc = (uint)crc64;
+    while (len--)
+    {
+        crc = _mm_crc32_u8(crc, *buf++);
+    }
+
+    return crc;
+}
+#endif
+
+/* Pick the implementation once, based on the running CPU */
+static void crc32c_select(void)
+{
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("sse4.2"))
+    {
+        crc32c_impl = crc32c_hw;
+        return;
+    }
+#endif
+    crc32c_init_tables();
+    crc32c_impl = crc32c_sw;
+}
+
+uint crc32c_update(uint crc, const void *data, size_t len)
+{
+    pthread_once(&crc32c_once, crc32c_select);
+
+    // CRC32C is pre- and post-inverted, so a zero start value chains cleanly
+    return ~crc32c_impl(~crc, (const unsigned char *)data, len);
+}
+
+uint crc32c_update_be32(uint crc, uint value)
+{
+    unsigned char bytes[4];
+
+    put_be32(bytes, value);
+    return crc32c_update(crc, bytes, sizeof(bytes));
+}
+
+void put_be32(unsigned char *p, uint value)
+{
+    p[0] = (unsigned char)(value >> 24);
+    p[1] = (unsigned char)(value >> 16);
+    p[2] = (unsigned char)(value >> 8);
+    p[3] = (unsigned char)value;
+}
+
+uint get_be32(const unsigned char *p)
+{
+    return (uint)p[0] << 24 | (uint)p[1] << 16 | (uint)p[2] << 8 | p[3];
+}
+
+int crc32c_hw_enabled(void)
+{
+    pthread_once(&crc32c_once, crc32c_select);
+    return crc32c_impl != crc32c_sw;
+}
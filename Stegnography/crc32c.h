@@ -0,0 +1,27 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stddef.h>
+#include "types.h"
+
+/*
+ * CRC32C (Castagnoli) checksums used to protect the
+ * stego header and every block of payload data.
+ * Uses the SSE4.2 crc32 instruction when the CPU has it,
+ * otherwise a slicing-by-8 table implementation.
+ */
+
+/* Update a running CRC32C with len bytes (start with crc = 0) */
+uint crc32c_update(uint crc, const void *data, size_t len);
+
+/* Update a running CRC32C with a 32-bit field, MSB first as it is embedded */
+uint crc32c_update_be32(uint crc, uint value);
+
+/* Store and load a 32-bit field MSB first, the order of every size and checksum in a payload */
+void put_be32(unsigned char *p, uint value);
+uint get_be32(const unsigned char *p);
+
+/* Returns 1 if the hardware (SSE4.2) path is in use */
+int crc32c_hw_enabled(void);
+
+#endif
@@ -1,25 +1,135 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <sys/stat.h>
 #include "decode.h"
 #include "types.h"
 #include "common.h"
+#include "crc32c.h"
 
 /* Function Definitions */
 
+/* Parse the number after an "--option=" prefix */
+static Status parse_range_value(const char *arg, size_t prefix_len, unsigned long long *value)
+{
+    char *end;
+
+    *value = strtoull(arg + prefix_len, &end, 0);
+    if (end == arg + prefix_len || *end != '\0' || arg[prefix_len] == '-')
+    {
+        printf("ERROR: Invalid number in %s\n", arg);
+        return e_failure;
+    }
+    return e_success;
+}
+
 Status read_and_validate_decode_args(int argc, char *argv[], DecodeInfo *decInfo)
 {
+    // Step 0: Take --options out so the checks below only see file names
+    static char *args[5];
+    int nargs = 0;
+
+    decInfo->has_range = 0;
+    decInfo->range_offset = 0;
+    decInfo->range_length = 0;
+    decInfo->list_entries = 0;
+    decInfo->entry_name = NULL;
+    memset(&decInfo->container, 0, sizeof(decInfo->container));
+    decInfo->io_flags = 0;
+    stats_start(&decInfo->stats, e_stats_off);
+    for (int i = 0; i < argc; i++)
+    {
+        if (i >= 2 && strncmp(argv[i], "--", 2) == 0)
+        {
+            if (strncmp(argv[i], "--offset=", 9) == 0)
+            {
+                if (parse_range_value(argv[i], 9, &decInfo->range_offset) == e_failure)
+                {
+                    return e_failure;
+                }
+                decInfo->has_range = 1;
+            }
+            else if (strncmp(argv[i], "--length=", 9) == 0)
+            {
+                if (parse_range_value(argv[i], 9, &decInfo->range_length) == e_failure)
+                {
+                    return e_failure;
+                }
+                if (decInfo->range_length == 0)
+                {
+                    printf("ERROR: --length must be at least 1.\n");
+                    return e_failure;
+                }
+                decInfo->has_range = 1;
+            }
+            else if (strcmp(argv[i], "--list") == 0)
+            {
+                decInfo->list_entries = 1;
+            }
+            else if (strncmp(argv[i], "--entry=", 8) == 0 && argv[i][8] != '\0')
+            {
+                decInfo->entry_name = argv[i] + 8;
+            }
+            else if (strcmp(argv[i], "--stats") == 0 || strncmp(argv[i], "--stats=", 8) == 0)
+            {
+                StatsFormat format;
+                if (stats_parse_format(argv[i][7] == '=' ? argv[i] + 8 : NULL, &format) == e_failure)
+                {
+                    return e_failure;
+                }
+                stats_start(&decInfo->stats, format);
+            }
+            else if (strcmp(argv[i], "--direct-io") == 0)
+            {
+                decInfo->io_flags |= IMAGE_IO_DIRECT;
+            }
+            else
+            {
+                printf("ERROR: Unknown option %s\n", argv[i]);
+                return e_failure;
+            }
+        }
+        else
+        {
+            // Keep counting past the end so Step 1 still sees too many names
+            if (nargs < 4)
+            {
+                args[nargs] = argv[i];
+            }
+            nargs++;
+        }
+    }
+    if (nargs < 5)
+    {
+        args[nargs] = NULL;
+    }
+    argv = args;
+    argc = nargs;
+
     // Step 1: Validate argument count
-    if (argc > 4)
+    if (argc > 4 || argc < 3)
     {
-        printf("ERROR: Invalid number of arguments. Usage: <Program Name> -d <Stego Image> <Base Output Name>\n");
+        printf("ERROR: Invalid number of arguments. Usage: <Program Name> -d <Stego Image> <Base Output Name> [--offset=N] [--length=N] [--list] [--entry=<Name>] [--stats[=json]] [--direct-io]\n");
         return e_failure;
     }
 
-    // Step 2: Check if stego image is a BMP file
-    if (!strstr(argv[2], ".bmp"))
+    // Step 1a: Container entries are picked by name, not by byte range
+    if ((decInfo->list_entries || decInfo->entry_name != NULL) && decInfo->has_range)
     {
-        printf("ERROR: Stego image must be a BMP file.\n");
+        printf("ERROR: --offset and --length cannot be combined with --list or --entry.\n");
+        return e_failure;
+    }
+    if (decInfo->list_entries && decInfo->entry_name != NULL)
+    {
+        printf("ERROR: --list and --entry cannot be combined.\n");
+        return e_failure;
+    }
+
+    // Step 2: Check if stego image is a BMP or PNG file
+    if (image_codec_for_name(argv[2]) == NULL)
+    {
+        printf("ERROR: Stego image must be a BMP or PNG file.\n");
         return e_failure;
     }
 
@@ -49,6 +159,7 @@ Status read_and_validate_decode_args(int argc, char *argv[], DecodeInfo *decInfo
 Status do_decoding(DecodeInfo *decInfo)
 {
     // Step 1: Open the stego image file
+    stats_phase(&decInfo->stats, e_phase_open);
     decInfo->fptr_stego_image = fopen(decInfo->stego_image_fname, "r");
     if (decInfo->fptr_stego_image == NULL)
     {
@@ -57,18 +168,59 @@ Status do_decoding(DecodeInfo *decInfo)
         return e_failure;
     }
 
+    // Step 1a: Read the image header and start streaming its carrier bytes
+    stats_phase(&decInfo->stats, e_phase_header);
+    if (carrier_open(&decInfo->carrier, decInfo->fptr_stego_image, NULL, 0, decInfo->io_flags) == e_failure)
+    {
+        printf("ERROR: Failed to read the pixel array of the stego image.\n");
+        fclose(decInfo->fptr_stego_image); // Close the stego image file
+        return e_failure;
+    }
+
     // Step 2: Decode the magic string and validate by prompting the user
+    stats_phase(&decInfo->stats, e_phase_magic);
+    decInfo->header_crc = 0;
     if (prompt_and_compare_magic_string(decInfo) == e_failure)
     {
         printf("ERROR: Magic string mismatch. Decoding aborted.\n");
+        carrier_close(&decInfo->carrier);
+        fclose(decInfo->fptr_stego_image); // Close the stego image file
+        return e_failure;
+    }
+
+    // Step 2b: The legacy layout has no mode word, checksums or index, only the file
+    if (decInfo->is_legacy)
+    {
+        stats_phase(&decInfo->stats, e_phase_data);
+        Status legacy_status = decode_legacy_payload(decInfo);
+        stats_phase(&decInfo->stats, e_phase_tail);
+        carrier_close(&decInfo->carrier);
+        fclose(decInfo->fptr_stego_image); // Close the stego image file
+        if (legacy_status == e_failure)
+        {
+            printf("ERROR: Failed to decode the legacy payload.\n");
+            return e_failure;
+        }
+        printf("Decoding successful. Secret file extracted to %s\n", decInfo->output_fname);
+        return e_success;
+    }
+
+    // Step 2a: Decode the embedding mode
+    stats_phase(&decInfo->stats, e_phase_mode);
+    if (decode_embed_mode(decInfo) == e_failure)
+    {
+        printf("ERROR: Failed to decode the embedding mode.\n");
+        carrier_close(&decInfo->carrier);
         fclose(decInfo->fptr_stego_image); // Close the stego image file
         return e_failure;
     }
 
     // Step 3: Decode the secret file extension size
+    stats_phase(&decInfo->stats, e_phase_extn);
     if (decode_secret_file_extn_size(decInfo) == e_failure)
     {
         printf("ERROR: Failed to decode secret file extension size.\n");
+        carrier_close(&decInfo->carrier);
         fclose(decInfo->fptr_stego_image); // Close the stego image file
         return e_failure;
     }
@@ -77,39 +229,98 @@ Status do_decoding(DecodeInfo *decInfo)
     if (decode_secret_file_extn(decInfo) == e_failure)
     {
         printf("ERROR: Failed to decode secret file extension.\n");
+        carrier_close(&decInfo->carrier);
         fclose(decInfo->fptr_stego_image); // Close the stego image file
         return e_failure;
     }
 
-    // Step 5: Open the output file using concatenated base name and extension
-    if (open_output_file(decInfo) == e_failure)
+    // Step 5: Decode the secret file size
+    stats_phase(&decInfo->stats, e_phase_size);
+    if (decode_secret_file_size(decInfo) == e_failure)
     {
-        printf("ERROR: Failed to open output file.\n");
+        printf("ERROR: Failed to decode secret file size.\n");
+        carrier_close(&decInfo->carrier);
         fclose(decInfo->fptr_stego_image); // Close the stego image file
         return e_failure;
     }
 
-    // Step 6: Decode the secret file size
-    if (decode_secret_file_size(decInfo) == e_failure)
+    // Step 6: Verify the header checksum before creating any output
+    stats_phase(&decInfo->stats, e_phase_checksum);
+    if (decode_header_crc(decInfo) == e_failure)
     {
-        printf("ERROR: Failed to decode secret file size.\n");
+        printf("ERROR: Header checksum mismatch. Decoding aborted.\n");
+        carrier_close(&decInfo->carrier);
+        fclose(decInfo->fptr_stego_image); // Close the stego image file
+        return e_failure;
+    }
+
+    // Step 6a: A container starts with its index, only that is read up front
+    stats_phase(&decInfo->stats, e_phase_data);
+    if (decInfo->is_container ? decode_container_index(decInfo) == e_failure :
+        decInfo->list_entries || decInfo->entry_name != NULL)
+    {
+        if (!decInfo->is_container)
+        {
+            printf("ERROR: The stego image holds a single file, not a container.\n");
+        }
+        carrier_close(&decInfo->carrier);
+        fclose(decInfo->fptr_stego_image); // Close the stego image file
+        container_free(&decInfo->container);
+        return e_failure;
+    }
+
+    // Step 6b: A requested byte range has to lie inside the payload
+    if (decInfo->has_range && check_secret_file_range(decInfo) == e_failure)
+    {
+        carrier_close(&decInfo->carrier);
+        fclose(decInfo->fptr_stego_image); // Close the stego image file
+        container_free(&decInfo->container);
+        return e_failure;
+    }
+
+    // Step 6c: List the container or extract its entries, each to a file of its own
+    if (decInfo->is_container && !decInfo->has_range)
+    {
+        Status entries_status = decInfo->list_entries ? list_container_entries(decInfo) : decode_container_entries(decInfo);
+
+        stats_phase(&decInfo->stats, e_phase_tail);
+        carrier_close(&decInfo->carrier);
+        fclose(decInfo->fptr_stego_image); // Close the stego image file
+        container_free(&decInfo->container);
+        if (entries_status == e_failure)
+        {
+            printf("ERROR: Failed to decode the container entries.\n");
+        }
+        return entries_status;
+    }
+
+    // Step 7: Open the output file using concatenated base name and extension
+    if (open_output_file(decInfo) == e_failure)
+    {
+        printf("ERROR: Failed to open output file.\n");
+        carrier_close(&decInfo->carrier);
         fclose(decInfo->fptr_stego_image); // Close the stego image file
-        fclose(decInfo->fptr_output); // Close the output file
         return e_failure;
     }
 
-    // Step 7: Decode the secret file data
-    if (decode_secret_file_data(decInfo) == e_failure)
+    // Step 8: Decode the secret file data, or only the requested range (verifying each block)
+    Status data_status = decInfo->has_range ? decode_secret_file_range(decInfo) : decode_secret_file_data(decInfo);
+    if (data_status == e_failure)
     {
         printf("ERROR: Failed to decode secret file data.\n");
+        carrier_close(&decInfo->carrier);
         fclose(decInfo->fptr_stego_image); // Close the stego image file
         fclose(decInfo->fptr_output); // Close the output file
+        container_free(&decInfo->container);
         return e_failure;
     }
 
     // Close both files after successful decoding
+    stats_phase(&decInfo->stats, e_phase_tail);
+    carrier_close(&decInfo->carrier);
     fclose(decInfo->fptr_stego_image);
     fclose(decInfo->fptr_output);
+    container_free(&decInfo->container);
 
     printf("Decoding successful. Secret file extracted to %s\n", decInfo->output_fname);
     return e_success;
@@ -117,30 +328,21 @@ Status do_decoding(DecodeInfo *decInfo)
 
 Status prompt_and_compare_magic_string(DecodeInfo *decInfo)
 {
-    char user_magic_string[10]; // Buffer for user input (adjust size if needed)
+    char *user_magic_string = decInfo->magic_str; // Kept for the legacy layout check
     const char *magic_string = MAGIC_STRING;
-    char image_buffer[8];
     char decoded_char;
 
     // Prompt the user to input the magic string
     printf("Enter the magic string to compare: ");
+    user_magic_string[0] = '\0';
     scanf("%9s", user_magic_string);  // Limiting input to avoid buffer overflow
-
-    // Skip the BMP header
-    fseek(decInfo->fptr_stego_image, 54, SEEK_SET);
+    decInfo->is_legacy = 0;
 
     // Step 1: Loop through each character in the magic string
     for (int i = 0; magic_string[i] != '\0'; i++)
     {
-        // Read 8 bytes from the stego image
-        if (fread(image_buffer, sizeof(char), 8, decInfo->fptr_stego_image) != 8)
-        {
-            printf("ERROR: Failed to read 8 bytes from stego image.\n");
-            return e_failure;
-        }
-
-        // Decode the character from LSBs
-        if (decode_byte_from_lsb(&decoded_char, image_buffer) != e_success)
+        // Decode the character from the LSBs of the next 8 carriers
+        if (carrier_extract(&decInfo->carrier, &decoded_char, 1) != e_success)
         {
             printf("ERROR: Failed to decode byte from LSB.\n");
             return e_failure;
@@ -149,15 +351,56 @@ Status prompt_and_compare_magic_string(DecodeInfo *decInfo)
         // Compare the decoded character with the user-entered magic string
         if (decoded_char != user_magic_string[i])
         {
+            // Images written before the mode word hold it at the start of the pixel bytes
+            if (decode_legacy_magic_string(decInfo) == e_success)
+            {
+                printf("Magic string successfully decoded and matched (legacy layout without checksums).\n");
+                decInfo->is_legacy = 1;
+                return e_success;
+            }
             printf("ERROR: Magic string mismatch at character %d.\n", i + 1);
             return e_failure;
         }
+
+        decInfo->header_crc = crc32c_update(decInfo->header_crc, &decoded_char, 1);
     }
 
     printf("Magic string successfully decoded and matched.\n");
     return e_success;
 }
 
+Status decode_embed_mode(DecodeInfo *decInfo)
+{
+    uint mode;
+
+    if (carrier_extract_be32(&decInfo->carrier, &mode) != e_success)
+    {
+        printf("ERROR: Failed to decode embedding mode.\n");
+        return e_failure;
+    }
+
+    // Reject modes this build does not know or that do not fit the pixel format
+    decInfo->channel_mask = mode & MODE_CHANNEL_MASK;
+    decInfo->is_container = (mode & MODE_CONTAINER) != 0;
+    decInfo->is_matching = (mode & MODE_MATCHING) != 0;
+    decInfo->matrix_p = (mode & MODE_MATRIX_MASK) >> MODE_MATRIX_SHIFT;
+    if (mode >> MODE_VERSION_SHIFT > FORMAT_VERSION)
+    {
+        printf("ERROR: Payload format version %u is newer than this build reads (%u).\n",
+               mode >> MODE_VERSION_SHIFT, FORMAT_VERSION);
+        return e_failure;
+    }
+    if ((mode & ~(MODE_CHANNEL_MASK | MODE_CONTAINER | MODE_MATCHING | MODE_MATRIX_MASK | MODE_VERSION_MASK)) != 0 ||
+        decInfo->matrix_p == 1 || decInfo->matrix_p > CARRIER_MAX_MATRIX || pixel_view(decInfo->carrier.image.format, decInfo->channel_mask) == NULL)
+    {
+        printf("ERROR: Unsupported embedding mode 0x%08X.\n", mode);
+        return e_failure;
+    }
+
+    decInfo->header_crc = crc32c_update_be32(decInfo->header_crc, mode);
+    return e_success;
+}
+
 Status open_output_file(DecodeInfo *decInfo)
 {
     char output_filename[100];  // Adjust size as needed, ensure it's large enough for the full file name
@@ -190,94 +433,433 @@ Status open_output_file(DecodeInfo *decInfo)
 
 Status decode_secret_file_extn_size(DecodeInfo *decInfo)
 {
-    char image_buffer[32];
-    int extn_size;
+    uint extn_size;
 
-    if (fread(image_buffer, sizeof(char), 32, decInfo->fptr_stego_image) != 32)
+    if (carrier_extract_be32(&decInfo->carrier, &extn_size) != e_success)
     {
-        printf("ERROR: Failed to read 32 bytes from stego image.\n");
+        printf("ERROR: Failed to decode secret file extension size.\n");
         return e_failure;
     }
 
-    if (decode_size_from_lsb(&extn_size, image_buffer) != e_success)
+    // Reject sizes that cannot be a valid extension (corrupt or foreign image)
+    if (extn_size >= sizeof(decInfo->file_extn))
     {
-        printf("ERROR: Failed to decode secret file extension size.\n");
+        printf("ERROR: Decoded extension size %u is out of range.\n", extn_size);
         return e_failure;
     }
 
     decInfo->extn_size = extn_size;
+    decInfo->header_crc = crc32c_update_be32(decInfo->header_crc, extn_size);
     return e_success;
 }
 
 Status decode_secret_file_extn(DecodeInfo *decInfo)
 {
-    char image_buffer[8];
-    char decoded_char;
+    if (carrier_extract(&decInfo->carrier, decInfo->file_extn, decInfo->extn_size) != e_success)
+    {
+        printf("ERROR: Failed to decode byte from LSB.\n");
+        return e_failure;
+    }
+
+    decInfo->file_extn[decInfo->extn_size] = '\0';  // Null-terminate the extension
+    decInfo->header_crc = crc32c_update(decInfo->header_crc, decInfo->file_extn, decInfo->extn_size);
+    return e_success;
+}
+
+Status decode_secret_file_size(DecodeInfo *decInfo)
+{
+    uint file_size;
+
+    if (carrier_extract_be32(&decInfo->carrier, &file_size) != e_success)
+    {
+        printf("ERROR: Failed to decode secret file size.\n");
+        return e_failure;
+    }
+
+    decInfo->header_crc = crc32c_update_be32(decInfo->header_crc, file_size);
+
+    // Sanity check the size against the payload capacity from here on, counted as check_capacity
+    // counts it: in the payload channels, matrix code blocks only where they fit a row
+    const Image *image = &decInfo->carrier.image;
+    uint cpp = pixel_view(image->format, decInfo->channel_mask)->carriers_per_pixel;
+    unsigned long long block_count = ((unsigned long long)file_size + CRC_BLOCK_SIZE - 1) / CRC_BLOCK_SIZE;
+    unsigned long long payload_bits = ((unsigned long long)file_size + block_count * CRC_SIZE) * 8;
+    if ((int)file_size < 0 ||
+        payload_bits > carrier_capacity_bits(image->width, image->height, cpp, decInfo->matrix_p,
+                                             carrier_tell(&decInfo->carrier)))
+    {
+        printf("ERROR: Decoded secret file size %u exceeds the image capacity.\n", file_size);
+        return e_failure;
+    }
+
+    decInfo->size_secret_file = file_size;
+    return e_success;
+}
+
+Status decode_header_crc(DecodeInfo *decInfo)
+{
+    uint stored_crc;
+
+    if (carrier_extract_be32(&decInfo->carrier, &stored_crc) != e_success)
+    {
+        printf("ERROR: Failed to decode header checksum.\n");
+        return e_failure;
+    }
+
+    if (stored_crc != decInfo->header_crc)
+    {
+        printf("ERROR: Header checksum is 0x%08X, expected 0x%08X.\n", decInfo->header_crc, stored_crc);
+        return e_failure;
+    }
+
+    // The payload sits in the channels named by the mode word, from the next pixel on
+    if (carrier_set_mask(&decInfo->carrier, decInfo->channel_mask) == e_failure ||
+        carrier_set_matrix(&decInfo->carrier, decInfo->matrix_p) == e_failure)
+    {
+        return e_failure;
+    }
+    decInfo->payload_pixel = carrier_tell(&decInfo->carrier);
+    decInfo->cached_block = -1;
+    decInfo->next_block = 0;
+    return e_success;
+}
 
-    for (int i = 0; i < decInfo->extn_size; i++)
+Status decode_secret_file_data(DecodeInfo *decInfo)
+{
+    char secret_block[CRC_BLOCK_SIZE];
+    uint stored_crc;
+
+    for (long offset = 0, block = 0; offset < decInfo->size_secret_file; offset += CRC_BLOCK_SIZE, block++)
     {
-        if (fread(image_buffer, sizeof(char), 8, decInfo->fptr_stego_image) != 8)
+        long block_len = decInfo->size_secret_file - offset;
+        if (block_len > CRC_BLOCK_SIZE)
+        {
+            block_len = CRC_BLOCK_SIZE;
+        }
+
+        // Extract the block and its checksum
+        if (carrier_extract(&decInfo->carrier, secret_block, block_len) != e_success ||
+            carrier_extract_be32(&decInfo->carrier, &stored_crc) != e_success)
         {
-            printf("ERROR: Failed to read 8 bytes from stego image.\n");
+            printf("ERROR: Failed to read block %ld from stego image.\n", block);
             return e_failure;
         }
 
-        if (decode_byte_from_lsb(&decoded_char, image_buffer) != e_success)
+        // Verify the block before any of it reaches the output file
+        uint block_crc = crc32c_update(0, secret_block, block_len);
+        if (block_crc != stored_crc)
         {
-            printf("ERROR: Failed to decode byte from LSB.\n");
+            printf("ERROR: Checksum mismatch in block %ld (payload bytes %ld-%ld).\n",
+                   block, offset, offset + block_len - 1);
             return e_failure;
         }
 
-        decInfo->file_extn[i] = decoded_char;
+        if (fwrite(secret_block, sizeof(char), block_len, decInfo->fptr_output) != (size_t)block_len)
+        {
+            printf("ERROR: Failed to write block %ld to output file.\n", block);
+            return e_failure;
+        }
     }
 
-    decInfo->file_extn[decInfo->extn_size] = '\0';  // Null-terminate the extension
     return e_success;
 }
 
-Status decode_secret_file_size(DecodeInfo *decInfo)
+Status check_secret_file_range(DecodeInfo *decInfo)
 {
-    char image_buffer[32];
-    int file_size;
+    unsigned long long size = decInfo->size_secret_file;
 
-    if (fread(image_buffer, sizeof(char), 32, decInfo->fptr_stego_image) != 32)
+    if (decInfo->range_offset > size)
     {
-        printf("ERROR: Failed to read 32 bytes from stego image.\n");
+        printf("ERROR: Offset %llu is past the end of the %llu byte payload.\n", decInfo->range_offset, size);
         return e_failure;
     }
+    if (decInfo->range_length == 0)
+    {
+        decInfo->range_length = size - decInfo->range_offset;
+    }
+    if (decInfo->range_length > size - decInfo->range_offset)
+    {
+        printf("ERROR: Range %llu+%llu runs past the end of the %llu byte payload.\n",
+               decInfo->range_offset, decInfo->range_length, size);
+        return e_failure;
+    }
+    return e_success;
+}
+
+/*
+ * Payload byte i is stored in block i / CRC_BLOCK_SIZE, after the
+ * checksums of all blocks before it, so its carriers are at a fixed
+ * position from the payload start. Only the blocks overlapping the
+ * range are read (and verified); the image is entered at the first one
+ * unless the carriers are there already. The last block read is kept,
+ * so ranges sharing a block (container entries back to back) never go
+ * back for it. The range goes to fptr, or to buf if fptr is NULL.
+ */
+Status decode_payload_range(DecodeInfo *decInfo, unsigned long long first, unsigned long long length,
+                            FILE *fptr, char *buf)
+{
+    uint stored_crc;
+    unsigned long long size = decInfo->size_secret_file;
+    unsigned long long end = first + length;
 
-    if (decode_size_from_lsb(&file_size, image_buffer) != e_success)
+    for (unsigned long long block = first / CRC_BLOCK_SIZE; first < end && block * CRC_BLOCK_SIZE < end; block++)
+    {
+        unsigned long long offset = block * CRC_BLOCK_SIZE;
+        unsigned long long block_len = size - offset;
+        if (block_len > CRC_BLOCK_SIZE)
+        {
+            block_len = CRC_BLOCK_SIZE;
+        }
+
+        if ((long long)block != decInfo->cached_block)
+        {
+            // Step 1: Jump to the carriers of the block unless they are next anyway
+            if (block != decInfo->next_block)
+            {
+                unsigned long long bit = (block * CRC_BLOCK_SIZE + block * CRC_SIZE) * 8;
+                if (carrier_seek_bit(&decInfo->carrier, decInfo->payload_pixel, bit) == e_failure)
+                {
+                    return e_failure;
+                }
+            }
+
+            // Step 2: Extract and verify the whole block, the checksum covers all of it
+            decInfo->cached_block = -1;
+            if (carrier_extract(&decInfo->carrier, decInfo->block_cache, block_len) != e_success ||
+                carrier_extract_be32(&decInfo->carrier, &stored_crc) != e_success)
+            {
+                printf("ERROR: Failed to read block %llu from stego image.\n", block);
+                return e_failure;
+            }
+            if (crc32c_update(0, decInfo->block_cache, block_len) != stored_crc)
+            {
+                printf("ERROR: Checksum mismatch in block %llu (payload bytes %llu-%llu).\n",
+                       block, offset, offset + block_len - 1);
+                return e_failure;
+            }
+            decInfo->cached_block = block;
+            decInfo->next_block = block + 1;
+        }
+
+        // Step 3: Hand over the part of the block inside the range
+        unsigned long long from = first > offset ? first - offset : 0;
+        unsigned long long to = end < offset + block_len ? end - offset : block_len;
+        if (fptr == NULL)
+        {
+            memcpy(buf, decInfo->block_cache + from, to - from);
+            buf += to - from;
+        }
+        else if (fwrite(decInfo->block_cache + from, sizeof(char), to - from, fptr) != to - from)
+        {
+            printf("ERROR: Failed to write block %llu to output file.\n", block);
+            return e_failure;
+        }
+    }
+
+    return e_success;
+}
+
+Status decode_secret_file_range(DecodeInfo *decInfo)
+{
+    return decode_payload_range(decInfo, decInfo->range_offset, decInfo->range_length, decInfo->fptr_output, NULL);
+}
+
+Status decode_container_index(DecodeInfo *decInfo)
+{
+    unsigned char head[CONTAINER_HEAD_SIZE];
+    uint count, index_size;
+
+    // Step 1: The entry count and the index size lead the payload
+    if (decInfo->size_secret_file < CONTAINER_HEAD_SIZE)
+    {
+        printf("ERROR: Container payload of %ld bytes has no index.\n", decInfo->size_secret_file);
+        return e_failure;
+    }
+    if (decode_payload_range(decInfo, 0, CONTAINER_HEAD_SIZE, NULL, (char *)head) == e_failure ||
+        container_read_head(head, decInfo->size_secret_file, &count, &index_size) == e_failure)
     {
-        printf("ERROR: Failed to decode secret file size.\n");
         return e_failure;
     }
 
-    decInfo->size_secret_file = file_size;
+    // Step 2: Read the rest of the index, none of the entries
+    unsigned char *index = malloc(index_size);
+    if (index == NULL)
+    {
+        printf("ERROR: Out of memory for the container index.\n");
+        return e_failure;
+    }
+    Status status = decode_payload_range(decInfo, 0, index_size, NULL, (char *)index);
+    if (status == e_success)
+    {
+        status = container_parse_index(&decInfo->container, index, index_size, decInfo->size_secret_file);
+    }
+    free(index);
+    return status;
+}
+
+Status list_container_entries(DecodeInfo *decInfo)
+{
+    const Container *c = &decInfo->container;
+
+    printf("Container holds %u entries (index of %u bytes):\n", c->count, c->index_size);
+    printf("%12s %12s  %s\n", "Offset", "Size", "Name");
+    for (uint i = 0; i < c->count; i++)
+    {
+        printf("%12u %12u  %s\n", c->entries[i].offset, c->entries[i].size, c->entries[i].name);
+    }
     return e_success;
 }
 
-Status decode_secret_file_data(DecodeInfo *decInfo)
+Status decode_container_entries(DecodeInfo *decInfo)
+{
+    const Container *c = &decInfo->container;
+    const ContainerEntry *first = c->entries;
+    const ContainerEntry *last = c->entries + c->count;
+    char path[4096];
+
+    // Step 1: Only the named entry, or all of them in payload order
+    if (decInfo->entry_name != NULL)
+    {
+        first = container_find(c, decInfo->entry_name);
+        if (first == NULL)
+        {
+            printf("ERROR: The container has no entry named %s.\n", decInfo->entry_name);
+            return e_failure;
+        }
+        last = first + 1;
+    }
+
+    // Step 2: Entries go into the directory named by the output name
+    if (mkdir(decInfo->output_fname, 0777) != 0 && errno != EEXIST)
+    {
+        perror("mkdir");
+        printf("ERROR: Unable to create directory %s\n", decInfo->output_fname);
+        return e_failure;
+    }
+
+    for (const ContainerEntry *entry = first; entry < last; entry++)
+    {
+        // Step 3: Decode the blocks the entry lies in straight into its file
+        if (snprintf(path, sizeof(path), "%s/%s", decInfo->output_fname, entry->name) >= (int)sizeof(path))
+        {
+            printf("ERROR: Output path for %s is too long.\n", entry->name);
+            return e_failure;
+        }
+        FILE *fptr = fopen(path, "w");
+        if (fptr == NULL)
+        {
+            perror("fopen");
+            printf("ERROR: Unable to open file %s\n", path);
+            return e_failure;
+        }
+        Status status = decode_payload_range(decInfo, entry->offset, entry->size, fptr, NULL);
+        if (fclose(fptr) != 0 || status == e_failure)
+        {
+            printf("ERROR: Failed to extract %s\n", path);
+            return e_failure;
+        }
+        printf("Extracted %s (%u bytes)\n", path, entry->size);
+    }
+
+    return e_success;
+}
+
+Status decode_legacy_magic_string(DecodeInfo *decInfo)
 {
     char image_buffer[8];
-    char decoded_byte;
+    char decoded_char;
 
-    for (long i = 0; i < decInfo->size_secret_file; i++)
+    // Step 1: Only BMP images had the legacy layout, read from the end of a 54 byte header
+    if (decInfo->carrier.image.codec != &bmp_codec || fseek(decInfo->fptr_stego_image, 54, SEEK_SET) != 0)
     {
-        if (fread(image_buffer, sizeof(char), 8, decInfo->fptr_stego_image) != 8)
+        return e_failure;
+    }
+
+    // Step 2: The magic string from the raw bytes, one character per 8 of them
+    for (int i = 0; MAGIC_STRING[i] != '\0'; i++)
+    {
+        if (fread(image_buffer, sizeof(char), 8, decInfo->fptr_stego_image) != 8 ||
+            decode_byte_from_lsb(&decoded_char, image_buffer) != e_success ||
+            decoded_char != decInfo->magic_str[i])
         {
-            printf("ERROR: Failed to read 8 bytes from stego image.\n");
             return e_failure;
         }
+    }
+    return e_success;
+}
 
-        if (decode_byte_from_lsb(&decoded_byte, image_buffer) != e_success)
+Status decode_legacy_payload(DecodeInfo *decInfo)
+{
+    char image_buffer[32];
+    char decoded_char;
+    int extn_size, file_size;
+
+    // Step 1: Options that need checksummed blocks or an index do not apply
+    if (decInfo->has_range || decInfo->list_entries || decInfo->entry_name != NULL)
+    {
+        printf("ERROR: The legacy layout holds a single file without checksums; --offset, --length, --list and --entry do not apply.\n");
+        return e_failure;
+    }
+
+    // Step 2: Extension size and extension, right behind the magic string
+    if (fread(image_buffer, sizeof(char), 32, decInfo->fptr_stego_image) != 32 ||
+        decode_size_from_lsb(&extn_size, image_buffer) != e_success ||
+        extn_size < 0 || extn_size >= (int)sizeof(decInfo->file_extn))
+    {
+        printf("ERROR: Failed to decode secret file extension size.\n");
+        return e_failure;
+    }
+    for (int i = 0; i < extn_size; i++)
+    {
+        if (fread(image_buffer, sizeof(char), 8, decInfo->fptr_stego_image) != 8 ||
+            decode_byte_from_lsb(&decoded_char, image_buffer) != e_success)
         {
-            printf("ERROR: Failed to decode byte from LSB.\n");
+            printf("ERROR: Failed to decode secret file extension.\n");
             return e_failure;
         }
+        decInfo->file_extn[i] = decoded_char;
+    }
+    decInfo->file_extn[extn_size] = '\0';
+    decInfo->extn_size = extn_size;
 
-        fputc(decoded_byte, decInfo->fptr_output);
+    // Step 3: The size, which has to fit the bytes left in the file
+    long data_start = ftell(decInfo->fptr_stego_image) + 32;
+    if (fread(image_buffer, sizeof(char), 32, decInfo->fptr_stego_image) != 32 ||
+        decode_size_from_lsb(&file_size, image_buffer) != e_success ||
+        fseek(decInfo->fptr_stego_image, 0, SEEK_END) != 0)
+    {
+        printf("ERROR: Failed to decode secret file size.\n");
+        return e_failure;
     }
+    if (file_size < 0 || (long long)file_size * 8 > ftell(decInfo->fptr_stego_image) - data_start)
+    {
+        printf("ERROR: Decoded secret file size %d exceeds the image capacity.\n", file_size);
+        return e_failure;
+    }
+    decInfo->size_secret_file = file_size;
 
+    // Step 4: The data, one byte per 8 file bytes
+    if (fseek(decInfo->fptr_stego_image, data_start, SEEK_SET) != 0 || open_output_file(decInfo) == e_failure)
+    {
+        printf("ERROR: Failed to open output file.\n");
+        return e_failure;
+    }
+    for (long i = 0; i < decInfo->size_secret_file; i++)
+    {
+        if (fread(image_buffer, sizeof(char), 8, decInfo->fptr_stego_image) != 8 ||
+            decode_byte_from_lsb(&decoded_char, image_buffer) != e_success)
+        {
+            printf("ERROR: Failed to decode secret file data.\n");
+            fclose(decInfo->fptr_output);
+            return e_failure;
+        }
+        fputc(decoded_char, decInfo->fptr_output);
+    }
+    if (fclose(decInfo->fptr_output) != 0)
+    {
+        printf("ERROR: Failed to write the output file %s\n", decInfo->output_fname);
+        return e_failure;
+    }
     return e_success;
 }
 
@@ -3,6 +3,10 @@
 
 #include <stdio.h>
 #include "types.h"
+#include "common.h"
+#include "carrier.h"
+#include "container.h"
+#include "stats.h"
 
 /* Structure to store decoding information */
 typedef struct _DecodeInfo
@@ -10,6 +14,7 @@ typedef struct _DecodeInfo
     /* Stego Image Info */
     char *stego_image_fname;
     FILE *fptr_stego_image;
+    CarrierStream carrier;    // Carrier bytes of the stego image
 
     /* Output File Info */
     char *output_fname;       // Name with or without extension
@@ -23,6 +28,36 @@ typedef struct _DecodeInfo
     char magic_str[10];    // For magic string
     int extn_size;        // For extension size
     char file_extn[10];   // To store the decoded file extension
+    uint channel_mask;    // Channels carrying the payload (from the mode word)
+    int is_matching;      // Embedded by LSB matching, read the same way
+    uint matrix_p;        // Payload bits per Hamming code block, 0 for one per carrier
+    unsigned long long payload_pixel;   // Pixel where the payload blocks start
+    int is_legacy;        // Written before the mode word: no checksums, bytes from offset 54 on
+
+    /* Byte range to extract (--offset=, --length=), whole payload if not set */
+    int has_range;
+    unsigned long long range_offset;
+    unsigned long long range_length;    // 0 until set: up to the end of the payload
+
+    /* Container payloads (MODE_CONTAINER): --list, --entry=<name> */
+    int is_container;
+    int list_entries;
+    const char *entry_name;             // Only this entry, all of them if NULL
+    Container container;
+
+    /* Last payload block read and verified, and the block the carriers are at */
+    char block_cache[CRC_BLOCK_SIZE];
+    long long cached_block;             // -1 if none
+    unsigned long long next_block;
+
+    /* Integrity checking */
+    uint header_crc;      // Running CRC32C over the decoded header fields
+
+    /* Per-phase counters (--stats=) */
+    Stats stats;
+
+    /* --direct-io: IMAGE_IO_DIRECT, pixel rows bypass the page cache */
+    uint io_flags;
 
 } DecodeInfo;
 
@@ -31,10 +66,20 @@ Status read_and_validate_decode_args(int argc, char *argv[], DecodeInfo *decInfo
 Status do_decoding(DecodeInfo *decInfo);
 Status decode_magic_string(DecodeInfo *decInfo);
 Status prompt_and_compare_magic_string(DecodeInfo *decInfo);  // New function
+Status decode_embed_mode(DecodeInfo *decInfo);
 Status decode_secret_file_extn_size(DecodeInfo *decInfo);
 Status decode_secret_file_extn(DecodeInfo *decInfo);
 Status decode_secret_file_size(DecodeInfo *decInfo);
+Status decode_header_crc(DecodeInfo *decInfo);
 Status decode_secret_file_data(DecodeInfo *decInfo);
+Status check_secret_file_range(DecodeInfo *decInfo);
+Status decode_secret_file_range(DecodeInfo *decInfo);
+Status decode_payload_range(DecodeInfo *decInfo, unsigned long long first, unsigned long long length, FILE *fptr, char *buf);
+Status decode_container_index(DecodeInfo *decInfo);
+Status list_container_entries(DecodeInfo *decInfo);
+Status decode_container_entries(DecodeInfo *decInfo);
+Status decode_legacy_magic_string(DecodeInfo *decInfo);
+Status decode_legacy_payload(DecodeInfo *decInfo);
 Status decode_byte_from_lsb(char *data, char *image_buffer);
 Status decode_size_from_lsb(int *data, char *image_buffer);
 Status open_output_file(DecodeInfo *decInfo);
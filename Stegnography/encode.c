@@ -1,33 +1,39 @@
 #include <stdio.h>
 #include<string.h>
+#include <stdlib.h>
 #include "encode.h"
 #include "types.h"
 #include "common.h"
+#include "crc32c.h"
+#include "image.h"
+#include "lsb.h"
 
 /* Function Definitions */
 
-/* Get image size
- * Input: Image file ptr
- * Output: width * height * bytes per pixel (3 in our case)
- * Description: In BMP Image, width is stored in offset 18, 
- * and height after that. size is 4 bytes
+/* Get image capacity
+ * Input: Image file ptr (BMP or PNG)
+ * Output: width * height * carrier bytes per pixel
+ * (3 for 24-bit, 3 for 32-bit as alpha is skipped, 1 for palettized)
+ * Description: The image codec reads width, height and
+ * pixel format from the BMP header or the PNG IHDR chunk
  */
 uint get_image_size_for_bmp(FILE *fptr_image)
 {
-    uint width, height;
-    // Seek to 18th byte
-    fseek(fptr_image, 18, SEEK_SET);//from 18th byte of an header file having width and heigth of the file
+    Image image;
 
-    // Read the width (an int)
-    fread(&width, sizeof(int), 1, fptr_image);
-    printf("width = %u\n", width);
-
-    // Read the height (an int)
-    fread(&height, sizeof(int), 1, fptr_image);
-    printf("height = %u\n", height);
+    // Read width, height and pixel format from the header
+    if (image_open(&image, fptr_image, NULL, 0, 0) == e_failure)
+    {
+        return 0;
+    }
+    image_close(&image);
+    printf("width = %u\n", image.width);
+    printf("height = %u\n", image.height);
+    printf("format = %s %s\n", image.codec->name, pixel_format_name(image.format));
 
     // Return image capacity
-    return width * height * 3;
+    const PixelView *view = pixel_view(image.format, pixel_default_mask(image.format));
+    return image.width * image.height * view->carriers_per_pixel;
 }
 
 /* 
@@ -39,8 +45,11 @@ uint get_image_size_for_bmp(FILE *fptr_image)
  */
 Status open_files(EncodeInfo *encInfo)
 {
-    // Src Image file
-    encInfo->fptr_src_image = fopen(encInfo->src_image_fname, "r");
+    // Src Image file (batch mode hands it over already read into memory)
+    if (encInfo->fptr_src_image == NULL)
+    {
+        encInfo->fptr_src_image = fopen(encInfo->src_image_fname, "r");
+    }
     // Do Error handling
     if (encInfo->fptr_src_image == NULL)
     {
@@ -50,10 +59,21 @@ Status open_files(EncodeInfo *encInfo)
     	return e_failure;
     }
 
+    // Container entries are opened one after the other while encoding
+    if (encInfo->n_entries > 0)
+    {
+        if (container_create(&encInfo->container, encInfo->entry_fnames, encInfo->n_entries) == e_failure)
+        {
+            return e_failure;
+        }
+    }
     // Secret file
-    encInfo->fptr_secret = fopen(encInfo->secret_fname, "r");
+    else
+    {
+        encInfo->fptr_secret = fopen(encInfo->secret_fname, "r");
+    }
     // Do Error handling
-    if (encInfo->fptr_secret == NULL)
+    if (encInfo->n_entries == 0 && encInfo->fptr_secret == NULL)
     {
     	perror("fopen");
     	fprintf(stderr, "ERROR: Unable to open file %s\n", encInfo->secret_fname);
@@ -78,25 +98,130 @@ Status open_files(EncodeInfo *encInfo)
 
 Status read_and_validate_encode_args(int argc, char *argv[], EncodeInfo *encInfo)
 {
+    // Step 0: Take --options out so the checks below only see file names
+    static char *args[6];
+    int nargs = 0;
+
+    encInfo->channel_names = NULL;
+    encInfo->match_passphrase = NULL;
+    encInfo->matrix_p = 0;
+    encInfo->compression_level = DEFAULT_PNG_LEVEL;
+    encInfo->fptr_src_image = NULL;
+    encInfo->fptr_secret = NULL;
+    encInfo->n_entries = 0;
+    encInfo->io_flags = 0;
+    stats_start(&encInfo->stats, e_stats_off);
+    int container = 0;
+    for (int i = 0; i < argc; i++)
+    {
+        if (i >= 2 && strncmp(argv[i], "--", 2) == 0)
+        {
+            if (strncmp(argv[i], "--channels=", 11) == 0)
+            {
+                encInfo->channel_names = argv[i] + 11;
+            }
+            else if (strncmp(argv[i], "--png-level=", 12) == 0)
+            {
+                char *end;
+                long level = strtol(argv[i] + 12, &end, 10);
+                if (end == argv[i] + 12 || *end != '\0' || level < 0 || level > 9)
+                {
+                    printf("ERROR: PNG level must be 0 (store) to 9 (smallest).\n");
+                    return e_failure;
+                }
+                encInfo->compression_level = (int)level;
+            }
+            else if (strncmp(argv[i], "--match=", 8) == 0)
+            {
+                if (argv[i][8] == '\0')
+                {
+                    printf("ERROR: --match needs a key.\n");
+                    return e_failure;
+                }
+                encInfo->match_passphrase = argv[i] + 8;
+            }
+            else if (strncmp(argv[i], "--matrix=", 9) == 0)
+            {
+                char *end;
+                long p = strtol(argv[i] + 9, &end, 10);
+                if (end == argv[i] + 9 || *end != '\0' || p < 2 || p > CARRIER_MAX_MATRIX)
+                {
+                    printf("ERROR: Matrix embedding takes 2 to %d bits per code block.\n", CARRIER_MAX_MATRIX);
+                    return e_failure;
+                }
+                encInfo->matrix_p = (uint)p;
+            }
+            else if (strcmp(argv[i], "--container") == 0)
+            {
+                container = 1;
+            }
+            else if (strncmp(argv[i], "--add=", 6) == 0)
+            {
+                // Slot 0 is kept for the secret file itself
+                if (encInfo->n_entries + 1 >= MAX_CONTAINER_FILES)
+                {
+                    printf("ERROR: A container holds at most %d files.\n", MAX_CONTAINER_FILES);
+                    return e_failure;
+                }
+                encInfo->entry_fnames[++encInfo->n_entries] = argv[i] + 6;
+                container = 1;
+            }
+            else if (strcmp(argv[i], "--stats") == 0 || strncmp(argv[i], "--stats=", 8) == 0)
+            {
+                StatsFormat format;
+                if (stats_parse_format(argv[i][7] == '=' ? argv[i] + 8 : NULL, &format) == e_failure)
+                {
+                    return e_failure;
+                }
+                stats_start(&encInfo->stats, format);
+            }
+            else if (strcmp(argv[i], "--direct-io") == 0)
+            {
+                encInfo->io_flags |= IMAGE_IO_DIRECT;
+            }
+            else
+            {
+                printf("ERROR: Unknown option %s\n", argv[i]);
+                return e_failure;
+            }
+        }
+        else
+        {
+            // Keep counting past the end so Step 1 still sees too many names
+            if (nargs < 5)
+            {
+                args[nargs] = argv[i];
+            }
+            nargs++;
+        }
+    }
+    if (nargs < 6)
+    {
+        args[nargs] = NULL;
+    }
+    argv = args;
+    argc = nargs;
+
     // Step 1: Check if the total number of arguments is NOT 5
     if (argc >= 6)
     {
         // Invalid number of arguments
-        printf("ERROR: Invalid number of arguments. Usage: <Program Name> -e <Source Image> <Secret File> <Stego Image>\n");
+        printf("ERROR: Invalid number of arguments. Usage: <Program Name> -e <Source Image> <Secret File> <Stego Image> [--channels=bgr] [--png-level=6] [--match=<Key>] [--matrix=<2-8>] [--container] [--add=<File>]... [--stats[=json]] [--direct-io]\n");
         return e_failure;
     }
 
-    // Step 2: Check if the source image file is not a BMP file
-    if (!strstr(argv[2], ".bmp"))
+    // Step 2: Check if the source image file is not a BMP or PNG file
+    const ImageCodec *codec = image_codec_for_name(argv[2]);
+    if (codec == NULL)
     { 
-        printf("ERROR: Source image must be a BMP file.\n");
+        printf("ERROR: Source image must be a BMP or PNG file.\n");
         return e_failure;
     }
     // Store source image filename
     encInfo->src_image_fname = argv[2];
 
     // Step 3: Check if the secret file is not a file
-    if (!strstr(argv[3], "."))
+    if (argv[3] == NULL)
     {
         printf("ERROR: Secret file must be a file.\n");
         return e_failure;
@@ -104,17 +229,49 @@ Status read_and_validate_encode_args(int argc, char *argv[], EncodeInfo *encInfo
     // Store secret file filename
     encInfo->secret_fname = argv[3];
 
+    // Step 3a: A container stores every file under its own name, a single
+    // file only keeps its extension (the part of the name from the first '.')
+    if (container)
+    {
+        encInfo->entry_fnames[0] = argv[3];
+        encInfo->n_entries++;
+        encInfo->extn_secret_file[0] = '\0';
+    }
+    else
+    {
+        const char *base = strrchr(argv[3], '/') ? strrchr(argv[3], '/') + 1 : argv[3];
+        const char *extn = strchr(base, '.');
+        if (extn == NULL)
+        {
+            printf("ERROR: Secret file must be a file.\n");
+            return e_failure;
+        }
+        if (strlen(extn) >= MAX_FILE_SUFFIX)
+        {
+            printf("ERROR: Extension %s is too long (at most %d characters), use --container to keep the full name.\n",
+                   extn, MAX_FILE_SUFFIX - 1);
+            return e_failure;
+        }
+        strcpy(encInfo->extn_secret_file, extn);
+    }
+
     // Step 4: Handle stego image filename
     if (argv[4] == NULL || strlen(argv[4]) == 0)
     {
-        // If argv[4] is NULL or empty, assign default filename "stego.bmp"
-        strcpy(encInfo->stego_image_fname, "stego.bmp");
-        printf("INFO: No stego image filename provided, using default: stego.bmp\n");
+        // If argv[4] is NULL or empty, assign default filename "stego" + source extension
+        strcpy(encInfo->stego_image_fname, "stego");
+        strcat(encInfo->stego_image_fname, codec->extension);
+        printf("INFO: No stego image filename provided, using default: %s\n", encInfo->stego_image_fname);
     }
-    else if (!strstr(argv[4], ".bmp"))
+    else if (image_codec_for_name(argv[4]) != codec)
     {
-        // Check if the stego image file is not a BMP file
-        printf("ERROR: Stego image must be a BMP file.\n");
+        // The stego image keeps the container type of the source
+        printf("ERROR: Stego image must be a %s file like the source image.\n", codec->name);
+        return e_failure;
+    }
+    else if (strlen(argv[4]) >= sizeof(encInfo->stego_image_fname))
+    {
+        printf("ERROR: Stego image filename is too long.\n");
         return e_failure;
     }
     else
@@ -130,6 +287,7 @@ Status read_and_validate_encode_args(int argc, char *argv[], EncodeInfo *encInfo
 Status do_encoding(EncodeInfo *encInfo)
 {
     // Step 1: Open the files (source image, secret file, stego image)
+    stats_phase(&encInfo->stats, e_phase_open);
     Status open_status = open_files(encInfo);
     if (open_status == e_failure)
     {
@@ -139,6 +297,7 @@ Status do_encoding(EncodeInfo *encInfo)
     }
 
     // Step 2: Check if the source image has enough capacity to store the secret
+    stats_phase(&encInfo->stats, e_phase_capacity);
     Status capacity_status = check_capacity(encInfo);
     if (capacity_status == e_failure)
     {
@@ -147,16 +306,23 @@ Status do_encoding(EncodeInfo *encInfo)
         return e_failure;
     }
 
-    // Step 3: Copy the BMP header from the source image to the stego image
-    Status copy_bmp_status = copy_bmp_header(encInfo->fptr_src_image, encInfo->fptr_stego_image);
-    if (copy_bmp_status == e_failure)
+    // Step 3: Copy the image header to the stego image and start streaming carrier bytes
+    stats_phase(&encInfo->stats, e_phase_header);
+    if (carrier_open(&encInfo->carrier, encInfo->fptr_src_image, encInfo->fptr_stego_image,
+                     encInfo->compression_level, encInfo->io_flags) == e_failure)
     {
-        // If the BMP header is not copied
-        printf("ERROR: Failed to copy the BMP header to stego image.\n");
+        printf("ERROR: Failed to copy the image header to stego image.\n");
         return e_failure;
     }
+    if (encInfo->match_passphrase != NULL)
+    {
+        encInfo->carrier.matching = 1;
+        encInfo->carrier.match_key = lsb_match_key(encInfo->match_passphrase);
+    }
 
-    // Step 4: Encode the magic string
+    // Step 4: Encode the magic string (header checksum starts here)
+    stats_phase(&encInfo->stats, e_phase_magic);
+    encInfo->header_crc = 0;
     Status magic_string_status = encode_magic_string("#*", encInfo);
     if (magic_string_status == e_failure)
     {
@@ -165,7 +331,29 @@ Status do_encoding(EncodeInfo *encInfo)
         return e_failure;
     }
 
+    // Step 4a: Encode the embedding mode (channels carrying the payload)
+    stats_phase(&encInfo->stats, e_phase_mode);
+    uint mode = encInfo->channel_mask & MODE_CHANNEL_MASK;
+    if (encInfo->n_entries > 0)
+    {
+        mode |= MODE_CONTAINER;
+    }
+    if (encInfo->carrier.matching)
+    {
+        mode |= MODE_MATCHING;
+    }
+    mode |= encInfo->matrix_p << MODE_MATRIX_SHIFT;
+    mode |= (uint)FORMAT_VERSION << MODE_VERSION_SHIFT;
+    Status mode_status = encode_embed_mode(mode, encInfo);
+    if (mode_status == e_failure)
+    {
+        // If the mode word is not encoded properly
+        printf("ERROR: Failed to encode the embedding mode.\n");
+        return e_failure;
+    }
+
     // Step 5: Encode the secret file extension size
+    stats_phase(&encInfo->stats, e_phase_extn);
     Status extn_size_status = encode_secret_file_extn_size(strlen(encInfo->extn_secret_file), encInfo);
     if (extn_size_status == e_failure)
     {
@@ -184,7 +372,8 @@ Status do_encoding(EncodeInfo *encInfo)
     }
 
     // Step 7: Encode the size of the secret file
-    Status secret_size_status = encode_secret_file_size(get_file_size(encInfo->fptr_secret), encInfo);
+    stats_phase(&encInfo->stats, e_phase_size);
+    Status secret_size_status = encode_secret_file_size(encInfo->size_secret_file, encInfo);
     if (secret_size_status == e_failure)
     {
         // If the secret file size is not encoded properly
@@ -192,7 +381,18 @@ Status do_encoding(EncodeInfo *encInfo)
         return e_failure;
     }
 
-    // Step 8: Encode the secret file data
+    // Step 8: Encode the checksum of all header fields
+    stats_phase(&encInfo->stats, e_phase_checksum);
+    Status header_crc_status = encode_header_crc(encInfo);
+    if (header_crc_status == e_failure)
+    {
+        // If the header checksum is not encoded properly
+        printf("ERROR: Failed to encode the header checksum.\n");
+        return e_failure;
+    }
+
+    // Step 9: Encode the secret file data (with per-block checksums)
+    stats_phase(&encInfo->stats, e_phase_data);
     Status secret_data_status = encode_secret_file_data(encInfo);
     if (secret_data_status == e_failure)
     {
@@ -201,14 +401,20 @@ Status do_encoding(EncodeInfo *encInfo)
         return e_failure;
     }
 
-    // Step 9: Copy remaining data from source image to stego image
-    Status remaining_data_status = copy_remaining_img_data(encInfo->fptr_src_image, encInfo->fptr_stego_image);
+    // Step 10: Copy remaining data from source image to stego image
+    stats_phase(&encInfo->stats, e_phase_tail);
+    Status remaining_data_status = carrier_close(&encInfo->carrier);
     if (remaining_data_status == e_failure)
     {
         // If the remaining data is not copied properly
         printf("ERROR: Failed to copy the remaining data from source to stego image.\n");
         return e_failure;
     }
+    if (fflush(encInfo->fptr_stego_image) != 0)
+    {
+        printf("ERROR: Failed to write the stego image.\n");
+        return e_failure;
+    }
 
     // Return success if all encoding steps are completed successfully
     return e_success;
@@ -234,67 +440,94 @@ Status check_capacity(EncodeInfo *encInfo)
     // Step 1: Calculate the estimated size required for encoding
     
     // Get the length of the magic string and multiply by 8 (1 byte = 8 bits)
-    int estimated_size = strlen(MAGIC_STRING) * 8; // Magic string size in bits (e.g., "#x")
-    printf("Size of magic string (in bits): %d\n", estimated_size);
+    unsigned long long header_bits = strlen(MAGIC_STRING) * 8; // Magic string size in bits (e.g., "#x")
+    printf("Size of magic string (in bits): %llu\n", header_bits);
 
-    // Step 2: Add the size required for the file extension (e.g., ".txt")
-    // Extract the file extension from the secret file
-    strcpy(encInfo->extn_secret_file, strstr(encInfo->secret_fname, "."));
+    // Step 1a: Add the embedding mode word (32 bits)
+    header_bits += MODE_SIZE * 8;
+
+    // Step 2: Add the size required for the file extension (e.g., ".txt", none for a container)
     int extension_size = (strlen(encInfo->extn_secret_file) * 8) + (sizeof(int) * 8); // File extension size in bits + 4 bytes for length
-    estimated_size += extension_size;
+    header_bits += extension_size;
     printf("Size of file extension (in bits): %d\n", extension_size);
 
     // Step 3: Add the size required to store the secret file size (32 bits)
-    int secret_file_size_bits = sizeof(encInfo->size_secret_file) * 8; // File size stored in 4 bytes (32 bits)
-    estimated_size += secret_file_size_bits;
+    int secret_file_size_bits = sizeof(int) * 8; // File size stored in 4 bytes (32 bits)
+    header_bits += secret_file_size_bits;
     printf("Size to store secret file size (in bits): %d\n", secret_file_size_bits);
 
+    // Step 3a: Add the header checksum (32 bits)
+    header_bits += CRC_SIZE * 8;
+
     // Step 4: Add the size of the secret file data (in bits)
-    encInfo->size_secret_file = get_file_size(encInfo->fptr_secret); // Get the secret file size in bytes
-    int secret_data_size = encInfo->size_secret_file * 8; // Convert file size to bits
-    estimated_size += secret_data_size;
-    printf("Size of secret file data (in bits): %d\n", secret_data_size);
-    printf("Size of estimated size (in bits): %d\n", estimated_size);
-
-    // Step 5: Get the size of the BMP image minus the 54-byte header
-    encInfo->image_capacity = (get_image_size_for_bmp(encInfo->fptr_src_image) - 54) * 8; // BMP image capacity excluding header in bits
-    printf("Available image capacity (in bits): %u\n", encInfo->image_capacity);
+    if (encInfo->n_entries > 0)
+    {
+        encInfo->size_secret_file = encInfo->container.total_size; // Index and all entries
+        printf("Container of %u files, index of %u bytes\n", encInfo->n_entries, encInfo->container.index_size);
+    }
+    else
+    {
+        encInfo->size_secret_file = get_file_size(encInfo->fptr_secret); // Get the secret file size in bytes
+    }
+    unsigned long long payload_bits = (unsigned long long)encInfo->size_secret_file * 8; // Convert file size to bits
+    printf("Size of secret file data (in bits): %llu\n", payload_bits);
 
-    // Step 6: Compare the estimated size with the image capacity
-    if (estimated_size > encInfo->image_capacity)
+    // Step 4a: Add one CRC32C per payload block
+    unsigned long long block_count = (encInfo->size_secret_file + CRC_BLOCK_SIZE - 1) / CRC_BLOCK_SIZE;
+    payload_bits += block_count * CRC_SIZE * 8;
+    printf("Size of block checksums (in bits): %llu\n", block_count * CRC_SIZE * 8);
+    printf("Size of estimated size (in bits): %llu\n", header_bits + payload_bits);
+
+    // Step 5: Get the pixel format and resolve the payload channels
+    Image image;
+    if (get_image_size_for_bmp(encInfo->fptr_src_image) == 0 ||
+        image_open(&image, encInfo->fptr_src_image, NULL, 0, 0) == e_failure)
     {
-        printf("ERROR: The source image does not have enough capacity to hold the secret data.\n");
         return e_failure;
     }
+    image_close(&image);
+    encInfo->bits_per_pixel = pixel_bytes_per_pixel(image.format) * 8;
 
-    // If the image has enough capacity, return success
-    return e_success;
-}
-
-Status copy_bmp_header(FILE *src_image, FILE *stego_image)
-{
-    // Step 1: Move file pointers to the start (position 0) of both files
-    fseek(src_image, 0L, SEEK_SET);  // Move to the beginning of the source image
-    fseek(stego_image, 0L, SEEK_SET);  // Move to the beginning of the stego image
+    uint header_mask = pixel_default_mask(image.format);
+    encInfo->channel_mask = header_mask;
+    if (encInfo->channel_names != NULL &&
+        pixel_parse_channels(image.format, encInfo->channel_names, &encInfo->channel_mask) == e_failure)
+    {
+        return e_failure;
+    }
 
-    // Step 2: Create a buffer to hold the BMP header (54 bytes)
-    char header[54];
+    // Step 6: The header always uses the default channels, the payload starts
+    // at the next whole pixel and uses the selected ones
+    uint header_cpp = pixel_view(image.format, header_mask)->carriers_per_pixel;
+    uint payload_cpp = pixel_view(image.format, encInfo->channel_mask)->carriers_per_pixel;
+    unsigned long long pixels = (unsigned long long)image.width * image.height;
+    unsigned long long header_pixels = (header_bits + header_cpp - 1) / header_cpp;
+    unsigned long long payload_capacity = carrier_capacity_bits(image.width, image.height, payload_cpp,
+                                                                encInfo->matrix_p, header_pixels);
 
-    // Step 3: Read 54 bytes (BMP header) from the source BMP file
-    if (fread(header, 54, 1, src_image) != 1)
+    encInfo->image_capacity = pixels * payload_cpp; // One bit per carrier byte
+    printf("Available image capacity (in bits): %u\n", encInfo->image_capacity);
+    if (encInfo->matrix_p != 0)
     {
-        printf("ERROR: Failed to read BMP header from the source image.\n");
-        return e_failure;
+        // Step 6a: Matrix embedding puts p bits in every code block of 2^p - 1 carriers that fits a row
+        printf("Code blocks needed: %llu of %llu (%u bits per %u carriers)\n",
+               (payload_bits + encInfo->matrix_p - 1) / encInfo->matrix_p, payload_capacity / encInfo->matrix_p,
+               encInfo->matrix_p, (1u << encInfo->matrix_p) - 1);
+    }
+    else
+    {
+        printf("Pixels needed: %llu of %llu (%u payload carriers per pixel)\n",
+               header_pixels + (payload_bits + payload_cpp - 1) / payload_cpp, pixels, payload_cpp);
     }
 
-    // Step 4: Write the BMP header into the stego BMP file
-    if (fwrite(header, 54, 1, stego_image) != 1)
+    // Step 7: Compare the payload with what fits behind the header
+    if (header_pixels > pixels || payload_bits > payload_capacity)
     {
-        printf("ERROR: Failed to write BMP header to the stego image.\n");
+        printf("ERROR: The source image does not have enough capacity to hold the secret data.\n");
         return e_failure;
     }
 
-    // Step 5: Successful header copy
+    // If the image has enough capacity, return success
     return e_success;
 }
 
@@ -349,31 +582,18 @@ Status encode_size_to_lsb(int data, char *image_buffer) {
 
 Status encode_magic_string(const char *magic_string, EncodeInfo *encInfo)
 {
-    char image_buffer[8];
-
     // Step 1: Loop through each character in the magic string
     for (int i = 0; magic_string[i] != '\0'; i++)
     {
-        // Step 2: Read 8 bytes from the source image
-        if (fread(image_buffer, sizeof(char), 8, encInfo->fptr_src_image) != 8)
-        {
-            printf("ERROR: Failed to read 8 bytes from source image during encoding.\n");
-            return e_failure;
-        }
-
-        // Step 3: Encode the current byte of the magic string into the LSB of the image buffer
-        if (encode_byte_to_lsb(magic_string[i], image_buffer) != e_success)
+        // Step 2: Encode the current byte of the magic string into the LSBs of the next 8 carriers
+        if (carrier_embed(&encInfo->carrier, &magic_string[i], 1) != e_success)
         {
             printf("ERROR: Failed to encode byte to LSB during encoding.\n");
             return e_failure;
         }
 
-        // Step 4: Write the modified 8 bytes to the stego image file
-        if (fwrite(image_buffer, sizeof(char), 8, encInfo->fptr_stego_image) != 8)
-        {
-            printf("ERROR: Failed to write 8 bytes to stego image during encoding.\n");
-            return e_failure;
-        }
+        // Step 3: Add the character to the header checksum
+        encInfo->header_crc = crc32c_update(encInfo->header_crc, &magic_string[i], 1);
 
         // Log the encoded character
         printf("Encoded character '%c' into LSBs.\n", magic_string[i]);
@@ -383,170 +603,139 @@ Status encode_magic_string(const char *magic_string, EncodeInfo *encInfo)
     return e_success;
 }
 
-
-Status encode_secret_file_extn_size(int file_size, EncodeInfo *encInfo)
+Status encode_embed_mode(uint mode, EncodeInfo *encInfo)
 {
-    // Step 1: Create a buffer to hold 8 bytes of data from the source image
-    char image_buffer[32];  // Allocate 32 bytes to hold 32 bits
-
-    // Step 2: Find the file extension from the secret file name
-    strcpy(encInfo->extn_secret_file, strstr(encInfo->secret_fname, "."));
-    
-    // Step 3: Calculate the size of the file extension
-    int extn_size = strlen(encInfo->extn_secret_file);
-
-    // Step 4: Read 32 bytes from the source image
-    if (fread(image_buffer, sizeof(char), 32, encInfo->fptr_src_image) != 32)
+    // Step 1: Encode the mode word into the next 32 carriers
+    if (carrier_embed_be32(&encInfo->carrier, mode) != e_success)
     {
-        printf("ERROR: Failed to read 32 bytes from source image.\n");
+        printf("ERROR: Failed to encode embedding mode to LSB.\n");
         return e_failure;
     }
 
-    // Step 5: Encode the file extension size (int) into the 32 least significant bits
-    if (encode_size_to_lsb(extn_size, image_buffer) != e_success)
+    // Step 2: Add the mode to the header checksum
+    encInfo->header_crc = crc32c_update_be32(encInfo->header_crc, mode);
+
+    printf("Encoded embedding mode 0x%08X.\n", mode);
+    return e_success;
+}
+
+
+Status encode_secret_file_extn_size(int extn_size, EncodeInfo *encInfo)
+{
+    // Step 1: Encode the file extension size (int) into the next 32 carriers
+    // (the extension was taken from the secret file name during validation)
+    if (carrier_embed_be32(&encInfo->carrier, extn_size) != e_success)
     {
         printf("ERROR: Failed to encode extension size to LSB.\n");
         return e_failure;
     }
 
-    // Step 6: Write the modified 32 bytes back to the stego image
-    if (fwrite(image_buffer, sizeof(char), 32, encInfo->fptr_stego_image) != 32)
-    {
-        printf("ERROR: Failed to write 32 bytes to stego image.\n");
-        return e_failure;
-    }
+    // Step 2: Add the extension size to the header checksum
+    encInfo->header_crc = crc32c_update_be32(encInfo->header_crc, extn_size);
 
-    // Step 7: Return success after encoding the file extension size
+    // Step 3: Return success after encoding the file extension size
     return e_success;
 }
 
 Status encode_secret_file_extn(const char *file_extn, EncodeInfo *encInfo) {
-     // Step 1: Create a buffer to hold 8 bytes of data from the source image
-     char image_buffer[8];
-
-     // Step 2: Loop through each character in the magic string
+     // Step 1: Loop through each character of the extension
      for (int i = 0; file_extn[i] != '\0'; i++)
      {
-         // Step 3: Read 8 bytes from the source image
-         if (fread(image_buffer, sizeof(char), 8, encInfo->fptr_src_image) != 8)
-         {
-             printf("ERROR: Failed to read 8 bytes from source image.\n");
-             return e_failure;
-         }
- 
-         // Step 4: Encode the current byte of the magic string into the LSB of the image buffer
-         if (encode_byte_to_lsb(file_extn[i], image_buffer) != e_success)
+         // Step 2: Encode the current character into the LSBs of the next 8 carriers
+         if (carrier_embed(&encInfo->carrier, &file_extn[i], 1) != e_success)
          {
              printf("ERROR: Failed to encode byte to LSB.\n");
              return e_failure;
          }
- 
-         // Step 5: Write the modified 8 bytes to the stego image file
-         if (fwrite(image_buffer, sizeof(char), 8, encInfo->fptr_stego_image) != 8)
-         {
-             printf("ERROR: Failed to write 8 bytes to stego image.\n");
-             return e_failure;
-         }
+
+         // Step 3: Add the character to the header checksum
+         encInfo->header_crc = crc32c_update(encInfo->header_crc, &file_extn[i], 1);
      }
  
-     // Step 6: Return success after encoding the entire magic string
+     // Step 4: Return success after encoding the entire extension
      return e_success;
 }
 
 Status encode_secret_file_size(long file_size, EncodeInfo *encInfo)
 {
-    // Step 1: Create a buffer to hold 32 bytes of data from the source image
-    char image_buffer[32];
-
     // Convert the file size from long to int (typically 4 bytes)
     int file_size_as_int = (int) file_size;  // Assuming file size fits into 32 bits
 
-    // Step 2: Read 32 bytes from the source image (enough for 32 bits encoding)
-    if (fread(image_buffer, sizeof(char), 32, encInfo->fptr_src_image) != 32)
+    // Step 1: Encode the file size (32 bits) into the next 32 carriers
+    if (carrier_embed_be32(&encInfo->carrier, file_size_as_int) != e_success)
     {
-        printf("ERROR: Failed to read 32 bytes from source image.\n");
+        printf("ERROR: Failed to encode file size to LSB.\n");
         return e_failure;
     }
 
-    // Step 3: Encode the file size (32 bits) into the least significant bits (LSBs) of the image buffer
-    if (encode_size_to_lsb(file_size_as_int, image_buffer) != e_success)
+    // Step 2: Add the file size to the header checksum
+    encInfo->header_crc = crc32c_update_be32(encInfo->header_crc, file_size_as_int);
+
+    // Step 3: Return success after encoding the file size
+    return e_success;
+}
+
+Status encode_header_crc(EncodeInfo *encInfo)
+{
+    // Step 1: Encode the checksum of all header fields into the next 32 carriers
+    if (carrier_embed_be32(&encInfo->carrier, encInfo->header_crc) != e_success)
     {
-        printf("ERROR: Failed to encode file size to LSB.\n");
+        printf("ERROR: Failed to encode header checksum to LSB.\n");
         return e_failure;
     }
 
-    // Step 4: Write the modified 32 bytes back to the stego image
-    if (fwrite(image_buffer, sizeof(char), 32, encInfo->fptr_stego_image) != 32)
+    // Step 2: The payload goes into the selected channels from the next pixel on
+    if (carrier_set_mask(&encInfo->carrier, encInfo->channel_mask) == e_failure)
     {
-        printf("ERROR: Failed to write 32 bytes to stego image.\n");
         return e_failure;
     }
-
-    // Step 5: Return success after encoding the file size
-    return e_success;
+    return carrier_set_matrix(&encInfo->carrier, encInfo->matrix_p);
 }
 
 
 Status encode_secret_file_data(EncodeInfo *encInfo)
 {
-    // Step 1: Create buffers for reading the image and storing the secret file data
-    char image_buffer[8];  // To store 8 bytes of image data at a time
-    char secret_byte;      // To store one byte of secret file data
+    // Step 1: Create a buffer for one block of secret data
+    char secret_block[CRC_BLOCK_SIZE];
 
-    // Step 2: Get the size of the secret file using the helper function
-    uint secret_file_size = get_file_size(encInfo->fptr_secret);  // Get the size of the secret file in bytes
+    // Step 2: Get the payload size worked out by the capacity check
+    uint secret_file_size = encInfo->size_secret_file;
 
-    // Step 3: Loop over each byte of the secret file
-    for (uint i = 0; i < secret_file_size; i++)
+    // Step 3: Loop over the secret file one block at a time
+    for (uint offset = 0; offset < secret_file_size; offset += CRC_BLOCK_SIZE)
     {
-        // Step 4: Read a byte from the secret file
-        if (fread(&secret_byte, sizeof(char), 1, encInfo->fptr_secret) != 1)
+        uint block_len = secret_file_size - offset;
+        if (block_len > CRC_BLOCK_SIZE)
         {
-            printf("ERROR: Failed to read a byte from secret file.\n");
-            return e_failure;
+            block_len = CRC_BLOCK_SIZE;
         }
 
-        // Step 5: Read 8 bytes from the source image
-        if (fread(image_buffer, sizeof(char), 8, encInfo->fptr_src_image) != 8)
+        // Step 4: Read the block from the secret file (or the container index and entries)
+        if (encInfo->n_entries > 0 ? container_read(&encInfo->container, secret_block, block_len) == e_failure :
+            fread(secret_block, sizeof(char), block_len, encInfo->fptr_secret) != block_len)
         {
-            printf("ERROR: Failed to read 8 bytes from source image.\n");
+            printf("ERROR: Failed to read a block from secret file.\n");
             return e_failure;
         }
 
-        // Step 6: Encode the secret file byte into the LSBs of the 8 bytes from the image
-        if (encode_byte_to_lsb(secret_byte, image_buffer) != e_success)
-        {
-            printf("ERROR: Failed to encode byte to LSB.\n");
-            return e_failure;
-        }
+        // Step 5: Checksum the block while it is still in cache
+        uint block_crc = crc32c_update(0, secret_block, block_len);
 
-        // Step 7: Write the modified 8 bytes to the stego image file
-        if (fwrite(image_buffer, sizeof(char), 8, encInfo->fptr_stego_image) != 8)
+        // Step 6: Encode the block into the LSBs of the next 8 * block_len carriers
+        if (carrier_embed(&encInfo->carrier, secret_block, block_len) != e_success)
         {
-            printf("ERROR: Failed to write 8 bytes to stego image.\n");
+            printf("ERROR: Failed to encode block at offset %u.\n", offset);
             return e_failure;
         }
-    }
 
-    // Step 8: Return success after encoding all the secret file data
-    return e_success;
-}
-
-// Function to copy the remaining data from src_image to stego_image
-Status copy_remaining_img_data(FILE *fptr_src_image, FILE *fptr_stego_image)
-{
-    char buffer[1024];
-    size_t bytes_read;
-
-    // Loop to copy data from the source image to the stego image
-    while ((bytes_read = fread(buffer, sizeof(char), sizeof(buffer), fptr_src_image)) > 0)
-    {
-        if (fwrite(buffer, sizeof(char), bytes_read, fptr_stego_image) != bytes_read)
+        // Step 7: Encode the block checksum right after the block
+        if (carrier_embed_be32(&encInfo->carrier, block_crc) != e_success)
         {
-            printf("ERROR: Failed to write remaining data to stego image.\n");
+            printf("ERROR: Failed to encode checksum of block at offset %u.\n", offset);
             return e_failure;
         }
     }
 
+    // Step 8: Return success after encoding all the secret file data
     return e_success;
 }
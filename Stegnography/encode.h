@@ -1,8 +1,12 @@
 #ifndef ENCODE_H
 #define ENCODE_H
 
+#include <stdio.h>
 #include "types.h" // Contains user defined types
 #include "common.h"
+#include "carrier.h"
+#include "container.h"
+#include "stats.h"
 /* 
  * Structure to store information required for
  * encoding secret file to source Image
@@ -12,7 +16,9 @@
 
 #define MAX_SECRET_BUF_SIZE 1
 #define MAX_IMAGE_BUF_SIZE (MAX_SECRET_BUF_SIZE * 8)
-#define MAX_FILE_SUFFIX 4
+#define MAX_FILE_SUFFIX 10
+#define MAX_CONTAINER_FILES 1024
+#define DEFAULT_PNG_LEVEL 6
 
 typedef struct _EncodeInfo
 {
@@ -22,6 +28,18 @@ typedef struct _EncodeInfo
     uint image_capacity;
     uint bits_per_pixel;
     char image_data[MAX_IMAGE_BUF_SIZE];
+    CarrierStream carrier;      // Carrier bytes of src, written through to stego
+    int compression_level;      // --png-level=, 0 (store) to 9 (smallest)
+
+    /* Channels carrying the payload */
+    const char *channel_names;  // --channels= value, NULL for the default
+    uint channel_mask;
+
+    /* --match=: passphrase keying LSB matching, NULL for LSB replacement */
+    const char *match_passphrase;
+
+    /* --matrix=: payload bits per Hamming code block of 2^p - 1 carriers, 0 for one per carrier */
+    uint matrix_p;
 
     /* Secret File Info */
     char *secret_fname;
@@ -30,10 +48,24 @@ typedef struct _EncodeInfo
     char secret_data[MAX_SECRET_BUF_SIZE];
     long size_secret_file;
 
+    /* Container payload (--container, --add=): the secret file and the added ones */
+    char *entry_fnames[MAX_CONTAINER_FILES];
+    uint n_entries;             // 0 for a plain single-file payload
+    Container container;
+
     /* Stego Image Info */
     char stego_image_fname[20];
     FILE *fptr_stego_image;
 
+    /* Running CRC32C over the encoded header fields */
+    uint header_crc;
+
+    /* Per-phase counters (--stats=) */
+    Stats stats;
+
+    /* --direct-io: IMAGE_IO_DIRECT, pixel rows bypass the page cache */
+    uint io_flags;
+
 } EncodeInfo;
 
 
@@ -54,20 +86,20 @@ Status open_files(EncodeInfo *encInfo);
 /* check capacity */
 Status check_capacity(EncodeInfo *encInfo);
 
-/* Get image size */
+/* Get image capacity in carrier bytes */
 uint get_image_size_for_bmp(FILE *fptr_image);
 
 /* Get file size */
 uint get_file_size(FILE *fptr);
 
-/* Copy bmp image header */
-Status copy_bmp_header(FILE *fptr_src_image, FILE *fptr_dest_image);
-
 /* Store Magic String */
 Status encode_magic_string(const char *magic_string, EncodeInfo *encInfo);
 
+/* Encode the embedding mode word */
+Status encode_embed_mode(uint mode, EncodeInfo *encInfo);
+
 /* Encode secret file extention size*/
-Status encode_secret_file_extn_size(int file_size, EncodeInfo *encInfo); 
+Status encode_secret_file_extn_size(int extn_size, EncodeInfo *encInfo); 
 
 /* Encode secret file extenstion */
 Status encode_secret_file_extn(const char *file_extn, EncodeInfo *encInfo);
@@ -75,6 +107,9 @@ Status encode_secret_file_extn(const char *file_extn, EncodeInfo *encInfo);
 /* Encode secret file size */
 Status encode_secret_file_size(long file_size, EncodeInfo *encInfo);
 
+/* Encode CRC32C of the header fields */
+Status encode_header_crc(EncodeInfo *encInfo);
+
 /* Encode a size into LSB of image data array */
 Status encode_size_to_lsb(int data, char *image_buffer);
 
@@ -87,7 +122,4 @@ Status encode_data_to_image(char *data, int size, FILE *fptr_src_image, FILE *fp
 /* Encode a byte into LSB of image data array */
 Status encode_byte_to_lsb(char data, char *image_buffer);
 
-/* Copy remaining image bytes from src to stego image after encoding */
-Status copy_remaining_img_data(FILE *fptr_src_image, FILE *fptr_stego_image);
-
 #endif
@@ -0,0 +1,1151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flate.h"
+
+#define FLATE_WMASK (FLATE_WSIZE - 1)
+#define FLATE_MIN_MATCH 3
+#define FLATE_MAX_MATCH 258
+
+/* Deflate buffer: window history, one block of new input, match lookahead */
+#define DEFL_BLOCK 65536
+#define DEFL_CAP (FLATE_WSIZE + DEFL_BLOCK + FLATE_MAX_MATCH)
+#define DEFL_HASH_BITS 15
+#define DEFL_HASH_SIZE (1 << DEFL_HASH_BITS)
+
+/* Length and distance code tables (RFC 1951 section 3.2.5) */
+static const uint16_t len_base[29] =
+{
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const unsigned char len_extra[29] =
+{
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t dist_base[30] =
+{
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const unsigned char dist_extra[30] =
+{
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+/* Order of code length code lengths in a dynamic block header */
+static const unsigned char clen_order[19] =
+{
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+/* Reverse the low n bits of code (Huffman codes are sent MSB first) */
+static uint flate_reverse(uint code, int n)
+{
+    uint rev = 0;
+    for (int i = 0; i < n; i++)
+    {
+        rev = (rev << 1) | (code & 1);
+        code >>= 1;
+    }
+    return rev;
+}
+
+/* Code lengths of the fixed Huffman block */
+static void flate_fixed_lengths(unsigned char *lit, unsigned char *dist)
+{
+    int i;
+    for (i = 0; i < 144; i++) lit[i] = 8;
+    for (; i < 256; i++) lit[i] = 9;
+    for (; i < 280; i++) lit[i] = 7;
+    for (; i < 288; i++) lit[i] = 8;
+    for (i = 0; i < 30; i++) dist[i] = 5;
+}
+
+/* ---------------------------------------------------------------- */
+/* Inflate                                                          */
+/* ---------------------------------------------------------------- */
+
+static Status huff_build(FlateHuffman *h, const unsigned char *lengths, int n)
+{
+    uint16_t offs[16];
+    uint next_code[16];
+    int left = 1;
+
+    // Step 1: Count codes per length and reject over-subscribed sets
+    memset(h->count, 0, sizeof(h->count));
+    for (int sym = 0; sym < n; sym++)
+    {
+        h->count[lengths[sym]]++;
+    }
+    h->count[0] = 0;
+    for (int len = 1; len < 16; len++)
+    {
+        left = (left << 1) - h->count[len];
+        if (left < 0)
+        {
+            return e_failure;
+        }
+    }
+
+    // Step 2: Symbols sorted by code (length, then value)
+    offs[1] = 0;
+    for (int len = 1; len < 15; len++)
+    {
+        offs[len + 1] = offs[len] + h->count[len];
+    }
+    for (int sym = 0; sym < n; sym++)
+    {
+        if (lengths[sym] != 0)
+        {
+            h->symbol[offs[lengths[sym]]++] = sym;
+        }
+    }
+
+    // Step 3: One-lookup table for short codes, indexed by the next bits as read
+    memset(h->fast, 0, sizeof(h->fast));
+    uint code = 0;
+    for (int len = 1; len < 16; len++)
+    {
+        code = (code + h->count[len - 1]) << 1;
+        next_code[len] = code;
+    }
+    for (int sym = 0; sym < n; sym++)
+    {
+        int len = lengths[sym];
+        if (len == 0)
+        {
+            continue;
+        }
+        uint c = next_code[len]++;
+        if (len <= FLATE_FAST_BITS)
+        {
+            for (uint j = flate_reverse(c, len); j < (1u << FLATE_FAST_BITS); j += 1u << len)
+            {
+                h->fast[j] = (uint16_t)((len << 9) | sym);
+            }
+        }
+    }
+
+    return e_success;
+}
+
+/* Top up the bit buffer to at least n bits if input allows */
+static void inf_fill(Inflate *s, int n)
+{
+    while (s->bitcnt < n)
+    {
+        if (s->in_pos == s->in_len)
+        {
+            s->in_len = s->read(s->ctx, s->in, sizeof(s->in));
+            s->in_pos = 0;
+            if (s->in_len == 0)
+            {
+                return;
+            }
+        }
+        s->bitbuf |= (uint64_t)s->in[s->in_pos++] << s->bitcnt;
+        s->bitcnt += 8;
+    }
+}
+
+static Status inf_bits(Inflate *s, int n, uint *value)
+{
+    inf_fill(s, n);
+    if (s->bitcnt < n)
+    {
+        printf("ERROR: Compressed image data is truncated.\n");
+        return e_failure;
+    }
+    *value = (uint)(s->bitbuf & ((1ULL << n) - 1));
+    s->bitbuf >>= n;
+    s->bitcnt -= n;
+    return e_success;
+}
+
+/* Decode one Huffman symbol, -1 on error */
+static int inf_decode(Inflate *s, const FlateHuffman *h)
+{
+    inf_fill(s, 15);
+
+    // Fast path: one table lookup
+    uint entry = h->fast[s->bitbuf & ((1u << FLATE_FAST_BITS) - 1)];
+    if (entry != 0)
+    {
+        int len = entry >> 9;
+        if (len > s->bitcnt)
+        {
+            return -1;
+        }
+        s->bitbuf >>= len;
+        s->bitcnt -= len;
+        return entry & 0x1FF;
+    }
+
+    // Slow path: walk the canonical code one bit at a time
+    int code = 0, first = 0, index = 0;
+    for (int len = 1; len < 16 && len <= s->bitcnt; len++)
+    {
+        code |= (int)((s->bitbuf >> (len - 1)) & 1);
+        int count = h->count[len];
+        if (code - count < first)
+        {
+            s->bitbuf >>= len;
+            s->bitcnt -= len;
+            return h->symbol[index + (code - first)];
+        }
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+
+    return -1;
+}
+
+/* Read the code lengths of a dynamic block and build its tables */
+static Status inf_dynamic_tables(Inflate *s)
+{
+    unsigned char lengths[320];
+    uint hlit, hdist, hclen, value;
+
+    if (inf_bits(s, 5, &hlit) == e_failure || inf_bits(s, 5, &hdist) == e_failure ||
+        inf_bits(s, 4, &hclen) == e_failure)
+    {
+        return e_failure;
+    }
+    hlit += 257;
+    hdist += 1;
+    hclen += 4;
+
+    // Step 1: Code length code
+    memset(lengths, 0, 19);
+    for (uint i = 0; i < hclen; i++)
+    {
+        if (inf_bits(s, 3, &value) == e_failure)
+        {
+            return e_failure;
+        }
+        lengths[clen_order[i]] = value;
+    }
+    if (huff_build(&s->lencode, lengths, 19) == e_failure)
+    {
+        return e_failure;
+    }
+
+    // Step 2: Literal/length and distance code lengths, run-length coded
+    for (uint i = 0; i < hlit + hdist;)
+    {
+        int sym = inf_decode(s, &s->lencode);
+        uint repeat, fill = 0;
+
+        if (sym < 0)
+        {
+            return e_failure;
+        }
+        if (sym < 16)
+        {
+            lengths[i++] = sym;
+            continue;
+        }
+        if (sym == 16)
+        {
+            if (i == 0 || inf_bits(s, 2, &repeat) == e_failure)
+            {
+                return e_failure;
+            }
+            fill = lengths[i - 1];
+            repeat += 3;
+        }
+        else if (sym == 17)
+        {
+            if (inf_bits(s, 3, &repeat) == e_failure)
+            {
+                return e_failure;
+            }
+            repeat += 3;
+        }
+        else
+        {
+            if (inf_bits(s, 7, &repeat) == e_failure)
+            {
+                return e_failure;
+            }
+            repeat += 11;
+        }
+        if (i + repeat > hlit + hdist)
+        {
+            return e_failure;
+        }
+        while (repeat--)
+        {
+            lengths[i++] = fill;
+        }
+    }
+
+    if (lengths[256] == 0 ||
+        huff_build(&s->lencode, lengths, hlit) == e_failure ||
+        huff_build(&s->distcode, lengths + hlit, hdist) == e_failure)
+    {
+        return e_failure;
+    }
+
+    return e_success;
+}
+
+static Status inf_block_header(Inflate *s)
+{
+    uint value;
+
+    if (s->final_block)
+    {
+        printf("ERROR: Compressed image data ends early.\n");
+        return e_failure;
+    }
+    if (inf_bits(s, 1, &value) == e_failure)
+    {
+        return e_failure;
+    }
+    s->final_block = value;
+    if (inf_bits(s, 2, &value) == e_failure)
+    {
+        return e_failure;
+    }
+    s->block_type = value;
+
+    if (s->block_type == 0)
+    {
+        // Stored: skip to a byte boundary, then LEN and its complement
+        uint len, nlen;
+        s->bitbuf >>= s->bitcnt & 7;
+        s->bitcnt -= s->bitcnt & 7;
+        if (inf_bits(s, 16, &len) == e_failure || inf_bits(s, 16, &nlen) == e_failure ||
+            len != (~nlen & 0xFFFF))
+        {
+            printf("ERROR: Corrupt stored block in compressed image data.\n");
+            return e_failure;
+        }
+        s->stored_left = len;
+    }
+    else if (s->block_type == 1)
+    {
+        unsigned char lit[288], dist[30];
+        flate_fixed_lengths(lit, dist);
+        huff_build(&s->lencode, lit, 288);
+        huff_build(&s->distcode, dist, 30);
+    }
+    else if (s->block_type == 2)
+    {
+        if (inf_dynamic_tables(s) == e_failure)
+        {
+            printf("ERROR: Corrupt Huffman tables in compressed image data.\n");
+            return e_failure;
+        }
+    }
+    else
+    {
+        printf("ERROR: Invalid block type in compressed image data.\n");
+        return e_failure;
+    }
+
+    s->in_block = 1;
+    return e_success;
+}
+
+Status inflate_init(Inflate *inf, FlateReadFn read, void *ctx)
+{
+    uint cmf, flg;
+
+    memset(inf, 0, offsetof(Inflate, window));
+    inf->read = read;
+    inf->ctx = ctx;
+    inf->total_out = 0;
+    inf->in_block = 0;
+    inf->final_block = 0;
+    inf->stored_left = 0;
+    inf->copy_len = 0;
+
+    // zlib header: deflate method, 32K window, no preset dictionary
+    if (inf_bits(inf, 8, &cmf) == e_failure || inf_bits(inf, 8, &flg) == e_failure ||
+        (cmf & 0x0F) != 8 || (cmf >> 4) > 7 || (flg & 0x20) || ((cmf << 8) | flg) % 31 != 0)
+    {
+        printf("ERROR: Image data is not a valid zlib stream.\n");
+        return e_failure;
+    }
+
+    return e_success;
+}
+
+Status inflate_read(Inflate *s, unsigned char *out, size_t len)
+{
+    size_t done = 0;
+
+    while (done < len)
+    {
+        // Pending back reference
+        if (s->copy_len > 0)
+        {
+            size_t n = len - done < s->copy_len ? len - done : s->copy_len;
+            for (size_t i = 0; i < n; i++)
+            {
+                unsigned char b = s->window[(s->total_out - s->copy_dist) & FLATE_WMASK];
+                s->window[s->total_out & FLATE_WMASK] = b;
+                s->total_out++;
+                out[done++] = b;
+            }
+            s->copy_len -= n;
+            continue;
+        }
+
+        if (!s->in_block)
+        {
+            if (inf_block_header(s) == e_failure)
+            {
+                return e_failure;
+            }
+            continue;
+        }
+
+        // Stored block bytes
+        if (s->block_type == 0)
+        {
+            uint b;
+            if (s->stored_left == 0)
+            {
+                s->in_block = 0;
+                continue;
+            }
+            if (inf_bits(s, 8, &b) == e_failure)
+            {
+                return e_failure;
+            }
+            s->window[s->total_out & FLATE_WMASK] = b;
+            s->total_out++;
+            out[done++] = b;
+            s->stored_left--;
+            continue;
+        }
+
+        // Huffman coded symbol
+        int sym = inf_decode(s, &s->lencode);
+        if (sym < 0)
+        {
+            printf("ERROR: Corrupt compressed image data.\n");
+            return e_failure;
+        }
+        if (sym < 256)
+        {
+            s->window[s->total_out & FLATE_WMASK] = sym;
+            s->total_out++;
+            out[done++] = sym;
+        }
+        else if (sym == 256)
+        {
+            s->in_block = 0;
+        }
+        else
+        {
+            uint extra, dist;
+            sym -= 257;
+            if (sym >= 29 || inf_bits(s, len_extra[sym], &extra) == e_failure)
+            {
+                printf("ERROR: Corrupt compressed image data.\n");
+                return e_failure;
+            }
+            s->copy_len = len_base[sym] + extra;
+
+            int dsym = inf_decode(s, &s->distcode);
+            if (dsym < 0 || dsym >= 30 || inf_bits(s, dist_extra[dsym], &extra) == e_failure)
+            {
+                printf("ERROR: Corrupt compressed image data.\n");
+                return e_failure;
+            }
+            dist = dist_base[dsym] + extra;
+            if (dist > s->total_out || dist > FLATE_WSIZE)
+            {
+                printf("ERROR: Compressed image data refers before its start.\n");
+                return e_failure;
+            }
+            s->copy_dist = dist;
+        }
+    }
+
+    return e_success;
+}
+
+/* ---------------------------------------------------------------- */
+/* Deflate                                                          */
+/* ---------------------------------------------------------------- */
+
+/* Length (3..258) to length symbol index 0..28, distance to code 0..29 */
+static unsigned char len_code[FLATE_MAX_MATCH + 1];
+static unsigned char dist_code_small[513];     // dist 1..512
+static unsigned char dist_code_large[128];     // (dist - 1) >> 8 for dist > 512
+
+static void defl_init_tables(void)
+{
+    static int done;
+    if (done)
+    {
+        return;
+    }
+    for (int code = 0; code < 29; code++)
+    {
+        for (int len = len_base[code]; len < len_base[code] + (1 << len_extra[code]) && len <= FLATE_MAX_MATCH; len++)
+        {
+            len_code[len] = code;
+        }
+    }
+    len_code[FLATE_MAX_MATCH] = 28;
+    for (int code = 0; code < 30; code++)
+    {
+        for (int dist = dist_base[code]; dist < dist_base[code] + (1 << dist_extra[code]); dist++)
+        {
+            if (dist <= 512)
+            {
+                dist_code_small[dist] = code;
+            }
+            else
+            {
+                dist_code_large[(dist - 1) >> 8] = code;
+            }
+        }
+    }
+    done = 1;
+}
+
+static int defl_dist_code(uint dist)
+{
+    return dist <= 512 ? dist_code_small[dist] : dist_code_large[(dist - 1) >> 8];
+}
+
+/* Flush whole bytes of the bit buffer to the output buffer, and that to the callback */
+static void defl_flush_out(Deflate *d, int force)
+{
+    if (d->out_len > 0 && (force || d->out_len >= sizeof(d->out) - 16))
+    {
+        if (d->status == e_success && d->write(d->ctx, d->out, d->out_len) == e_failure)
+        {
+            d->status = e_failure;
+        }
+        d->out_len = 0;
+    }
+}
+
+static void defl_bits(Deflate *d, uint value, int n)
+{
+    d->bitbuf |= (uint64_t)value << d->bitcnt;
+    d->bitcnt += n;
+    while (d->bitcnt >= 8)
+    {
+        d->out[d->out_len++] = (unsigned char)d->bitbuf;
+        d->bitbuf >>= 8;
+        d->bitcnt -= 8;
+    }
+    defl_flush_out(d, 0);
+}
+
+static void defl_align(Deflate *d)
+{
+    if (d->bitcnt > 0)
+    {
+        defl_bits(d, 0, 8 - d->bitcnt);
+    }
+}
+
+/*
+ * Huffman code lengths limited to max_bits for n symbols.
+ * Symbols with zero frequency get length 0.
+ */
+static void defl_huff_lengths(const uint *freq, int n, int max_bits, unsigned char *lengths)
+{
+    int sorted[320], parent[640], depth[640];
+    uint weight[640];
+    int count[64];
+    int used = 0;
+
+    memset(lengths, 0, n);
+
+    // Step 1: Used symbols in ascending frequency
+    for (int i = 0; i < n; i++)
+    {
+        if (freq[i] != 0)
+        {
+            int j = used++;
+            while (j > 0 && freq[sorted[j - 1]] > freq[i])
+            {
+                sorted[j] = sorted[j - 1];
+                j--;
+            }
+            sorted[j] = i;
+        }
+    }
+    if (used == 0)
+    {
+        return;
+    }
+    if (used == 1)
+    {
+        // Pair the lone symbol with a dummy so the code stays complete
+        lengths[sorted[0]] = 1;
+        lengths[sorted[0] == 0 ? 1 : 0] = 1;
+        return;
+    }
+
+    // Step 2: Build the tree with two queues (leaves, then internal nodes in creation order)
+    for (int i = 0; i < used; i++)
+    {
+        weight[i] = freq[sorted[i]];
+    }
+    int leaf = 0, node = used, next_node = used;
+    while (next_node < 2 * used - 1)
+    {
+        int pick[2];
+        for (int k = 0; k < 2; k++)
+        {
+            if (leaf < used && (node >= next_node || weight[leaf] <= weight[node]))
+            {
+                pick[k] = leaf++;
+            }
+            else
+            {
+                pick[k] = node++;
+            }
+        }
+        weight[next_node] = weight[pick[0]] + weight[pick[1]];
+        parent[pick[0]] = parent[pick[1]] = next_node;
+        next_node++;
+    }
+
+    // Step 3: Depths from the root down
+    memset(count, 0, sizeof(count));
+    depth[2 * used - 2] = 0;
+    for (int i = 2 * used - 3; i >= 0; i--)
+    {
+        depth[i] = depth[parent[i]] + 1;
+    }
+    for (int i = 0; i < used; i++)
+    {
+        count[depth[i] < 63 ? depth[i] : 63]++;
+    }
+
+    // Step 4: Fold codes that are too long, then repair the Kraft sum
+    uint total = 0;
+    for (int i = max_bits + 1; i < 64; i++)
+    {
+        count[max_bits] += count[i];
+        count[i] = 0;
+    }
+    for (int i = max_bits; i > 0; i--)
+    {
+        total += (uint)count[i] << (max_bits - i);
+    }
+    while (total != (1u << max_bits))
+    {
+        count[max_bits]--;
+        for (int i = max_bits - 1; i > 0; i--)
+        {
+            if (count[i] != 0)
+            {
+                count[i]--;
+                count[i + 1] += 2;
+                break;
+            }
+        }
+        total--;
+    }
+
+    // Step 5: Shortest codes to the most frequent symbols
+    for (int len = 1, j = used; len <= max_bits; len++)
+    {
+        for (int k = count[len]; k > 0; k--)
+        {
+            lengths[sorted[--j]] = len;
+        }
+    }
+}
+
+/* Canonical codes (bit-reversed for sending) from lengths */
+static void defl_huff_codes(const unsigned char *lengths, int n, uint16_t *codes)
+{
+    uint count[16] = { 0 }, next_code[16];
+    uint code = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+        count[lengths[i]]++;
+    }
+    count[0] = 0;
+    for (int len = 1; len < 16; len++)
+    {
+        code = (code + count[len - 1]) << 1;
+        next_code[len] = code;
+    }
+    for (int i = 0; i < n; i++)
+    {
+        codes[i] = lengths[i] ? (uint16_t)flate_reverse(next_code[lengths[i]]++, lengths[i]) : 0;
+    }
+}
+
+/* Run-length code the lit+dist code lengths for a dynamic header */
+static int defl_rle_lengths(const unsigned char *lengths, int n, uint16_t *rle)
+{
+    int out = 0;
+
+    for (int i = 0; i < n;)
+    {
+        int run = 1;
+        while (i + run < n && lengths[i + run] == lengths[i])
+        {
+            run++;
+        }
+
+        if (lengths[i] == 0 && run >= 3)
+        {
+            int r = run > 138 ? 138 : run;
+            rle[out++] = r <= 10 ? (17 | ((r - 3) << 8)) : (18 | ((r - 11) << 8));
+            i += r;
+        }
+        else if (lengths[i] != 0 && run >= 4)
+        {
+            int r = run - 1 > 6 ? 6 : run - 1;
+            rle[out++] = lengths[i];
+            rle[out++] = 16 | ((r - 3) << 8);
+            i += r + 1;
+        }
+        else
+        {
+            rle[out++] = lengths[i];
+            i++;
+        }
+    }
+
+    return out;
+}
+
+/* Emit the symbols of the current block, stored bytes are [start, end) */
+static void defl_emit_block(Deflate *d, size_t start, size_t end, int final)
+{
+    uint lit_freq[286] = { 0 }, dist_freq[30] = { 0 }, clen_freq[19] = { 0 };
+    unsigned char lit_len[286], dist_len[30], clen_len[19];
+    unsigned char fixed_lit[288], fixed_dist[30];
+    uint16_t lit_codes[288], dist_codes[30], clen_codes[19];
+    unsigned char all_len[316];
+    uint16_t rle[316];
+
+    // Step 1: Symbol statistics
+    for (size_t i = 0; i < d->nsym; i++)
+    {
+        if (d->sym_dist[i] == 0)
+        {
+            lit_freq[d->sym_litlen[i]]++;
+        }
+        else
+        {
+            lit_freq[257 + len_code[d->sym_litlen[i]]]++;
+            dist_freq[defl_dist_code(d->sym_dist[i])]++;
+        }
+    }
+    lit_freq[256] = 1;
+
+    // Step 2: Dynamic code and its header
+    defl_huff_lengths(lit_freq, 286, 15, lit_len);
+    defl_huff_lengths(dist_freq, 30, 15, dist_len);
+    int hlit = 286, hdist = 30, hclen = 19;
+    while (hlit > 257 && lit_len[hlit - 1] == 0) hlit--;
+    while (hdist > 1 && dist_len[hdist - 1] == 0) hdist--;
+    if (dist_len[0] == 0 && hdist == 1)
+    {
+        dist_len[0] = 1;    // At least one distance code must be sent
+    }
+    memcpy(all_len, lit_len, hlit);
+    memcpy(all_len + hlit, dist_len, hdist);
+    int nrle = defl_rle_lengths(all_len, hlit + hdist, rle);
+    for (int i = 0; i < nrle; i++)
+    {
+        clen_freq[rle[i] & 0xFF]++;
+    }
+    defl_huff_lengths(clen_freq, 19, 7, clen_len);
+    while (hclen > 4 && clen_len[clen_order[hclen - 1]] == 0) hclen--;
+
+    // Step 3: Cost of dynamic, fixed and stored encodings
+    flate_fixed_lengths(fixed_lit, fixed_dist);
+    unsigned long long dyn_bits = 3 + 5 + 5 + 4 + 3 * hclen;
+    unsigned long long fix_bits = 3;
+    for (int i = 0; i < nrle; i++)
+    {
+        int sym = rle[i] & 0xFF;
+        dyn_bits += clen_len[sym] + (sym == 16 ? 2 : sym == 17 ? 3 : sym == 18 ? 7 : 0);
+    }
+    for (int i = 0; i < 286; i++)
+    {
+        uint extra = i >= 257 ? len_extra[i - 257] : 0;
+        dyn_bits += (unsigned long long)lit_freq[i] * (lit_len[i] + extra);
+        fix_bits += (unsigned long long)lit_freq[i] * (fixed_lit[i] + extra);
+    }
+    for (int i = 0; i < 30; i++)
+    {
+        dyn_bits += (unsigned long long)dist_freq[i] * (dist_len[i] + dist_extra[i]);
+        fix_bits += (unsigned long long)dist_freq[i] * (fixed_dist[i] + dist_extra[i]);
+    }
+    size_t raw = end - start;
+    unsigned long long stored_bits = (raw + 5 * ((raw + 65534) / 65535 + 1)) * 8;
+
+    // Step 4: Stored blocks when compression does not pay (or at level 0)
+    if (d->level == 0 || (stored_bits <= dyn_bits && stored_bits <= fix_bits))
+    {
+        do
+        {
+            size_t n = end - start > 65535 ? 65535 : end - start;
+            int last = final && start + n == end;
+            defl_bits(d, last, 1);
+            defl_bits(d, 0, 2);
+            defl_align(d);
+            defl_bits(d, n & 0xFFFF, 16);
+            defl_bits(d, ~n & 0xFFFF, 16);
+            for (size_t i = 0; i < n; i++)
+            {
+                defl_bits(d, d->buf[start + i], 8);
+            }
+            start += n;
+        } while (start < end);
+        return;
+    }
+
+    // Step 5: Huffman coded block header
+    defl_bits(d, final, 1);
+    if (fix_bits <= dyn_bits)
+    {
+        defl_bits(d, 1, 2);
+        defl_huff_codes(fixed_lit, 288, lit_codes);
+        defl_huff_codes(fixed_dist, 30, dist_codes);
+        memcpy(lit_len, fixed_lit, 286);
+        memcpy(dist_len, fixed_dist, 30);
+    }
+    else
+    {
+        defl_bits(d, 2, 2);
+        defl_bits(d, hlit - 257, 5);
+        defl_bits(d, hdist - 1, 5);
+        defl_bits(d, hclen - 4, 4);
+        for (int i = 0; i < hclen; i++)
+        {
+            defl_bits(d, clen_len[clen_order[i]], 3);
+        }
+        defl_huff_codes(clen_len, 19, clen_codes);
+        for (int i = 0; i < nrle; i++)
+        {
+            int sym = rle[i] & 0xFF;
+            defl_bits(d, clen_codes[sym], clen_len[sym]);
+            if (sym == 16) defl_bits(d, rle[i] >> 8, 2);
+            if (sym == 17) defl_bits(d, rle[i] >> 8, 3);
+            if (sym == 18) defl_bits(d, rle[i] >> 8, 7);
+        }
+        defl_huff_codes(lit_len, 286, lit_codes);
+        defl_huff_codes(dist_len, 30, dist_codes);
+    }
+
+    // Step 6: The symbols and end of block
+    for (size_t i = 0; i < d->nsym; i++)
+    {
+        if (d->sym_dist[i] == 0)
+        {
+            int lit = d->sym_litlen[i];
+            defl_bits(d, lit_codes[lit], lit_len[lit]);
+        }
+        else
+        {
+            uint len = d->sym_litlen[i], dist = d->sym_dist[i];
+            int lc = len_code[len], dc = defl_dist_code(dist);
+            defl_bits(d, lit_codes[257 + lc], lit_len[257 + lc]);
+            defl_bits(d, len - len_base[lc], len_extra[lc]);
+            defl_bits(d, dist_codes[dc], dist_len[dc]);
+            defl_bits(d, dist - dist_base[dc], dist_extra[dc]);
+        }
+    }
+    defl_bits(d, lit_codes[256], lit_len[256]);
+}
+
+static uint defl_hash(const unsigned char *p)
+{
+    return ((p[0] << 10) ^ (p[1] << 5) ^ p[2]) & (DEFL_HASH_SIZE - 1);
+}
+
+/* Add position p to the hash chains */
+static void defl_insert(Deflate *d, size_t p)
+{
+    if (p + FLATE_MIN_MATCH <= d->buf_len)
+    {
+        uint h = defl_hash(d->buf + p);
+        d->prev[p & FLATE_WMASK] = d->head[h];
+        d->head[h] = (int)p;
+    }
+}
+
+/* Longest match for position p that does not read past limit */
+static uint defl_longest_match(Deflate *d, size_t p, size_t limit, uint *dist)
+{
+    uint best = 0;
+    size_t max_len = limit - p < FLATE_MAX_MATCH ? limit - p : FLATE_MAX_MATCH;
+    int chain = d->max_chain;
+
+    if (max_len < FLATE_MIN_MATCH)
+    {
+        return 0;
+    }
+
+    const unsigned char *cur = d->buf + p;
+    int cand = d->head[defl_hash(cur)];
+    while (cand >= 0 && chain-- > 0)
+    {
+        size_t back = p - (size_t)cand;
+        if (back == 0 || back > FLATE_WSIZE)
+        {
+            break;
+        }
+        const unsigned char *m = d->buf + cand;
+        if (m[best] == cur[best] && m[0] == cur[0])
+        {
+            uint len = 0;
+            while (len < max_len && m[len] == cur[len])
+            {
+                len++;
+            }
+            if (len > best)
+            {
+                best = len;
+                *dist = (uint)back;
+                if (len == max_len)
+                {
+                    break;
+                }
+            }
+        }
+        int next = d->prev[cand & FLATE_WMASK];
+        if (next >= cand)
+        {
+            break;
+        }
+        cand = next;
+    }
+
+    return best >= FLATE_MIN_MATCH ? best : 0;
+}
+
+static void defl_literal(Deflate *d, unsigned char c)
+{
+    d->sym_litlen[d->nsym] = c;
+    d->sym_dist[d->nsym] = 0;
+    d->nsym++;
+}
+
+static void defl_match(Deflate *d, uint len, uint dist)
+{
+    d->sym_litlen[d->nsym] = len;
+    d->sym_dist[d->nsym] = dist;
+    d->nsym++;
+}
+
+/* LZ77 parse of [buf_pos, end) with matches allowed up to limit, then emit */
+static void defl_compress(Deflate *d, size_t end, size_t limit, int final)
+{
+    size_t start = d->buf_pos, p = d->buf_pos;
+    d->nsym = 0;
+
+    if (d->level > 0)
+    {
+        uint prev_len = 0, prev_dist = 0, dist = 0;
+        int pending = 0;
+
+        while (p < end)
+        {
+            uint len = defl_longest_match(d, p, limit, &dist);
+            defl_insert(d, p);
+
+            if (!d->lazy)
+            {
+                if (len > 0)
+                {
+                    defl_match(d, len, dist);
+                    // Fast levels skip hashing inside long matches
+                    for (size_t q = p + 1; q < p + len && len <= 16; q++)
+                    {
+                        defl_insert(d, q);
+                    }
+                    p += len;
+                }
+                else
+                {
+                    defl_literal(d, d->buf[p]);
+                    p++;
+                }
+                continue;
+            }
+
+            // Lazy: emit the previous match unless this position has a longer one
+            if (pending && prev_len > 0 && len <= prev_len)
+            {
+                defl_match(d, prev_len, prev_dist);
+                for (size_t q = p + 1; q < p - 1 + prev_len; q++)
+                {
+                    defl_insert(d, q);
+                }
+                p = p - 1 + prev_len;
+                pending = 0;
+                prev_len = 0;
+                continue;
+            }
+            if (pending)
+            {
+                defl_literal(d, d->buf[p - 1]);
+            }
+            pending = 1;
+            prev_len = len;
+            prev_dist = dist;
+            p++;
+        }
+        if (pending)
+        {
+            defl_literal(d, d->buf[p - 1]);
+        }
+    }
+    else
+    {
+        p = end;
+    }
+
+    defl_emit_block(d, start, p, final);
+    d->buf_pos = p;
+}
+
+/* Drop history older than one window and rebase the hash chains */
+static void defl_slide(Deflate *d)
+{
+    if (d->buf_pos <= FLATE_WSIZE)
+    {
+        return;
+    }
+
+    size_t delta = d->buf_pos - FLATE_WSIZE;
+    memmove(d->buf, d->buf + delta, d->buf_len - delta);
+    d->buf_len -= delta;
+    d->buf_pos -= delta;
+
+    for (int i = 0; i < DEFL_HASH_SIZE; i++)
+    {
+        d->head[i] = d->head[i] >= (int)delta ? d->head[i] - (int)delta : -1;
+    }
+    for (int i = 0; i < FLATE_WSIZE; i++)
+    {
+        d->prev[i] = d->prev[i] >= (int)delta ? d->prev[i] - (int)delta : -1;
+    }
+}
+
+Status deflate_init(Deflate *d, int level, FlateWriteFn write, void *ctx)
+{
+    static const int chains[10] = { 0, 4, 8, 16, 32, 64, 128, 256, 1024, 4096 };
+
+    memset(d, 0, sizeof(*d));
+    defl_init_tables();
+    d->write = write;
+    d->ctx = ctx;
+    d->status = e_success;
+    d->level = level < 0 ? 6 : level > 9 ? 9 : level;
+    d->max_chain = chains[d->level];
+    d->lazy = d->level >= 4;
+    d->adler = 1;
+
+    d->buf = malloc(DEFL_CAP);
+    d->head = malloc(sizeof(int) * DEFL_HASH_SIZE);
+    d->prev = malloc(sizeof(int) * FLATE_WSIZE);
+    d->sym_litlen = malloc(sizeof(uint16_t) * DEFL_CAP);
+    d->sym_dist = malloc(sizeof(uint16_t) * DEFL_CAP);
+    if (d->buf == NULL || d->head == NULL || d->prev == NULL || d->sym_litlen == NULL || d->sym_dist == NULL)
+    {
+        printf("ERROR: Out of memory for the compressor.\n");
+        deflate_end(d);
+        return e_failure;
+    }
+    memset(d->head, 0xFF, sizeof(int) * DEFL_HASH_SIZE);
+    memset(d->prev, 0xFF, sizeof(int) * FLATE_WSIZE);
+
+    // zlib header: deflate, 32K window, level hint in FLEVEL (FCHECK makes it a multiple of 31)
+    static const unsigned char flg[4] = { 0x01, 0x5E, 0x9C, 0xDA };
+    int hint = d->level <= 1 ? 0 : d->level <= 5 ? 1 : d->level == 6 ? 2 : 3;
+    defl_bits(d, 0x78, 8);
+    defl_bits(d, flg[hint], 8);
+
+    return d->status;
+}
+
+Status deflate_write(Deflate *d, const void *data, size_t len)
+{
+    const unsigned char *bytes = data;
+
+    // Step 1: Running adler32 of the uncompressed data
+    uint a = d->adler & 0xFFFF, b = d->adler >> 16;
+    for (size_t i = 0; i < len;)
+    {
+        size_t n = len - i < 5552 ? len - i : 5552;
+        for (size_t k = 0; k < n; k++)
+        {
+            a += bytes[i + k];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+        i += n;
+    }
+    d->adler = (b << 16) | a;
+
+    // Step 2: Fill the window, compressing a block whenever it is full
+    while (len > 0)
+    {
+        size_t room = DEFL_CAP - d->buf_len;
+        size_t n = len < room ? len : room;
+        memcpy(d->buf + d->buf_len, bytes, n);
+        d->buf_len += n;
+        bytes += n;
+        len -= n;
+
+        if (d->buf_len == DEFL_CAP)
+        {
+            // Keep MAX_MATCH bytes of lookahead for the next block
+            defl_compress(d, d->buf_len - FLATE_MAX_MATCH, d->buf_len, 0);
+            defl_slide(d);
+        }
+    }
+
+    return d->status;
+}
+
+Status deflate_finish(Deflate *d)
+{
+    // Step 1: Last block with everything that is left
+    defl_compress(d, d->buf_len, d->buf_len, 1);
+    defl_align(d);
+
+    // Step 2: adler32 trailer, big endian
+    defl_bits(d, (d->adler >> 24) & 0xFF, 8);
+    defl_bits(d, (d->adler >> 16) & 0xFF, 8);
+    defl_bits(d, (d->adler >> 8) & 0xFF, 8);
+    defl_bits(d, d->adler & 0xFF, 8);
+    defl_flush_out(d, 1);
+
+    return d->status;
+}
+
+void deflate_end(Deflate *d)
+{
+    free(d->buf);
+    free(d->head);
+    free(d->prev);
+    free(d->sym_litlen);
+    free(d->sym_dist);
+    d->buf = NULL;
+    d->head = NULL;
+    d->prev = NULL;
+    d->sym_litlen = NULL;
+    d->sym_dist = NULL;
+}
@@ -0,0 +1,107 @@
+#ifndef FLATE_H
+#define FLATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "types.h"
+
+/*
+ * Streaming zlib (RFC 1950/1951) inflate and deflate, enough for
+ * PNG image data. Inflate pulls compressed bytes through a callback
+ * and hands out exactly as many bytes as asked for; deflate takes
+ * bytes as they come and pushes compressed output to a callback.
+ */
+
+#define FLATE_WSIZE 32768          // Deflate window (history) size
+#define FLATE_FAST_BITS 9          // Huffman codes up to this length decode with one lookup
+
+/* Pull up to len compressed bytes, return 0 at end of input */
+typedef size_t (*FlateReadFn)(void *ctx, unsigned char *buf, size_t len);
+
+/* Push len compressed bytes */
+typedef Status (*FlateWriteFn)(void *ctx, const unsigned char *buf, size_t len);
+
+/* Canonical Huffman decode table */
+typedef struct _FlateHuffman
+{
+    uint16_t fast[1 << FLATE_FAST_BITS];   // (length << 9) | symbol, 0 for longer codes
+    uint16_t count[16];                    // Codes per length
+    uint16_t symbol[288];                  // Symbols ordered by code
+} FlateHuffman;
+
+typedef struct _Inflate
+{
+    /* Compressed input */
+    FlateReadFn read;
+    void *ctx;
+    unsigned char in[16384];
+    size_t in_len;
+    size_t in_pos;
+    uint64_t bitbuf;
+    int bitcnt;
+
+    /* Output history for back references */
+    unsigned char window[FLATE_WSIZE];
+    uint64_t total_out;
+
+    /* Block state */
+    int in_block;          // 0: next thing is a block header
+    int final_block;
+    int block_type;        // 0 stored, 1 fixed, 2 dynamic
+    size_t stored_left;
+    uint copy_len;         // Pending back reference
+    uint copy_dist;
+    FlateHuffman lencode;
+    FlateHuffman distcode;
+} Inflate;
+
+typedef struct _Deflate
+{
+    /* Compressed output */
+    FlateWriteFn write;
+    void *ctx;
+    unsigned char out[65536];
+    size_t out_len;
+    uint64_t bitbuf;
+    int bitcnt;
+    Status status;
+
+    /* Level 0 stores, 1-9 trade speed for size through the match search */
+    int level;
+    int max_chain;
+    int lazy;
+
+    /* Window: history followed by input not yet encoded */
+    unsigned char *buf;
+    size_t buf_len;
+    size_t buf_pos;
+    int *head;
+    int *prev;
+
+    /* Symbols of the block being built: literal/length and distance (0 for literals) */
+    uint16_t *sym_litlen;
+    uint16_t *sym_dist;
+    size_t nsym;
+
+    uint adler;
+} Deflate;
+
+/* Start inflating a zlib stream (reads and checks its 2-byte header) */
+Status inflate_init(Inflate *inf, FlateReadFn read, void *ctx);
+
+/* Produce exactly len bytes of uncompressed data */
+Status inflate_read(Inflate *inf, unsigned char *out, size_t len);
+
+/* Start a zlib stream at the given level (0-9) */
+Status deflate_init(Deflate *def, int level, FlateWriteFn write, void *ctx);
+
+/* Compress len more bytes */
+Status deflate_write(Deflate *def, const void *data, size_t len);
+
+/* Flush the final block and the adler32 trailer */
+Status deflate_finish(Deflate *def);
+
+/* Release deflate buffers */
+void deflate_end(Deflate *def);
+
+#endif
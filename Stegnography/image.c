@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "image.h"
+
+/* Registered containers, probed in order */
+static const ImageCodec *const codecs[] = { &bmp_codec, &png_codec };
+
+#define NUM_CODECS (sizeof(codecs) / sizeof(codecs[0]))
+
+const ImageCodec *image_codec_for_name(const char *fname)
+{
+    const char *extn = strrchr(fname, '.');
+
+    for (size_t i = 0; extn != NULL && i < NUM_CODECS; i++)
+    {
+        if (strcasecmp(extn, codecs[i]->extension) == 0)
+        {
+            return codecs[i];
+        }
+    }
+    return NULL;
+}
+
+Status image_open(Image *image, FILE *fptr_src, FILE *fptr_dest, int level, uint io_flags)
+{
+    unsigned char sig[8] = { 0 };
+
+    memset(image, 0, sizeof(*image));
+    image->fptr_src = fptr_src;
+    image->fptr_dest = fptr_dest;
+    image->level = level;
+    image->io_flags = io_flags;
+
+    // Step 1: Pick the codec from the file signature
+    fseek(fptr_src, 0L, SEEK_SET);
+    if (fread(sig, 1, sizeof(sig), fptr_src) < 2)
+    {
+        printf("ERROR: Image file is too short.\n");
+        return e_failure;
+    }
+    if (sig[0] == 'B' && sig[1] == 'M')
+    {
+        image->codec = &bmp_codec;
+    }
+    else if (memcmp(sig, "\x89PNG\r\n\x1a\n", 8) == 0)
+    {
+        image->codec = &png_codec;
+    }
+    else
+    {
+        printf("ERROR: Unsupported image format (not BMP or PNG).\n");
+        return e_failure;
+    }
+
+    // Step 2: Let the codec parse (and copy) the header
+    fseek(fptr_src, 0L, SEEK_SET);
+    if (image->codec->open(image) == e_failure)
+    {
+        image_close(image);
+        return e_failure;
+    }
+
+    return e_success;
+}
+
+Status image_read_rows(Image *image, unsigned char *rows, uint n)
+{
+    if (n > image->height - image->rows_read)
+    {
+        printf("ERROR: Image has no rows left.\n");
+        return e_failure;
+    }
+    if (image->codec->read_rows(image, rows, n) == e_failure)
+    {
+        return e_failure;
+    }
+    image->rows_read += n;
+    return e_success;
+}
+
+Status image_write_rows(Image *image, const unsigned char *rows, uint n)
+{
+    if (n > image->height - image->rows_written)
+    {
+        printf("ERROR: Stego image has no rows left.\n");
+        return e_failure;
+    }
+    if (image->codec->write_rows(image, rows, n) == e_failure)
+    {
+        return e_failure;
+    }
+    image->rows_written += n;
+    return e_success;
+}
+
+Status image_seek_row(Image *image, uint y)
+{
+    if (image->fptr_dest != NULL || y > image->height)
+    {
+        printf("ERROR: Cannot seek to row %u of the image.\n", y);
+        return e_failure;
+    }
+
+    // Step 1: Codecs with random access just move the row position
+    if (image->codec->seek_row != NULL)
+    {
+        if (image->codec->seek_row(image, y) == e_failure)
+        {
+            return e_failure;
+        }
+        image->rows_read = y;
+        return e_success;
+    }
+
+    // Step 2: Others decode and drop the rows in between
+    if (y < image->rows_read)
+    {
+        printf("ERROR: %s images can only be read forward.\n", image->codec->name);
+        return e_failure;
+    }
+    unsigned char *row = malloc((size_t)image->row_alloc + PIXEL_VIEW_SLACK);
+    if (row == NULL)
+    {
+        printf("ERROR: Out of memory for a %u byte row.\n", image->row_alloc);
+        return e_failure;
+    }
+    Status status = e_success;
+    while (status == e_success && image->rows_read < y)
+    {
+        status = image_read_rows(image, row, 1);
+    }
+    free(row);
+    return status;
+}
+
+Status image_rewrite_rows(Image *image, uint y, const unsigned char *rows, uint n)
+{
+    if (image->codec->rewrite_rows == NULL)
+    {
+        printf("ERROR: %s images cannot be updated in place.\n", image->codec->name);
+        return e_failure;
+    }
+    if (image->fptr_dest != NULL || y > image->height || n > image->height - y)
+    {
+        printf("ERROR: Cannot rewrite rows %u-%u of the image.\n", y, y + n - 1);
+        return e_failure;
+    }
+    return image->codec->rewrite_rows(image, y, rows, n);
+}
+
+Status image_finish(Image *image)
+{
+    return image->codec->finish(image);
+}
+
+void image_close(Image *image)
+{
+    if (image->codec != NULL && image->state != NULL)
+    {
+        image->codec->close(image);
+    }
+    image->state = NULL;
+}
@@ -0,0 +1,79 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stdio.h>
+#include "types.h"
+#include "pixel.h"
+
+/*
+ * Image container layer. A codec turns an image file into a sequence
+ * of pixel rows in display order (top row first, whatever the storage
+ * orientation) and, when a destination is
+ * given, writes possibly modified rows back into a file of the same
+ * container type. Everything that is not pixel data (headers,
+ * palettes, other chunks) is passed through unchanged.
+ */
+
+typedef struct _Image Image;
+
+/* I/O flags given to image_open */
+#define IMAGE_IO_DIRECT 0x1     // Move pixel rows past the page cache (O_DIRECT) where codec and filesystem allow
+
+typedef struct _ImageCodec
+{
+    const char *name;
+    const char *extension;                                       // e.g. ".bmp"
+    Status (*open)(Image *image);                                // Parse header, copy it to dest
+    Status (*read_rows)(Image *image, unsigned char *rows, uint n);        // Next n rows, row_alloc apart
+    Status (*write_rows)(Image *image, const unsigned char *rows, uint n); // Next n rows to dest
+    Status (*finish)(Image *image);                              // Pass the remaining rows and trailer to dest
+    void (*close)(Image *image);                                 // Free codec state
+    Status (*seek_row)(Image *image, uint y);                    // Jump to row y, NULL if rows only come in order
+    Status (*rewrite_rows)(Image *image, uint y, const unsigned char *rows, uint n); // Overwrite rows y.. in src, NULL if not possible
+} ImageCodec;
+
+struct _Image
+{
+    const ImageCodec *codec;
+    FILE *fptr_src;
+    FILE *fptr_dest;          // NULL when only reading
+    int level;                // Compression level for codecs that re-encode (0-9)
+    uint io_flags;            // IMAGE_IO_*
+
+    /* Filled in by open */
+    uint width;
+    uint height;
+    PixelFormat format;
+    uint row_bytes;           // Pixel bytes per row
+    uint row_alloc;           // Distance between rows in buffers passed to read_rows/write_rows
+
+    uint rows_read;
+    uint rows_written;
+    void *state;              // Codec private
+};
+
+extern const ImageCodec bmp_codec;
+extern const ImageCodec png_codec;
+
+/* Codec for a file name by its extension, NULL if unsupported */
+const ImageCodec *image_codec_for_name(const char *fname);
+
+/* Detect the container from src's signature and open it */
+Status image_open(Image *image, FILE *fptr_src, FILE *fptr_dest, int level, uint io_flags);
+
+/* Read / write the next n rows (top to bottom) through one codec call */
+Status image_read_rows(Image *image, unsigned char *rows, uint n);
+Status image_write_rows(Image *image, const unsigned char *rows, uint n);
+
+/* Make row y the next one read (read-only images; forward only without codec support) */
+Status image_seek_row(Image *image, uint y);
+
+/* Overwrite rows y .. y+n-1 in the source file itself (src opened for update) */
+Status image_rewrite_rows(Image *image, uint y, const unsigned char *rows, uint n);
+
+/* Write everything after the rows handled so far to dest */
+Status image_finish(Image *image);
+
+void image_close(Image *image);
+
+#endif
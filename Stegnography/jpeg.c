@@ -0,0 +1,1131 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "jpeg.h"
+#include "common.h"
+#include "crc32c.h"
+#include "payload.h"
+
+/* Markers */
+#define M_SOF0 0xC0
+#define M_SOF1 0xC1
+#define M_DHT  0xC4
+#define M_JPG  0xC8
+#define M_DAC  0xCC
+#define M_RST0 0xD0
+#define M_RST7 0xD7
+#define M_SOI  0xD8
+#define M_EOI  0xD9
+#define M_SOS  0xDA
+#define M_DRI  0xDD
+#define M_TEM  0x01
+#define JPEG_EOF 0x100              // Stands in for a marker when the file ends
+
+static int jpeg_getc(JpegState *js)
+{
+    if (js->in_pos == js->in_len)
+    {
+        js->in_len = fread(js->in, 1, JPEG_BUF_SIZE, js->src);
+        js->in_pos = 0;
+        if (js->in_len == 0)
+        {
+            return -1;
+        }
+    }
+    return js->in[js->in_pos++];
+}
+
+static void jpeg_flush_out(JpegState *js)
+{
+    if (js->dest != NULL && js->out_len > 0 && fwrite(js->out, 1, js->out_len, js->dest) != js->out_len)
+    {
+        js->out_failed = 1;
+    }
+    js->out_len = 0;
+}
+
+static void jpeg_putc(JpegState *js, int c)
+{
+    if (js->dest == NULL)
+    {
+        return;
+    }
+    if (js->out_len == JPEG_BUF_SIZE)
+    {
+        jpeg_flush_out(js);
+    }
+    js->out[js->out_len++] = (unsigned char)c;
+}
+
+/* Append n bits (n <= 16), stuffing a zero byte after every 0xFF */
+static void jpeg_put_bits(JpegState *js, uint value, int n)
+{
+    js->out_bits = (js->out_bits << n) | (value & ((1u << n) - 1));
+    js->out_nbits += n;
+    while (js->out_nbits >= 8)
+    {
+        int c = (int)(js->out_bits >> (js->out_nbits - 8)) & 0xFF;
+        jpeg_putc(js, c);
+        if (c == 0xFF)
+        {
+            jpeg_putc(js, 0);
+        }
+        js->out_nbits -= 8;
+    }
+}
+
+/* Pad the last byte of entropy-coded data with 1 bits */
+static void jpeg_pad_bits(JpegState *js)
+{
+    if (js->out_nbits > 0)
+    {
+        jpeg_put_bits(js, 0x7F, 8 - js->out_nbits);
+    }
+    js->out_bits = 0;
+    js->out_nbits = 0;
+}
+
+/* Top up the bit reader; past a marker it reads zeros */
+static void jpeg_fill(JpegState *js)
+{
+    while (js->nbits <= 56)
+    {
+        int c = 0;
+        if (js->marker == 0)
+        {
+            c = jpeg_getc(js);
+            if (c == 0xFF)
+            {
+                int m;
+                do
+                {
+                    m = jpeg_getc(js);
+                } while (m == 0xFF);
+                if (m == 0)
+                {
+                    c = 0xFF;
+                }
+                else
+                {
+                    js->marker = m < 0 ? JPEG_EOF : m;
+                    c = 0;
+                }
+            }
+            else if (c < 0)
+            {
+                js->marker = JPEG_EOF;
+                c = 0;
+            }
+        }
+        js->bits |= (uint64_t)c << (56 - js->nbits);
+        js->nbits += 8;
+    }
+}
+
+static uint jpeg_get_bits(JpegState *js, int n)
+{
+    if (js->nbits < n)
+    {
+        jpeg_fill(js);
+    }
+    uint value = (uint)(js->bits >> (64 - n));
+    js->bits <<= n;
+    js->nbits -= n;
+    return value;
+}
+
+/* Table-driven decode: one lookup for codes up to JPEG_LOOKAHEAD bits, then by length */
+static int jpeg_decode_symbol(JpegState *js, const JpegHuffman *h)
+{
+    if (js->nbits < 16)
+    {
+        jpeg_fill(js);
+    }
+    uint entry = h->lookup[js->bits >> (64 - JPEG_LOOKAHEAD)];
+    if (entry != 0)
+    {
+        js->bits <<= entry >> 8;
+        js->nbits -= entry >> 8;
+        return entry & 0xFF;
+    }
+    for (int l = JPEG_LOOKAHEAD + 1; l <= 16; l++)
+    {
+        int code = (int)(js->bits >> (64 - l));
+        if (code <= h->maxcode[l])
+        {
+            js->bits <<= l;
+            js->nbits -= l;
+            return h->values[h->valoffset[l] + code];
+        }
+    }
+    return -1;
+}
+
+/* s magnitude bits to a signed value */
+static int jpeg_extend(uint value, int s)
+{
+    return value < (1u << (s - 1)) ? (int)value - (1 << s) + 1 : (int)value;
+}
+
+/* Size category of a value */
+static int jpeg_category(int v)
+{
+    uint magnitude = v < 0 ? -v : v;
+    return magnitude == 0 ? 0 : 32 - __builtin_clz(magnitude);
+}
+
+/* Next marker: the one that ended the entropy-coded data, or the next in the file */
+static int jpeg_next_marker(JpegState *js)
+{
+    int c;
+
+    if (js->marker != 0)
+    {
+        c = js->marker;
+        js->marker = 0;
+        return c == JPEG_EOF ? -1 : c;
+    }
+    do
+    {
+        c = jpeg_getc(js);
+    } while (c >= 0 && c != 0xFF);
+    do
+    {
+        c = jpeg_getc(js);
+    } while (c == 0xFF);
+    return c;
+}
+
+/* Build both directions of a table from its code counts and symbols */
+static Status jpeg_build_huffman(JpegHuffman *h, const unsigned char counts[16], const unsigned char *values, uint nvalues)
+{
+    uint code = 0, k = 0;
+
+    memset(h, 0, sizeof(*h));
+    memcpy(h->values, values, nvalues);
+    for (int l = 1; l <= 16; l++)
+    {
+        h->maxcode[l] = -1;
+        if (code + counts[l - 1] > (1u << l))
+        {
+            printf("ERROR: Invalid Huffman table: too many codes of %d bits.\n", l);
+            return e_failure;
+        }
+        if (counts[l - 1] > 0)
+        {
+            h->valoffset[l] = (int)k - (int)code;
+            for (uint i = 0; i < counts[l - 1]; i++, k++, code++)
+            {
+                unsigned char symbol = values[k];
+                h->code[symbol] = (uint16_t)code;
+                h->size[symbol] = (unsigned char)l;
+                if (l <= JPEG_LOOKAHEAD)
+                {
+                    uint first = code << (JPEG_LOOKAHEAD - l), last = (code + 1) << (JPEG_LOOKAHEAD - l);
+                    for (uint e = first; e < last; e++)
+                    {
+                        h->lookup[e] = (uint16_t)(l << 8 | symbol);
+                    }
+                }
+            }
+            h->maxcode[l] = (int)code - 1;
+        }
+        code <<= 1;
+    }
+    h->defined = 1;
+    return e_success;
+}
+
+static Status jpeg_parse_dht(JpegState *js, const unsigned char *p, uint len)
+{
+    while (len > 0)
+    {
+        if (len < 17)
+        {
+            printf("ERROR: Truncated DHT segment.\n");
+            return e_failure;
+        }
+        uint tc = p[0] >> 4, th = p[0] & 15, nvalues = 0;
+        for (int i = 0; i < 16; i++)
+        {
+            nvalues += p[1 + i];
+        }
+        if (tc > 1 || th > 3 || nvalues > 256 || len < 17 + nvalues)
+        {
+            printf("ERROR: Invalid DHT segment.\n");
+            return e_failure;
+        }
+        if (jpeg_build_huffman(tc == 0 ? &js->dc[th] : &js->ac[th], p + 1, p + 17, nvalues) == e_failure)
+        {
+            return e_failure;
+        }
+        p += 17 + nvalues;
+        len -= 17 + nvalues;
+    }
+    return e_success;
+}
+
+static Status jpeg_parse_sof(JpegState *js, const unsigned char *p, uint len)
+{
+    if (len < 6 || p[0] != 8)
+    {
+        printf("ERROR: Only 8-bit JPEG samples are supported.\n");
+        return e_failure;
+    }
+    js->height = (uint)p[1] << 8 | p[2];
+    js->width = (uint)p[3] << 8 | p[4];
+    js->ncomponents = p[5];
+    if (js->width == 0 || js->height == 0 || js->ncomponents == 0 || js->ncomponents > JPEG_MAX_COMPONENTS ||
+        len < 6 + 3 * js->ncomponents)
+    {
+        printf("ERROR: Unsupported JPEG frame: %ux%u with %u components.\n", js->width, js->height, js->ncomponents);
+        return e_failure;
+    }
+
+    js->hmax = js->vmax = 1;
+    for (uint i = 0; i < js->ncomponents; i++)
+    {
+        JpegComponent *c = &js->components[i];
+        c->id = p[6 + 3 * i];
+        c->h = p[7 + 3 * i] >> 4;
+        c->v = p[7 + 3 * i] & 15;
+        if (c->h < 1 || c->h > 4 || c->v < 1 || c->v > 4)
+        {
+            printf("ERROR: Invalid sampling factors %ux%u.\n", c->h, c->v);
+            return e_failure;
+        }
+        js->hmax = c->h > js->hmax ? c->h : js->hmax;
+        js->vmax = c->v > js->vmax ? c->v : js->vmax;
+    }
+    for (uint i = 0; i < js->ncomponents; i++)
+    {
+        JpegComponent *c = &js->components[i];
+        uint samples_w = (js->width * c->h + js->hmax - 1) / js->hmax;
+        uint samples_h = (js->height * c->v + js->vmax - 1) / js->vmax;
+        c->blocks_w = (samples_w + 7) / 8;
+        c->blocks_h = (samples_h + 7) / 8;
+    }
+    js->frame_seen = 1;
+    return e_success;
+}
+
+static Status jpeg_parse_sos(JpegState *js, const unsigned char *p, uint len)
+{
+    if (!js->frame_seen || len < 1 || p[0] < 1 || p[0] > js->ncomponents || len < 4 + 2u * p[0])
+    {
+        printf("ERROR: Invalid SOS segment.\n");
+        return e_failure;
+    }
+    js->nscan = p[0];
+    uint blocks = 0;
+    for (uint i = 0; i < js->nscan; i++)
+    {
+        uint id = p[1 + 2 * i], tables = p[2 + 2 * i], k;
+        for (k = 0; k < js->ncomponents && js->components[k].id != id; k++)
+        {
+        }
+        if (k == js->ncomponents || (tables >> 4) > 3 || (tables & 15) > 3 ||
+            !js->dc[tables >> 4].defined || !js->ac[tables & 15].defined)
+        {
+            printf("ERROR: Scan component %u has no frame component or Huffman tables.\n", id);
+            return e_failure;
+        }
+        js->scan[i] = k;
+        js->components[k].dc_table = tables >> 4;
+        js->components[k].ac_table = tables & 15;
+        blocks += js->components[k].h * js->components[k].v;
+    }
+    const unsigned char *spectral = p + 1 + 2 * js->nscan;
+    if (spectral[0] != 0 || spectral[1] != 63 || spectral[2] != 0)
+    {
+        printf("ERROR: Only baseline scans (coefficients 0 to 63, no approximation) are supported.\n");
+        return e_failure;
+    }
+    if (js->nscan > 1 && blocks > JPEG_MAX_BLOCKS_IN_MCU)
+    {
+        printf("ERROR: %u blocks in an MCU, at most %d are allowed.\n", blocks, JPEG_MAX_BLOCKS_IN_MCU);
+        return e_failure;
+    }
+    return e_success;
+}
+
+static Status jpeg_decode_block(JpegState *js, JpegComponent *c, int16_t *block)
+{
+    memset(block, 0, 64 * sizeof(int16_t));
+
+    // DC difference from the previous block of the component
+    int s = jpeg_decode_symbol(js, &js->dc[c->dc_table]);
+    if (s < 0 || s > 11)
+    {
+        return e_failure;
+    }
+    if (s > 0)
+    {
+        c->dc_pred += jpeg_extend(jpeg_get_bits(js, s), s);
+    }
+    block[0] = (int16_t)c->dc_pred;
+
+    // AC run/size symbols up to the end of block
+    for (int k = 1; k < 64; k++)
+    {
+        int rs = jpeg_decode_symbol(js, &js->ac[c->ac_table]);
+        if (rs < 0)
+        {
+            return e_failure;
+        }
+        int r = rs >> 4;
+        s = rs & 15;
+        if (s > 0)
+        {
+            k += r;
+            if (k > 63)
+            {
+                return e_failure;
+            }
+            block[k] = (int16_t)jpeg_extend(jpeg_get_bits(js, s), s);
+        }
+        else if (r == 15)
+        {
+            k += 15;
+        }
+        else
+        {
+            break;
+        }
+    }
+    return e_success;
+}
+
+static Status jpeg_put_symbol(JpegState *js, const JpegHuffman *h, int symbol)
+{
+    if (h->size[symbol] == 0)
+    {
+        printf("ERROR: Huffman table has no code for symbol 0x%02X.\n", symbol);
+        return e_failure;
+    }
+    jpeg_put_bits(js, h->code[symbol], h->size[symbol]);
+    return e_success;
+}
+
+static Status jpeg_encode_block(JpegState *js, JpegComponent *c, const int16_t *block)
+{
+    const JpegHuffman *ac = &js->ac[c->ac_table];
+    int diff = block[0] - c->dc_pred_out;
+    int s = jpeg_category(diff);
+    int run = 0;
+
+    c->dc_pred_out = block[0];
+    if (jpeg_put_symbol(js, &js->dc[c->dc_table], s) == e_failure)
+    {
+        return e_failure;
+    }
+    if (s > 0)
+    {
+        jpeg_put_bits(js, (uint)(diff < 0 ? diff - 1 : diff), s);
+    }
+
+    for (int k = 1; k < 64; k++)
+    {
+        int v = block[k];
+        if (v == 0)
+        {
+            run++;
+            continue;
+        }
+        for (; run > 15; run -= 16)
+        {
+            if (jpeg_put_symbol(js, ac, 0xF0) == e_failure)
+            {
+                return e_failure;
+            }
+        }
+        s = jpeg_category(v);
+        if (jpeg_put_symbol(js, ac, run << 4 | s) == e_failure)
+        {
+            return e_failure;
+        }
+        jpeg_put_bits(js, (uint)(v < 0 ? v - 1 : v), s);
+        run = 0;
+    }
+    if (run > 0)
+    {
+        return jpeg_put_symbol(js, ac, 0x00);
+    }
+    return e_success;
+}
+
+/* Length of the next data block with its checksum */
+static size_t jpeg_next_block(const JpegState *js)
+{
+    return (js->left < CRC_BLOCK_SIZE ? js->left : CRC_BLOCK_SIZE) + CRC_SIZE;
+}
+
+/* A payload byte is complete: check the header as it arrives, then verify and write each block */
+static void jpeg_sink_byte(JpegState *js, unsigned char byte)
+{
+    js->sink[js->sink_size++] = byte;
+    if (js->sink_size < js->need)
+    {
+        return;
+    }
+
+    const unsigned char *p = js->sink;
+    if (js->sink_stage == 0)
+    {
+        // Magic string, mode word and extension size
+        js->need = payload_header_size(p);
+        if (js->need == 0)
+        {
+            printf("ERROR: No payload header found (magic string or extension size), the JPEG holds no payload.\n");
+            js->sink_status = e_failure;
+            js->done = 1;
+        }
+        js->sink_stage = 1;
+        return;
+    }
+    if (js->sink_stage == 1)
+    {
+        // Header checksum, then the size against the carriers the JPEG has
+        if (payload_header_check(p, js->sink_size, &js->size) == e_failure)
+        {
+            printf("ERROR: Header checksum mismatch, the payload header is corrupted.\n");
+            js->sink_status = e_failure;
+            js->done = 1;
+            return;
+        }
+        if ((js->sink_size + payload_data_bytes(js->size)) * 8 > js->capacity)
+        {
+            printf("ERROR: Decoded secret file size %u exceeds the JPEG capacity.\n", js->size);
+            js->sink_status = e_failure;
+            js->done = 1;
+            return;
+        }
+        payload_output_name(js->output_fname, sizeof(js->output_fname), js->output_base, p);
+        js->fptr_out = fopen(js->output_fname, "w");
+        if (js->fptr_out == NULL)
+        {
+            perror("fopen");
+            printf("ERROR: Unable to open file %s\n", js->output_fname);
+            js->sink_status = e_failure;
+            js->done = 1;
+            return;
+        }
+        js->left = js->size;
+        js->sink_stage = 2;
+    }
+    else
+    {
+        // A whole block: verify it and write its data
+        uint n = (uint)(js->sink_size - CRC_SIZE);
+        if (payload_write_block(js->fptr_out, js->output_fname, p, n, js->block++) == e_failure)
+        {
+            js->sink_status = e_failure;
+            js->done = 1;
+            return;
+        }
+        js->left -= n;
+    }
+    js->sink_size = 0;
+    js->need = jpeg_next_block(js);
+    js->done = js->left == 0;
+}
+
+/* Count, embed into or extract from the carriers of nblocks blocks */
+static void jpeg_carriers(JpegState *js, int16_t *coefs, size_t nblocks)
+{
+    size_t n = nblocks * 64;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        int v = coefs[i];
+        // DC terms and coefficients in -1..1 carry nothing
+        if ((i & 63) == 0 || (uint)(v + 1) <= 2)
+        {
+            continue;
+        }
+        js->carriers++;
+        if (js->pass == e_jpeg_embed)
+        {
+            if (js->bit < js->payload_bits)
+            {
+                int bit = (js->payload[js->bit >> 3] >> (7 - (js->bit & 7))) & 1;
+                int magnitude = v < 0 ? -v : v;
+                if ((magnitude & 1) != bit)
+                {
+                    magnitude ^= 1;
+                    coefs[i] = (int16_t)(v < 0 ? -magnitude : magnitude);
+                    js->changed++;
+                }
+                js->bit++;
+            }
+        }
+        else if (js->pass == e_jpeg_extract)
+        {
+            int magnitude = v < 0 ? -v : v;
+            js->sink[js->sink_size] = (unsigned char)(js->sink[js->sink_size] << 1 | (magnitude & 1));
+            if ((++js->bit & 7) == 0)
+            {
+                jpeg_sink_byte(js, js->sink[js->sink_size]);
+                if (js->done)
+                {
+                    return;
+                }
+                js->sink[js->sink_size] = 0;
+            }
+        }
+    }
+}
+
+/* Expect RSTn after restart_interval MCUs */
+static Status jpeg_read_restart(JpegState *js, uint *next)
+{
+    js->bits = 0;
+    js->nbits = 0;
+    int m = jpeg_next_marker(js);
+    if (m != M_RST0 + (int)(*next % 8))
+    {
+        printf("ERROR: Expected restart marker RST%u, found 0x%02X.\n", *next % 8, m < 0 ? 0 : m);
+        return e_failure;
+    }
+    *next += 1;
+    for (uint i = 0; i < js->nscan; i++)
+    {
+        js->components[js->scan[i]].dc_pred = 0;
+    }
+    return e_success;
+}
+
+static void jpeg_write_restart(JpegState *js, uint *next)
+{
+    jpeg_pad_bits(js);
+    jpeg_putc(js, 0xFF);
+    jpeg_putc(js, M_RST0 + (int)(*next % 8));
+    *next += 1;
+    for (uint i = 0; i < js->nscan; i++)
+    {
+        js->components[js->scan[i]].dc_pred_out = 0;
+    }
+}
+
+/* Blocks of one MCU, in scan order; interleaved MCUs hold h x v blocks of each component */
+static Status jpeg_mcu(JpegState *js, int16_t *blocks, int encode)
+{
+    for (uint i = 0; i < js->nscan; i++)
+    {
+        JpegComponent *c = &js->components[js->scan[i]];
+        uint n = js->nscan == 1 ? 1 : c->h * c->v;
+        for (uint b = 0; b < n; b++, blocks += 64)
+        {
+            if ((encode ? jpeg_encode_block(js, c, blocks) : jpeg_decode_block(js, c, blocks)) == e_failure)
+            {
+                return e_failure;
+            }
+        }
+    }
+    return e_success;
+}
+
+/* One scan, a row of MCUs at a time: decode, carriers, encode */
+static Status jpeg_scan(JpegState *js)
+{
+    uint mcus_w, mcus_h, blocks_per_mcu = 0;
+
+    // Step 1: Geometry; a single component is coded block by block over its own size
+    if (js->nscan == 1)
+    {
+        JpegComponent *c = &js->components[js->scan[0]];
+        mcus_w = c->blocks_w;
+        mcus_h = c->blocks_h;
+        blocks_per_mcu = 1;
+    }
+    else
+    {
+        mcus_w = (js->width + 8 * js->hmax - 1) / (8 * js->hmax);
+        mcus_h = (js->height + 8 * js->vmax - 1) / (8 * js->vmax);
+        for (uint i = 0; i < js->nscan; i++)
+        {
+            blocks_per_mcu += js->components[js->scan[i]].h * js->components[js->scan[i]].v;
+        }
+    }
+    size_t row_blocks = (size_t)mcus_w * blocks_per_mcu;
+    if (row_blocks > js->row_blocks)
+    {
+        int16_t *row = realloc(js->row, row_blocks * 64 * sizeof(int16_t));
+        if (row == NULL)
+        {
+            printf("ERROR: Out of memory for a row of %u MCUs.\n", mcus_w);
+            return e_failure;
+        }
+        js->row = row;
+        js->row_blocks = row_blocks;
+    }
+
+    // Step 2: Fresh predictions and bit buffers
+    for (uint i = 0; i < js->nscan; i++)
+    {
+        js->components[js->scan[i]].dc_pred = 0;
+        js->components[js->scan[i]].dc_pred_out = 0;
+    }
+    js->bits = 0;
+    js->nbits = 0;
+    js->marker = 0;
+    js->out_bits = 0;
+    js->out_nbits = 0;
+
+    // Step 3: Every MCU row through the three stages
+    uint rst_in = 0, rst_out = 0;
+    unsigned long long mcu = 0;
+    for (uint my = 0; my < mcus_h; my++)
+    {
+        for (uint mx = 0; mx < mcus_w; mx++, mcu++)
+        {
+            if (js->restart_interval != 0 && mcu > 0 && mcu % js->restart_interval == 0 &&
+                jpeg_read_restart(js, &rst_in) == e_failure)
+            {
+                return e_failure;
+            }
+            if (jpeg_mcu(js, js->row + (size_t)mx * blocks_per_mcu * 64, 0) == e_failure)
+            {
+                printf("ERROR: Corrupt entropy-coded data in MCU row %u.\n", my);
+                return e_failure;
+            }
+        }
+
+        jpeg_carriers(js, js->row, row_blocks);
+        if (js->pass == e_jpeg_extract && js->done)
+        {
+            return e_success;
+        }
+
+        if (js->pass == e_jpeg_embed)
+        {
+            unsigned long long first = (unsigned long long)my * mcus_w;
+            for (uint mx = 0; mx < mcus_w; mx++)
+            {
+                if (js->restart_interval != 0 && first + mx > 0 && (first + mx) % js->restart_interval == 0)
+                {
+                    jpeg_write_restart(js, &rst_out);
+                }
+                if (jpeg_mcu(js, js->row + (size_t)mx * blocks_per_mcu * 64, 1) == e_failure)
+                {
+                    return e_failure;
+                }
+            }
+        }
+    }
+    jpeg_pad_bits(js);
+    return e_success;
+}
+
+/* Copy the rest of the file after EOI */
+static void jpeg_copy_trailer(JpegState *js)
+{
+    int c;
+    while ((c = jpeg_getc(js)) >= 0)
+    {
+        jpeg_putc(js, c);
+    }
+}
+
+/* Walk the markers of a JPEG, every scan through jpeg_scan */
+static Status jpeg_run(JpegState *js)
+{
+    // Step 1: SOI
+    if (jpeg_getc(js) != 0xFF || jpeg_getc(js) != M_SOI)
+    {
+        printf("ERROR: Not a JPEG file (no SOI marker).\n");
+        return e_failure;
+    }
+    jpeg_putc(js, 0xFF);
+    jpeg_putc(js, M_SOI);
+
+    for (;;)
+    {
+        // Step 2: Next marker; standalone ones have no segment
+        int m = jpeg_next_marker(js);
+        if (m < 0)
+        {
+            printf("ERROR: The JPEG ends before its EOI marker.\n");
+            return e_failure;
+        }
+        if (m == M_EOI)
+        {
+            jpeg_putc(js, 0xFF);
+            jpeg_putc(js, M_EOI);
+            jpeg_copy_trailer(js);
+            return e_success;
+        }
+        if (m == M_TEM || (m >= M_RST0 && m <= M_RST7) || m == M_SOI)
+        {
+            jpeg_putc(js, 0xFF);
+            jpeg_putc(js, m);
+            continue;
+        }
+
+        // Step 3: Read the segment, parse the ones that drive decoding
+        int hi = jpeg_getc(js), lo = jpeg_getc(js);
+        if (hi < 0 || lo < 0 || (hi << 8 | lo) < 2)
+        {
+            printf("ERROR: Truncated marker segment 0x%02X.\n", m);
+            return e_failure;
+        }
+        uint len = (uint)(hi << 8 | lo) - 2;
+        for (uint i = 0; i < len; i++)
+        {
+            int c = jpeg_getc(js);
+            if (c < 0)
+            {
+                printf("ERROR: Truncated marker segment 0x%02X.\n", m);
+                return e_failure;
+            }
+            js->segment[i] = (unsigned char)c;
+        }
+
+        Status status = e_success;
+        if (m == M_SOF0 || m == M_SOF1)
+        {
+            status = jpeg_parse_sof(js, js->segment, len);
+        }
+        else if ((m >= 0xC2 && m <= 0xCF) && m != M_DHT && m != M_JPG && m != M_DAC)
+        {
+            printf("ERROR: Only baseline (sequential, Huffman coded) JPEGs are supported, this one uses SOF%d.\n", m - M_SOF0);
+            status = e_failure;
+        }
+        else if (m == M_DHT)
+        {
+            status = jpeg_parse_dht(js, js->segment, len);
+        }
+        else if (m == M_DRI)
+        {
+            js->restart_interval = len >= 2 ? (uint)js->segment[0] << 8 | js->segment[1] : 0;
+        }
+        else if (m == M_SOS)
+        {
+            status = jpeg_parse_sos(js, js->segment, len);
+        }
+        if (status == e_failure)
+        {
+            return e_failure;
+        }
+
+        // Step 4: Copy it, then the entropy-coded data of a scan
+        jpeg_putc(js, 0xFF);
+        jpeg_putc(js, m);
+        jpeg_putc(js, hi);
+        jpeg_putc(js, lo);
+        for (uint i = 0; i < len; i++)
+        {
+            jpeg_putc(js, js->segment[i]);
+        }
+        if (m == M_SOS)
+        {
+            if (jpeg_scan(js) == e_failure)
+            {
+                return e_failure;
+            }
+            if (js->pass == e_jpeg_extract && js->done)
+            {
+                return e_success;
+            }
+        }
+    }
+}
+
+/* A state for one pass over src */
+static JpegState *jpeg_start(FILE *src, FILE *dest, JpegPass pass)
+{
+    JpegState *js = calloc(1, sizeof(JpegState));
+    if (js == NULL)
+    {
+        printf("ERROR: Out of memory for the JPEG state.\n");
+        return NULL;
+    }
+    js->src = src;
+    js->dest = dest;
+    js->pass = pass;
+    return js;
+}
+
+static void jpeg_end(JpegState *js)
+{
+    free(js->row);
+    free(js->sink);
+    free(js);
+}
+
+Status jpeg_count_carriers(JpegInfo *info, FILE *fptr_src)
+{
+    JpegState *js = jpeg_start(fptr_src, NULL, e_jpeg_count);
+    if (js == NULL || jpeg_run(js) == e_failure)
+    {
+        if (js != NULL)
+        {
+            jpeg_end(js);
+        }
+        return e_failure;
+    }
+    info->capacity_bits = js->carriers;
+    info->width = js->width;
+    info->height = js->height;
+    info->ncomponents = js->ncomponents;
+    jpeg_end(js);
+    return e_success;
+}
+
+Status jpeg_check_capacity(JpegInfo *info, FILE *fptr_src)
+{
+    // Step 1: Header and payload bits, as check_capacity counts them
+    unsigned long long header_bits = strlen(MAGIC_STRING) * 8;
+    printf("Size of magic string (in bits): %llu\n", header_bits);
+    header_bits += MODE_SIZE * 8;
+    int extension_size = (strlen(info->extn_secret_file) * 8) + (sizeof(int) * 8);
+    header_bits += extension_size;
+    printf("Size of file extension (in bits): %d\n", extension_size);
+    header_bits += sizeof(int) * 8;
+    printf("Size to store secret file size (in bits): %d\n", (int)(sizeof(int) * 8));
+    header_bits += CRC_SIZE * 8;
+
+    unsigned long long payload_bits = info->size_secret_file * 8;
+    printf("Size of secret file data (in bits): %llu\n", payload_bits);
+    unsigned long long block_count = (info->size_secret_file + CRC_BLOCK_SIZE - 1) / CRC_BLOCK_SIZE;
+    payload_bits += block_count * CRC_SIZE * 8;
+    printf("Size of block checksums (in bits): %llu\n", block_count * CRC_SIZE * 8);
+    printf("Size of estimated size (in bits): %llu\n", header_bits + payload_bits);
+
+    // Step 2: One decoding pass counts the carriers
+    if (jpeg_count_carriers(info, fptr_src) == e_failure)
+    {
+        return e_failure;
+    }
+    printf("Available JPEG capacity (in bits): %llu (%ux%u, %u components, AC coefficients with |v| >= 2)\n",
+           info->capacity_bits, info->width, info->height, info->ncomponents);
+
+    // Step 3: Compare
+    if (header_bits + payload_bits > info->capacity_bits)
+    {
+        printf("ERROR: Not enough capacity: %llu bits needed, %llu available.\n",
+               header_bits + payload_bits, info->capacity_bits);
+        return e_failure;
+    }
+    return e_success;
+}
+
+static Status jpeg_embed(JpegInfo *info)
+{
+    FILE *fptr_src = fopen(info->src_fname, "r");
+    if (fptr_src == NULL)
+    {
+        perror("fopen");
+        printf("ERROR: Unable to open file %s\n", info->src_fname);
+        return e_failure;
+    }
+    FILE *fptr_secret = fopen(info->secret_fname, "r");
+    if (fptr_secret == NULL)
+    {
+        perror("fopen");
+        printf("ERROR: Unable to open file %s\n", info->secret_fname);
+        fclose(fptr_src);
+        return e_failure;
+    }
+
+    // Step 1: Capacity from a counting pass
+    info->size_secret_file = get_file_size(fptr_secret);
+    if (jpeg_check_capacity(info, fptr_src) == e_failure)
+    {
+        printf("ERROR: Source image does not have enough capacity to hold the secret data.\n");
+        fclose(fptr_src);
+        fclose(fptr_secret);
+        return e_failure;
+    }
+
+    // Step 2: The payload, then the embedding pass from the start of the file
+    size_t payload_size;
+    unsigned char *payload = payload_build(fptr_secret, info->secret_fname, info->extn_secret_file,
+                                           info->size_secret_file, &payload_size);
+    fclose(fptr_secret);
+    if (payload == NULL || fseek(fptr_src, 0, SEEK_SET) != 0)
+    {
+        free(payload);
+        fclose(fptr_src);
+        return e_failure;
+    }
+    FILE *fptr_stego = fopen(info->stego_fname, "w");
+    if (fptr_stego == NULL)
+    {
+        perror("fopen");
+        printf("ERROR: Unable to open file %s\n", info->stego_fname);
+        free(payload);
+        fclose(fptr_src);
+        return e_failure;
+    }
+    JpegState *js = jpeg_start(fptr_src, fptr_stego, e_jpeg_embed);
+    Status status = js != NULL ? e_success : e_failure;
+    if (status == e_success)
+    {
+        js->payload = payload;
+        js->payload_bits = (unsigned long long)payload_size * 8;
+        status = jpeg_run(js);
+        jpeg_flush_out(js);
+        if (status == e_success && (js->out_failed || fflush(fptr_stego) != 0))
+        {
+            printf("ERROR: Failed to write the stego image %s\n", info->stego_fname);
+            status = e_failure;
+        }
+        if (status == e_success)
+        {
+            printf("INFO: %llu payload bits in %llu carriers, %llu coefficients changed\n",
+                   js->payload_bits, js->carriers, js->changed);
+        }
+        jpeg_end(js);
+    }
+
+    free(payload);
+    fclose(fptr_src);
+    fclose(fptr_stego);
+    return status;
+}
+
+static Status jpeg_extract(JpegInfo *info)
+{
+    FILE *fptr_src = fopen(info->src_fname, "r");
+    if (fptr_src == NULL)
+    {
+        perror("fopen");
+        printf("ERROR: Unable to open file %s\n", info->src_fname);
+        return e_failure;
+    }
+
+    // Step 1: A counting pass bounds the size the header may claim
+    if (jpeg_count_carriers(info, fptr_src) == e_failure || fseek(fptr_src, 0, SEEK_SET) != 0)
+    {
+        fclose(fptr_src);
+        return e_failure;
+    }
+
+    // Step 2: Decode until the payload is complete, writing each block once it is verified
+    JpegState *js = jpeg_start(fptr_src, NULL, e_jpeg_extract);
+    if (js == NULL)
+    {
+        fclose(fptr_src);
+        return e_failure;
+    }
+    js->capacity = info->capacity_bits;
+    js->output_base = info->output_fname;
+    js->need = PAYLOAD_HEADER_FIXED;
+    js->sink = calloc(CRC_BLOCK_SIZE + CRC_SIZE, 1);     // A block, the larger of it and the header
+    js->sink_status = e_success;
+    Status status = js->sink != NULL && jpeg_run(js) == e_success ? js->sink_status : e_failure;
+    fclose(fptr_src);
+    if (status == e_success && !js->done)
+    {
+        if (js->sink_stage < 2)
+        {
+            printf("ERROR: The JPEG ends inside the payload header.\n");
+        }
+        else
+        {
+            printf("ERROR: The JPEG ends before the payload does (%u of %u bytes found).\n",
+                   js->size - js->left, js->size);
+        }
+        status = e_failure;
+    }
+
+    // Step 3: Close the output
+    if (js->fptr_out != NULL && fclose(js->fptr_out) != 0)
+    {
+        printf("ERROR: Failed to write the output file %s\n", js->output_fname);
+        status = e_failure;
+    }
+    if (status == e_success)
+    {
+        printf("Decoding successful. Secret file extracted to %s (%u bytes from %llu carriers)\n",
+               js->output_fname, js->size, js->carriers);
+    }
+    jpeg_end(js);
+    return status;
+}
+
+/* .jpg or .jpeg, any case */
+static int jpeg_name(const char *fname)
+{
+    const char *dot = strrchr(fname, '.');
+    return dot != NULL && (strcasecmp(dot, ".jpg") == 0 || strcasecmp(dot, ".jpeg") == 0);
+}
+
+Status do_jpeg(int argc, char *argv[])
+{
+    JpegInfo info;
+    const char *names[4];
+    int nnames = 0, extract = 0;
+
+    // Step 1: Options first, then the file names
+    memset(&info, 0, sizeof(info));
+    for (int i = 2; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--extract") == 0)
+        {
+            extract = 1;
+        }
+        else if (strncmp(argv[i], "--", 2) == 0)
+        {
+            printf("ERROR: Unknown option %s\n", argv[i]);
+            return e_failure;
+        }
+        else if (nnames < 4)
+        {
+            names[nnames++] = argv[i];
+        }
+        else
+        {
+            nnames++;
+        }
+    }
+    if (extract ? (nnames < 1 || nnames > 2) : nnames != 3)
+    {
+        printf("ERROR: Invalid number of arguments. Usage: <Program Name> -j <Source JPEG> <Secret File> <Stego JPEG>\n"
+               "       or <Program Name> -j <Stego JPEG> --extract [<Output File>]\n");
+        return e_failure;
+    }
+    if (!jpeg_name(names[0]))
+    {
+        printf("ERROR: %s is not a JPEG file.\n", names[0]);
+        return e_failure;
+    }
+    info.src_fname = names[0];
+
+    // Step 2: Extraction writes to the output base name plus the stored extension
+    if (extract)
+    {
+        info.output_fname = nnames == 2 ? names[1] : "output";
+        if (nnames == 1)
+        {
+            printf("No output file name provided, using default name: output\n");
+        }
+        return jpeg_extract(&info);
+    }
+
+    // Step 3: The secret keeps its extension, the stego image is a JPEG as well
+    const char *base = strrchr(names[1], '/') ? strrchr(names[1], '/') + 1 : names[1];
+    const char *extn = strchr(base, '.');
+    if (extn == NULL)
+    {
+        printf("ERROR: Secret file must be a file.\n");
+        return e_failure;
+    }
+    if (strlen(extn) >= MAX_FILE_SUFFIX)
+    {
+        printf("ERROR: Extension %s is too long (at most %d characters).\n", extn, MAX_FILE_SUFFIX - 1);
+        return e_failure;
+    }
+    strcpy(info.extn_secret_file, extn);
+    info.secret_fname = names[1];
+    if (!jpeg_name(names[2]))
+    {
+        printf("ERROR: Stego image must be a JPEG file like the source image.\n");
+        return e_failure;
+    }
+    info.stego_fname = names[2];
+    return jpeg_embed(&info);
+}
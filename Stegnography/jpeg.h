@@ -0,0 +1,142 @@
+#ifndef JPEG_H
+#define JPEG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "types.h"
+#include "encode.h"
+
+/*
+ * Baseline JPEG covers, embedded in the DCT domain. The entropy-coded
+ * data is Huffman decoded to quantized coefficients one MCU row at a
+ * time, the payload goes into the AC coefficients, and the row is
+ * Huffman coded again with the file's own tables; every other segment
+ * is copied as it is. Nothing is ever transformed back to pixels, so the
+ * payload survives and the rest of the image is bit-exact.
+ *
+ * The carriers are the AC coefficients with |v| >= 2 (JSteg skips 0 and
+ * 1 the same way), one bit in the LSB of the magnitude. A magnitude of
+ * 2 or more keeps its size category whatever its LSB, so every Huffman
+ * symbol and the set of carriers stay the same and extraction sees the
+ * carriers the embedder saw.
+ *
+ * The payload has the layout of the BMP/PNG format: magic string, mode
+ * word (0), extension size, extension, size, header CRC32C, then the
+ * data in CRC_BLOCK_SIZE blocks each followed by its CRC32C.
+ */
+
+#define JPEG_LOOKAHEAD 9                // Huffman codes up to this long decode with one table lookup
+#define JPEG_BUF_SIZE (64 * 1024)       // Input and output buffers
+#define JPEG_MAX_COMPONENTS 4
+#define JPEG_MAX_BLOCKS_IN_MCU 10
+
+/* One Huffman table, both directions */
+typedef struct _JpegHuffman
+{
+    int defined;
+    uint16_t lookup[1 << JPEG_LOOKAHEAD];   // (length << 8) | symbol, 0 for longer codes
+    int maxcode[17];                // Largest code of each length, -1 for none
+    int valoffset[17];              // Index in values of a code of each length, minus the code
+    unsigned char values[256];
+    uint16_t code[256];             // Encoding: code of each symbol
+    unsigned char size[256];        // Its length, 0 if the symbol has no code
+} JpegHuffman;
+
+typedef struct _JpegComponent
+{
+    uint id;
+    uint h, v;                      // Sampling factors
+    uint dc_table, ac_table;        // Of the current scan
+    uint blocks_w, blocks_h;        // Blocks holding the component's samples
+    int dc_pred;                    // Decoder DC prediction
+    int dc_pred_out;                // Encoder DC prediction
+} JpegComponent;
+
+typedef enum
+{
+    e_jpeg_count,                   // Count the carriers
+    e_jpeg_embed,                   // Embed a payload, write the stego image
+    e_jpeg_extract                  // Collect carrier bits until the payload is complete
+} JpegPass;
+
+typedef struct _JpegState
+{
+    FILE *src;
+    FILE *dest;                     // NULL unless embedding
+    JpegPass pass;
+
+    /* Buffered input, bit reader over the entropy-coded data */
+    unsigned char in[JPEG_BUF_SIZE];
+    size_t in_pos, in_len;
+    uint64_t bits;                  // MSB first
+    int nbits;
+    int marker;                     // Marker that ended the entropy-coded data, 0 before
+
+    /* Buffered output, bit writer */
+    unsigned char out[JPEG_BUF_SIZE];
+    size_t out_len;
+    int out_failed;                 // A write to dest failed
+    uint64_t out_bits;              // LSB aligned, out_nbits valid
+    int out_nbits;
+
+    /* Frame */
+    uint width, height;
+    uint ncomponents;
+    JpegComponent components[JPEG_MAX_COMPONENTS];
+    uint hmax, vmax;
+    uint restart_interval;
+    JpegHuffman dc[4], ac[4];
+    int frame_seen;
+
+    /* Current scan */
+    uint nscan;
+    uint scan[JPEG_MAX_COMPONENTS]; // Component indices
+    int16_t *row;                   // Coefficients of one MCU row, zigzag order
+    size_t row_blocks;
+
+    /* Carriers and payload bits */
+    unsigned long long carriers;
+    const unsigned char *payload;   // Embedding
+    unsigned long long payload_bits;
+    unsigned long long bit;         // Next payload bit (embedded or extracted)
+    unsigned char *sink;            // Extraction: bytes so far, need of them wanted
+    size_t sink_size;
+    size_t need;
+    uint sink_stage;                // 0: magic to extension size, 1: rest of the header, 2: data
+    int done;                       // Extraction complete or failed
+    Status sink_status;
+    unsigned long long capacity;    // Extraction: carriers counted beforehand, bounds the stored size
+    const char *output_base;
+    char output_fname[256];
+    FILE *fptr_out;                 // Opened once the header is verified, written a block at a time
+    uint size;                      // Secret size from the header
+    uint left;                      // Data bytes still to write
+    uint block;
+    unsigned long long changed;     // Embedding: carriers whose LSB changed
+
+    unsigned char segment[65536];   // Marker segment being copied
+} JpegState;
+
+typedef struct _JpegInfo
+{
+    const char *src_fname;
+    const char *secret_fname;
+    const char *stego_fname;
+    char extn_secret_file[MAX_FILE_SUFFIX];
+    const char *output_fname;       // Extraction base name
+    unsigned long long size_secret_file;
+    unsigned long long capacity_bits;
+    uint width, height, ncomponents;    // Of the frame, once counted
+} JpegInfo;
+
+/* -j <Source JPEG> <Secret File> <Stego JPEG>: embed
+   -j <Stego JPEG> --extract [<Output File>]: extract */
+Status do_jpeg(int argc, char *argv[]);
+
+/* One decoding pass over the source: its carriers and frame, nothing printed unless it fails */
+Status jpeg_count_carriers(JpegInfo *info, FILE *fptr_src);
+
+/* Carriers of the source against the payload size, like check_capacity */
+Status jpeg_check_capacity(JpegInfo *info, FILE *fptr_src);
+
+#endif
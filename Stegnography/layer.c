@@ -0,0 +1,559 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "layer.h"
+#include "carrier.h"
+#include "common.h"
+#include "crc32c.h"
+#include "lsb.h"
+#include "payload.h"
+
+#define LAYER_GOLDEN 0x9E3779B97F4A7C15ULL
+
+/* splitmix64 finalizer */
+static uint64_t mix64(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+void layer_key(const char *passphrase, LayerKey *lk)
+{
+    // Same passphrase hash as LSB matching, split into a permutation key and a set order
+    uint64_t hash = lsb_match_key(passphrase);
+    uint n = 0;
+
+    lk->key = mix64(hash ^ 0x6C61796572ULL);
+    for (uint64_t i = 1; n < LAYER_PROBES; i++)
+    {
+        uint slot = (uint)(mix64(hash + i * LAYER_GOLDEN) % LAYER_SLOTS);
+        uint k = 0;
+        while (k < n && lk->slots[k] != slot)
+        {
+            k++;
+        }
+        if (k == n)
+        {
+            lk->slots[n++] = slot;
+        }
+    }
+}
+
+/* Bits of each Feistel half: the smallest h with 4^h >= n */
+static uint layer_half_bits(unsigned long long n)
+{
+    uint h = 1;
+    while (h < 32 && (1ULL << (2 * h)) < n)
+    {
+        h++;
+    }
+    return h;
+}
+
+static uint64_t layer_round(uint64_t key, uint round, uint64_t half)
+{
+    return mix64(key + round * LAYER_GOLDEN + (half << 5));
+}
+
+/*
+ * A balanced Feistel network over 2h bits is a bijection of [0, 4^h);
+ * applying it again until the value lands below n (cycle walking) makes
+ * it one of [0, n). 4^h < 4n, so a handful of walks at most.
+ */
+unsigned long long layer_permute(uint64_t key, unsigned long long n, unsigned long long x)
+{
+    uint h = layer_half_bits(n);
+    uint64_t mask = (1ULL << h) - 1;
+
+    do
+    {
+        uint64_t l = x >> h, r = x & mask;
+        for (uint round = 0; round < LAYER_ROUNDS; round++)
+        {
+            uint64_t t = l ^ (layer_round(key, round, r) & mask);
+            l = r;
+            r = t;
+        }
+        x = l << h | r;
+    } while (x >= n);
+    return x;
+}
+
+unsigned long long layer_unpermute(uint64_t key, unsigned long long n, unsigned long long x)
+{
+    uint h = layer_half_bits(n);
+    uint64_t mask = (1ULL << h) - 1;
+
+    do
+    {
+        uint64_t l = x >> h, r = x & mask;
+        for (uint round = LAYER_ROUNDS; round-- > 0;)
+        {
+            uint64_t t = r ^ (layer_round(key, round, l) & mask);
+            r = l;
+            l = t;
+        }
+        x = l << h | r;
+    } while (x >= n);
+    return x;
+}
+
+unsigned long long layer_slot_carriers(unsigned long long n, uint slot)
+{
+    return n / LAYER_SLOTS + (slot < n % LAYER_SLOTS);
+}
+
+/* The secret in the payload format */
+static Status layer_build_payload(Layer *layer)
+{
+    FILE *fptr_secret = fopen(layer->secret_fname, "r");
+    if (fptr_secret == NULL)
+    {
+        perror("fopen");
+        printf("ERROR: Unable to open file %s\n", layer->secret_fname);
+        return e_failure;
+    }
+    size_t size;
+    layer->payload = payload_build(fptr_secret, layer->secret_fname, layer->extn_secret_file,
+                                   get_file_size(fptr_secret), &size);
+    fclose(fptr_secret);
+    if (layer->payload == NULL)
+    {
+        return e_failure;
+    }
+    layer->payload_bits = (unsigned long long)size * 8;
+    return e_success;
+}
+
+/* First carrier of a span (from carrier first on) in set slot, and its index within the set */
+static size_t layer_first(uint slot, unsigned long long first, unsigned long long *index)
+{
+    size_t j = (slot + LAYER_SLOTS - first % LAYER_SLOTS) % LAYER_SLOTS;
+    *index = (first + j) / LAYER_SLOTS;
+    return j;
+}
+
+/* Every carrier of the layer's set in a span takes the payload bit its index maps back to, if any */
+static void layer_embed_span(Layer *layer, unsigned char *carriers, size_t n, unsigned long long first)
+{
+    unsigned long long index;
+
+    for (size_t j = layer_first(layer->slot, first, &index); j < n; j += LAYER_SLOTS, index++)
+    {
+        unsigned long long bit = layer_unpermute(layer->key.key, layer->slot_carriers, index);
+        if (bit < layer->payload_bits)
+        {
+            unsigned char value = (layer->payload[bit >> 3] >> (7 - (bit & 7))) & 1;
+            if ((carriers[j] & 1) != value)
+            {
+                carriers[j] = (carriers[j] & 0xFE) | value;
+                layer->changed++;
+            }
+        }
+    }
+}
+
+static void layer_free(Layer *layers, uint nlayers)
+{
+    for (uint i = 0; i < nlayers; i++)
+    {
+        free(layers[i].payload);
+        layers[i].payload = NULL;
+    }
+}
+
+static Status layer_embed(const char *src_fname, const char *dest_fname, Layer *layers, uint nlayers, int level)
+{
+    CarrierStream cs;
+    int taken[LAYER_SLOTS] = {0};
+
+    // Step 1: Open both images, the destination gets the source's header
+    FILE *fptr_src = fopen(src_fname, "r");
+    if (fptr_src == NULL)
+    {
+        perror("fopen");
+        printf("ERROR: Unable to open file %s\n", src_fname);
+        return e_failure;
+    }
+    FILE *fptr_dest = fopen(dest_fname, "w");
+    if (fptr_dest == NULL)
+    {
+        perror("fopen");
+        printf("ERROR: Unable to open file %s\n", dest_fname);
+        fclose(fptr_src);
+        return e_failure;
+    }
+    if (carrier_open(&cs, fptr_src, fptr_dest, level, 0) == e_failure)
+    {
+        fclose(fptr_src);
+        fclose(fptr_dest);
+        return e_failure;
+    }
+    unsigned long long n = (unsigned long long)cs.image.width * cs.image.height * cs.view->carriers_per_pixel;
+
+    // Step 2: Every layer gets the first of its candidate sets still free, and has to fit it
+    for (uint i = 0; i < nlayers; i++)
+    {
+        Layer *layer = &layers[i];
+        uint k = 0;
+        while (k < LAYER_PROBES && taken[layer->key.slots[k]])
+        {
+            k++;
+        }
+        if (k == LAYER_PROBES)
+        {
+            printf("ERROR: The sets of layer %u's key are all taken by earlier layers, choose another key.\n", i + 1);
+            layer_free(layers, nlayers);
+            carrier_close(&cs);
+            fclose(fptr_src);
+            fclose(fptr_dest);
+            return e_failure;
+        }
+        layer->slot = layer->key.slots[k];
+        layer->slot_carriers = layer_slot_carriers(n, layer->slot);
+        taken[layer->slot] = 1;
+
+        if (layer_build_payload(layer) == e_failure)
+        {
+            layer_free(layers, nlayers);
+            carrier_close(&cs);
+            fclose(fptr_src);
+            fclose(fptr_dest);
+            return e_failure;
+        }
+        if (layer->payload_bits > layer->slot_carriers)
+        {
+            printf("ERROR: Layer %u needs %llu carriers, its set has %llu (1/%d of the image).\n",
+                   i + 1, layer->payload_bits, layer->slot_carriers, LAYER_SLOTS);
+            layer_free(layers, nlayers);
+            carrier_close(&cs);
+            fclose(fptr_src);
+            fclose(fptr_dest);
+            return e_failure;
+        }
+    }
+
+    // Step 3: One pass over the rows, all layers in every window
+    Status status = e_success;
+    for (unsigned long long first = 0; first < n && status == e_success;)
+    {
+        unsigned char *carriers;
+        size_t count;
+        status = carrier_span(&cs, &carriers, &count);
+        if (status == e_success)
+        {
+            for (uint i = 0; i < nlayers; i++)
+            {
+                layer_embed_span(&layers[i], carriers, count, first);
+            }
+            first += count;
+        }
+    }
+    if (carrier_close(&cs) == e_failure || status == e_failure || fflush(fptr_dest) != 0)
+    {
+        printf("ERROR: Failed to write the stego image %s\n", dest_fname);
+        layer_free(layers, nlayers);
+        fclose(fptr_src);
+        fclose(fptr_dest);
+        return e_failure;
+    }
+    fclose(fptr_src);
+    fclose(fptr_dest);
+
+    for (uint i = 0; i < nlayers; i++)
+    {
+        printf("INFO: Layer %u: %llu payload bits in carrier set %u of %d (%llu carriers), %llu changed\n",
+               i + 1, layers[i].payload_bits, layers[i].slot, LAYER_SLOTS, layers[i].slot_carriers, layers[i].changed);
+    }
+    layer_free(layers, nlayers);
+    return e_success;
+}
+
+/* len payload bytes from byte offset on, each bit from the set carrier its position maps to */
+static void layer_read(const unsigned char *set, uint64_t key, unsigned long long count,
+                       unsigned long long offset, size_t len, unsigned char *out)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        unsigned char byte = 0;
+        for (uint b = 0; b < 8; b++)
+        {
+            unsigned long long pos = layer_permute(key, count, (offset + i) * 8 + b);
+            byte = (byte << 1) | ((set[pos >> 3] >> (7 - (pos & 7))) & 1);
+        }
+        out[i] = byte;
+    }
+}
+
+/* Header of a layer in one set: magic, sizes and checksum all valid, and the payload fits the set */
+static int layer_header(const unsigned char *set, uint64_t key, unsigned long long count, unsigned char *header, size_t *header_size)
+{
+    uint size;
+
+    if (count < 8ULL * (PAYLOAD_HEADER_FIXED + PAYLOAD_HEADER_TAIL))
+    {
+        return 0;
+    }
+    layer_read(set, key, count, 0, PAYLOAD_HEADER_FIXED, header);
+    *header_size = payload_header_size(header);
+    if (*header_size == 0 || 8ULL * *header_size > count)
+    {
+        return 0;
+    }
+    layer_read(set, key, count, PAYLOAD_HEADER_FIXED, *header_size - PAYLOAD_HEADER_FIXED, header + PAYLOAD_HEADER_FIXED);
+    if (payload_header_check(header, *header_size, &size) == e_failure)
+    {
+        return 0;
+    }
+    return 8 * (*header_size + payload_data_bytes(size)) <= count;
+}
+
+static Status layer_extract(const char *fname, const char *passphrase, const char *output_fname)
+{
+    CarrierStream cs;
+    LayerKey lk;
+    unsigned char *sets[LAYER_PROBES] = {NULL};
+    unsigned long long counts[LAYER_PROBES];
+
+    layer_key(passphrase, &lk);
+
+    FILE *fptr = fopen(fname, "r");
+    if (fptr == NULL)
+    {
+        perror("fopen");
+        printf("ERROR: Unable to open file %s\n", fname);
+        return e_failure;
+    }
+    if (carrier_open(&cs, fptr, NULL, 0, 0) == e_failure)
+    {
+        fclose(fptr);
+        return e_failure;
+    }
+
+    // Step 1: Pack the LSBs of the key's candidate sets, nothing else is read
+    unsigned long long n = (unsigned long long)cs.image.width * cs.image.height * cs.view->carriers_per_pixel;
+    Status status = e_success;
+    for (uint k = 0; k < LAYER_PROBES && status == e_success; k++)
+    {
+        counts[k] = layer_slot_carriers(n, lk.slots[k]);
+        sets[k] = calloc(counts[k] / 8 + 1, 1);
+        if (sets[k] == NULL)
+        {
+            printf("ERROR: Out of memory for the carriers of %s\n", fname);
+            status = e_failure;
+        }
+    }
+    for (unsigned long long first = 0; first < n && status == e_success;)
+    {
+        unsigned char *carriers;
+        size_t count;
+        status = carrier_span(&cs, &carriers, &count);
+        if (status == e_failure)
+        {
+            break;
+        }
+        for (uint k = 0; k < LAYER_PROBES; k++)
+        {
+            unsigned long long index;
+            for (size_t j = layer_first(lk.slots[k], first, &index); j < count; j += LAYER_SLOTS, index++)
+            {
+                sets[k][index >> 3] |= (carriers[j] & 1) << (7 - (index & 7));
+            }
+        }
+        first += count;
+    }
+    carrier_close(&cs);
+    fclose(fptr);
+
+    // Step 2: The first candidate whose header holds up under the key's permutation
+    unsigned char header[PAYLOAD_HEADER_MAX];
+    size_t header_size = 0;
+    uint k = 0;
+    while (status == e_success && k < LAYER_PROBES && !layer_header(sets[k], lk.key, counts[k], header, &header_size))
+    {
+        k++;
+    }
+    if (status == e_success && k == LAYER_PROBES)
+    {
+        printf("ERROR: No layer for this key in %s\n", fname);
+        status = e_failure;
+    }
+    if (status == e_failure)
+    {
+        for (uint i = 0; i < LAYER_PROBES; i++)
+        {
+            free(sets[i]);
+        }
+        return e_failure;
+    }
+
+    // Step 3: Output name from the base and the stored extension
+    char out_fname[256];
+    payload_output_name(out_fname, sizeof(out_fname), output_fname, header);
+
+    // Step 4: Verify every block before writing it
+    uint size = get_be32(header + header_size - PAYLOAD_HEADER_TAIL);
+    FILE *fptr_out = fopen(out_fname, "w");
+    if (fptr_out == NULL)
+    {
+        perror("fopen");
+        printf("ERROR: Unable to open file %s\n", out_fname);
+        for (uint i = 0; i < LAYER_PROBES; i++)
+        {
+            free(sets[i]);
+        }
+        return e_failure;
+    }
+    unsigned char block[CRC_BLOCK_SIZE + CRC_SIZE];
+    unsigned long long offset = header_size;
+    for (uint left = size, b = 0; left > 0 && status == e_success; b++)
+    {
+        uint len = left < CRC_BLOCK_SIZE ? left : CRC_BLOCK_SIZE;
+        layer_read(sets[k], lk.key, counts[k], offset, len + CRC_SIZE, block);
+        status = payload_write_block(fptr_out, out_fname, block, len, b);
+        offset += len + CRC_SIZE;
+        left -= len;
+    }
+    if (fclose(fptr_out) != 0)
+    {
+        status = e_failure;
+    }
+    if (status == e_success)
+    {
+        printf("Decoding successful. Secret file extracted to %s (%u bytes from carrier set %u of %d)\n",
+               out_fname, size, lk.slots[k], LAYER_SLOTS);
+    }
+    for (uint i = 0; i < LAYER_PROBES; i++)
+    {
+        free(sets[i]);
+    }
+    return status;
+}
+
+Status do_layers(int argc, char *argv[])
+{
+    Layer layers[LAYER_MAX];
+    uint nlayers = 0;
+    int level = DEFAULT_PNG_LEVEL;
+    const char *key = NULL;
+    const char *names[3];
+    int nnames = 0;
+
+    // Step 1: Options first, at most two image names
+    memset(layers, 0, sizeof(layers));
+    for (int i = 2; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--layer=", 8) == 0)
+        {
+            // The key ends at the first ':' (cut there in place), the file name may hold more
+            char *colon = strchr(argv[i] + 8, ':');
+            if (colon == NULL || colon == argv[i] + 8 || colon[1] == '\0')
+            {
+                printf("ERROR: --layer needs <Key>:<Secret File>.\n");
+                return e_failure;
+            }
+            if (nlayers == LAYER_MAX)
+            {
+                printf("ERROR: At most %d layers fit in one image.\n", LAYER_MAX);
+                return e_failure;
+            }
+            *colon = '\0';
+            layers[nlayers].passphrase = argv[i] + 8;
+            layers[nlayers].secret_fname = colon + 1;
+            nlayers++;
+        }
+        else if (strncmp(argv[i], "--key=", 6) == 0)
+        {
+            key = argv[i] + 6;
+            if (key[0] == '\0')
+            {
+                printf("ERROR: --key needs a key.\n");
+                return e_failure;
+            }
+        }
+        else if (strncmp(argv[i], "--png-level=", 12) == 0)
+        {
+            char *end;
+            long l = strtol(argv[i] + 12, &end, 10);
+            if (end == argv[i] + 12 || *end != '\0' || l < 0 || l > 9)
+            {
+                printf("ERROR: PNG level must be 0 (store) to 9 (smallest).\n");
+                return e_failure;
+            }
+            level = (int)l;
+        }
+        else if (strncmp(argv[i], "--", 2) == 0)
+        {
+            printf("ERROR: Unknown option %s\n", argv[i]);
+            return e_failure;
+        }
+        else if (nnames < 3)
+        {
+            names[nnames++] = argv[i];
+        }
+        else
+        {
+            nnames++;
+        }
+    }
+    if (key != NULL ? (nlayers > 0 || nnames < 1 || nnames > 2) : (nlayers == 0 || nnames != 2))
+    {
+        printf("ERROR: Invalid arguments. Usage: <Program Name> -l <Source Image> <Stego Image> --layer=<Key>:<Secret File> [--layer=<Key>:<Secret File>]... [--png-level=6]\n"
+               "       or <Program Name> -l <Stego Image> --key=<Key> [<Output File>] to extract\n");
+        return e_failure;
+    }
+
+    // Step 2: Images of one container type
+    const ImageCodec *codec = image_codec_for_name(names[0]);
+    if (codec == NULL)
+    {
+        printf("ERROR: %s is not a BMP or PNG file.\n", names[0]);
+        return e_failure;
+    }
+    if (key != NULL)
+    {
+        if (nnames == 1)
+        {
+            printf("No output file name provided, using default name: output\n");
+        }
+        return layer_extract(names[0], key, nnames == 2 ? names[1] : "output");
+    }
+    if (image_codec_for_name(names[1]) != codec)
+    {
+        printf("ERROR: Stego image must be a %s file like the source image.\n", codec->name);
+        return e_failure;
+    }
+
+    // Step 3: Every secret keeps its extension, every key is different
+    for (uint i = 0; i < nlayers; i++)
+    {
+        Layer *layer = &layers[i];
+        const char *base = strrchr(layer->secret_fname, '/') ? strrchr(layer->secret_fname, '/') + 1 : layer->secret_fname;
+        const char *extn = strchr(base, '.');
+        if (extn == NULL)
+        {
+            printf("ERROR: Secret file %s must be a file with an extension.\n", layer->secret_fname);
+            return e_failure;
+        }
+        if (strlen(extn) >= MAX_FILE_SUFFIX)
+        {
+            printf("ERROR: Extension %s is too long (at most %d characters).\n", extn, MAX_FILE_SUFFIX - 1);
+            return e_failure;
+        }
+        strcpy(layer->extn_secret_file, extn);
+        for (uint j = 0; j < i; j++)
+        {
+            if (strcmp(layers[j].passphrase, layer->passphrase) == 0)
+            {
+                printf("ERROR: Layers %u and %u have the same key.\n", j + 1, i + 1);
+                return e_failure;
+            }
+        }
+        layer_key(layer->passphrase, &layer->key);
+    }
+    return layer_embed(names[0], names[1], layers, nlayers, level);
+}
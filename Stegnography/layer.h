@@ -0,0 +1,68 @@
+#ifndef LAYER_H
+#define LAYER_H
+
+#include <stdint.h>
+#include "types.h"
+#include "encode.h"
+
+/*
+ * Layered payloads: several secrets in one image, each found only with
+ * its own key. The carriers (default channels, one bit each) are dealt
+ * into LAYER_SLOTS disjoint sets, carrier c going to set c mod
+ * LAYER_SLOTS, and a layer owns one set. Within its set the payload
+ * bits are scattered by a permutation keyed by the layer's passphrase,
+ * so there is no fixed position and no shared marker to look for.
+ *
+ * A key has LAYER_PROBES candidate sets in its own order. The embedder
+ * gives every layer the first candidate no earlier layer took; the
+ * extractor reads only the LSBs of its candidates and decodes from the
+ * first whose header checks out under its permutation. A layer holds
+ * the payload of the BMP/PNG format: magic string, mode word (0),
+ * extension size, extension, size, header CRC32C, then the data in
+ * CRC_BLOCK_SIZE blocks each followed by its CRC32C.
+ *
+ * All layers go in with one pass over the pixel rows: each carrier of a
+ * used set is mapped back through that layer's permutation to the
+ * payload bit it holds, if any.
+ */
+
+#define LAYER_SLOTS 16          // Disjoint carrier sets
+#define LAYER_PROBES 4          // Candidate sets of a key
+#define LAYER_MAX 8             // Layers in one image
+#define LAYER_ROUNDS 6          // Feistel rounds of a permutation
+
+/* Permutation key and candidate sets of a passphrase */
+typedef struct _LayerKey
+{
+    uint64_t key;
+    uint slots[LAYER_PROBES];   // Distinct sets, in the order they are tried
+} LayerKey;
+
+typedef struct _Layer
+{
+    const char *passphrase;
+    const char *secret_fname;
+    char extn_secret_file[MAX_FILE_SUFFIX];
+    LayerKey key;
+    uint slot;                          // Set the layer owns
+    unsigned long long slot_carriers;   // Carriers in it
+    unsigned char *payload;
+    unsigned long long payload_bits;
+    unsigned long long changed;         // Carriers whose LSB changed
+} Layer;
+
+/* -l <Source Image> <Stego Image> --layer=<Key>:<Secret File>... [--png-level=N]: embed
+   -l <Stego Image> --key=<Key> [<Output File>]: extract the layer of one key */
+Status do_layers(int argc, char *argv[]);
+
+/* Key and candidate sets of a passphrase */
+void layer_key(const char *passphrase, LayerKey *lk);
+
+/* Keyed bijection of [0, n) and its inverse */
+unsigned long long layer_permute(uint64_t key, unsigned long long n, unsigned long long x);
+unsigned long long layer_unpermute(uint64_t key, unsigned long long n, unsigned long long x);
+
+/* Carriers of set slot among n carriers */
+unsigned long long layer_slot_carriers(unsigned long long n, uint slot);
+
+#endif
@@ -0,0 +1,595 @@
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include "lsb.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+/* Every carrier byte with its LSB cleared / isolated */
+#define LSB_CLEAR 0xFEFEFEFEFEFEFEFEULL
+#define LSB_ONLY  0x0101010101010101ULL
+
+/* Multiplier that moves the LSBs of 8 bytes into one byte, byte 0 to bit 7 */
+#define LSB_GATHER 0x8040201008040201ULL
+
+/* The same with byte 0 to bit 0 */
+#define LSB_GATHER_LOW_FIRST 0x0102040810204080ULL
+
+/* Carriers packed per call of the pack kernels in the matrix kernels */
+#define LSB_PACK_WORDS 64
+
+/* lsb_spread[v]: byte k holds bit (7 - k) of v, i.e. v laid out over 8 carriers */
+static uint64_t lsb_spread[256];
+
+/* lsb_reverse[v]: v with its bit order reversed */
+static unsigned char lsb_reverse[256];
+
+/* lsb_columns[v]: XOR of k over the set bits k of v, the low column bits of 8 LSBs packed low first */
+static unsigned char lsb_columns[256];
+
+/* Select masks for spreading 8 bits over 8 bytes: MSB first (data), LSB first (signs) */
+#define SPREAD_MSB_FIRST 0x0102040810204080ULL
+#define SPREAD_LSB_FIRST 0x8040201008040201ULL
+
+/* Selected kernels */
+static void (*lsb_embed_impl)(unsigned char *carriers, const unsigned char *data, size_t nbytes);
+static void (*lsb_extract_impl)(const unsigned char *carriers, unsigned char *data, size_t nbytes);
+static void (*lsb_match_impl)(unsigned char *carriers, const unsigned char *data, size_t nbytes,
+                              unsigned long long key, unsigned long long ordinal);
+static void (*lsb_pack_impl)(const unsigned char *carriers, size_t count, uint64_t *bits);
+static const char *lsb_impl_name;
+
+/* splitmix64 finalizer */
+static uint64_t mix64(uint64_t x)
+{
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+/* Signs of carriers ordinal .. ordinal+63, bit j for carrier ordinal+j (1 = add one) */
+static uint64_t match_signs(uint64_t key, uint64_t ordinal)
+{
+    uint64_t word = ordinal >> 6;
+    unsigned int shift = ordinal & 63;
+    uint64_t low = mix64(key + word * 0x9E3779B97F4A7C15ULL);
+
+    if (shift == 0)
+    {
+        return low;
+    }
+    return (low >> shift) | (mix64(key + (word + 1) * 0x9E3779B97F4A7C15ULL) << (64 - shift));
+}
+
+/* One carrier: keep it if its LSB is right, otherwise step towards the sign, away from 0 and 255 */
+static unsigned char match_carrier(unsigned char v, unsigned int bit, unsigned int up)
+{
+    if ((v & 1) == bit)
+    {
+        return v;
+    }
+    if (v == 0xFF || (v != 0 && !up))
+    {
+        return v - 1;
+    }
+    return v + 1;
+}
+
+/* 64-bit SWAR: one data byte per 8-byte word */
+static void embed_swar(unsigned char *carriers, const unsigned char *data, size_t nbytes)
+{
+    for (size_t i = 0; i < nbytes; i++, carriers += 8)
+    {
+        uint64_t word;
+        memcpy(&word, carriers, 8);
+        word = (word & LSB_CLEAR) | lsb_spread[data[i]];
+        memcpy(carriers, &word, 8);
+    }
+}
+
+static void extract_swar(const unsigned char *carriers, unsigned char *data, size_t nbytes)
+{
+    for (size_t i = 0; i < nbytes; i++, carriers += 8)
+    {
+        uint64_t word;
+        memcpy(&word, carriers, 8);
+        data[i] = (unsigned char)(((word & LSB_ONLY) * LSB_GATHER) >> 56);
+    }
+}
+
+/* Scalar LSB matching, one carrier at a time */
+static void match_scalar(unsigned char *carriers, const unsigned char *data, size_t nbytes,
+                         unsigned long long key, unsigned long long ordinal)
+{
+    for (size_t i = 0; i < nbytes; i++, carriers += 8, ordinal += 8)
+    {
+        uint64_t signs = match_signs(key, ordinal);
+        for (int k = 0; k < 8; k++)
+        {
+            carriers[k] = match_carrier(carriers[k], (data[i] >> (7 - k)) & 1, (signs >> k) & 1);
+        }
+    }
+}
+
+/* Pack the LSBs of count carriers, carrier k into bit k % 64 of word k / 64 (64-bit SWAR) */
+static void pack_swar(const unsigned char *carriers, size_t count, uint64_t *bits)
+{
+    size_t k = 0;
+
+    for (; k + 8 <= count; k += 8)
+    {
+        uint64_t word;
+        memcpy(&word, carriers + k, 8);
+        if ((k & 63) == 0)
+        {
+            bits[k / 64] = 0;
+        }
+        bits[k / 64] |= (((word & LSB_ONLY) * LSB_GATHER_LOW_FIRST) >> 56) << (k & 63);
+    }
+    for (; k < count; k++)
+    {
+        if ((k & 63) == 0)
+        {
+            bits[k / 64] = 0;
+        }
+        bits[k / 64] |= (uint64_t)(carriers[k] & 1) << (k & 63);
+    }
+}
+
+#if defined(__x86_64__)
+/* SSE2: two data bytes per 16 carriers */
+static void embed_sse2(unsigned char *carriers, const unsigned char *data, size_t nbytes)
+{
+    const __m128i clear = _mm_set1_epi8((char)0xFE);
+    size_t i = 0;
+
+    for (; i + 2 <= nbytes; i += 2, carriers += 16)
+    {
+        __m128i bits = _mm_set_epi64x((long long)lsb_spread[data[i + 1]], (long long)lsb_spread[data[i]]);
+        __m128i v = _mm_loadu_si128((const __m128i *)carriers);
+        _mm_storeu_si128((__m128i *)carriers, _mm_or_si128(_mm_and_si128(v, clear), bits));
+    }
+
+    embed_swar(carriers, data + i, nbytes - i);
+}
+
+static void extract_sse2(const unsigned char *carriers, unsigned char *data, size_t nbytes)
+{
+    size_t i = 0;
+
+    for (; i + 2 <= nbytes; i += 2, carriers += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)carriers);
+        // LSB of every byte into its MSB, then one bit per carrier
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_slli_epi64(v, 7));
+        // movemask puts carrier 0 in bit 0, the data byte wants it in bit 7
+        data[i] = lsb_reverse[mask & 0xFF];
+        data[i + 1] = lsb_reverse[mask >> 8];
+    }
+
+    extract_swar(carriers, data + i, nbytes - i);
+}
+
+/* AVX2: four data bytes per 32 carriers, bits expanded with shuffles */
+__attribute__((target("avx2")))
+static void embed_avx2(unsigned char *carriers, const unsigned char *data, size_t nbytes)
+{
+    const __m256i clear = _mm256_set1_epi8((char)0xFE);
+    const __m256i one = _mm256_set1_epi8(1);
+    const __m256i select = _mm256_set1_epi64x((long long)SPREAD_MSB_FIRST);
+    const __m256i broadcast = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                                               2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    size_t i = 0;
+
+    for (; i + 4 <= nbytes; i += 4, carriers += 32)
+    {
+        uint32_t four;
+        memcpy(&four, data + i, 4);
+        // Byte k of the result is data byte k/8; keep bit (7 - k%8), make it 0/1
+        __m256i bytes = _mm256_shuffle_epi8(_mm256_set1_epi32((int)four), broadcast);
+        __m256i bits = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(bytes, select), select), one);
+        __m256i v = _mm256_loadu_si256((const __m256i *)carriers);
+        _mm256_storeu_si256((__m256i *)carriers, _mm256_or_si256(_mm256_and_si256(v, clear), bits));
+    }
+
+    embed_swar(carriers, data + i, nbytes - i);
+}
+
+/*
+ * SSE2 LSB matching. A carrier whose LSB has to change gets a saturating
+ * +1 or -1 by its sign; at 255 it always goes down and at 0 always up,
+ * so saturation never swallows a change.
+ */
+static void match_sse2(unsigned char *carriers, const unsigned char *data, size_t nbytes,
+                       unsigned long long key, unsigned long long ordinal)
+{
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i max = _mm_set1_epi8((char)0xFF);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i select = _mm_set1_epi64x((long long)SPREAD_LSB_FIRST);
+    size_t i = 0;
+
+    for (; i + 8 <= nbytes; i += 8, ordinal += 64)
+    {
+        uint64_t signs = match_signs(key, ordinal);
+
+        for (int j = 0; j < 8; j += 2, carriers += 16, signs >>= 16)
+        {
+            __m128i bits = _mm_set_epi64x((long long)lsb_spread[data[i + j + 1]], (long long)lsb_spread[data[i + j]]);
+            __m128i spread = _mm_set_epi64x((long long)(((signs >> 8) & 0xFF) * LSB_ONLY), (long long)((signs & 0xFF) * LSB_ONLY));
+            __m128i up_sign = _mm_cmpeq_epi8(_mm_and_si128(spread, select), select);
+            __m128i v = _mm_loadu_si128((const __m128i *)carriers);
+
+            // 1 where the LSB differs from the data bit, split into the steps up and down
+            __m128i change = _mm_and_si128(_mm_xor_si128(v, bits), one);
+            __m128i take_up = _mm_or_si128(_mm_andnot_si128(_mm_cmpeq_epi8(v, max), up_sign), _mm_cmpeq_epi8(v, zero));
+            __m128i inc = _mm_and_si128(take_up, change);
+            __m128i dec = _mm_xor_si128(inc, change);
+            _mm_storeu_si128((__m128i *)carriers, _mm_subs_epu8(_mm_adds_epu8(v, inc), dec));
+        }
+    }
+
+    match_scalar(carriers, data + i, nbytes - i, key, ordinal);
+}
+
+/* AVX2 LSB matching: as SSE2, 32 carriers per step, bits and signs expanded with shuffles */
+__attribute__((target("avx2")))
+static void match_avx2(unsigned char *carriers, const unsigned char *data, size_t nbytes,
+                       unsigned long long key, unsigned long long ordinal)
+{
+    const __m256i one = _mm256_set1_epi8(1);
+    const __m256i max = _mm256_set1_epi8((char)0xFF);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i select_data = _mm256_set1_epi64x((long long)SPREAD_MSB_FIRST);
+    const __m256i select_sign = _mm256_set1_epi64x((long long)SPREAD_LSB_FIRST);
+    const __m256i broadcast = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                                               2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    size_t i = 0;
+
+    for (; i + 8 <= nbytes; i += 8, ordinal += 64)
+    {
+        uint64_t signs = match_signs(key, ordinal);
+
+        for (int j = 0; j < 8; j += 4, carriers += 32, signs >>= 32)
+        {
+            uint32_t four;
+            memcpy(&four, data + i + j, 4);
+            __m256i bytes = _mm256_shuffle_epi8(_mm256_set1_epi32((int)four), broadcast);
+            __m256i bits = _mm256_cmpeq_epi8(_mm256_and_si256(bytes, select_data), select_data);
+            __m256i spread = _mm256_shuffle_epi8(_mm256_set1_epi32((int)(uint32_t)signs), broadcast);
+            __m256i up_sign = _mm256_cmpeq_epi8(_mm256_and_si256(spread, select_sign), select_sign);
+            __m256i v = _mm256_loadu_si256((const __m256i *)carriers);
+
+            __m256i change = _mm256_and_si256(_mm256_xor_si256(v, bits), one);
+            __m256i take_up = _mm256_or_si256(_mm256_andnot_si256(_mm256_cmpeq_epi8(v, max), up_sign),
+                                              _mm256_cmpeq_epi8(v, zero));
+            __m256i inc = _mm256_and_si256(take_up, change);
+            __m256i dec = _mm256_xor_si256(inc, change);
+            _mm256_storeu_si256((__m256i *)carriers, _mm256_subs_epu8(_mm256_adds_epu8(v, inc), dec));
+        }
+    }
+
+    match_scalar(carriers, data + i, nbytes - i, key, ordinal);
+}
+
+/* SSE2 packing: 16 LSBs per movemask */
+static void pack_sse2(const unsigned char *carriers, size_t count, uint64_t *bits)
+{
+    size_t k = 0;
+
+    for (; k + 64 <= count; k += 64)
+    {
+        uint64_t word = 0;
+        for (int j = 0; j < 64; j += 16)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i *)(carriers + k + j));
+            word |= (uint64_t)(unsigned int)_mm_movemask_epi8(_mm_slli_epi64(v, 7)) << j;
+        }
+        bits[k / 64] = word;
+    }
+
+    pack_swar(carriers + k, count - k, bits + k / 64);
+}
+
+/* AVX2 packing: 32 LSBs per movemask */
+__attribute__((target("avx2")))
+static void pack_avx2(const unsigned char *carriers, size_t count, uint64_t *bits)
+{
+    size_t k = 0;
+
+    for (; k + 64 <= count; k += 64)
+    {
+        __m256i lo = _mm256_loadu_si256((const __m256i *)(carriers + k));
+        __m256i hi = _mm256_loadu_si256((const __m256i *)(carriers + k + 32));
+        bits[k / 64] = (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_slli_epi64(lo, 7)) |
+                       (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_slli_epi64(hi, 7)) << 32;
+    }
+
+    pack_swar(carriers + k, count - k, bits + k / 64);
+}
+
+__attribute__((target("avx2")))
+static void extract_avx2(const unsigned char *carriers, unsigned char *data, size_t nbytes)
+{
+    // Reverse each group of 8 carriers so movemask yields MSB-first bytes
+    const __m256i reverse = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+                                             7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    size_t i = 0;
+
+    for (; i + 4 <= nbytes; i += 4, carriers += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)carriers);
+        v = _mm256_shuffle_epi8(_mm256_slli_epi64(v, 7), reverse);
+        uint32_t four = (uint32_t)_mm256_movemask_epi8(v);
+        memcpy(data + i, &four, 4);
+    }
+
+    extract_swar(carriers, data + i, nbytes - i);
+}
+#endif
+
+/* The tables and the default kernel are set up once, whichever thread gets there first */
+static pthread_once_t lsb_once = PTHREAD_ONCE_INIT;
+
+/* Kernel variants, narrowest first */
+static const char *const lsb_variants[] = {"swar64", "sse2", "avx2"};
+
+/* Point every kernel at one variant, e_failure if it is unknown or the CPU lacks it */
+static Status lsb_use(const char *name)
+{
+    if (strcmp(name, "swar64") == 0)
+    {
+        lsb_embed_impl = embed_swar;
+        lsb_extract_impl = extract_swar;
+        lsb_match_impl = match_scalar;
+        lsb_pack_impl = pack_swar;
+        lsb_impl_name = "swar64";
+        return e_success;
+    }
+#if defined(__x86_64__)
+    if (strcmp(name, "sse2") == 0)
+    {
+        lsb_embed_impl = embed_sse2;
+        lsb_extract_impl = extract_sse2;
+        lsb_match_impl = match_sse2;
+        lsb_pack_impl = pack_sse2;
+        lsb_impl_name = "sse2";
+        return e_success;
+    }
+    if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2"))
+    {
+        lsb_embed_impl = embed_avx2;
+        lsb_extract_impl = extract_avx2;
+        lsb_match_impl = match_avx2;
+        lsb_pack_impl = pack_avx2;
+        lsb_impl_name = "avx2";
+        return e_success;
+    }
+#endif
+    return e_failure;
+}
+
+/* Build the spread table and pick the widest supported kernel */
+static void lsb_select(void)
+{
+    for (int v = 0; v < 256; v++)
+    {
+        uint64_t word = 0;
+        unsigned char reversed = 0;
+        for (int k = 0; k < 8; k++)
+        {
+            word |= (uint64_t)((v >> (7 - k)) & 1) << (8 * k);
+            reversed |= ((v >> (7 - k)) & 1) << k;
+        }
+        lsb_spread[v] = word;
+        lsb_reverse[v] = reversed;
+        lsb_columns[v] = 0;
+        for (int k = 0; k < 8; k++)
+        {
+            if ((v >> k) & 1)
+            {
+                lsb_columns[v] ^= k;
+            }
+        }
+    }
+
+    for (int i = sizeof(lsb_variants) / sizeof(lsb_variants[0]) - 1; i >= 0; i--)
+    {
+        if (lsb_use(lsb_variants[i]) == e_success)
+        {
+            break;
+        }
+    }
+}
+
+const char *lsb_kernel_variant(unsigned int i)
+{
+    return i < sizeof(lsb_variants) / sizeof(lsb_variants[0]) ? lsb_variants[i] : NULL;
+}
+
+Status lsb_set_kernel(const char *name)
+{
+    pthread_once(&lsb_once, lsb_select);
+    return lsb_use(name);
+}
+
+void lsb_embed(unsigned char *carriers, const unsigned char *data, size_t nbytes)
+{
+    pthread_once(&lsb_once, lsb_select);
+    lsb_embed_impl(carriers, data, nbytes);
+}
+
+void lsb_extract(const unsigned char *carriers, unsigned char *data, size_t nbytes)
+{
+    pthread_once(&lsb_once, lsb_select);
+    lsb_extract_impl(carriers, data, nbytes);
+}
+
+void lsb_match(unsigned char *carriers, const unsigned char *data, size_t nbytes,
+               unsigned long long key, unsigned long long ordinal)
+{
+    pthread_once(&lsb_once, lsb_select);
+    lsb_match_impl(carriers, data, nbytes, key, ordinal);
+}
+
+unsigned char lsb_match_bit(unsigned char carrier, unsigned int bit, unsigned long long key, unsigned long long ordinal)
+{
+    return match_carrier(carrier, bit & 1, (unsigned int)(match_signs(key, ordinal) & 1));
+}
+
+unsigned int lsb_syndrome(const unsigned char *carriers, unsigned int n)
+{
+    unsigned int syndrome = 0;
+    unsigned int column = 1;
+
+    pthread_once(&lsb_once, lsb_select);
+
+    // Step 1: Columns 1 to 7 are carriers 0 to 6
+    for (; column < 8 && column <= n; column++)
+    {
+        if (carriers[column - 1] & 1)
+        {
+            syndrome ^= column;
+        }
+    }
+
+    // Step 2: Columns 8g to 8g+7 share their high bits, one word of carriers each
+    for (; column + 7 <= n; column += 8)
+    {
+        uint64_t word;
+        memcpy(&word, carriers + column - 1, 8);
+        unsigned int bits = (unsigned int)(((word & LSB_ONLY) * LSB_GATHER_LOW_FIRST) >> 56);
+        syndrome ^= lsb_columns[bits] ^ (__builtin_parity(bits) ? column : 0);
+    }
+
+    // Step 3: Columns left over when n + 1 is not a multiple of 8
+    for (; column <= n; column++)
+    {
+        if (carriers[column - 1] & 1)
+        {
+            syndrome ^= column;
+        }
+    }
+    return syndrome;
+}
+
+/* k <= 8 packed LSBs from bit first on, the first in bit 0 */
+static unsigned int packed_bits(const uint64_t *bits, size_t first, unsigned int k)
+{
+    unsigned int shift = first & 63;
+    uint64_t value = bits[first / 64] >> shift;
+
+    if (shift + k > 64)
+    {
+        value |= bits[first / 64 + 1] << (64 - shift);
+    }
+    return (unsigned int)value & ((1u << k) - 1);
+}
+
+/* Syndrome of the code block of n carriers whose LSBs are packed from bit first on */
+static unsigned int packed_syndrome(const uint64_t *bits, size_t first, unsigned int n)
+{
+    // Columns 1 to 7, then 8c to 8c+7 (carriers 8c-1 to 8c+6) sharing their high bits
+    unsigned int low = n < 7 ? n : 7;
+    unsigned int syndrome = lsb_columns[packed_bits(bits, first, low) << 1];
+
+    for (unsigned int column = 8; column + 7 <= n; column += 8)
+    {
+        unsigned int group = packed_bits(bits, first + column - 1, 8);
+        syndrome ^= lsb_columns[group] ^ (__builtin_parity(group) ? column : 0);
+    }
+    return syndrome;
+}
+
+/* p data bits from bit on, MSB first, the first in the highest bit of the result */
+static unsigned int data_bits(const unsigned char *data, size_t bit, unsigned int p)
+{
+    unsigned int offset = bit & 7;
+    unsigned int value = (unsigned int)data[bit / 8] << 8;
+
+    if (offset + p > 8)
+    {
+        value |= data[bit / 8 + 1];
+    }
+    return (value >> (16 - offset - p)) & ((1u << p) - 1);
+}
+
+void lsb_matrix_embed(unsigned char *carriers, size_t nblocks, unsigned int p, const unsigned char *data, size_t bit,
+                      int matching, unsigned long long key, unsigned long long ordinal)
+{
+    uint64_t bits[LSB_PACK_WORDS + 1];
+    unsigned int n = (1u << p) - 1;
+    size_t per_pack = LSB_PACK_WORDS * 64 / n;
+
+    pthread_once(&lsb_once, lsb_select);
+    while (nblocks > 0)
+    {
+        // Step 1: LSBs of as many blocks as one pack holds
+        size_t count = nblocks < per_pack ? nblocks : per_pack;
+        lsb_pack_impl(carriers, count * n, bits);
+
+        // Step 2: Every block whose syndrome differs from its message gets one carrier changed
+        for (size_t j = 0; j < count; j++, bit += p)
+        {
+            unsigned int column = packed_syndrome(bits, j * n, n) ^ data_bits(data, bit, p);
+            if (column != 0)
+            {
+                size_t at = j * n + column - 1;
+                carriers[at] = matching ? match_carrier(carriers[at], ~carriers[at] & 1,
+                                                        (unsigned int)(match_signs(key, ordinal + at) & 1))
+                                        : carriers[at] ^ 1;
+            }
+        }
+        carriers += count * n;
+        ordinal += count * n;
+        nblocks -= count;
+    }
+}
+
+void lsb_matrix_extract(const unsigned char *carriers, size_t nblocks, unsigned int p, unsigned char *data, size_t bit)
+{
+    uint64_t bits[LSB_PACK_WORDS + 1];
+    unsigned int n = (1u << p) - 1;
+    size_t per_pack = LSB_PACK_WORDS * 64 / n;
+
+    pthread_once(&lsb_once, lsb_select);
+    while (nblocks > 0)
+    {
+        size_t count = nblocks < per_pack ? nblocks : per_pack;
+        lsb_pack_impl(carriers, count * n, bits);
+
+        // Each syndrome is the next p bits of the message, ORed into the (cleared) data
+        for (size_t j = 0; j < count; j++, bit += p)
+        {
+            unsigned int value = packed_syndrome(bits, j * n, n);
+            unsigned int offset = bit & 7;
+            unsigned int spread = value << (16 - offset - p);
+            data[bit / 8] |= (unsigned char)(spread >> 8);
+            if (offset + p > 8)
+            {
+                data[bit / 8 + 1] |= (unsigned char)spread;
+            }
+        }
+        carriers += count * n;
+        nblocks -= count;
+    }
+}
+
+unsigned long long lsb_match_key(const char *passphrase)
+{
+    // FNV-1a over the passphrase, then mixed so similar phrases give unrelated streams
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (const unsigned char *p = (const unsigned char *)passphrase; *p != '\0'; p++)
+    {
+        hash = (hash ^ *p) * 0x100000001B3ULL;
+    }
+    return mix64(hash);
+}
+
+const char *lsb_kernel_name(void)
+{
+    pthread_once(&lsb_once, lsb_select);
+    return lsb_impl_name;
+}
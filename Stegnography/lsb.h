@@ -0,0 +1,66 @@
+#ifndef LSB_H
+#define LSB_H
+
+#include <stddef.h>
+#include "types.h"
+
+/*
+ * Bulk LSB kernels over contiguous carrier bytes.
+ * Every data byte occupies 8 consecutive carriers, MSB first,
+ * exactly like encode_byte_to_lsb/decode_byte_from_lsb.
+ * The widest variant the CPU supports (AVX2, SSE2, 64-bit SWAR)
+ * is selected on first use.
+ */
+
+/* Embed nbytes of data into the LSBs of 8 * nbytes carriers */
+void lsb_embed(unsigned char *carriers, const unsigned char *data, size_t nbytes);
+
+/* Extract nbytes of data from the LSBs of 8 * nbytes carriers */
+void lsb_extract(const unsigned char *carriers, unsigned char *data, size_t nbytes);
+
+/*
+ * LSB matching: a carrier whose LSB already holds the data bit is left
+ * alone, otherwise one is added or subtracted (never wrapping past 0 or
+ * 255). The direction comes from a keyed stream indexed by the
+ * carrier's ordinal, so the result is deterministic for a key and does
+ * not depend on how a run is split. Extraction is lsb_extract as usual.
+ */
+void lsb_match(unsigned char *carriers, const unsigned char *data, size_t nbytes,
+               unsigned long long key, unsigned long long ordinal);
+
+/* One carrier of lsb_match, bit in the LSB */
+unsigned char lsb_match_bit(unsigned char carrier, unsigned int bit, unsigned long long key, unsigned long long ordinal);
+
+/* Key of the sign stream for a passphrase */
+unsigned long long lsb_match_key(const char *passphrase);
+
+/*
+ * Syndrome of a Hamming code block of n carriers: the XOR of the
+ * columns (1 to n) of the carriers whose LSB is set. With n = 2^p - 1
+ * the block holds a p-bit message and any message is reached by
+ * changing at most one carrier, the one in column syndrome ^ message.
+ */
+unsigned int lsb_syndrome(const unsigned char *carriers, unsigned int n);
+
+/*
+ * Whole code blocks in bulk: nblocks blocks of 2^p - 1 carriers back to
+ * back carry the message bits from bit on (MSB first). Their LSBs are
+ * packed with movemask and the syndromes come from a table per 8
+ * columns. Embedding flips the carrier to change, or matches it (see
+ * lsb_match) with ordinal the ordinal of the first carrier. Extraction
+ * ORs the bits into data, which has to be cleared.
+ */
+void lsb_matrix_embed(unsigned char *carriers, size_t nblocks, unsigned int p, const unsigned char *data, size_t bit,
+                      int matching, unsigned long long key, unsigned long long ordinal);
+void lsb_matrix_extract(const unsigned char *carriers, size_t nblocks, unsigned int p, unsigned char *data, size_t bit);
+
+/* Name of the selected kernel variant */
+const char *lsb_kernel_name(void);
+
+/* Name of kernel variant i (narrowest first, whether the CPU has it or not), NULL past the last */
+const char *lsb_kernel_variant(unsigned int i);
+
+/* Switch every kernel to a variant by name, e_failure if the CPU cannot run it */
+Status lsb_set_kernel(const char *name);
+
+#endif
@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "payload.h"
+#include "crc32c.h"
+
+unsigned long long payload_data_bytes(unsigned long long size)
+{
+    return size + (size + CRC_BLOCK_SIZE - 1) / CRC_BLOCK_SIZE * CRC_SIZE;
+}
+
+unsigned char *payload_build(FILE *fptr_secret, const char *secret_fname, const char *extn,
+                             unsigned long long size, size_t *payload_size)
+{
+    size_t extn_size = strlen(extn);
+    size_t header = PAYLOAD_HEADER_FIXED + extn_size + PAYLOAD_HEADER_TAIL;
+    unsigned char *payload = malloc(header + payload_data_bytes(size));
+    if (payload == NULL)
+    {
+        printf("ERROR: Out of memory for the payload of %s\n", secret_fname);
+        return NULL;
+    }
+
+    // Step 1: Header and its checksum
+    memcpy(payload, MAGIC_STRING, 2);
+    put_be32(payload + 2, (uint)FORMAT_VERSION << MODE_VERSION_SHIFT);
+    put_be32(payload + 6, (uint)extn_size);
+    memcpy(payload + PAYLOAD_HEADER_FIXED, extn, extn_size);
+    put_be32(payload + PAYLOAD_HEADER_FIXED + extn_size, (uint)size);
+    put_be32(payload + header - CRC_SIZE, crc32c_update(0, payload, header - CRC_SIZE));
+
+    // Step 2: The data, every block followed by its checksum
+    unsigned char *p = payload + header;
+    for (unsigned long long left = size; left > 0;)
+    {
+        size_t n = left < CRC_BLOCK_SIZE ? left : CRC_BLOCK_SIZE;
+        if (fread(p, 1, n, fptr_secret) != n)
+        {
+            printf("ERROR: Failed to read the secret file %s\n", secret_fname);
+            free(payload);
+            return NULL;
+        }
+        put_be32(p + n, crc32c_update(0, p, n));
+        p += n + CRC_SIZE;
+        left -= n;
+    }
+    *payload_size = p - payload;
+    return payload;
+}
+
+size_t payload_header_size(const unsigned char *header)
+{
+    uint mode = get_be32(header + 2);
+    uint extn_size = get_be32(header + 6);
+
+    // These modes embed the payload whole, so the mode word holds nothing but the version
+    if (memcmp(header, MAGIC_STRING, 2) != 0 || (mode & ~MODE_VERSION_MASK) != 0 ||
+        mode >> MODE_VERSION_SHIFT > FORMAT_VERSION || extn_size >= MAX_FILE_SUFFIX)
+    {
+        return 0;
+    }
+    return PAYLOAD_HEADER_FIXED + extn_size + PAYLOAD_HEADER_TAIL;
+}
+
+Status payload_header_check(const unsigned char *header, size_t header_size, uint *size)
+{
+    if (crc32c_update(0, header, header_size - CRC_SIZE) != get_be32(header + header_size - CRC_SIZE))
+    {
+        return e_failure;
+    }
+    *size = get_be32(header + header_size - PAYLOAD_HEADER_TAIL);
+    return e_success;
+}
+
+void payload_output_name(char *fname, size_t len, const char *base, const unsigned char *header)
+{
+    uint extn_size = get_be32(header + 6);
+
+    if (strchr(base, '.') != NULL || extn_size == 0)
+    {
+        snprintf(fname, len, "%s", base);
+    }
+    else
+    {
+        snprintf(fname, len, "%s%.*s", base, (int)extn_size, header + PAYLOAD_HEADER_FIXED);
+    }
+}
+
+Status payload_write_block(FILE *fptr_out, const char *fname, const unsigned char *block, uint len, uint index)
+{
+    if (crc32c_update(0, block, len) != get_be32(block + len))
+    {
+        printf("ERROR: Checksum mismatch in payload block %u.\n", index);
+        return e_failure;
+    }
+    if (fwrite(block, 1, len, fptr_out) != len)
+    {
+        printf("ERROR: Failed to write the output file %s\n", fname);
+        return e_failure;
+    }
+    return e_success;
+}
@@ -0,0 +1,45 @@
+#ifndef PAYLOAD_H
+#define PAYLOAD_H
+
+#include <stdio.h>
+#include "types.h"
+#include "common.h"
+#include "encode.h"
+
+/*
+ * The payload in the byte layout the BMP/PNG format embeds, for the
+ * modes that hold it as a whole (JPEG coefficients, layered carrier
+ * sets):
+ *
+ *   magic string | mode word (format version only) | extension size | extension | size |
+ *   header CRC32C | data in CRC_BLOCK_SIZE blocks, each followed by its CRC32C
+ *
+ * All sizes and checksums are big endian. Building, parsing and block
+ * verification live here only, so the format changes in one place.
+ */
+
+/* Bytes of the header before the extension, and after it */
+#define PAYLOAD_HEADER_FIXED (2 + MODE_SIZE + 4)
+#define PAYLOAD_HEADER_TAIL (4 + CRC_SIZE)
+#define PAYLOAD_HEADER_MAX (PAYLOAD_HEADER_FIXED + MAX_FILE_SUFFIX + PAYLOAD_HEADER_TAIL)
+
+/* Data bytes of a secret of size bytes with its block checksums */
+unsigned long long payload_data_bytes(unsigned long long size);
+
+/* Header and checksummed blocks of a secret file of size bytes, NULL (reported) on failure */
+unsigned char *payload_build(FILE *fptr_secret, const char *secret_fname, const char *extn,
+                             unsigned long long size, size_t *payload_size);
+
+/* Magic string, mode word and extension size of the first PAYLOAD_HEADER_FIXED bytes: the size of the whole header, 0 if invalid */
+size_t payload_header_size(const unsigned char *header);
+
+/* Checksum of a complete header: the size of the secret, e_failure if it does not match */
+Status payload_header_check(const unsigned char *header, size_t header_size, uint *size);
+
+/* Output file name: the base, with the stored extension unless the base has one */
+void payload_output_name(char *fname, size_t len, const char *base, const unsigned char *header);
+
+/* Verify block number index (len data bytes and their CRC32C) and write its data */
+Status payload_write_block(FILE *fptr_out, const char *fname, const unsigned char *block, uint len, uint index);
+
+#endif
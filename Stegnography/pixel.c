@@ -0,0 +1,245 @@
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include "pixel.h"
+
+#if defined(__x86_64__)
+#include <tmmintrin.h>
+#endif
+
+/* Number of set bits in a 4-bit channel mask, usable in initializers */
+#define MASK_CARRIERS(m) (((m) & 1) + (((m) >> 1) & 1) + (((m) >> 2) & 1) + (((m) >> 3) & 1))
+
+/*
+ * Gather/scatter specialized per bytes-per-pixel and channel mask.
+ * BPP and MASK are compile-time constants, so the channel loop is
+ * fully unrolled and the mask tests disappear in each instance.
+ */
+#define DEFINE_PIXEL_VIEW(BPP, MASK)                                                           \
+static size_t gather_##BPP##_##MASK(unsigned char *carriers, const unsigned char *pixels,      \
+                                    size_t npixels)                                            \
+{                                                                                              \
+    unsigned char *out = carriers;                                                             \
+    for (size_t p = 0; p < npixels; p++, pixels += BPP)                                        \
+    {                                                                                          \
+        for (uint c = 0; c < BPP; c++)                                                         \
+        {                                                                                      \
+            if ((MASK) & (1u << c))                                                            \
+            {                                                                                  \
+                *out++ = pixels[c];                                                            \
+            }                                                                                  \
+        }                                                                                      \
+    }                                                                                          \
+    return out - carriers;                                                                     \
+}                                                                                              \
+static void scatter_##BPP##_##MASK(unsigned char *pixels, const unsigned char *carriers,       \
+                                   size_t npixels)                                             \
+{                                                                                              \
+    for (size_t p = 0; p < npixels; p++, pixels += BPP)                                        \
+    {                                                                                          \
+        for (uint c = 0; c < BPP; c++)                                                         \
+        {                                                                                      \
+            if ((MASK) & (1u << c))                                                            \
+            {                                                                                  \
+                pixels[c] = *carriers++;                                                       \
+            }                                                                                  \
+        }                                                                                      \
+    }                                                                                          \
+}
+
+#define PIXEL_VIEW_ENTRY(BPP, MASK) \
+    [MASK] = { BPP, MASK, MASK_CARRIERS(MASK), gather_##BPP##_##MASK, scatter_##BPP##_##MASK },
+
+/* Partial channel masks for 2, 3 and 4 byte pixels (full masks need no copy) */
+#define PARTIAL_MASKS_16(X) X(2, 1) X(2, 2)
+#define PARTIAL_MASKS_24(X) X(3, 1) X(3, 2) X(3, 3) X(3, 4) X(3, 5) X(3, 6)
+#define PARTIAL_MASKS_32(X) X(4, 1) X(4, 2) X(4, 3) X(4, 4) X(4, 5) X(4, 6) X(4, 7) \
+                            X(4, 8) X(4, 9) X(4, 10) X(4, 11) X(4, 12) X(4, 13) X(4, 14)
+
+PARTIAL_MASKS_16(DEFINE_PIXEL_VIEW)
+PARTIAL_MASKS_24(DEFINE_PIXEL_VIEW)
+PARTIAL_MASKS_32(DEFINE_PIXEL_VIEW)
+
+static const PixelView views_graya16[4] =
+{
+    PARTIAL_MASKS_16(PIXEL_VIEW_ENTRY)
+    [3] = { 2, 3, 2, NULL, NULL },
+};
+
+static const PixelView views_bgr24[8] =
+{
+    PARTIAL_MASKS_24(PIXEL_VIEW_ENTRY)
+    [7] = { 3, 7, 3, NULL, NULL },
+};
+
+static const PixelView views_bgra32[16] =
+{
+    PARTIAL_MASKS_32(PIXEL_VIEW_ENTRY)
+    [15] = { 4, 15, 4, NULL, NULL },
+};
+
+static const PixelView view_8bit = { 1, 1, 1, NULL, NULL };
+
+#if defined(__x86_64__)
+/*
+ * BGRA/RGBA with alpha skipped is the common 32-bit case: compact 4 pixels
+ * (16 bytes) into 12 carriers with one shuffle. Both directions touch
+ * up to 4 bytes past the last carrier, see carrier buffer slack.
+ */
+__attribute__((target("ssse3")))
+static size_t gather_bgra_ssse3(unsigned char *carriers, const unsigned char *pixels, size_t npixels)
+{
+    const __m128i pick = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    size_t p = 0;
+
+    for (; p + 4 <= npixels; p += 4)
+    {
+        __m128i px = _mm_loadu_si128((const __m128i *)(pixels + p * 4));
+        _mm_storeu_si128((__m128i *)(carriers + p * 3), _mm_shuffle_epi8(px, pick));
+    }
+
+    return p * 3 + gather_4_7(carriers + p * 3, pixels + p * 4, npixels - p);
+}
+
+__attribute__((target("ssse3")))
+static void scatter_bgra_ssse3(unsigned char *pixels, const unsigned char *carriers, size_t npixels)
+{
+    const __m128i spread = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+    size_t p = 0;
+
+    for (; p + 4 <= npixels; p += 4)
+    {
+        __m128i px = _mm_loadu_si128((const __m128i *)(pixels + p * 4));
+        __m128i bgr = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(carriers + p * 3)), spread);
+        _mm_storeu_si128((__m128i *)(pixels + p * 4), _mm_or_si128(_mm_and_si128(px, alpha), bgr));
+    }
+
+    scatter_4_7(pixels + p * 4, carriers + p * 3, npixels - p);
+}
+
+static const PixelView view_bgra_ssse3 = { 4, 7, 3, gather_bgra_ssse3, scatter_bgra_ssse3 };
+#endif
+
+uint pixel_bytes_per_pixel(PixelFormat format)
+{
+    switch (format)
+    {
+        case e_pixel_bgr24:   return 3;
+        case e_pixel_bgra32:  return 4;
+        case e_pixel_pal8:    return 1;
+        case e_pixel_rgb24:   return 3;
+        case e_pixel_rgba32:  return 4;
+        case e_pixel_gray8:   return 1;
+        case e_pixel_graya16: return 2;
+        default:              return 0;
+    }
+}
+
+uint pixel_default_mask(PixelFormat format)
+{
+    switch (format)
+    {
+        case e_pixel_bgr24:   return 0x7;   // B, G, R
+        case e_pixel_bgra32:  return 0x7;   // B, G, R (alpha untouched)
+        case e_pixel_pal8:    return 0x1;   // Palette index
+        case e_pixel_rgb24:   return 0x7;   // R, G, B
+        case e_pixel_rgba32:  return 0x7;   // R, G, B (alpha untouched)
+        case e_pixel_gray8:   return 0x1;   // Gray
+        case e_pixel_graya16: return 0x1;   // Gray (alpha untouched)
+        default:              return 0;
+    }
+}
+
+const char *pixel_format_name(PixelFormat format)
+{
+    switch (format)
+    {
+        case e_pixel_bgr24:   return "24-bit BGR";
+        case e_pixel_bgra32:  return "32-bit BGRA";
+        case e_pixel_pal8:    return "8-bit palettized";
+        case e_pixel_rgb24:   return "24-bit RGB";
+        case e_pixel_rgba32:  return "32-bit RGBA";
+        case e_pixel_gray8:   return "8-bit grayscale";
+        case e_pixel_graya16: return "16-bit grayscale+alpha";
+        default:              return "unsupported";
+    }
+}
+
+const char *pixel_channel_names(PixelFormat format)
+{
+    switch (format)
+    {
+        case e_pixel_bgr24:   return "bgr";
+        case e_pixel_bgra32:  return "bgra";
+        case e_pixel_pal8:    return "i";
+        case e_pixel_rgb24:   return "rgb";
+        case e_pixel_rgba32:  return "rgba";
+        case e_pixel_gray8:   return "l";
+        case e_pixel_graya16: return "la";
+        default:              return NULL;
+    }
+}
+
+Status pixel_parse_channels(PixelFormat format, const char *names, uint *mask)
+{
+    // Step 1: Channel letters in byte order for each format
+    const char *order = pixel_channel_names(format);
+    if (order == NULL)
+    {
+        return e_failure;
+    }
+
+    // Step 2: Set the bit of every named channel
+    *mask = 0;
+    for (const char *p = names; *p != '\0'; p++)
+    {
+        const char *found = strchr(order, tolower((unsigned char)*p));
+        if (found == NULL)
+        {
+            printf("ERROR: Channel '%c' does not exist in %s images (use \"%s\").\n",
+                   *p, pixel_format_name(format), order);
+            return e_failure;
+        }
+        *mask |= 1u << (found - order);
+    }
+
+    // Step 3: An empty selection leaves nothing to embed into
+    if (*mask == 0)
+    {
+        printf("ERROR: No channels selected.\n");
+        return e_failure;
+    }
+
+    return e_success;
+}
+
+const PixelView *pixel_view(PixelFormat format, uint mask)
+{
+    switch (format)
+    {
+        case e_pixel_bgr24:
+        case e_pixel_rgb24:
+            return (mask >= 1 && mask <= 7) ? &views_bgr24[mask] : NULL;
+
+        case e_pixel_bgra32:
+        case e_pixel_rgba32:
+#if defined(__x86_64__)
+            if (mask == 0x7 && __builtin_cpu_supports("ssse3"))
+            {
+                return &view_bgra_ssse3;
+            }
+#endif
+            return (mask >= 1 && mask <= 15) ? &views_bgra32[mask] : NULL;
+
+        case e_pixel_pal8:
+        case e_pixel_gray8:
+            return (mask == 1) ? &view_8bit : NULL;
+
+        case e_pixel_graya16:
+            return (mask >= 1 && mask <= 3) ? &views_graya16[mask] : NULL;
+
+        default:
+            return NULL;
+    }
+}
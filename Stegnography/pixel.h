@@ -0,0 +1,59 @@
+#ifndef PIXEL_H
+#define PIXEL_H
+
+#include <stddef.h>
+#include "types.h"
+
+/* Extra bytes a carrier buffer needs past its last carrier */
+#define PIXEL_VIEW_SLACK 16
+
+/* Pixel layouts the embedder understands */
+typedef enum
+{
+    e_pixel_bgr24,     // 24-bit BMP: B, G, R
+    e_pixel_bgra32,    // 32-bit BMP: B, G, R, A
+    e_pixel_pal8,      // 8-bit palettized BMP/PNG: one palette index
+    e_pixel_rgb24,     // 24-bit PNG: R, G, B
+    e_pixel_rgba32,    // 32-bit PNG: R, G, B, A
+    e_pixel_gray8,     // 8-bit grayscale PNG
+    e_pixel_graya16,   // 8-bit grayscale + alpha PNG
+    e_pixel_unsupported
+} PixelFormat;
+
+/*
+ * A carrier view of one pixel format under one channel mask.
+ * Bit i of the mask selects byte i of every pixel as a carrier.
+ * gather copies the selected bytes of npixels pixels into a
+ * contiguous carrier array, scatter writes them back. Views whose
+ * mask selects every byte have NULL gather/scatter: the pixel bytes
+ * are used as carriers in place. Gather and scatter may touch up to
+ * PIXEL_VIEW_SLACK bytes past the last carrier.
+ */
+typedef struct _PixelView
+{
+    uint bytes_per_pixel;
+    uint mask;
+    uint carriers_per_pixel;
+    size_t (*gather)(unsigned char *carriers, const unsigned char *pixels, size_t npixels);
+    void (*scatter)(unsigned char *pixels, const unsigned char *carriers, size_t npixels);
+} PixelView;
+
+/* Bytes per pixel of a format (0 if unsupported) */
+uint pixel_bytes_per_pixel(PixelFormat format);
+
+/* Channel mask used for the stego header (all colour channels, never alpha) */
+uint pixel_default_mask(PixelFormat format);
+
+/* Name of a format for messages */
+const char *pixel_format_name(PixelFormat format);
+
+/* Channel letters in byte order (e.g. "bgr"), NULL if unsupported */
+const char *pixel_channel_names(PixelFormat format);
+
+/* Parse channel letters (e.g. "bg") into a mask for the format */
+Status pixel_parse_channels(PixelFormat format, const char *names, uint *mask);
+
+/* Get the specialized view for a format and mask, NULL if the mask is invalid */
+const PixelView *pixel_view(PixelFormat format, uint mask);
+
+#endif
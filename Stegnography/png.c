@@ -0,0 +1,509 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "image.h"
+#include "flate.h"
+#include "bmp.h"
+#include "crc32c.h"
+
+/*
+ * PNG container. Chunks before the image data are copied as they are,
+ * the IDAT stream is inflated row by row, unfiltered for the caller and,
+ * when writing, filtered again with the row's original filter type and
+ * deflated into fresh IDAT chunks. Chunks after the image data are
+ * copied as they are. Only 8-bit, non-interlaced images are handled.
+ */
+
+#define PNG_SIGNATURE "\x89PNG\r\n\x1a\n"
+#define PNG_SIGNATURE_SIZE 8
+
+/* Reflected IEEE polynomial used by PNG chunk CRCs */
+#define PNG_CRC_POLY 0xEDB88320u
+
+typedef struct _PngState
+{
+    /* Source IDAT stream */
+    Inflate inflate;
+    uint idat_left;                   // Bytes left in the current IDAT chunk
+    uint idat_crc;                    // Running CRC of the current IDAT chunk
+    int idat_done;                    // Next non-IDAT chunk header is in next_chunk
+    unsigned char next_chunk[8];
+    Status src_status;
+
+    /* Destination IDAT stream */
+    Deflate deflate;
+    int deflate_open;
+
+    /* Filtering */
+    uint bpp;                         // Bytes per pixel, the filter distance
+    unsigned char *filter_types;      // Filter type of each source row, reused on write
+    unsigned char *prev_in;           // Previous unfiltered source row
+    unsigned char *prev_out;          // Previous unfiltered destination row
+    unsigned char *line;              // Filter byte + filtered row
+} PngState;
+
+static uint png_crc_table[256];
+
+static void png_crc_init(void)
+{
+    for (uint i = 0; i < 256; i++)
+    {
+        uint crc = i;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ PNG_CRC_POLY : (crc >> 1);
+        }
+        png_crc_table[i] = crc;
+    }
+}
+
+/* Chunk CRC, chained like crc32c_update (start with 0) */
+static uint png_crc(uint crc, const unsigned char *buf, size_t len)
+{
+    if (png_crc_table[1] == 0)
+    {
+        png_crc_init();
+    }
+
+    crc = ~crc;
+    while (len--)
+    {
+        crc = (crc >> 8) ^ png_crc_table[(crc ^ *buf++) & 0xFF];
+    }
+    return ~crc;
+}
+
+/* Write one complete chunk */
+static Status png_write_chunk(FILE *fptr, const char *type, const unsigned char *data, uint len)
+{
+    unsigned char head[8], tail[4];
+
+    put_be32(head, len);
+    memcpy(head + 4, type, 4);
+    put_be32(tail, png_crc(png_crc(0, head + 4, 4), data, len));
+
+    if (fwrite(head, 1, 8, fptr) != 8 || fwrite(data, 1, len, fptr) != len || fwrite(tail, 1, 4, fptr) != 4)
+    {
+        printf("ERROR: Failed to write %.4s chunk to stego image.\n", type);
+        return e_failure;
+    }
+    return e_success;
+}
+
+/* Deflate output goes straight into IDAT chunks */
+static Status png_write_idat(void *ctx, const unsigned char *buf, size_t len)
+{
+    Image *image = ctx;
+    return png_write_chunk(image->fptr_dest, "IDAT", buf, (uint)len);
+}
+
+/* Verify the CRC of the IDAT chunk just consumed and read the next chunk header */
+static int png_next_idat(Image *image, PngState *png)
+{
+    unsigned char crc[4];
+
+    if (fread(crc, 1, 4, image->fptr_src) != 4 || get_be32(crc) != png->idat_crc)
+    {
+        printf("ERROR: PNG image data chunk is corrupt.\n");
+        png->src_status = e_failure;
+        return 0;
+    }
+    if (fread(png->next_chunk, 1, 8, image->fptr_src) != 8)
+    {
+        printf("ERROR: PNG file is truncated.\n");
+        png->src_status = e_failure;
+        return 0;
+    }
+    if (memcmp(png->next_chunk + 4, "IDAT", 4) != 0)
+    {
+        png->idat_done = 1;
+        return 0;
+    }
+    png->idat_left = get_be32(png->next_chunk);
+    png->idat_crc = png_crc(0, png->next_chunk + 4, 4);
+    return 1;
+}
+
+/* Inflate input: the data of consecutive IDAT chunks */
+static size_t png_read_idat(void *ctx, unsigned char *buf, size_t len)
+{
+    Image *image = ctx;
+    PngState *png = image->state;
+
+    while (!png->idat_done && png->src_status == e_success)
+    {
+        if (png->idat_left == 0)
+        {
+            if (!png_next_idat(image, png))
+            {
+                break;
+            }
+            continue;
+        }
+
+        size_t n = len < png->idat_left ? len : png->idat_left;
+        if (fread(buf, 1, n, image->fptr_src) != n)
+        {
+            printf("ERROR: PNG file is truncated.\n");
+            png->src_status = e_failure;
+            break;
+        }
+        png->idat_left -= n;
+        png->idat_crc = png_crc(png->idat_crc, buf, n);
+        return n;
+    }
+    return 0;
+}
+
+static unsigned char paeth(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+
+    if (pa <= pb && pa <= pc)
+    {
+        return a;
+    }
+    return pb <= pc ? b : c;
+}
+
+/* Undo the row filter in place */
+static Status png_unfilter(unsigned char *row, const unsigned char *prev, uint n, uint bpp, uint type)
+{
+    uint i;
+
+    switch (type)
+    {
+        case 0:
+            break;
+        case 1:
+            for (i = bpp; i < n; i++)
+                row[i] += row[i - bpp];
+            break;
+        case 2:
+            for (i = 0; i < n; i++)
+                row[i] += prev[i];
+            break;
+        case 3:
+            for (i = 0; i < bpp; i++)
+                row[i] += prev[i] >> 1;
+            for (; i < n; i++)
+                row[i] += (row[i - bpp] + prev[i]) >> 1;
+            break;
+        case 4:
+            for (i = 0; i < bpp; i++)
+                row[i] += prev[i];
+            for (; i < n; i++)
+                row[i] += paeth(row[i - bpp], prev[i], prev[i - bpp]);
+            break;
+        default:
+            printf("ERROR: Unknown PNG filter type %u.\n", type);
+            return e_failure;
+    }
+    return e_success;
+}
+
+/* Apply a row filter, out and row must not overlap */
+static void png_filter(unsigned char *out, const unsigned char *row, const unsigned char *prev,
+                       uint n, uint bpp, uint type)
+{
+    uint i;
+
+    switch (type)
+    {
+        case 1:
+            memcpy(out, row, bpp < n ? bpp : n);
+            for (i = bpp; i < n; i++)
+                out[i] = row[i] - row[i - bpp];
+            break;
+        case 2:
+            for (i = 0; i < n; i++)
+                out[i] = row[i] - prev[i];
+            break;
+        case 3:
+            for (i = 0; i < bpp && i < n; i++)
+                out[i] = row[i] - (prev[i] >> 1);
+            for (; i < n; i++)
+                out[i] = row[i] - ((row[i - bpp] + prev[i]) >> 1);
+            break;
+        case 4:
+            for (i = 0; i < bpp && i < n; i++)
+                out[i] = row[i] - prev[i];
+            for (; i < n; i++)
+                out[i] = row[i] - paeth(row[i - bpp], prev[i], prev[i - bpp]);
+            break;
+        default:
+            memcpy(out, row, n);
+            break;
+    }
+}
+
+/* Map IHDR colour type to a pixel format (8 bits per sample only) */
+static PixelFormat png_pixel_format(uint bit_depth, uint color_type)
+{
+    if (bit_depth != 8)
+    {
+        return e_pixel_unsupported;
+    }
+
+    switch (color_type)
+    {
+        case 0:  return e_pixel_gray8;
+        case 2:  return e_pixel_rgb24;
+        case 3:  return e_pixel_pal8;
+        case 4:  return e_pixel_graya16;
+        case 6:  return e_pixel_rgba32;
+        default: return e_pixel_unsupported;
+    }
+}
+
+static Status png_open(Image *image)
+{
+    unsigned char sig[PNG_SIGNATURE_SIZE], head[8], ihdr[13 + 4];
+    FILE *src = image->fptr_src, *dest = image->fptr_dest;
+
+    PngState *png = calloc(1, sizeof(*png));
+    if (png == NULL)
+    {
+        printf("ERROR: Out of memory.\n");
+        return e_failure;
+    }
+    image->state = png;
+    png->src_status = e_success;
+
+    // Step 1: Signature and IHDR
+    if (fread(sig, 1, sizeof(sig), src) != sizeof(sig) || memcmp(sig, PNG_SIGNATURE, sizeof(sig)) != 0 ||
+        fread(head, 1, 8, src) != 8 || memcmp(head + 4, "IHDR", 4) != 0 || get_be32(head) != 13 ||
+        fread(ihdr, 1, sizeof(ihdr), src) != sizeof(ihdr))
+    {
+        printf("ERROR: Not a PNG file.\n");
+        return e_failure;
+    }
+    if (png_crc(png_crc(0, head + 4, 4), ihdr, 13) != get_be32(ihdr + 13))
+    {
+        printf("ERROR: PNG header chunk is corrupt.\n");
+        return e_failure;
+    }
+
+    image->width = get_be32(ihdr);
+    image->height = get_be32(ihdr + 4);
+    image->format = png_pixel_format(ihdr[8], ihdr[9]);
+    if (image->format == e_pixel_unsupported || ihdr[12] != 0)
+    {
+        printf("ERROR: Unsupported PNG format (bit depth %u, colour type %u, interlace %u).\n",
+               ihdr[8], ihdr[9], ihdr[12]);
+        return e_failure;
+    }
+    png->bpp = pixel_bytes_per_pixel(image->format);
+    if (image->width == 0 || image->height == 0 || image->width > 0x7FFFFFFFu / png->bpp)
+    {
+        printf("ERROR: Corrupt PNG header.\n");
+        return e_failure;
+    }
+    image->row_bytes = image->width * png->bpp;
+    image->row_alloc = image->row_bytes;
+
+    if (dest != NULL &&
+        (fwrite(sig, 1, sizeof(sig), dest) != sizeof(sig) || fwrite(head, 1, 8, dest) != 8 ||
+         fwrite(ihdr, 1, sizeof(ihdr), dest) != sizeof(ihdr)))
+    {
+        printf("ERROR: Failed to write PNG header to stego image.\n");
+        return e_failure;
+    }
+
+    // Step 2: Copy ancillary chunks (and the palette) up to the first IDAT
+    while (1)
+    {
+        if (fread(head, 1, 8, src) != 8)
+        {
+            printf("ERROR: PNG file has no image data.\n");
+            return e_failure;
+        }
+        if (memcmp(head + 4, "IDAT", 4) == 0)
+        {
+            break;
+        }
+        if (dest != NULL && fwrite(head, 1, 8, dest) != 8)
+        {
+            printf("ERROR: Failed to write PNG chunk to stego image.\n");
+            return e_failure;
+        }
+
+        unsigned char buf[4096];
+        long left = (long)get_be32(head) + 4;
+        while (left > 0)
+        {
+            size_t n = left < (long)sizeof(buf) ? (size_t)left : sizeof(buf);
+            if (fread(buf, 1, n, src) != n)
+            {
+                printf("ERROR: PNG file is truncated.\n");
+                return e_failure;
+            }
+            if (dest != NULL && fwrite(buf, 1, n, dest) != n)
+            {
+                printf("ERROR: Failed to write PNG chunk to stego image.\n");
+                return e_failure;
+            }
+            left -= n;
+        }
+    }
+
+    // Step 3: Row buffers (with one zero pixel in front for the filters)
+    png->filter_types = malloc(image->height);
+    png->prev_in = calloc(1, image->row_bytes);
+    png->prev_out = calloc(1, image->row_bytes);
+    png->line = malloc((size_t)image->row_bytes + 1);
+    if (png->filter_types == NULL || png->prev_in == NULL || png->prev_out == NULL || png->line == NULL)
+    {
+        printf("ERROR: Out of memory for a %u byte row.\n", image->row_bytes);
+        return e_failure;
+    }
+
+    // Step 4: Start the compressed streams
+    png->idat_left = get_be32(head);
+    png->idat_crc = png_crc(0, head + 4, 4);
+    if (inflate_init(&png->inflate, png_read_idat, image) == e_failure)
+    {
+        printf("ERROR: PNG image data is corrupt.\n");
+        return e_failure;
+    }
+    if (dest != NULL)
+    {
+        if (deflate_init(&png->deflate, image->level, png_write_idat, image) == e_failure)
+        {
+            return e_failure;
+        }
+        png->deflate_open = 1;
+    }
+
+    return e_success;
+}
+
+static Status png_read_row(Image *image, unsigned char *row, uint y)
+{
+    PngState *png = image->state;
+    unsigned char type;
+
+    // Step 1: Filter byte and filtered row
+    if (inflate_read(&png->inflate, &type, 1) == e_failure ||
+        inflate_read(&png->inflate, row, image->row_bytes) == e_failure)
+    {
+        printf("ERROR: PNG image data is corrupt.\n");
+        return e_failure;
+    }
+
+    // Step 2: Undo the filter against the previous row
+    if (png_unfilter(row, png->prev_in, image->row_bytes, png->bpp, type) == e_failure)
+    {
+        return e_failure;
+    }
+    png->filter_types[y] = type;
+    memcpy(png->prev_in, row, image->row_bytes);
+    return e_success;
+}
+
+static Status png_write_row(Image *image, const unsigned char *row, uint y)
+{
+    PngState *png = image->state;
+    uint type = png->filter_types[y];
+
+    // Keep the encoder's filter choice, it was picked for this image content
+    png->line[0] = type;
+    png_filter(png->line + 1, row, png->prev_out, image->row_bytes, png->bpp, type);
+    memcpy(png->prev_out, row, image->row_bytes);
+
+    return deflate_write(&png->deflate, png->line, (size_t)image->row_bytes + 1);
+}
+
+/* PNG rows are filtered against each other, so they go one at a time */
+static Status png_read_rows(Image *image, unsigned char *rows, uint n)
+{
+    for (uint i = 0; i < n; i++)
+    {
+        if (png_read_row(image, rows + (size_t)i * image->row_alloc, image->rows_read + i) == e_failure)
+        {
+            return e_failure;
+        }
+    }
+    return e_success;
+}
+
+static Status png_write_rows(Image *image, const unsigned char *rows, uint n)
+{
+    for (uint i = 0; i < n; i++)
+    {
+        if (png_write_row(image, rows + (size_t)i * image->row_alloc, image->rows_written + i) == e_failure)
+        {
+            return e_failure;
+        }
+    }
+    return e_success;
+}
+
+static Status png_finish(Image *image)
+{
+    PngState *png = image->state;
+    unsigned char *row = malloc((size_t)image->row_bytes + PIXEL_VIEW_SLACK);
+
+    if (row == NULL)
+    {
+        printf("ERROR: Out of memory for a %u byte row.\n", image->row_bytes);
+        return e_failure;
+    }
+
+    // Step 1: Rows not touched by the payload are re-encoded unchanged
+    while (image->rows_written < image->height)
+    {
+        if (image_read_rows(image, row, 1) == e_failure || image_write_rows(image, row, 1) == e_failure)
+        {
+            free(row);
+            return e_failure;
+        }
+    }
+    free(row);
+
+    // Step 2: Close the new IDAT stream
+    if (deflate_finish(&png->deflate) == e_failure)
+    {
+        printf("ERROR: Failed to compress the stego image data.\n");
+        return e_failure;
+    }
+
+    // Step 3: Skip what is left of the source IDAT chunks
+    unsigned char buf[4096];
+    while (png_read_idat(image, buf, sizeof(buf)) > 0)
+    {
+    }
+    if (png->src_status == e_failure)
+    {
+        return e_failure;
+    }
+
+    // Step 4: Everything after the image data is copied unchanged
+    if (fwrite(png->next_chunk, 1, 8, image->fptr_dest) != 8)
+    {
+        printf("ERROR: Failed to write PNG chunk to stego image.\n");
+        return e_failure;
+    }
+    return copy_remaining_img_data(image->fptr_src, image->fptr_dest);
+}
+
+static void png_close(Image *image)
+{
+    PngState *png = image->state;
+
+    if (png->deflate_open)
+    {
+        deflate_end(&png->deflate);
+    }
+    free(png->filter_types);
+    free(png->prev_in);
+    free(png->prev_out);
+    free(png->line);
+    free(png);
+}
+
+const ImageCodec png_codec =
+{
+    "PNG", ".png", png_open, png_read_rows, png_write_rows, png_finish, png_close, NULL, NULL
+};
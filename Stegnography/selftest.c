@@ -0,0 +1,1954 @@
+#define _GNU_SOURCE     // O_DIRECT
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include "selftest.h"
+#include "analyze.h"
+#include "carrier.h"
+#include "crc32c.h"
+#include "decode.h"
+#include "flate.h"
+#include "image.h"
+#include "jpeg.h"
+#include "layer.h"
+#include "lsb.h"
+#include "payload.h"
+#include "pixel.h"
+
+/* One line of the results table */
+typedef struct _SelftestResult
+{
+    char variant[24];
+    const char *check;
+    unsigned long long cases;       // 0 for a throughput-only line
+    unsigned long long failures;
+    double bytes;                   // Carrier or pixel bytes timed
+    double seconds;
+} SelftestResult;
+
+typedef struct _Selftest
+{
+    uint64_t rng;
+    uint64_t seed;
+    uint ncovers;
+    uint nthreads;
+    const char *dir;
+    const char *report_fname;
+    SelftestResult results[SELFTEST_MAX_RESULTS];
+    uint nresults;
+    unsigned long long cases;
+    unsigned long long failures;
+} Selftest;
+
+/* A random cover, both as pixels and as the file holding them */
+typedef struct _SelftestCover
+{
+    int png;
+    uint width, height;
+    uint bpp;                       // Bytes per pixel
+    PixelFormat format;
+    unsigned char *pixels;          // Top row first, width * bpp bytes per row
+    unsigned char *file;
+    size_t file_size;
+    size_t data_offset;             // BMP: pixel array
+    size_t stride;                  // BMP: bytes per stored row
+    int top_down;                   // BMP: first stored row is the top one
+    char desc[64];
+} SelftestCover;
+
+/* Growing byte buffer for the PNG writer */
+typedef struct _SelftestBuffer
+{
+    unsigned char *data;
+    size_t len;
+    size_t cap;
+} SelftestBuffer;
+
+/* One thread's piece of a split kernel run */
+typedef struct _SelftestThread
+{
+    int op;                         // 0 embed, 1 extract, 2 match
+    unsigned char *carriers;
+    unsigned char *data;
+    size_t nbytes;
+    unsigned long long key;
+    unsigned long long ordinal;
+    pthread_t tid;
+    int started;
+} SelftestThread;
+
+/* splitmix64, so a seed gives the same run everywhere */
+static uint64_t selftest_rand(Selftest *st)
+{
+    uint64_t x = (st->rng += 0x9E3779B97F4A7C15ULL);
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+static size_t selftest_below(Selftest *st, size_t n)
+{
+    return n == 0 ? 0 : (size_t)(selftest_rand(st) % n);
+}
+
+static void selftest_fill(Selftest *st, unsigned char *buf, size_t n)
+{
+    for (size_t i = 0; i < n; i += 8)
+    {
+        uint64_t r = selftest_rand(st);
+        memcpy(buf + i, &r, n - i < 8 ? n - i : 8);
+    }
+}
+
+static double now_seconds(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static SelftestResult *selftest_result(Selftest *st, const char *variant, const char *check)
+{
+    for (uint i = 0; i < st->nresults; i++)
+    {
+        if (strcmp(st->results[i].variant, variant) == 0 && strcmp(st->results[i].check, check) == 0)
+        {
+            return &st->results[i];
+        }
+    }
+    if (st->nresults == SELFTEST_MAX_RESULTS)
+    {
+        return &st->results[SELFTEST_MAX_RESULTS - 1];
+    }
+    SelftestResult *res = &st->results[st->nresults++];
+    memset(res, 0, sizeof(*res));
+    snprintf(res->variant, sizeof(res->variant), "%s", variant);
+    res->check = check;
+    return res;
+}
+
+/* Count a case, and describe it if it failed and not too many did before */
+static void selftest_case(Selftest *st, SelftestResult *res, int ok, const char *fmt, ...)
+{
+    res->cases++;
+    st->cases++;
+    if (ok)
+    {
+        return;
+    }
+    res->failures++;
+    if (st->failures++ < SELFTEST_MAX_ERRORS)
+    {
+        va_list ap;
+        va_start(ap, fmt);
+        printf("ERROR: %s %s: ", res->variant, res->check);
+        vprintf(fmt, ap);
+        printf("\n");
+        va_end(ap);
+    }
+}
+
+/* First differing byte of two buffers, -1 if equal */
+static long long first_difference(const unsigned char *a, const unsigned char *b, size_t n)
+{
+    if (memcmp(a, b, n) == 0)
+    {
+        return -1;
+    }
+    size_t i = 0;
+    while (a[i] == b[i])
+    {
+        i++;
+    }
+    return (long long)i;
+}
+
+/* encode_byte_to_lsb without its per-bit log: bit 7 - i of the byte replaces the LSB of carrier i */
+static void ref_embed(unsigned char *carriers, const unsigned char *data, size_t nbytes)
+{
+    for (size_t i = 0; i < nbytes; i++)
+    {
+        for (int b = 0; b < 8; b++)
+        {
+            carriers[8 * i + b] = (carriers[8 * i + b] & ~1) | ((data[i] >> (7 - b)) & 1);
+        }
+    }
+}
+
+/* decode_byte_from_lsb itself, one byte per 8 carriers */
+static void ref_extract(const unsigned char *carriers, unsigned char *data, size_t nbytes)
+{
+    for (size_t i = 0; i < nbytes; i++)
+    {
+        decode_byte_from_lsb((char *)&data[i], (char *)carriers + 8 * i);
+    }
+}
+
+/* Mostly short runs, now and then a long one */
+static size_t selftest_length(Selftest *st)
+{
+    size_t r = selftest_below(st, 20);
+    if (r < 14)
+    {
+        return selftest_below(st, 65);
+    }
+    if (r < 19)
+    {
+        return selftest_below(st, 513);
+    }
+    return selftest_below(st, SELFTEST_CASE_BYTES + 1);
+}
+
+/* p message bits of a matrix payload from bit on, MSB first */
+static uint message_bits(const unsigned char *data, size_t bit, uint p)
+{
+    uint value = 0;
+    for (uint k = 0; k < p; k++, bit++)
+    {
+        value = (value << 1) | ((data[bit / 8] >> (7 - (bit & 7))) & 1);
+    }
+    return value;
+}
+
+/* Step 1: Random cases of one kernel variant against the reference */
+static Status selftest_kernel_cases(Selftest *st, const char *variant)
+{
+    size_t total = 8 * SELFTEST_CASE_BYTES + 3 * SELFTEST_GUARD;
+    unsigned char *cover = malloc(total);
+    unsigned char *expect = malloc(total);
+    unsigned char *actual = malloc(total);
+    unsigned char *split = malloc(total);
+    unsigned char *data = malloc(SELFTEST_CASE_BYTES + 1);
+    unsigned char *out_expect = malloc(SELFTEST_CASE_BYTES + 2 * SELFTEST_GUARD);
+    unsigned char *out_actual = malloc(SELFTEST_CASE_BYTES + 2 * SELFTEST_GUARD);
+    if (cover == NULL || expect == NULL || actual == NULL || split == NULL || data == NULL ||
+        out_expect == NULL || out_actual == NULL)
+    {
+        printf("ERROR: Out of memory for the kernel cases.\n");
+        free(cover);
+        free(expect);
+        free(actual);
+        free(split);
+        free(data);
+        free(out_expect);
+        free(out_actual);
+        return e_failure;
+    }
+    SelftestResult *r_embed = selftest_result(st, variant, "embed");
+    SelftestResult *r_extract = selftest_result(st, variant, "extract");
+    SelftestResult *r_match = selftest_result(st, variant, "match");
+    SelftestResult *r_matrix = selftest_result(st, variant, "matrix");
+
+    for (uint c = 0; c < SELFTEST_KERNEL_CASES; c++)
+    {
+        size_t n = selftest_length(st);
+        size_t off = SELFTEST_GUARD + selftest_below(st, SELFTEST_GUARD);
+        long long d;
+        selftest_fill(st, cover, total);
+        selftest_fill(st, data, n + 1);
+
+        // Embedding: the whole buffer, guards included, as the reference leaves it
+        memcpy(expect, cover, total);
+        ref_embed(expect + off, data, n);
+        memcpy(actual, cover, total);
+        lsb_embed(actual + off, data, n);
+        d = first_difference(expect, actual, total);
+        selftest_case(st, r_embed, d < 0, "carrier %lld differs (%zu bytes at offset %zu)", d - (long long)off, n, off);
+
+        // Extraction: the data bytes and nothing around them
+        memset(out_expect, 0xA5, n + 2 * SELFTEST_GUARD);
+        memset(out_actual, 0xA5, n + 2 * SELFTEST_GUARD);
+        ref_extract(cover + off, out_expect + SELFTEST_GUARD, n);
+        lsb_extract(cover + off, out_actual + SELFTEST_GUARD, n);
+        d = first_difference(out_expect, out_actual, n + 2 * SELFTEST_GUARD);
+        selftest_case(st, r_extract, d < 0, "byte %lld differs (%zu bytes at offset %zu)", d - SELFTEST_GUARD, n, off);
+
+        // Matching: same carriers as the scalar variant, LSBs as the reference, +-1 only, independent of splits
+        unsigned long long key = selftest_rand(st);
+        unsigned long long ordinal = selftest_rand(st) >> 24;
+        size_t cut = selftest_below(st, n + 1);
+        lsb_set_kernel("swar64");
+        memcpy(expect, cover, total);
+        lsb_match(expect + off, data, n, key, ordinal);
+        lsb_set_kernel(variant);
+        memcpy(actual, cover, total);
+        lsb_match(actual + off, data, n, key, ordinal);
+        memcpy(split, cover, total);
+        lsb_match(split + off, data, cut, key, ordinal);
+        lsb_match(split + off + 8 * cut, data + cut, n - cut, key, ordinal + 8 * cut);
+        d = first_difference(expect, actual, total);
+        long long ds = first_difference(actual, split, total);
+        int ok = d < 0 && ds < 0;
+        for (size_t i = 0; ok && i < total; i++)
+        {
+            int delta = (int)actual[i] - (int)cover[i];
+            int inside = i >= off && i < off + 8 * n;
+            int want = inside ? (data[(i - off) / 8] >> (7 - (i - off) % 8)) & 1 : cover[i] & 1;
+            ok = (actual[i] & 1) == want && (delta == 0) == ((cover[i] & 1) == want) && delta >= -1 && delta <= 1;
+        }
+        selftest_case(st, r_match, ok, "%zu bytes at offset %zu (scalar differs at %lld, split at %zu differs at %lld)",
+                      n, off, d, cut, ds);
+
+        // Matrix: the syndrome of every block is its message, at most one carrier changes per block
+        uint p = 1 + (uint)selftest_below(st, CARRIER_MAX_MATRIX);
+        uint block = (1u << p) - 1;
+        size_t bit = selftest_below(st, 8);
+        size_t nblocks = selftest_below(st, (8 * n - bit) / p + 1);
+        int matching = (int)selftest_below(st, 2);
+        if ((size_t)block * nblocks > 8 * SELFTEST_CASE_BYTES)
+        {
+            nblocks = 8 * SELFTEST_CASE_BYTES / block;
+        }
+        lsb_set_kernel("swar64");
+        memcpy(expect, cover, total);
+        lsb_matrix_embed(expect + off, nblocks, p, data, bit, matching, key, ordinal);
+        lsb_set_kernel(variant);
+        memcpy(actual, cover, total);
+        lsb_matrix_embed(actual + off, nblocks, p, data, bit, matching, key, ordinal);
+        d = first_difference(expect, actual, total);
+        ok = d < 0;
+        for (size_t b = 0; ok && b < nblocks; b++)
+        {
+            const unsigned char *from = cover + off + b * block, *to = actual + off + b * block;
+            uint changed = 0;
+            for (uint k = 0; k < block; k++)
+            {
+                changed += from[k] != to[k];
+            }
+            ok = changed <= 1 && lsb_syndrome(to, block) == message_bits(data, bit + b * p, p);
+        }
+        memset(out_actual, 0, SELFTEST_CASE_BYTES + 1);
+        lsb_matrix_extract(actual + off, nblocks, p, out_actual, bit);
+        for (size_t b = 0; ok && b < nblocks; b++)
+        {
+            ok = message_bits(out_actual, bit + b * p, p) == message_bits(data, bit + b * p, p);
+        }
+        selftest_case(st, r_matrix, ok, "p %u, %zu blocks from bit %zu%s (scalar differs at %lld)",
+                      p, nblocks, bit, matching ? ", matching" : "", d);
+    }
+
+    free(cover);
+    free(expect);
+    free(actual);
+    free(split);
+    free(data);
+    free(out_expect);
+    free(out_actual);
+    return e_success;
+}
+
+/* Best time of SELFTEST_BENCH_RUNS runs of one operation over the bench buffers */
+static double selftest_time(int op, unsigned char *carriers, unsigned char *data, size_t nbytes)
+{
+    double best = 0;
+    for (uint run = 0; run < SELFTEST_BENCH_RUNS; run++)
+    {
+        double t0 = now_seconds();
+        switch (op)
+        {
+            case 0: lsb_embed(carriers, data, nbytes); break;
+            case 1: lsb_extract(carriers, data, nbytes); break;
+            case 2: lsb_match(carriers, data, nbytes, 0x5EED, 0); break;
+            case 3: lsb_matrix_embed(carriers, 8 * nbytes / 127, 7, data, 0, 0, 0, 0); break;
+            case 4: ref_embed(carriers, data, nbytes); break;
+            default: ref_extract(carriers, data, nbytes); break;
+        }
+        double t = now_seconds() - t0;
+        if (run == 0 || t < best)
+        {
+            best = t;
+        }
+    }
+    return best;
+}
+
+/* Step 2: Throughput of one variant (NULL: the reference) over 8 * SELFTEST_BENCH_BYTES carriers */
+static void selftest_kernel_speed(Selftest *st, const char *variant, unsigned char *carriers, unsigned char *data)
+{
+    static const char *const checks[] = {"embed", "extract", "match", "matrix"};
+    double carrier_bytes = 8.0 * SELFTEST_BENCH_BYTES;
+
+    for (int op = 0; op < (variant == NULL ? 2 : 4); op++)
+    {
+        SelftestResult *res = selftest_result(st, variant == NULL ? "reference" : variant, checks[op]);
+        res->seconds += selftest_time(variant == NULL ? op + 4 : op, carriers, data, SELFTEST_BENCH_BYTES);
+        res->bytes += carrier_bytes;
+    }
+}
+
+static void *selftest_worker(void *arg)
+{
+    SelftestThread *t = arg;
+    switch (t->op)
+    {
+        case 0: lsb_embed(t->carriers, t->data, t->nbytes); break;
+        case 1: lsb_extract(t->carriers, t->data, t->nbytes); break;
+        default: lsb_match(t->carriers, t->data, t->nbytes, t->key, t->ordinal); break;
+    }
+    return NULL;
+}
+
+/* Run one operation over the bench buffers cut at cuts[0 .. nthreads], one piece per thread; seconds taken */
+static double selftest_split_run(Selftest *st, int op, unsigned char *carriers, unsigned char *data,
+                                 const size_t *cuts, unsigned long long key)
+{
+    SelftestThread threads[SELFTEST_MAX_THREADS];
+    double t0 = now_seconds();
+
+    for (uint t = 0; t < st->nthreads; t++)
+    {
+        threads[t].op = op;
+        threads[t].carriers = carriers + 8 * cuts[t];
+        threads[t].data = data + cuts[t];
+        threads[t].nbytes = cuts[t + 1] - cuts[t];
+        threads[t].key = key;
+        threads[t].ordinal = 8ULL * cuts[t];
+        threads[t].started = pthread_create(&threads[t].tid, NULL, selftest_worker, &threads[t]) == 0;
+        if (!threads[t].started)
+        {
+            // A piece that could not get a thread runs here
+            selftest_worker(&threads[t]);
+        }
+    }
+    for (uint t = 0; t < st->nthreads; t++)
+    {
+        if (threads[t].started)
+        {
+            pthread_join(threads[t].tid, NULL);
+        }
+    }
+    return now_seconds() - t0;
+}
+
+/* Step 3: The selected kernel split over threads at random byte boundaries */
+static void selftest_threads(Selftest *st, unsigned char *cover, unsigned char *expect, unsigned char *actual,
+                             unsigned char *data, unsigned char *out)
+{
+    char variant[24];
+    size_t n = SELFTEST_BENCH_BYTES, cuts[SELFTEST_MAX_THREADS + 1];
+    size_t total = 8 * n;
+    unsigned long long key = selftest_rand(st);
+
+    snprintf(variant, sizeof(variant), "%s x%u", lsb_kernel_name(), st->nthreads);
+    SelftestResult *r_embed = selftest_result(st, variant, "embed");
+    SelftestResult *r_extract = selftest_result(st, variant, "extract");
+    SelftestResult *r_match = selftest_result(st, variant, "match");
+
+    for (uint run = 0; run < SELFTEST_BENCH_RUNS; run++)
+    {
+        // Sorted random cuts, the first at 0 and the last at n
+        cuts[0] = 0;
+        cuts[st->nthreads] = n;
+        for (uint t = 1; t < st->nthreads; t++)
+        {
+            size_t c = selftest_below(st, n + 1);
+            uint k = t;
+            while (k > 1 && cuts[k - 1] > c)
+            {
+                cuts[k] = cuts[k - 1];
+                k--;
+            }
+            cuts[k] = c;
+        }
+        selftest_fill(st, cover, total);
+        selftest_fill(st, data, n);
+
+        memcpy(expect, cover, total);
+        ref_embed(expect, data, n);
+        memcpy(actual, cover, total);
+        double t = selftest_split_run(st, 0, actual, data, cuts, 0);
+        long long d = first_difference(expect, actual, total);
+        selftest_case(st, r_embed, d < 0, "carrier %lld differs", d);
+        r_embed->seconds += t;
+        r_embed->bytes += total;
+
+        ref_extract(cover, expect, n);
+        t = selftest_split_run(st, 1, cover, out, cuts, 0);
+        d = first_difference(expect, out, n);
+        selftest_case(st, r_extract, d < 0, "byte %lld differs", d);
+        r_extract->seconds += t;
+        r_extract->bytes += total;
+
+        memcpy(expect, cover, total);
+        lsb_match(expect, data, n, key, 0);
+        memcpy(actual, cover, total);
+        t = selftest_split_run(st, 2, actual, data, cuts, key);
+        d = first_difference(expect, actual, total);
+        selftest_case(st, r_match, d < 0, "carrier %lld differs from one unsplit run", d);
+        r_match->seconds += t;
+        r_match->bytes += total;
+    }
+}
+
+static void put_le16(unsigned char *p, uint value)
+{
+    p[0] = (unsigned char)value;
+    p[1] = (unsigned char)(value >> 8);
+}
+
+static void put_le32(unsigned char *p, uint value)
+{
+    put_le16(p, value & 0xFFFF);
+    put_le16(p + 2, value >> 16);
+}
+
+/* Stored row of display row y */
+static size_t bmp_row(const SelftestCover *cover, uint y)
+{
+    return cover->data_offset + (size_t)(cover->top_down ? y : cover->height - 1 - y) * cover->stride;
+}
+
+/* Pixels into a BMP file image at their stored positions */
+static void bmp_store(const SelftestCover *cover, unsigned char *file, const unsigned char *pixels)
+{
+    size_t row_bytes = (size_t)cover->width * cover->bpp;
+    for (uint y = 0; y < cover->height; y++)
+    {
+        memcpy(file + bmp_row(cover, y), pixels + y * row_bytes, row_bytes);
+    }
+}
+
+/* 8, 24 or 32 bits per pixel, either orientation, random padding, gap before the pixels and trailer */
+static Status selftest_make_bmp(Selftest *st, SelftestCover *cover)
+{
+    static const uint depths[] = {8, 24, 32};
+    uint bits = depths[selftest_below(st, 3)];
+    size_t palette = bits == 8 ? 1024 : 0;
+    size_t gap = selftest_below(st, 4) == 0 ? selftest_below(st, 40) : 0;
+    size_t trailer = selftest_below(st, 4) == 0 ? selftest_below(st, 20) : 0;
+
+    cover->bpp = bits / 8;
+    cover->format = bits == 8 ? e_pixel_pal8 : bits == 24 ? e_pixel_bgr24 : e_pixel_bgra32;
+    cover->top_down = (int)selftest_below(st, 2);
+    cover->stride = (((size_t)cover->width * bits + 31) / 32) * 4;
+    cover->data_offset = 54 + palette + gap;
+    cover->file_size = cover->data_offset + cover->stride * cover->height + trailer;
+    cover->file = malloc(cover->file_size);
+    if (cover->file == NULL)
+    {
+        return e_failure;
+    }
+
+    // Everything random first (palette, gap, padding, trailer), then the header and the rows
+    unsigned char *h = cover->file;
+    selftest_fill(st, h, cover->file_size);
+    h[0] = 'B';
+    h[1] = 'M';
+    put_le32(h + 2, (uint)cover->file_size);
+    put_le32(h + 6, 0);
+    put_le32(h + 10, (uint)cover->data_offset);
+    put_le32(h + 14, 40);
+    put_le32(h + 18, cover->width);
+    put_le32(h + 22, cover->top_down ? (uint)-(int)cover->height : cover->height);
+    put_le16(h + 26, 1);
+    put_le16(h + 28, bits);
+    put_le32(h + 30, 0);
+    put_le32(h + 34, (uint)(cover->stride * cover->height));
+    put_le32(h + 38, 2835);
+    put_le32(h + 42, 2835);
+    put_le32(h + 46, bits == 8 ? 256 : 0);
+    put_le32(h + 50, 0);
+    bmp_store(cover, cover->file, cover->pixels);
+
+    snprintf(cover->desc, sizeof(cover->desc), "bmp %u-bit %ux%u %s", bits, cover->width, cover->height,
+             cover->top_down ? "top-down" : "bottom-up");
+    return e_success;
+}
+
+static Status buffer_append(SelftestBuffer *buf, const void *data, size_t len)
+{
+    if (buf->len + len > buf->cap)
+    {
+        size_t cap = buf->cap ? buf->cap : 4096;
+        while (cap < buf->len + len)
+        {
+            cap *= 2;
+        }
+        unsigned char *grown = realloc(buf->data, cap);
+        if (grown == NULL)
+        {
+            return e_failure;
+        }
+        buf->data = grown;
+        buf->cap = cap;
+    }
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+    return e_success;
+}
+
+static Status buffer_write(void *ctx, const unsigned char *buf, size_t len)
+{
+    return buffer_append(ctx, buf, len);
+}
+
+/* PNG chunk CRC (not CRC32C) */
+static uint png_crc(const unsigned char *buf, size_t len)
+{
+    static uint table[256];
+    if (table[1] == 0)
+    {
+        for (uint i = 0; i < 256; i++)
+        {
+            uint c = i;
+            for (int k = 0; k < 8; k++)
+            {
+                c = (c & 1) ? (c >> 1) ^ 0xEDB88320u : c >> 1;
+            }
+            table[i] = c;
+        }
+    }
+    uint crc = 0xFFFFFFFFu;
+    while (len--)
+    {
+        crc = (crc >> 8) ^ table[(crc ^ *buf++) & 0xFF];
+    }
+    return ~crc;
+}
+
+static Status png_chunk(SelftestBuffer *out, const char *type, const unsigned char *data, size_t len)
+{
+    unsigned char *chunk = malloc(len + 12);
+    if (chunk == NULL)
+    {
+        return e_failure;
+    }
+    put_be32(chunk, (uint)len);
+    memcpy(chunk + 4, type, 4);
+    if (len > 0)
+    {
+        memcpy(chunk + 8, data, len);
+    }
+    put_be32(chunk + 8 + len, png_crc(chunk + 4, len + 4));
+    Status status = buffer_append(out, chunk, len + 12);
+    free(chunk);
+    return status;
+}
+
+static int paeth(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    return (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+}
+
+/* Every 8-bit colour type, a random filter per row, a random level and IDAT split, sometimes a text chunk */
+static Status selftest_make_png(Selftest *st, SelftestCover *cover)
+{
+    static const uint types[] = {0, 2, 3, 4, 6};
+    static const uint bpps[] = {1, 3, 1, 2, 4};
+    static const PixelFormat formats[] = {e_pixel_gray8, e_pixel_rgb24, e_pixel_pal8, e_pixel_graya16, e_pixel_rgba32};
+    uint t = (uint)selftest_below(st, 5);
+    int level = (int)selftest_below(st, 10);
+    size_t row_bytes;
+    SelftestBuffer z = {NULL, 0, 0}, out = {NULL, 0, 0};
+    Deflate def;
+
+    cover->bpp = bpps[t];
+    cover->format = formats[t];
+    row_bytes = (size_t)cover->width * cover->bpp;
+
+    // Step 1: Filtered rows through deflate
+    unsigned char *line = malloc(row_bytes + 1);
+    if (line == NULL || deflate_init(&def, level, buffer_write, &z) == e_failure)
+    {
+        free(line);
+        return e_failure;
+    }
+    Status status = e_success;
+    for (uint y = 0; y < cover->height && status == e_success; y++)
+    {
+        const unsigned char *raw = cover->pixels + y * row_bytes;
+        const unsigned char *up = y > 0 ? raw - row_bytes : NULL;
+        line[0] = (unsigned char)selftest_below(st, 5);
+        for (size_t i = 0; i < row_bytes; i++)
+        {
+            int a = i >= cover->bpp ? raw[i - cover->bpp] : 0;
+            int b = up != NULL ? up[i] : 0;
+            int c = (up != NULL && i >= cover->bpp) ? up[i - cover->bpp] : 0;
+            int pred = line[0] == 0 ? 0 : line[0] == 1 ? a : line[0] == 2 ? b : line[0] == 3 ? (a + b) / 2 : paeth(a, b, c);
+            line[i + 1] = (unsigned char)(raw[i] - pred);
+        }
+        status = deflate_write(&def, line, row_bytes + 1);
+    }
+    if (status == e_success)
+    {
+        status = deflate_finish(&def);
+    }
+    deflate_end(&def);
+    free(line);
+
+    // Step 2: Chunks around it, the data cut into IDATs of random sizes
+    unsigned char ihdr[13] = {0};
+    put_be32(ihdr, cover->width);
+    put_be32(ihdr + 4, cover->height);
+    ihdr[8] = 8;
+    ihdr[9] = (unsigned char)types[t];
+    if (status == e_success)
+    {
+        status = buffer_append(&out, "\x89PNG\r\n\x1a\n", 8);
+    }
+    if (status == e_success)
+    {
+        status = png_chunk(&out, "IHDR", ihdr, sizeof(ihdr));
+    }
+    if (status == e_success && types[t] == 3)
+    {
+        unsigned char plte[768];
+        selftest_fill(st, plte, sizeof(plte));
+        status = png_chunk(&out, "PLTE", plte, sizeof(plte));
+    }
+    if (status == e_success && selftest_below(st, 3) == 0)
+    {
+        status = png_chunk(&out, "tEXt", (const unsigned char *)"Comment\0self-test", 17);
+    }
+    for (size_t pos = 0; pos < z.len && status == e_success;)
+    {
+        size_t n = selftest_below(st, 3) == 0 ? 1 + selftest_below(st, 64) : 1 + selftest_below(st, z.len);
+        if (n > z.len - pos)
+        {
+            n = z.len - pos;
+        }
+        status = png_chunk(&out, "IDAT", z.data + pos, n);
+        pos += n;
+    }
+    if (status == e_success)
+    {
+        status = png_chunk(&out, "IEND", NULL, 0);
+    }
+    free(z.data);
+    if (status == e_failure)
+    {
+        free(out.data);
+        return e_failure;
+    }
+    cover->file = out.data;
+    cover->file_size = out.len;
+    snprintf(cover->desc, sizeof(cover->desc), "png type %u %ux%u level %d", types[t], cover->width, cover->height, level);
+    return e_success;
+}
+
+/* Odd widths more often than not, a few one-pixel edges */
+static Status selftest_make_cover(Selftest *st, SelftestCover *cover, int png)
+{
+    memset(cover, 0, sizeof(*cover));
+    cover->png = png;
+    cover->width = selftest_below(st, 8) == 0 ? 1 + (uint)selftest_below(st, 4)
+                                              : 1 + (uint)selftest_below(st, SELFTEST_MAX_WIDTH);
+    cover->height = selftest_below(st, 8) == 0 ? 1 + (uint)selftest_below(st, 4)
+                                               : 1 + (uint)selftest_below(st, SELFTEST_MAX_HEIGHT);
+    if (selftest_below(st, 3) != 0)
+    {
+        cover->width |= 1;
+    }
+    cover->pixels = malloc((size_t)cover->width * cover->height * 4);
+    if (cover->pixels == NULL)
+    {
+        return e_failure;
+    }
+    selftest_fill(st, cover->pixels, (size_t)cover->width * cover->height * 4);
+    return png ? selftest_make_png(st, cover) : selftest_make_bmp(st, cover);
+}
+
+static Status write_file(const char *fname, const unsigned char *data, size_t len)
+{
+    FILE *fptr = fopen(fname, "w");
+    if (fptr == NULL)
+    {
+        perror("fopen");
+        printf("ERROR: Unable to open file %s\n", fname);
+        return e_failure;
+    }
+    if (fwrite(data, 1, len, fptr) != len || fclose(fptr) != 0)
+    {
+        printf("ERROR: Failed to write %s\n", fname);
+        return e_failure;
+    }
+    return e_success;
+}
+
+static unsigned char *read_file(const char *fname, size_t *len)
+{
+    FILE *fptr = fopen(fname, "r");
+    if (fptr == NULL)
+    {
+        return NULL;
+    }
+    fseek(fptr, 0, SEEK_END);
+    long size = ftell(fptr);
+    fseek(fptr, 0, SEEK_SET);
+    unsigned char *data = malloc(size > 0 ? size : 1);
+    if (data == NULL || fread(data, 1, size, fptr) != (size_t)size)
+    {
+        free(data);
+        fclose(fptr);
+        return NULL;
+    }
+    fclose(fptr);
+    *len = size;
+    return data;
+}
+
+/* Pixels of an image through its codec, top row first */
+static Status selftest_decode(const char *fname, const SelftestCover *cover, unsigned char *pixels)
+{
+    Image image;
+    size_t row_bytes = (size_t)cover->width * cover->bpp;
+    FILE *fptr = fopen(fname, "r");
+    if (fptr == NULL || image_open(&image, fptr, NULL, 0, 0) == e_failure)
+    {
+        if (fptr != NULL)
+        {
+            fclose(fptr);
+        }
+        return e_failure;
+    }
+    Status status = image.width == cover->width && image.height == cover->height && image.format == cover->format
+                    ? e_success : e_failure;
+    unsigned char *row = malloc((size_t)image.row_alloc + PIXEL_VIEW_SLACK);
+    if (row == NULL)
+    {
+        status = e_failure;
+    }
+    for (uint y = 0; y < cover->height && status == e_success; y++)
+    {
+        status = image_read_rows(&image, row, 1);
+        memcpy(pixels + y * row_bytes, row, row_bytes);
+    }
+    free(row);
+    image_close(&image);
+    fclose(fptr);
+    return status;
+}
+
+/* Open an image for one I/O variant: the file, or its bytes through a memory stream (no descriptor, no mapping) */
+static FILE *selftest_open(const char *fname, const unsigned char *data, size_t len, int buffered)
+{
+    return buffered ? fmemopen((void *)data, len, "r") : fopen(fname, "r");
+}
+
+/* Step 4: Embed a random payload into one cover through a carrier stream, check the stego image, extract it again */
+static void selftest_cover(Selftest *st, const SelftestCover *cover, const char *variant, uint io_flags, int buffered,
+                           const char *cover_fname, const char *stego_fname)
+{
+    SelftestResult *r_embed = selftest_result(st, variant, "embed");
+    SelftestResult *r_extract = selftest_result(st, variant, "extract");
+    size_t npixels = (size_t)cover->width * cover->height;
+    size_t image_bytes = npixels * cover->bpp;
+    CarrierStream cs;
+
+    // Step 4a: Channels, mode and payload
+    uint mask = 1 + (uint)selftest_below(st, (1u << cover->bpp) - 1);
+    const PixelView *view = pixel_view(cover->format, mask);
+    uint mode = (uint)selftest_below(st, 4);            // 0, 1: replacement, 2: matching, 3: matrix
+    uint p = mode == 3 ? 2 + (uint)selftest_below(st, CARRIER_MAX_MATRIX - 1) : 0;
+    while (p > 0 && (1u << p) - 1 > cover->width * view->carriers_per_pixel)
+    {
+        p = p > 2 ? p - 1 : 0;    // Code blocks never cross a row
+    }
+    int matching = mode == 2 || (mode == 3 && selftest_below(st, 2));
+    unsigned long long capacity = carrier_capacity_bits(cover->width, cover->height, view->carriers_per_pixel, p, 0) / 8;
+    size_t len = selftest_below(st, 4) == 0 ? capacity : selftest_below(st, capacity + 1);
+    unsigned long long key = selftest_rand(st);
+    int level = (int)selftest_below(st, 10);
+    char desc[160];
+    snprintf(desc, sizeof(desc), "%s, mask 0x%x, %s%s, %zu of %llu bytes", cover->desc, mask,
+             p ? "matrix" : matching ? "matching" : "replacement", p && matching ? " + matching" : "", len, capacity);
+
+    unsigned char *payload = malloc(len + 1);
+    unsigned char *extracted = malloc(len + 1);
+    unsigned char *expect = malloc(image_bytes + 1);
+    unsigned char *actual = malloc(image_bytes + 1);
+    if (payload == NULL || extracted == NULL || expect == NULL || actual == NULL)
+    {
+        selftest_case(st, r_embed, 0, "%s: out of memory", desc);
+        free(payload);
+        free(extracted);
+        free(expect);
+        free(actual);
+        return;
+    }
+    selftest_fill(st, payload, len);
+
+    // Step 4b: Embed, timed from opening the cover to closing the stego image
+    double t0 = now_seconds();
+    FILE *src = selftest_open(cover_fname, cover->file, cover->file_size, buffered);
+    FILE *dest = fopen(stego_fname, "w");
+    Status status = src != NULL && dest != NULL ? carrier_open(&cs, src, dest, level, io_flags) : e_failure;
+    if (status == e_success)
+    {
+        status = carrier_set_mask(&cs, mask);
+        cs.matching = matching;
+        cs.match_key = key;
+        if (status == e_success && p != 0)
+        {
+            status = carrier_set_matrix(&cs, p);
+        }
+        if (status == e_success)
+        {
+            status = carrier_embed(&cs, payload, len);
+        }
+        if (carrier_close(&cs) == e_failure)
+        {
+            status = e_failure;
+        }
+    }
+    if (src != NULL)
+    {
+        fclose(src);
+    }
+    if (dest != NULL && fclose(dest) != 0)
+    {
+        status = e_failure;
+    }
+    r_embed->seconds += now_seconds() - t0;
+    r_embed->bytes += image_bytes;
+
+    // Step 4c: Reference pixels: the carriers in display order, the payload bits into the first ones
+    memcpy(expect, cover->pixels, image_bytes);
+    for (size_t i = 0, c = 0; i < image_bytes && c < 8 * len; i++)
+    {
+        if (mask & (1u << (i % cover->bpp)))
+        {
+            expect[i] = (expect[i] & ~1) | ((payload[c / 8] >> (7 - c % 8)) & 1);
+            c++;
+        }
+    }
+
+    // Step 4d: The stego image against the reference (replacement), or within +-1 on carriers only
+    size_t stego_size = 0;
+    unsigned char *stego = status == e_success ? read_file(stego_fname, &stego_size) : NULL;
+    int ok = stego != NULL;
+    if (ok && !cover->png)
+    {
+        // Whole file: header, palette, gap, padding and trailer have to come through untouched
+        unsigned char *want = malloc(cover->file_size);
+        ok = want != NULL && stego_size == cover->file_size;
+        if (ok)
+        {
+            memcpy(want, cover->file, cover->file_size);
+            for (uint y = 0; y < cover->height; y++)
+            {
+                memcpy(actual + (size_t)y * cover->width * cover->bpp, stego + bmp_row(cover, y), (size_t)cover->width * cover->bpp);
+            }
+            bmp_store(cover, want, p == 0 && !matching ? expect : actual);
+            long long d = first_difference(want, stego, cover->file_size);
+            if (d >= 0)
+            {
+                ok = 0;
+                selftest_case(st, r_embed, 0, "%s: stego file byte %lld differs", desc, d);
+            }
+        }
+        else
+        {
+            selftest_case(st, r_embed, 0, "%s: stego file has %zu bytes, not %zu", desc, stego_size, cover->file_size);
+        }
+        free(want);
+    }
+    else if (ok)
+    {
+        ok = selftest_decode(stego_fname, cover, actual) == e_success;
+        long long d = p == 0 && !matching ? first_difference(expect, actual, image_bytes) : -1;
+        if (!ok || d >= 0)
+        {
+            selftest_case(st, r_embed, 0, "%s: %s", desc, ok ? "pixel byte differs" : "stego image does not decode");
+            ok = 0;
+        }
+    }
+    for (size_t i = 0; ok && i < image_bytes && (p != 0 || matching); i++)
+    {
+        int delta = (int)actual[i] - (int)cover->pixels[i];
+        ok = (mask & (1u << (i % cover->bpp))) ? (delta >= -1 && delta <= 1) : delta == 0;
+        if (!ok)
+        {
+            selftest_case(st, r_embed, 0, "%s: pixel byte %zu changed by %d", desc, i, delta);
+        }
+    }
+    if (ok || status == e_failure || stego == NULL)
+    {
+        selftest_case(st, r_embed, ok, "%s: embedding failed", desc);
+    }
+
+    // Step 4e: Extract through the same I/O variant
+    if (ok)
+    {
+        t0 = now_seconds();
+        src = selftest_open(stego_fname, stego, stego_size, buffered);
+        status = src != NULL ? carrier_open(&cs, src, NULL, 0, io_flags) : e_failure;
+        if (status == e_success)
+        {
+            status = carrier_set_mask(&cs, mask);
+            if (status == e_success && p != 0)
+            {
+                status = carrier_set_matrix(&cs, p);
+            }
+            if (status == e_success)
+            {
+                status = carrier_extract(&cs, extracted, len);
+            }
+            carrier_close(&cs);
+        }
+        if (src != NULL)
+        {
+            fclose(src);
+        }
+        r_extract->seconds += now_seconds() - t0;
+        r_extract->bytes += image_bytes;
+        long long d = status == e_success ? first_difference(payload, extracted, len) : 0;
+        selftest_case(st, r_extract, d < 0, "%s: %s %lld", desc, status == e_success ? "payload byte differs at" : "extraction failed", d);
+    }
+
+    free(stego);
+    free(payload);
+    free(extracted);
+    free(expect);
+    free(actual);
+}
+
+/* Step 5: Huffman tables of random code counts in a minimal JPEG, accepted exactly when the code space holds them */
+/* Send stdout to /dev/null around calls that report on their own: the descriptor to restore, -1 if unchanged */
+static int selftest_quiet(void)
+{
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO), null = open("/dev/null", O_WRONLY);
+    if (saved >= 0 && null >= 0)
+    {
+        dup2(null, STDOUT_FILENO);
+    }
+    else if (saved >= 0)
+    {
+        close(saved);
+        saved = -1;
+    }
+    if (null >= 0)
+    {
+        close(null);
+    }
+    return saved;
+}
+
+static void selftest_loud(int saved)
+{
+    fflush(stdout);
+    if (saved >= 0)
+    {
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+    }
+}
+
+static void selftest_jpeg_tables(Selftest *st)
+{
+    SelftestResult *res = selftest_result(st, "jpeg", "dht");
+    unsigned char file[4 + 4 + 17 + 256 + 2];
+
+    for (uint c = 0; c < SELFTEST_JPEG_CASES; c++)
+    {
+        unsigned char counts[16] = {0};
+        uint nvalues = 0;
+
+        // The first case is the worst over-full table, 255 codes of 1 bit
+        if (c == 0)
+        {
+            counts[0] = 255;
+            nvalues = 255;
+        }
+        else
+        {
+            uint lengths = 1 + (uint)selftest_below(st, 16);
+            for (uint k = 0; k < lengths && nvalues < 256; k++)
+            {
+                uint l = (uint)selftest_below(st, 16), n = 1 + (uint)selftest_below(st, 1u << (l < 4 ? l + 1 : 4));
+                n = n > 256 - nvalues ? 256 - nvalues : n;
+                n = n > 255u - counts[l] ? 255u - counts[l] : n;
+                counts[l] += n;
+                nvalues += n;
+            }
+        }
+
+        // Kraft: the codes fit a prefix code when sum counts[l] * 2^(16 - l) <= 2^16
+        unsigned long long kraft = 0;
+        for (uint l = 1; l <= 16; l++)
+        {
+            kraft += (unsigned long long)counts[l - 1] << (16 - l);
+        }
+        int valid = kraft <= (1u << 16);
+
+        size_t len = 0;
+        file[len++] = 0xFF;
+        file[len++] = 0xD8;
+        file[len++] = 0xFF;
+        file[len++] = 0xC4;
+        file[len++] = (unsigned char)((2 + 17 + nvalues) >> 8);
+        file[len++] = (unsigned char)(2 + 17 + nvalues);
+        file[len++] = (unsigned char)selftest_below(st, 2) << 4 | (unsigned char)selftest_below(st, 4);
+        memcpy(file + len, counts, 16);
+        len += 16;
+        selftest_fill(st, file + len, nvalues);
+        len += nvalues;
+        file[len++] = 0xFF;
+        file[len++] = 0xD9;
+
+        JpegInfo info;
+        memset(&info, 0, sizeof(info));
+        FILE *fptr = fmemopen(file, len, "r");
+        if (fptr == NULL)
+        {
+            selftest_case(st, res, 0, "case %u: no memory stream", c);
+            continue;
+        }
+        // The parser reports every rejected table, expected here, so its output goes nowhere
+        int saved = selftest_quiet();
+        Status status = jpeg_count_carriers(&info, fptr);
+        selftest_loud(saved);
+        fclose(fptr);
+        selftest_case(st, res, (status == e_success) == valid, "case %u: %u codes, Kraft sum %llu/65536, %s",
+                      c, nvalues, kraft, status == e_success ? "accepted" : "rejected");
+    }
+}
+
+/* Bit writer over entropy-coded data, a zero byte stuffed after every 0xFF */
+typedef struct _SelftestBits
+{
+    SelftestBuffer *out;
+    uint32_t bits;
+    int nbits;
+    Status status;
+} SelftestBits;
+
+static void selftest_put_bits(SelftestBits *b, uint value, int n)
+{
+    b->bits = (b->bits << n) | (value & ((1u << n) - 1));
+    b->nbits += n;
+    while (b->nbits >= 8)
+    {
+        unsigned char c[2] = {(unsigned char)(b->bits >> (b->nbits - 8)), 0};
+        if (buffer_append(b->out, c, c[0] == 0xFF ? 2 : 1) == e_failure)
+        {
+            b->status = e_failure;
+        }
+        b->nbits -= 8;
+    }
+}
+
+/* Size category of a coefficient and its extra bits */
+static void selftest_put_value(SelftestBits *b, int v, int s)
+{
+    selftest_put_bits(b, (uint)(v < 0 ? v - 1 : v), s);
+}
+
+static int selftest_category(int v)
+{
+    int s = 0;
+    for (uint a = (uint)(v < 0 ? -v : v); a > 0; a >>= 1)
+    {
+        s++;
+    }
+    return s;
+}
+
+/* AC symbols in the order of the generated table: EOB, ZRL, then run/size */
+static uint selftest_ac_index(int run, int s)
+{
+    return 2 + (uint)run * 10 + (uint)(s - 1);
+}
+
+/*
+ * A baseline JPEG of random quantized coefficients, nothing transformed:
+ * 1 or 3 components with random sampling factors, sometimes restart
+ * markers. Flat Huffman tables (every DC category a 4-bit code, every
+ * AC symbol an 8-bit one) code whatever the coefficients are. The
+ * carriers, AC coefficients with |v| >= 2, are counted on the way.
+ */
+static Status selftest_make_jpeg(Selftest *st, SelftestBuffer *out, unsigned long long *carriers, char *desc, size_t desc_len)
+{
+    uint width = 128 + (uint)selftest_below(st, 384), height = 128 + (uint)selftest_below(st, 256);
+    uint ncomp = selftest_below(st, 2) ? 3 : 1, h[3] = {1, 1, 1}, v[3] = {1, 1, 1};
+    uint restart = selftest_below(st, 3) == 0 ? 1 + (uint)selftest_below(st, 8) : 0;
+    unsigned char seg[4 + 3 * 17 + 12 + 162];
+    size_t len;
+
+    h[0] = 1 + (uint)selftest_below(st, 2);
+    v[0] = 1 + (uint)selftest_below(st, 2);
+    *carriers = 0;
+    snprintf(desc, desc_len, "jpeg %ux%u, %u component%s %ux%u%s, restart %u", width, height, ncomp, ncomp > 1 ? "s" : "",
+             h[0], v[0], ncomp > 1 ? ",1x1,1x1" : "", restart);
+
+    // Step 1: SOI, a quantization table, the frame
+    seg[0] = 0xFF;
+    seg[1] = 0xD8;
+    seg[2] = 0xFF;
+    seg[3] = 0xDB;
+    seg[4] = 0;
+    seg[5] = 67;
+    seg[6] = 0;
+    for (uint k = 0; k < 64; k++)
+    {
+        seg[7 + k] = (unsigned char)(1 + selftest_below(st, 50));
+    }
+    Status status = buffer_append(out, seg, 7 + 64);
+    len = 0;
+    seg[len++] = 0xFF;
+    seg[len++] = 0xC0;
+    seg[len++] = 0;
+    seg[len++] = (unsigned char)(8 + 3 * ncomp);
+    seg[len++] = 8;
+    seg[len++] = (unsigned char)(height >> 8);
+    seg[len++] = (unsigned char)height;
+    seg[len++] = (unsigned char)(width >> 8);
+    seg[len++] = (unsigned char)width;
+    seg[len++] = (unsigned char)ncomp;
+    for (uint i = 0; i < ncomp; i++)
+    {
+        seg[len++] = (unsigned char)(1 + i);
+        seg[len++] = (unsigned char)(h[i] << 4 | v[i]);
+        seg[len++] = 0;
+    }
+    if (status == e_success)
+    {
+        status = buffer_append(out, seg, len);
+    }
+
+    // Step 2: Both Huffman tables in one DHT segment
+    len = 0;
+    seg[len++] = 0xFF;
+    seg[len++] = 0xC4;
+    seg[len++] = (unsigned char)((2 + 17 + 12 + 17 + 162) >> 8);
+    seg[len++] = (unsigned char)(2 + 17 + 12 + 17 + 162);
+    seg[len++] = 0x00;
+    memset(seg + len, 0, 16);
+    seg[len + 3] = 12;
+    len += 16;
+    for (uint s = 0; s < 12; s++)
+    {
+        seg[len++] = (unsigned char)s;
+    }
+    seg[len++] = 0x10;
+    memset(seg + len, 0, 16);
+    seg[len + 7] = 162;
+    len += 16;
+    seg[len++] = 0x00;
+    seg[len++] = 0xF0;
+    for (uint run = 0; run < 16; run++)
+    {
+        for (uint s = 1; s <= 10; s++)
+        {
+            seg[len++] = (unsigned char)(run << 4 | s);
+        }
+    }
+    if (status == e_success)
+    {
+        status = buffer_append(out, seg, len);
+    }
+
+    // Step 3: The restart interval and the scan header
+    len = 0;
+    if (restart > 0)
+    {
+        seg[len++] = 0xFF;
+        seg[len++] = 0xDD;
+        seg[len++] = 0;
+        seg[len++] = 4;
+        seg[len++] = 0;
+        seg[len++] = (unsigned char)restart;
+    }
+    seg[len++] = 0xFF;
+    seg[len++] = 0xDA;
+    seg[len++] = 0;
+    seg[len++] = (unsigned char)(6 + 2 * ncomp);
+    seg[len++] = (unsigned char)ncomp;
+    for (uint i = 0; i < ncomp; i++)
+    {
+        seg[len++] = (unsigned char)(1 + i);
+        seg[len++] = 0x00;
+    }
+    seg[len++] = 0;
+    seg[len++] = 63;
+    seg[len++] = 0;
+    if (status == e_success)
+    {
+        status = buffer_append(out, seg, len);
+    }
+
+    // Step 4: MCUs; a single component is not interleaved, its MCU is one block
+    uint mcu_w = ncomp > 1 ? 8 * h[0] : 8, mcu_h = ncomp > 1 ? 8 * v[0] : 8;
+    uint mcus = ((width + mcu_w - 1) / mcu_w) * ((height + mcu_h - 1) / mcu_h);
+    int pred[3] = {0, 0, 0};
+    SelftestBits b = {out, 0, 0, status};
+    for (uint m = 0; m < mcus && b.status == e_success; m++)
+    {
+        if (restart > 0 && m > 0 && m % restart == 0)
+        {
+            unsigned char marker[2] = {0xFF, (unsigned char)(0xD0 + (m / restart - 1) % 8)};
+            if (b.nbits > 0)
+            {
+                selftest_put_bits(&b, 0x7F, 8 - b.nbits);
+            }
+            if (buffer_append(out, marker, 2) == e_failure)
+            {
+                b.status = e_failure;
+            }
+            memset(pred, 0, sizeof(pred));
+        }
+        for (uint i = 0; i < ncomp; i++)
+        {
+            for (uint blk = 0; blk < (ncomp > 1 ? h[i] * v[i] : 1); blk++)
+            {
+                int dc = (int)selftest_below(st, 401) - 200, s = selftest_category(dc - pred[i]);
+                selftest_put_bits(&b, (uint)s, 4);
+                selftest_put_value(&b, dc - pred[i], s);
+                pred[i] = dc;
+
+                // Nonzero coefficients up to a random limit, some of them 1 and no carrier
+                uint limit = 1 + (uint)selftest_below(st, 64);
+                int run = 0;
+                for (uint k = 1; k < 64; k++)
+                {
+                    int c = 0;
+                    if (k < limit && selftest_below(st, 3) == 0)
+                    {
+                        c = selftest_below(st, 4) == 0 ? 1 : 2 + (int)selftest_below(st, selftest_below(st, 8) ? 30 : 1022);
+                        c = selftest_below(st, 2) ? -c : c;
+                    }
+                    if (c == 0)
+                    {
+                        run++;
+                        continue;
+                    }
+                    for (; run > 15; run -= 16)
+                    {
+                        selftest_put_bits(&b, 1, 8);
+                    }
+                    s = selftest_category(c);
+                    selftest_put_bits(&b, selftest_ac_index(run, s), 8);
+                    selftest_put_value(&b, c, s);
+                    *carriers += c >= 2 || c <= -2;
+                    run = 0;
+                }
+                if (run > 0)
+                {
+                    selftest_put_bits(&b, 0, 8);
+                }
+            }
+        }
+    }
+    if (b.nbits > 0)
+    {
+        selftest_put_bits(&b, 0x7F, 8 - b.nbits);
+    }
+
+    // Step 5: EOI
+    seg[0] = 0xFF;
+    seg[1] = 0xD9;
+    return b.status == e_success ? buffer_append(out, seg, 2) : e_failure;
+}
+
+/* Random secret data in fname, kept in *data for the comparison */
+static Status selftest_secret(Selftest *st, const char *fname, size_t size, unsigned char **data)
+{
+    *data = malloc(size + 1);
+    if (*data == NULL)
+    {
+        return e_failure;
+    }
+    selftest_fill(st, *data, size);
+    return write_file(fname, *data, size);
+}
+
+/* Whether fname holds exactly size bytes of data */
+static int selftest_same_file(const char *fname, const unsigned char *data, size_t size)
+{
+    size_t len;
+    unsigned char *got = read_file(fname, &len);
+    int same = got != NULL && len == size && memcmp(got, data, size) == 0;
+    free(got);
+    return same;
+}
+
+/* Largest secret whose payload (header with a 4-character extension, checksummed blocks) fits in bits carriers */
+static size_t selftest_fit(unsigned long long bits)
+{
+    unsigned long long header = PAYLOAD_HEADER_FIXED + 4 + PAYLOAD_HEADER_TAIL, bytes = bits / 8;
+    if (bytes < header + CRC_SIZE + 1)
+    {
+        return 0;
+    }
+    size_t size = (size_t)(bytes - header);
+    while (size > 0 && payload_data_bytes(size) > bytes - header)
+    {
+        size--;
+    }
+    return size;
+}
+
+/*
+ * Step 6: Generated JPEGs through do_jpeg. The carrier count has to
+ * match the generator's, the stego image has to keep it, and the secret
+ * has to come back intact; one byte more than fits has to be refused.
+ */
+static void selftest_jpeg_files(Selftest *st)
+{
+    SelftestResult *r_count = selftest_result(st, "jpeg", "carriers");
+    SelftestResult *r_embed = selftest_result(st, "jpeg", "embed");
+    SelftestResult *r_extract = selftest_result(st, "jpeg", "extract");
+    char cover[4096], stego[4096], secret[4096], output[4096], desc[128];
+
+    snprintf(cover, sizeof(cover), "%s/steg-selftest-%ld-cover.jpg", st->dir, (long)getpid());
+    snprintf(stego, sizeof(stego), "%s/steg-selftest-%ld-stego.jpg", st->dir, (long)getpid());
+    snprintf(secret, sizeof(secret), "%s/steg-selftest-%ld-secret.bin", st->dir, (long)getpid());
+    snprintf(output, sizeof(output), "%s/steg-selftest-%ld-output.bin", st->dir, (long)getpid());
+    for (uint c = 0; c < SELFTEST_JPEG_FILES; c++)
+    {
+        SelftestBuffer file = {NULL, 0, 0};
+        unsigned long long expect;
+        if (selftest_make_jpeg(st, &file, &expect, desc, sizeof(desc)) == e_failure ||
+            write_file(cover, file.data, file.len) == e_failure)
+        {
+            selftest_case(st, r_count, 0, "%s: unable to write the cover", desc);
+            free(file.data);
+            break;
+        }
+        free(file.data);
+
+        // Step 6a: The parser counts the carriers the generator wrote
+        JpegInfo info;
+        memset(&info, 0, sizeof(info));
+        FILE *fptr = fopen(cover, "r");
+        Status status = fptr != NULL ? jpeg_count_carriers(&info, fptr) : e_failure;
+        if (fptr != NULL)
+        {
+            fclose(fptr);
+        }
+        selftest_case(st, r_count, status == e_success && info.capacity_bits == expect, "%s: %llu carriers counted, %llu written",
+                      desc, info.capacity_bits, expect);
+        if (status == e_failure)
+        {
+            continue;
+        }
+
+        // Step 6b: Every fourth secret is one byte too large
+        size_t fit = selftest_fit(expect), size;
+        int over = c % 4 == 3;
+        unsigned char *data;
+        size = over ? fit + 1 : 1 + selftest_below(st, fit > 0 ? fit : 1);
+        if (selftest_secret(st, secret, size, &data) == e_failure)
+        {
+            selftest_case(st, r_embed, 0, "%s: unable to write the secret", desc);
+            free(data);
+            break;
+        }
+        char *embed_argv[] = {"steg", "-j", cover, secret, stego};
+        int saved = selftest_quiet();
+        status = do_jpeg(5, embed_argv);
+        selftest_loud(saved);
+        selftest_case(st, r_embed, (status == e_success) == !over, "%s: %zu of %zu bytes %s", desc, size, fit,
+                      status == e_success ? "embedded" : "refused");
+        if (status == e_failure || over)
+        {
+            free(data);
+            continue;
+        }
+
+        // Step 6c: The stego image keeps every carrier and gives the secret back
+        memset(&info, 0, sizeof(info));
+        fptr = fopen(stego, "r");
+        status = fptr != NULL ? jpeg_count_carriers(&info, fptr) : e_failure;
+        if (fptr != NULL)
+        {
+            fclose(fptr);
+        }
+        char *extract_argv[] = {"steg", "-j", stego, "--extract", output};
+        saved = selftest_quiet();
+        if (status == e_success && info.capacity_bits == expect)
+        {
+            status = do_jpeg(5, extract_argv);
+        }
+        selftest_loud(saved);
+        selftest_case(st, r_extract, status == e_success && info.capacity_bits == expect && selftest_same_file(output, data, size),
+                      "%s: %zu bytes, %llu carriers in the stego image, %s", desc, size, info.capacity_bits,
+                      status == e_success ? "extracted" : "not extracted");
+        free(data);
+    }
+    unlink(cover);
+    unlink(stego);
+    unlink(secret);
+    unlink(output);
+}
+
+/*
+ * Step 7: Layers of different keys in one BMP or PNG cover through
+ * do_layers. Every key has to give its own secret back, a key that was
+ * not used has to find nothing.
+ */
+static void selftest_layer_files(Selftest *st)
+{
+    SelftestResult *r_embed = selftest_result(st, "layers", "embed");
+    SelftestResult *r_extract = selftest_result(st, "layers", "extract");
+    char cover[4096], stego[4096], output[4096];
+    char options[SELFTEST_LAYERS][4096 + 64], keys[SELFTEST_LAYERS + 1][64];
+    const char *secrets[SELFTEST_LAYERS];
+    unsigned char *data[SELFTEST_LAYERS];
+    size_t sizes[SELFTEST_LAYERS];
+
+    snprintf(output, sizeof(output), "%s/steg-selftest-%ld-output.bin", st->dir, (long)getpid());
+    for (uint c = 0; c < SELFTEST_LAYER_FILES; c++)
+    {
+        SelftestCover sc;
+        int png = (int)selftest_below(st, 3) == 0;
+        memset(&sc, 0, sizeof(sc));
+        sc.png = png;
+        sc.width = 64 + (uint)selftest_below(st, 256);
+        sc.height = 64 + (uint)selftest_below(st, 192);
+        sc.pixels = malloc((size_t)sc.width * sc.height * 4);
+        snprintf(cover, sizeof(cover), "%s/steg-selftest-%ld-cover.%s", st->dir, (long)getpid(), png ? "png" : "bmp");
+        snprintf(stego, sizeof(stego), "%s/steg-selftest-%ld-stego.%s", st->dir, (long)getpid(), png ? "png" : "bmp");
+        if (sc.pixels != NULL)
+        {
+            selftest_fill(st, sc.pixels, (size_t)sc.width * sc.height * 4);
+        }
+        if (sc.pixels == NULL || (png ? selftest_make_png(st, &sc) : selftest_make_bmp(st, &sc)) == e_failure ||
+            write_file(cover, sc.file, sc.file_size) == e_failure)
+        {
+            selftest_case(st, r_embed, 0, "cover %u: unable to write it", c);
+            free(sc.pixels);
+            free(sc.file);
+            break;
+        }
+
+        // Step 7a: Every layer fits the smallest carrier set, every key is different
+        const PixelView *view = pixel_view(sc.format, pixel_default_mask(sc.format));
+        unsigned long long n = (unsigned long long)sc.width * sc.height * view->carriers_per_pixel;
+        size_t fit = selftest_fit(n / LAYER_SLOTS);
+        uint nlayers = 1 + (uint)selftest_below(st, SELFTEST_LAYERS);
+        char *embed_argv[4 + SELFTEST_LAYERS] = {"steg", "-l", cover, stego};
+        Status status = e_success;
+        for (uint i = 0; i <= nlayers; i++)
+        {
+            snprintf(keys[i], sizeof(keys[i]), "--key=%u-%llx", i, (unsigned long long)selftest_rand(st));
+        }
+        for (uint i = 0; i < nlayers; i++)
+        {
+            // do_layers cuts the option at the ':', the secret's name after it stays
+            snprintf(options[i], sizeof(options[i]), "--layer=%s:%s/steg-selftest-%ld-layer%u.bin", keys[i] + 6,
+                     st->dir, (long)getpid(), i);
+            secrets[i] = strchr(options[i] + 8, ':') + 1;
+            embed_argv[4 + i] = options[i];
+            sizes[i] = 1 + selftest_below(st, fit > 0 ? fit : 1);
+            data[i] = NULL;
+            if (status == e_success)
+            {
+                status = selftest_secret(st, secrets[i], sizes[i], &data[i]);
+            }
+        }
+        int saved = selftest_quiet();
+        if (status == e_success)
+        {
+            status = do_layers(4 + nlayers, embed_argv);
+        }
+        selftest_loud(saved);
+        selftest_case(st, r_embed, status == e_success, "%s, %u layers of up to %zu bytes", sc.desc, nlayers, fit);
+
+        // Step 7b: Each key its own secret, the spare key none
+        for (uint i = 0; i <= nlayers && status == e_success; i++)
+        {
+            char *extract_argv[] = {"steg", "-l", stego, keys[i], output};
+            unlink(output);
+            saved = selftest_quiet();
+            Status found = do_layers(5, extract_argv);
+            selftest_loud(saved);
+            if (i < nlayers)
+            {
+                selftest_case(st, r_extract, found == e_success && selftest_same_file(output, data[i], sizes[i]),
+                              "%s, layer %u of %u: %zu bytes %s", sc.desc, i + 1, nlayers, sizes[i],
+                              found == e_success ? "extracted" : "not found");
+            }
+            else
+            {
+                selftest_case(st, r_extract, found == e_failure, "%s: a key of no layer %s", sc.desc,
+                              found == e_success ? "extracted something" : "found nothing");
+            }
+        }
+        for (uint i = 0; i < nlayers; i++)
+        {
+            free(data[i]);
+            unlink(secrets[i]);
+        }
+        free(sc.pixels);
+        free(sc.file);
+        unlink(cover);
+        unlink(stego);
+    }
+    unlink(output);
+}
+
+/* Step 8: Every steganalysis kernel variant against the scalar one, saturated runs included */
+static void selftest_analyze_kernels(Selftest *st)
+{
+    unsigned char values[SELFTEST_CASE_BYTES];
+    const char *selected = analyze_kernel_name();
+
+    for (uint v = 1; analyze_kernel_variant(v) != NULL; v++)
+    {
+        const char *variant = analyze_kernel_variant(v);
+        SelftestResult *res = selftest_result(st, variant, "analyze");
+        if (analyze_set_kernel(variant) == e_failure)
+        {
+            continue;
+        }
+        for (uint c = 0; c < SELFTEST_KERNEL_CASES; c++)
+        {
+            static AnalyzeCounts expect, actual;
+            size_t n = selftest_below(st, sizeof(values) + 1);
+
+            // Random values, some runs of them clipped to 0 or 255 as in saturated areas
+            selftest_fill(st, values, n);
+            for (uint k = (uint)selftest_below(st, 4); k > 0 && n > 0; k--)
+            {
+                size_t at = selftest_below(st, n), len = 1 + selftest_below(st, 64);
+                memset(values + at, selftest_below(st, 2) ? 255 : 0, len < n - at ? len : n - at);
+            }
+            memset(&expect, 0, sizeof(expect));
+            memset(&actual, 0, sizeof(actual));
+            analyze_set_kernel("scalar");
+            analyze_plane(values, n, &expect);
+            analyze_set_kernel(variant);
+            analyze_plane(values, n, &actual);
+            selftest_case(st, res, memcmp(&expect, &actual, sizeof(expect)) == 0, "case %u: %zu values count differently", c, n);
+        }
+    }
+    analyze_set_kernel(selected);
+}
+
+/* Zero mean, unit variance, near enough: the sum of four uniforms */
+static double selftest_gauss(Selftest *st)
+{
+    double sum = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        sum += (selftest_rand(st) >> 11) * (1.0 / 9007199254740992.0);
+    }
+    return (sum - 2) * sqrt(3);
+}
+
+/* Pixels like a photograph's: smooth shading, an edge, sensor noise, clipped at 0 and 255 */
+static void selftest_smooth(Selftest *st, SelftestCover *cover)
+{
+    double noise = 1 + selftest_below(st, 7) / 2.0;
+    size_t row_bytes = (size_t)cover->width * cover->bpp;
+
+    for (uint c = 0; c < cover->bpp; c++)
+    {
+        double base = 48 + (double)selftest_below(st, 160), amp = 10 + (double)selftest_below(st, 70);
+        double fx = 2 * M_PI * (1 + selftest_below(st, 3)) / cover->width;
+        double fy = 2 * M_PI * (1 + selftest_below(st, 3)) / cover->height;
+        double edge = (double)selftest_below(st, 60) - 30;
+        uint edge_x = (uint)selftest_below(st, cover->width);
+
+        for (uint y = 0; y < cover->height; y++)
+        {
+            for (uint x = 0; x < cover->width; x++)
+            {
+                // Alpha stays opaque
+                double v = cover->bpp == 4 && c == 3 ? 255 :
+                           base + amp * sin(fx * x) * cos(fy * y) + (x >= edge_x ? edge : 0) + noise * selftest_gauss(st);
+                cover->pixels[y * row_bytes + (size_t)x * cover->bpp + c] = (unsigned char)(v < 0 ? 0 : v > 255 ? 255 : lround(v));
+            }
+        }
+    }
+}
+
+/* Step 9: Smooth covers with random LSBs in a known share of the carriers; RS and SPA have to find that share */
+static void selftest_analyze_rates(Selftest *st, const char *fname)
+{
+    static const double rates[] = {0, 0.25, 0.5};
+    SelftestResult *res = selftest_result(st, analyze_kernel_name(), "rate");
+
+    for (uint c = 0; c < SELFTEST_ANALYZE_COVERS; c++)
+    {
+        SelftestCover sc;
+        double rate = rates[c % (sizeof(rates) / sizeof(rates[0]))];
+        memset(&sc, 0, sizeof(sc));
+        sc.width = 512 + (uint)selftest_below(st, 512);
+        sc.height = 384 + (uint)selftest_below(st, 384);
+        sc.pixels = malloc((size_t)sc.width * sc.height * 4);
+        if (sc.pixels == NULL || selftest_make_bmp(st, &sc) == e_failure)
+        {
+            selftest_case(st, res, 0, "cover %u: out of memory", c);
+            free(sc.pixels);
+            break;
+        }
+        selftest_smooth(st, &sc);
+
+        // Every carrier (not alpha) takes a random LSB with probability rate
+        size_t nbytes = (size_t)sc.width * sc.height * sc.bpp;
+        for (size_t i = 0; i < nbytes; i++)
+        {
+            if ((sc.bpp != 4 || i % 4 != 3) && (selftest_rand(st) >> 11) * (1.0 / 9007199254740992.0) < rate)
+            {
+                sc.pixels[i] = (unsigned char)((sc.pixels[i] & ~1) | (selftest_rand(st) & 1));
+            }
+        }
+        bmp_store(&sc, sc.file, sc.pixels);
+
+        AnalyzeResult result;
+        double bytes, ms;
+        Status status = write_file(fname, sc.file, sc.file_size);
+        if (status == e_success)
+        {
+            int saved = selftest_quiet();
+            status = analyze_image(fname, st->nthreads, &result, &bytes, &ms);
+            selftest_loud(saved);
+        }
+        selftest_case(st, res, status == e_success && result.flagged == (rate > 0) &&
+                      fabs(result.rs_rate - rate) <= SELFTEST_ANALYZE_ERROR && fabs(result.spa_rate - rate) <= SELFTEST_ANALYZE_ERROR &&
+                      fabs(result.rate - rate) <= SELFTEST_ANALYZE_ERROR,
+                      "%s, rate %.2f: RS %.4f, SPA %.4f, estimate %.4f, %s", sc.desc, rate, result.rs_rate, result.spa_rate, result.rate,
+                      result.flagged ? "flagged" : "not flagged");
+        free(sc.pixels);
+        free(sc.file);
+    }
+}
+
+/* O_DIRECT on files of the test directory, so the direct variant does not just fall back */
+static int selftest_direct_supported(const char *fname)
+{
+    int fd = open(fname, O_RDONLY | O_DIRECT);
+    if (fd < 0)
+    {
+        return 0;
+    }
+    close(fd);
+    return 1;
+}
+
+static void selftest_print(Selftest *st, FILE *report)
+{
+    printf("  %-14s %-8s %8s %9s %10s\n", "variant", "check", "cases", "failures", "MB/s");
+    if (report != NULL)
+    {
+        fprintf(report, "variant,check,cases,failures,mb_per_s\n");
+    }
+    for (uint i = 0; i < st->nresults; i++)
+    {
+        const SelftestResult *res = &st->results[i];
+        double mbps = res->seconds > 0 ? res->bytes / 1e6 / res->seconds : 0;
+        char cases[24], failures[24];
+        snprintf(cases, sizeof(cases), res->cases ? "%llu" : "-", res->cases);
+        snprintf(failures, sizeof(failures), res->cases ? "%llu" : "-", res->failures);
+        printf("  %-14s %-8s %8s %9s %10.1f\n", res->variant, res->check, cases, failures, mbps);
+        if (report != NULL)
+        {
+            fprintf(report, "%s,%s,%llu,%llu,%.1f\n", res->variant, res->check, res->cases, res->failures, mbps);
+        }
+    }
+}
+
+static Status selftest_run(Selftest *st)
+{
+    char cover_fname[4096], stego_fname[4096];
+    const char *selected = lsb_kernel_name();
+    size_t total = 8 * (size_t)SELFTEST_BENCH_BYTES;
+
+    // Step 1 and 2: Every kernel variant the CPU has, then its speed
+    unsigned char *cover = malloc(total);
+    unsigned char *expect = malloc(total);
+    unsigned char *actual = malloc(total);
+    unsigned char *data = malloc(SELFTEST_BENCH_BYTES);
+    unsigned char *out = malloc(SELFTEST_BENCH_BYTES);
+    if (cover == NULL || expect == NULL || actual == NULL || data == NULL || out == NULL)
+    {
+        printf("ERROR: Out of memory for the kernel buffers.\n");
+        free(cover);
+        free(expect);
+        free(actual);
+        free(data);
+        free(out);
+        return e_failure;
+    }
+    selftest_fill(st, cover, total);
+    selftest_fill(st, data, SELFTEST_BENCH_BYTES);
+    selftest_kernel_speed(st, NULL, cover, data);
+    for (uint v = 0; lsb_kernel_variant(v) != NULL; v++)
+    {
+        const char *variant = lsb_kernel_variant(v);
+        if (lsb_set_kernel(variant) == e_failure)
+        {
+            printf("INFO: The CPU cannot run the %s kernels, skipping them.\n", variant);
+            continue;
+        }
+        if (selftest_kernel_cases(st, variant) == e_failure)
+        {
+            break;
+        }
+        selftest_kernel_speed(st, variant, cover, data);
+    }
+    lsb_set_kernel(selected);
+
+    // Step 3: The selected kernel across threads
+    selftest_threads(st, cover, expect, actual, data, out);
+    free(cover);
+    free(expect);
+    free(actual);
+    free(data);
+    free(out);
+
+    // Step 4: Covers, the BMP ones cycling through the I/O variants
+    snprintf(cover_fname, sizeof(cover_fname), "%s/steg-selftest-%ld-cover", st->dir, (long)getpid());
+    snprintf(stego_fname, sizeof(stego_fname), "%s/steg-selftest-%ld-stego", st->dir, (long)getpid());
+    int direct = -1;
+    for (uint c = 0; c < st->ncovers; c++)
+    {
+        SelftestCover sc;
+        int png = (int)selftest_below(st, 3) == 0;
+        if (selftest_make_cover(st, &sc, png) == e_failure || write_file(cover_fname, sc.file, sc.file_size) == e_failure)
+        {
+            printf("ERROR: Unable to make cover %u.\n", c);
+            free(sc.pixels);
+            free(sc.file);
+            st->failures++;
+            break;
+        }
+        if (direct < 0)
+        {
+            direct = selftest_direct_supported(cover_fname);
+            if (!direct)
+            {
+                printf("INFO: O_DIRECT is not supported in %s, skipping the direct I/O variant.\n", st->dir);
+            }
+        }
+        if (png)
+        {
+            selftest_cover(st, &sc, "png", 0, 0, cover_fname, stego_fname);
+        }
+        else
+        {
+            uint io = (uint)selftest_below(st, direct ? 3 : 2);
+            selftest_cover(st, &sc, io == 0 ? "bmp mmap" : io == 1 ? "bmp buffered" : "bmp direct",
+                           io == 2 ? IMAGE_IO_DIRECT : 0, io == 1, cover_fname, stego_fname);
+        }
+        free(sc.pixels);
+        free(sc.file);
+    }
+    unlink(stego_fname);
+
+    // Step 5: JPEG Huffman tables, over-full ones included
+    selftest_jpeg_tables(st);
+
+    // Step 6 and 7: JPEG and layered round trips through the command handlers
+    selftest_jpeg_files(st);
+    selftest_layer_files(st);
+
+    // Step 8 and 9: Steganalysis kernels, then its estimates at known embedding rates
+    selftest_analyze_kernels(st);
+    selftest_analyze_rates(st, cover_fname);
+    unlink(cover_fname);
+    return e_success;
+}
+
+Status do_selftest(int argc, char *argv[])
+{
+    Selftest st;
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+
+    // Step 1: Options only
+    memset(&st, 0, sizeof(st));
+    st.ncovers = SELFTEST_DEFAULT_COVERS;
+    st.nthreads = online > 1 ? (uint)online : 2;
+    st.dir = getenv("TMPDIR") != NULL ? getenv("TMPDIR") : "/tmp";
+    st.seed = (uint64_t)time(NULL) ^ ((uint64_t)getpid() << 32);
+    for (int i = 2; i < argc; i++)
+    {
+        char *end;
+        if (strncmp(argv[i], "--covers=", 9) == 0)
+        {
+            long n = strtol(argv[i] + 9, &end, 10);
+            if (end == argv[i] + 9 || *end != '\0' || n < 0 || n > 1000000)
+            {
+                printf("ERROR: --covers must be 0 to 1000000.\n");
+                return e_failure;
+            }
+            st.ncovers = (uint)n;
+        }
+        else if (strncmp(argv[i], "--seed=", 7) == 0)
+        {
+            st.seed = strtoull(argv[i] + 7, &end, 10);
+            if (end == argv[i] + 7 || *end != '\0')
+            {
+                printf("ERROR: --seed needs a number.\n");
+                return e_failure;
+            }
+        }
+        else if (strncmp(argv[i], "--threads=", 10) == 0)
+        {
+            long t = strtol(argv[i] + 10, &end, 10);
+            if (end == argv[i] + 10 || *end != '\0' || t < 1 || t > SELFTEST_MAX_THREADS)
+            {
+                printf("ERROR: --threads must be 1 to %d.\n", SELFTEST_MAX_THREADS);
+                return e_failure;
+            }
+            st.nthreads = (uint)t;
+        }
+        else if (strncmp(argv[i], "--dir=", 6) == 0 && argv[i][6] != '\0')
+        {
+            st.dir = argv[i] + 6;
+        }
+        else if (strncmp(argv[i], "--report=", 9) == 0 && argv[i][9] != '\0')
+        {
+            st.report_fname = argv[i] + 9;
+        }
+        else
+        {
+            printf("ERROR: Invalid arguments. Usage: <Program Name> -t [--covers=%d] [--seed=N] [--threads=N] [--dir=<Directory>] [--report=<File>]\n",
+                   SELFTEST_DEFAULT_COVERS);
+            return e_failure;
+        }
+    }
+    if (st.nthreads > SELFTEST_MAX_THREADS)
+    {
+        st.nthreads = SELFTEST_MAX_THREADS;
+    }
+    st.rng = st.seed;
+
+    printf("Self-test with seed %llu (--seed=%llu repeats it): %u kernel cases per variant, %u covers, %u threads, files in %s\n",
+           (unsigned long long)st.seed, (unsigned long long)st.seed, SELFTEST_KERNEL_CASES, st.ncovers, st.nthreads, st.dir);
+
+    // Step 2: Everything against the reference, then the table
+    Status status = selftest_run(&st);
+    FILE *report = NULL;
+    if (st.report_fname != NULL)
+    {
+        report = fopen(st.report_fname, "w");
+        if (report == NULL)
+        {
+            perror("fopen");
+            printf("ERROR: Unable to open file %s\n", st.report_fname);
+            status = e_failure;
+        }
+    }
+    printf("Results (MB/s of carrier bytes for the kernels, of pixel bytes for the covers):\n");
+    selftest_print(&st, report);
+    if (report != NULL && fclose(report) != 0)
+    {
+        printf("ERROR: Failed to write %s\n", st.report_fname);
+        status = e_failure;
+    }
+
+    if (st.failures > 0)
+    {
+        printf("ERROR: %llu of %llu cases do not match the reference (seed %llu).\n",
+               st.failures, st.cases, (unsigned long long)st.seed);
+        return e_failure;
+    }
+    if (status == e_success)
+    {
+        printf("All %llu cases match the reference.\n", st.cases);
+    }
+    return status;
+}
@@ -0,0 +1,66 @@
+#ifndef SELFTEST_H
+#define SELFTEST_H
+
+#include "types.h"
+
+/*
+ * Differential self-test. Every embed/extract path is held against the
+ * semantics of encode_byte_to_lsb / decode_byte_from_lsb (a byte in 8
+ * consecutive carriers, MSB first, nothing but the LSB changed) and has
+ * to give bit-identical output:
+ *
+ *   kernels  every LSB kernel variant the CPU can run (swar64, sse2,
+ *            avx2), on random lengths at random alignments with guard
+ *            bytes around each buffer: embedding, extraction, LSB
+ *            matching (against the scalar variant, and split at random
+ *            points) and matrix embedding (against lsb_syndrome)
+ *   threads  the selected kernel over one buffer cut at random byte
+ *            boundaries, one piece per thread
+ *   covers   whole carrier streams over random BMP and PNG covers: odd
+ *            widths and row padding, both BMP orientations, 8/24/32-bit
+ *            BMP, every 8-bit PNG colour type with random row filters,
+ *            compression levels and IDAT splits, random channel masks.
+ *            BMP covers are read mapped, buffered and with O_DIRECT. A
+ *            replaced BMP has to match the cover patched by the
+ *            reference byte for byte, header, padding and trailer
+ *            included; every stego image has to give its payload back.
+ *   jpeg     Huffman tables of random code counts, over-full ones
+ *            included, have to be rejected exactly when they break the
+ *            Kraft inequality; generated baseline JPEGs (1 or 3
+ *            components, random sampling and restart intervals) have to
+ *            count the carriers they were written with, keep them, give
+ *            the secret back, and refuse one byte too many
+ *   layers   one to four keys in a BMP or PNG cover: every key its own
+ *            secret, a spare key nothing
+ *   analyze  every counting kernel of the steganalysis against the scalar
+ *            one, saturated runs included; smooth photo-like covers with
+ *            random LSBs at known rates have to be flagged exactly when
+ *            embedded, with RS, SPA and the combined rate near the truth
+ *
+ * The throughput of every variant is measured in the same run, so a
+ * faster kernel cannot come with a change of format. The seed is
+ * printed, --seed repeats a run exactly.
+ */
+
+#define SELFTEST_DEFAULT_COVERS 60
+#define SELFTEST_KERNEL_CASES 2000              // Random cases per kernel variant and check
+#define SELFTEST_CASE_BYTES 4096                // Largest data run of a kernel case
+#define SELFTEST_GUARD 64                       // Guard bytes around every kernel buffer
+#define SELFTEST_BENCH_BYTES (4 * 1024 * 1024)  // Data bytes of a throughput run (8x as many carriers)
+#define SELFTEST_BENCH_RUNS 3                   // Best of
+#define SELFTEST_JPEG_CASES 400                // Random Huffman tables
+#define SELFTEST_JPEG_FILES 8                   // Generated JPEGs embedded and extracted
+#define SELFTEST_LAYER_FILES 6                  // Covers with layers
+#define SELFTEST_LAYERS 4                       // Most layers of one cover (at most LAYER_PROBES, so every key finds a set)
+#define SELFTEST_ANALYZE_COVERS 12              // Smooth covers at known embedding rates
+#define SELFTEST_ANALYZE_ERROR 0.15             // Largest error of the RS, SPA and combined rates
+#define SELFTEST_MAX_THREADS 64
+#define SELFTEST_MAX_WIDTH 1000
+#define SELFTEST_MAX_HEIGHT 300
+#define SELFTEST_MAX_RESULTS 64
+#define SELFTEST_MAX_ERRORS 10                  // Mismatches described in detail
+
+/* -t [--covers=N] [--seed=N] [--threads=N] [--dir=<Directory>] [--report=<File>] */
+Status do_selftest(int argc, char *argv[]);
+
+#endif
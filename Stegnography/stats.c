@@ -0,0 +1,213 @@
+#define _GNU_SOURCE     // RUSAGE_THREAD
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "stats.h"
+
+static const char *phase_names[NUM_STATS_PHASES] = {
+    "open", "capacity", "header", "magic", "mode", "extn", "size", "checksum", "data", "tail"
+};
+
+/* I/O counters of the thread, opened on first use (-1 if the kernel has none) */
+static int io_fd = -2;
+
+/* Reads of the counter file itself, left out of every sample */
+static unsigned long long self_bytes, self_calls;
+
+/* Value of "name: N" in the counter file text */
+static unsigned long long io_field(const char *text, const char *name)
+{
+    const char *p = strstr(text, name);
+    return p != NULL ? strtoull(p + strlen(name), NULL, 10) : 0;
+}
+
+static void take_sample(StatsSample *sample)
+{
+    struct timespec now;
+    struct rusage usage;
+    char text[512];
+
+    // Step 1: Wall clock and page faults
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    sample->ns = now.tv_sec * 1000000000ULL + now.tv_nsec;
+    sample->page_faults = 0;
+    if (getrusage(RUSAGE_THREAD, &usage) == 0)
+    {
+        sample->page_faults = usage.ru_minflt + usage.ru_majflt;
+    }
+
+    // Step 2: The file resolves to the opening thread, every run is timed on that one
+    if (io_fd == -2)
+    {
+        io_fd = open("/proc/thread-self/io", O_RDONLY);
+    }
+    ssize_t n = io_fd >= 0 ? pread(io_fd, text, sizeof(text) - 1, 0) : -1;
+    if (n <= 0)
+    {
+        sample->bytes_read = sample->bytes_written = sample->read_calls = sample->write_calls = 0;
+        return;
+    }
+    text[n] = '\0';
+
+    // Step 3: This read shows up from the next sample on
+    sample->bytes_read = io_field(text, "rchar:") - self_bytes;
+    sample->bytes_written = io_field(text, "wchar:");
+    sample->read_calls = io_field(text, "syscr:") - self_calls;
+    sample->write_calls = io_field(text, "syscw:");
+    self_bytes += n;
+    self_calls++;
+}
+
+Status stats_parse_format(const char *value, StatsFormat *format)
+{
+    if (value == NULL || strcmp(value, "text") == 0)
+    {
+        *format = e_stats_text;
+    }
+    else if (strcmp(value, "json") == 0)
+    {
+        *format = e_stats_json;
+    }
+    else
+    {
+        printf("ERROR: Unknown stats format %s, use --stats or --stats=json.\n", value);
+        return e_failure;
+    }
+    return e_success;
+}
+
+void stats_start(Stats *stats, StatsFormat format)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->format = format;
+    stats->current = -1;
+}
+
+void stats_phase(Stats *stats, StatsPhase phase)
+{
+    StatsSample now;
+
+    if (stats->format == e_stats_off)
+    {
+        return;
+    }
+
+    // Step 1: Charge the difference since the last boundary to the running phase
+    take_sample(&now);
+    if (stats->current >= 0)
+    {
+        PhaseStats *p = &stats->phase[stats->current];
+        p->total.ns += now.ns - stats->mark.ns;
+        p->total.bytes_read += now.bytes_read - stats->mark.bytes_read;
+        p->total.bytes_written += now.bytes_written - stats->mark.bytes_written;
+        p->total.read_calls += now.read_calls - stats->mark.read_calls;
+        p->total.write_calls += now.write_calls - stats->mark.write_calls;
+        p->total.page_faults += now.page_faults - stats->mark.page_faults;
+    }
+
+    // Step 2: The next phase starts now (NUM_STATS_PHASES ends the run)
+    if (phase < NUM_STATS_PHASES)
+    {
+        stats->phase[phase].calls++;
+        stats->current = phase;
+    }
+    else
+    {
+        stats->current = -1;
+    }
+    stats->mark = now;
+}
+
+void stats_end(Stats *stats)
+{
+    if (stats->format == e_stats_off || stats->current < 0)
+    {
+        return;
+    }
+    stats_phase(stats, NUM_STATS_PHASES);
+    stats->runs++;
+}
+
+void stats_add(Stats *total, const Stats *stats)
+{
+    for (int i = 0; i < NUM_STATS_PHASES; i++)
+    {
+        const PhaseStats *p = &stats->phase[i];
+        total->phase[i].calls += p->calls;
+        total->phase[i].total.ns += p->total.ns;
+        total->phase[i].total.bytes_read += p->total.bytes_read;
+        total->phase[i].total.bytes_written += p->total.bytes_written;
+        total->phase[i].total.read_calls += p->total.read_calls;
+        total->phase[i].total.write_calls += p->total.write_calls;
+        total->phase[i].total.page_faults += p->total.page_faults;
+    }
+    total->runs += stats->runs;
+}
+
+void stats_report(const Stats *stats, const char *operation)
+{
+    StatsSample sum = { 0 };
+
+    if (stats->format == e_stats_off)
+    {
+        return;
+    }
+    for (int i = 0; i < NUM_STATS_PHASES; i++)
+    {
+        sum.ns += stats->phase[i].total.ns;
+        sum.bytes_read += stats->phase[i].total.bytes_read;
+        sum.bytes_written += stats->phase[i].total.bytes_written;
+        sum.read_calls += stats->phase[i].total.read_calls;
+        sum.write_calls += stats->phase[i].total.write_calls;
+        sum.page_faults += stats->phase[i].total.page_faults;
+    }
+
+    // One JSON object on a line of its own, phases that never ran are left out
+    if (stats->format == e_stats_json)
+    {
+        fprintf(stderr, "{\"operation\":\"%s\",\"runs\":%u,\"io_counters\":%s,\"phases\":[",
+                operation, stats->runs, io_fd >= 0 ? "true" : "false");
+        int first = 1;
+        for (int i = 0; i < NUM_STATS_PHASES; i++)
+        {
+            const PhaseStats *p = &stats->phase[i];
+            if (p->calls == 0)
+            {
+                continue;
+            }
+            fprintf(stderr, "%s{\"phase\":\"%s\",\"calls\":%llu,\"ns\":%llu,\"bytes_read\":%llu,\"bytes_written\":%llu,"
+                    "\"read_calls\":%llu,\"write_calls\":%llu,\"page_faults\":%llu}",
+                    first ? "" : ",", phase_names[i], p->calls, p->total.ns, p->total.bytes_read,
+                    p->total.bytes_written, p->total.read_calls, p->total.write_calls, p->total.page_faults);
+            first = 0;
+        }
+        fprintf(stderr, "],\"total\":{\"ns\":%llu,\"bytes_read\":%llu,\"bytes_written\":%llu,"
+                "\"read_calls\":%llu,\"write_calls\":%llu,\"page_faults\":%llu}}\n",
+                sum.ns, sum.bytes_read, sum.bytes_written, sum.read_calls, sum.write_calls, sum.page_faults);
+        return;
+    }
+
+    fprintf(stderr, "Stats (%s, %u run%s):\n", operation, stats->runs, stats->runs == 1 ? "" : "s");
+    fprintf(stderr, "  %-9s %6s %12s %12s %12s %8s %8s %8s\n",
+            "phase", "calls", "ms", "bytes read", "written", "reads", "writes", "faults");
+    for (int i = 0; i <= NUM_STATS_PHASES; i++)
+    {
+        const StatsSample *s = i < NUM_STATS_PHASES ? &stats->phase[i].total : &sum;
+        if (i < NUM_STATS_PHASES && stats->phase[i].calls == 0)
+        {
+            continue;
+        }
+        fprintf(stderr, "  %-9s %6llu %12.3f %12llu %12llu %8llu %8llu %8llu\n",
+                i < NUM_STATS_PHASES ? phase_names[i] : "total",
+                i < NUM_STATS_PHASES ? stats->phase[i].calls : (unsigned long long)stats->runs,
+                s->ns / 1e6, s->bytes_read, s->bytes_written, s->read_calls, s->write_calls, s->page_faults);
+    }
+    if (io_fd < 0)
+    {
+        fprintf(stderr, "  (no I/O counters on this system, times only)\n");
+    }
+}
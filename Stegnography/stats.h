@@ -0,0 +1,84 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "types.h"
+
+/*
+ * Per-phase instrumentation of encode and decode runs (--stats,
+ * --stats=json). At every phase boundary the wall clock and the I/O
+ * counters of the calling thread (/proc/thread-self/io: bytes and
+ * read/write system calls, whatever layer issued them) are sampled and
+ * the difference is charged to the phase that just ended. Pixels read
+ * through a mapping show up as page faults rather than as reads.
+ * Nothing is sampled while stats are off, a boundary is then a single
+ * test.
+ * Reads done ahead by batch I/O threads are not charged to any phase.
+ */
+
+typedef enum
+{
+    e_phase_open,           // Opening input and output files
+    e_phase_capacity,       // Encode only: sizing the payload against the cover
+    e_phase_header,         // Image header, copied to the stego image when encoding
+    e_phase_magic,          // Magic string (decode: includes the prompt)
+    e_phase_mode,
+    e_phase_extn,           // Extension size and extension
+    e_phase_size,
+    e_phase_checksum,       // Header checksum
+    e_phase_data,           // Payload blocks
+    e_phase_tail,           // Rows after the payload, flushing and closing
+    NUM_STATS_PHASES
+} StatsPhase;
+
+typedef enum
+{
+    e_stats_off,
+    e_stats_text,
+    e_stats_json
+} StatsFormat;
+
+/* Counter snapshot at a phase boundary */
+typedef struct _StatsSample
+{
+    unsigned long long ns;
+    unsigned long long bytes_read;
+    unsigned long long bytes_written;
+    unsigned long long read_calls;
+    unsigned long long write_calls;
+    unsigned long long page_faults;     // Minor and major, mapped files fault their pages in
+} StatsSample;
+
+typedef struct _PhaseStats
+{
+    unsigned long long calls;
+    StatsSample total;      // Summed differences, same fields as a sample
+} PhaseStats;
+
+typedef struct _Stats
+{
+    StatsFormat format;
+    uint runs;              // Runs added up (images in a batch)
+    int current;            // Phase being timed, -1 if none
+    StatsSample mark;       // Sample taken when it started
+    PhaseStats phase[NUM_STATS_PHASES];
+} Stats;
+
+/* Parse the value of --stats (NULL) or --stats=text|json */
+Status stats_parse_format(const char *value, StatsFormat *format);
+
+/* Start (or restart) counting a run */
+void stats_start(Stats *stats, StatsFormat format);
+
+/* End the running phase and start the next one */
+void stats_phase(Stats *stats, StatsPhase phase);
+
+/* End the running phase and count the run */
+void stats_end(Stats *stats);
+
+/* Add the phases and runs of one run to a running total */
+void stats_add(Stats *total, const Stats *stats);
+
+/* Print the counters to stderr, operation names the run ("encode", "batch") */
+void stats_report(const Stats *stats, const char *operation);
+
+#endif
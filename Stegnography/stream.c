@@ -0,0 +1,698 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include "stream.h"
+#include "crc32c.h"
+#include "lsb.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+/* Frame layouts: bytes per frame, then carriers (a prefix of the frame) */
+typedef enum
+{
+    e_frame_bgr24,
+    e_frame_rgb24,
+    e_frame_gray8,
+    e_frame_yuv420,     // Planar Y, then U and V at half width and height (I420)
+    e_frame_unsupported
+} FrameFormat;
+
+static const char *const frame_format_names[] = { "bgr24", "rgb24", "gray8", "yuv420" };
+
+/* Timestamps of the frame in one slot */
+typedef struct _StreamTimes
+{
+    unsigned long long read_ns;     // Whole frame read
+    unsigned long long done_ns;     // Segment embedded or extracted
+    size_t segment;                 // Data bytes of its segment
+} StreamTimes;
+
+/*
+ * Ring of frame buffers. Cursors count frames since the start: slot
+ * k % nslots holds frame k. filled is written by the reader only, done
+ * by the embedder, sent by the writer (the extractor when there is no
+ * writer); each sits on its own cache line.
+ */
+typedef struct _StreamRing
+{
+    unsigned char *frames;
+    size_t frame_size;
+    uint nslots;
+    StreamTimes *times;
+
+    unsigned long long filled __attribute__((aligned(64)));
+    unsigned long long done __attribute__((aligned(64)));
+    unsigned long long sent __attribute__((aligned(64)));
+
+    /* Set once the stage is over, after its cursor stopped moving */
+    int read_end __attribute__((aligned(64)));
+    int work_end;
+    int send_end;
+    int failed;                     // Any stage, every other one stops waiting
+} StreamRing;
+
+/* Per-frame latencies, kept by the last stage */
+typedef struct _StreamLog
+{
+    unsigned long long *latency_ns; // Read to written (extracted without a writer)
+    size_t count;
+    size_t alloc;
+    unsigned long long work_ns;     // Embedding or extraction, summed
+    FILE *report;                   // One CSV line per frame, NULL for none
+} StreamLog;
+
+typedef struct _StreamInfo
+{
+    FrameFormat format;
+    uint width;
+    uint height;
+    size_t carriers;                // Carriers of a frame
+    const char *secret_fname;       // Embedding
+    const char *output_fname;       // Extraction
+    const char *report_fname;
+    uint nslots;
+} StreamInfo;
+
+static unsigned long long now_ns(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (unsigned long long)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static size_t frame_bytes(FrameFormat format, uint width, uint height)
+{
+    size_t pixels = (size_t)width * height;
+
+    switch (format)
+    {
+        case e_frame_bgr24:
+        case e_frame_rgb24:
+            return 3 * pixels;
+        case e_frame_gray8:
+            return pixels;
+        case e_frame_yuv420:
+            return pixels + 2 * ((size_t)(width + 1) / 2) * ((height + 1) / 2);
+        default:
+            return 0;
+    }
+}
+
+/* Every byte, only the Y plane for YUV */
+static size_t frame_carriers(FrameFormat format, uint width, uint height)
+{
+    return format == e_frame_yuv420 ? (size_t)width * height : frame_bytes(format, width, height);
+}
+
+static unsigned char *ring_slot(StreamRing *ring, unsigned long long k)
+{
+    return ring->frames + (size_t)(k % ring->nslots) * ring->frame_size;
+}
+
+/*
+ * Wait until *cursor passes k. Returns 0 when it never will: the stage
+ * owning it set *end first, or some stage failed.
+ */
+static int ring_wait(StreamRing *ring, const unsigned long long *cursor, unsigned long long k, const int *end)
+{
+    for (uint spins = 0;; spins++)
+    {
+        if (__atomic_load_n(cursor, __ATOMIC_ACQUIRE) > k)
+        {
+            return 1;
+        }
+        if (__atomic_load_n(end, __ATOMIC_ACQUIRE))
+        {
+            return __atomic_load_n(cursor, __ATOMIC_ACQUIRE) > k;
+        }
+        if (__atomic_load_n(&ring->failed, __ATOMIC_RELAXED))
+        {
+            return 0;
+        }
+        if (spins < STREAM_SPINS)
+        {
+#if defined(__x86_64__)
+            _mm_pause();
+#endif
+        }
+        else
+        {
+            sched_yield();
+        }
+    }
+}
+
+static void ring_fail(StreamRing *ring)
+{
+    __atomic_store_n(&ring->failed, 1, __ATOMIC_RELEASE);
+}
+
+/* Record the latency of frame k, finished at end_ns */
+static Status stream_log_frame(StreamLog *log, const StreamTimes *times, unsigned long long k, unsigned long long end_ns)
+{
+    if (log->count == log->alloc)
+    {
+        size_t alloc = log->alloc ? 2 * log->alloc : 1024;
+        unsigned long long *grown = realloc(log->latency_ns, alloc * sizeof(*grown));
+        if (grown == NULL)
+        {
+            fprintf(stderr, "ERROR: Out of memory for the frame latencies.\n");
+            return e_failure;
+        }
+        log->latency_ns = grown;
+        log->alloc = alloc;
+    }
+    log->latency_ns[log->count++] = end_ns - times->read_ns;
+    log->work_ns += times->done_ns - times->read_ns;
+    if (log->report != NULL)
+    {
+        fprintf(log->report, "%llu,%zu,%.1f,%.1f\n", k, times->segment,
+                (times->done_ns - times->read_ns) / 1e3, (end_ns - times->read_ns) / 1e3);
+    }
+    return e_success;
+}
+
+static void *stream_reader(void *arg)
+{
+    StreamRing *ring = arg;
+
+    for (unsigned long long k = 0;; k++)
+    {
+        // The slot is free once the writer sent the frame one lap back
+        if (k >= ring->nslots && !ring_wait(ring, &ring->sent, k - ring->nslots, &ring->send_end))
+        {
+            break;
+        }
+        size_t n = fread(ring_slot(ring, k), 1, ring->frame_size, stdin);
+        if (n < ring->frame_size)
+        {
+            if (ferror(stdin))
+            {
+                fprintf(stderr, "ERROR: Failed to read frame %llu from stdin.\n", k);
+                ring_fail(ring);
+            }
+            else if (n > 0)
+            {
+                fprintf(stderr, "WARNING: Stream ended inside frame %llu (%zu of %zu bytes), dropped.\n",
+                        k, n, ring->frame_size);
+            }
+            break;
+        }
+        ring->times[k % ring->nslots].read_ns = now_ns();
+        __atomic_store_n(&ring->filled, k + 1, __ATOMIC_RELEASE);
+    }
+
+    __atomic_store_n(&ring->read_end, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/* Writer thread state */
+typedef struct _StreamWriter
+{
+    StreamRing *ring;
+    StreamLog *log;
+} StreamWriter;
+
+static void *stream_writer(void *arg)
+{
+    StreamWriter *writer = arg;
+    StreamRing *ring = writer->ring;
+
+    for (unsigned long long k = 0; ring_wait(ring, &ring->done, k, &ring->work_end); k++)
+    {
+        if (fwrite(ring_slot(ring, k), ring->frame_size, 1, stdout) != 1 || fflush(stdout) != 0)
+        {
+            fprintf(stderr, "ERROR: Failed to write frame %llu to stdout.\n", k);
+            ring_fail(ring);
+            break;
+        }
+        if (stream_log_frame(writer->log, &ring->times[k % ring->nslots], k, now_ns()) == e_failure)
+        {
+            ring_fail(ring);
+            break;
+        }
+        __atomic_store_n(&ring->sent, k + 1, __ATOMIC_RELEASE);
+    }
+
+    __atomic_store_n(&ring->send_end, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/* Embedder: one segment per frame until the secret ends, then frames pass through */
+static Status stream_embed(StreamRing *ring, const StreamInfo *info, int fd, unsigned long long *payload, uint *segments)
+{
+    size_t capacity = info->carriers / 8 - STREAM_SEGMENT_OVERHEAD;
+    unsigned char *segment = malloc(capacity + STREAM_SEGMENT_OVERHEAD);
+    int finished = 0;
+    uint seq = 0;
+
+    if (segment == NULL)
+    {
+        fprintf(stderr, "ERROR: Out of memory for a segment of %zu bytes.\n", capacity);
+        return e_failure;
+    }
+
+    for (unsigned long long k = 0; ring_wait(ring, &ring->filled, k, &ring->read_end); k++)
+    {
+        StreamTimes *times = &ring->times[k % ring->nslots];
+
+        times->segment = 0;
+        if (!finished)
+        {
+            // Step 1: Whatever data is there, without waiting for more
+            ssize_t got = read(fd, segment + 8, capacity);
+            if (got < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                perror("read");
+                fprintf(stderr, "ERROR: Failed to read the secret file %s\n", info->secret_fname);
+                free(segment);
+                return e_failure;
+            }
+            finished = got == 0;
+            if (got < 0)
+            {
+                got = 0;
+            }
+
+            // Step 2: Sequence, length and CRC around it, into the frame's carriers
+            put_be32(segment, seq++);
+            put_be32(segment + 4, (uint)got | (finished ? STREAM_LAST : 0));
+            put_be32(segment + 8 + got, crc32c_update(0, segment, 8 + got));
+            lsb_embed(ring_slot(ring, k), segment, got + STREAM_SEGMENT_OVERHEAD);
+            times->segment = got;
+            *payload += got;
+        }
+        times->done_ns = now_ns();
+        __atomic_store_n(&ring->done, k + 1, __ATOMIC_RELEASE);
+    }
+
+    *segments = seq;
+    free(segment);
+    if (!finished && !__atomic_load_n(&ring->failed, __ATOMIC_ACQUIRE))
+    {
+        fprintf(stderr, "WARNING: The frames ran out after %u segments, before the end of %s.\n",
+                seq, info->secret_fname);
+    }
+    return e_success;
+}
+
+/* Extractor: segments in order into fptr until the final one, later frames are drained */
+static Status stream_extract(StreamRing *ring, const StreamInfo *info, FILE *fptr, StreamLog *log,
+                             unsigned long long *payload, uint *segments)
+{
+    size_t capacity = info->carriers / 8 - STREAM_SEGMENT_OVERHEAD;
+    unsigned char *segment = malloc(capacity + STREAM_SEGMENT_OVERHEAD);
+    unsigned long long skipped = 0;
+    int finished = 0;
+    Status status = e_success;
+    uint seq = 0;
+
+    if (segment == NULL)
+    {
+        fprintf(stderr, "ERROR: Out of memory for a segment of %zu bytes.\n", capacity);
+        return e_failure;
+    }
+
+    for (unsigned long long k = 0; status == e_success && ring_wait(ring, &ring->filled, k, &ring->read_end); k++)
+    {
+        StreamTimes *times = &ring->times[k % ring->nslots];
+        const unsigned char *frame = ring_slot(ring, k);
+
+        times->segment = 0;
+        if (!finished)
+        {
+            // Step 1: Header, then data and CRC if the length is plausible
+            lsb_extract(frame, segment, 8);
+            uint len = get_be32(segment + 4) & ~STREAM_LAST;
+            int valid = len <= capacity;
+            if (valid)
+            {
+                lsb_extract(frame + 64, segment + 8, len + 4);
+                valid = crc32c_update(0, segment, 8 + len) == get_be32(segment + 8 + len);
+            }
+
+            // Step 2: A frame without a segment is skipped, a gap in the sequence is data lost
+            if (!valid)
+            {
+                skipped++;
+            }
+            else if (get_be32(segment) != seq)
+            {
+                fprintf(stderr, "ERROR: Frame %llu carries segment %u, expected %u: frames were dropped or reordered.\n",
+                        k, get_be32(segment), seq);
+                status = e_failure;
+            }
+            else if (len > 0 && fwrite(segment + 8, len, 1, fptr) != 1)
+            {
+                fprintf(stderr, "ERROR: Failed to write the output file %s\n", info->output_fname);
+                status = e_failure;
+            }
+            else
+            {
+                seq++;
+                finished = (get_be32(segment + 4) & STREAM_LAST) != 0;
+                times->segment = len;
+                *payload += len;
+            }
+        }
+        times->done_ns = now_ns();
+        if (status == e_success && stream_log_frame(log, times, k, times->done_ns) == e_failure)
+        {
+            status = e_failure;
+        }
+        __atomic_store_n(&ring->done, k + 1, __ATOMIC_RELEASE);
+        __atomic_store_n(&ring->sent, k + 1, __ATOMIC_RELEASE);
+    }
+    if (status == e_failure)
+    {
+        ring_fail(ring);
+    }
+
+    *segments = seq;
+    free(segment);
+    if (skipped > 0)
+    {
+        fprintf(stderr, "WARNING: %llu frames without a valid segment were skipped.\n", skipped);
+    }
+    if (status == e_success && !finished && !__atomic_load_n(&ring->failed, __ATOMIC_ACQUIRE))
+    {
+        fprintf(stderr, "ERROR: The stream ended after %u segments, before the final one.\n", seq);
+        status = e_failure;
+    }
+    return status;
+}
+
+static int compare_ull(const void *a, const void *b)
+{
+    unsigned long long x = *(const unsigned long long *)a, y = *(const unsigned long long *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* Summary of a run on stderr */
+static void stream_report(const StreamInfo *info, StreamLog *log, unsigned long long elapsed_ns,
+                          unsigned long long payload, uint segments)
+{
+    double seconds = elapsed_ns / 1e9;
+    size_t frame_size = frame_bytes(info->format, info->width, info->height);
+
+    fprintf(stderr, "INFO: %zu frames %ux%u %s in %.2f s (%.1f fps, %.0f MB/s), %llu bytes of payload in %u segments\n",
+            log->count, info->width, info->height, frame_format_names[info->format], seconds,
+            seconds > 0 ? log->count / seconds : 0.0, seconds > 0 ? log->count * (double)frame_size / 1e6 / seconds : 0.0,
+            payload, segments);
+    if (log->count == 0)
+    {
+        return;
+    }
+
+    unsigned long long sum = 0;
+    for (size_t i = 0; i < log->count; i++)
+    {
+        sum += log->latency_ns[i];
+    }
+    qsort(log->latency_ns, log->count, sizeof(unsigned long long), compare_ull);
+    fprintf(stderr, "INFO: Latency per frame (read to %s): avg %.3f ms, p50 %.3f, p99 %.3f, max %.3f ms; "
+            "%s avg %.3f ms (%s kernel, ring of %u frames)\n",
+            info->secret_fname != NULL ? "written" : "extracted",
+            sum / 1e6 / log->count, log->latency_ns[log->count / 2] / 1e6,
+            log->latency_ns[(log->count * 99) / 100] / 1e6, log->latency_ns[log->count - 1] / 1e6,
+            info->secret_fname != NULL ? "read to embedded" : "read to extracted",
+            log->work_ns / 1e6 / log->count, lsb_kernel_name(), info->nslots);
+}
+
+/* Parse "<W>x<H>" */
+static Status parse_size(const char *text, uint *width, uint *height)
+{
+    char *end;
+    long w = strtol(text, &end, 10);
+    if (end == text || *end != 'x')
+    {
+        return e_failure;
+    }
+    const char *rest = end + 1;
+    long h = strtol(rest, &end, 10);
+    if (end == rest || *end != '\0' || w < 1 || h < 1 || w > 65535 || h > 65535)
+    {
+        return e_failure;
+    }
+    *width = (uint)w;
+    *height = (uint)h;
+    return e_success;
+}
+
+static Status read_and_validate_stream_args(int argc, char *argv[], StreamInfo *info)
+{
+    const char *names[4];
+    int nnames = 0;
+
+    // Step 1: Options first, then size, format and secret file
+    memset(info, 0, sizeof(*info));
+    info->nslots = STREAM_DEFAULT_RING;
+    for (int i = 2; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--extract=", 10) == 0 && argv[i][10] != '\0')
+        {
+            info->output_fname = argv[i] + 10;
+        }
+        else if (strncmp(argv[i], "--report=", 9) == 0 && argv[i][9] != '\0')
+        {
+            info->report_fname = argv[i] + 9;
+        }
+        else if (strncmp(argv[i], "--ring=", 7) == 0)
+        {
+            char *end;
+            long n = strtol(argv[i] + 7, &end, 10);
+            if (end == argv[i] + 7 || *end != '\0' || n < 2 || n > STREAM_MAX_RING)
+            {
+                fprintf(stderr, "ERROR: --ring must be 2 to %d frames.\n", STREAM_MAX_RING);
+                return e_failure;
+            }
+            info->nslots = (uint)n;
+        }
+        else if (strncmp(argv[i], "--", 2) == 0)
+        {
+            fprintf(stderr, "ERROR: Unknown option %s\n", argv[i]);
+            return e_failure;
+        }
+        else if (nnames < 4)
+        {
+            names[nnames++] = argv[i];
+        }
+        else
+        {
+            nnames++;
+        }
+    }
+    if (nnames != (info->output_fname != NULL ? 2 : 3))
+    {
+        fprintf(stderr, "ERROR: Invalid number of arguments. Usage: <Program Name> -s <W>x<H> <bgr24|rgb24|gray8|yuv420> <Secret File> [--ring=8] [--report=<File>]\n"
+                "       or <Program Name> -s <W>x<H> <Format> --extract=<Output File> [--ring=8] [--report=<File>]\n");
+        return e_failure;
+    }
+
+    // Step 2: Frame geometry and layout
+    if (parse_size(names[0], &info->width, &info->height) == e_failure)
+    {
+        fprintf(stderr, "ERROR: Frame size %s is not <Width>x<Height>.\n", names[0]);
+        return e_failure;
+    }
+    info->format = e_frame_unsupported;
+    for (int f = 0; f < e_frame_unsupported; f++)
+    {
+        if (strcmp(names[1], frame_format_names[f]) == 0)
+        {
+            info->format = (FrameFormat)f;
+        }
+    }
+    if (info->format == e_frame_unsupported)
+    {
+        fprintf(stderr, "ERROR: Frame format %s is not bgr24, rgb24, gray8 or yuv420.\n", names[1]);
+        return e_failure;
+    }
+    info->carriers = frame_carriers(info->format, info->width, info->height);
+    if (info->carriers / 8 <= STREAM_SEGMENT_OVERHEAD)
+    {
+        fprintf(stderr, "ERROR: A %ux%u %s frame has %zu carriers, a segment needs more than %d.\n",
+                info->width, info->height, names[1], info->carriers, 8 * STREAM_SEGMENT_OVERHEAD);
+        return e_failure;
+    }
+    info->secret_fname = info->output_fname == NULL ? names[2] : NULL;
+
+    // Step 3: Frames never go to a terminal
+    if (info->secret_fname != NULL && isatty(STDOUT_FILENO))
+    {
+        fprintf(stderr, "ERROR: Standard output is a terminal, pipe the frames somewhere.\n");
+        return e_failure;
+    }
+    return e_success;
+}
+
+Status do_stream(int argc, char *argv[])
+{
+    StreamInfo info;
+    StreamRing ring;
+    StreamLog log;
+    StreamWriter writer;
+    pthread_t reader_tid, writer_tid;
+    unsigned long long payload = 0;
+    uint segments = 0;
+    int fd = -1;
+    FILE *fptr_out = NULL;
+    Status status;
+
+    if (read_and_validate_stream_args(argc, argv, &info) == e_failure)
+    {
+        return e_failure;
+    }
+
+    // Step 1: Secret read without blocking (a FIFO is opened once a writer
+    // is there, so EOF means its writer is gone), or the output file
+    if (info.secret_fname != NULL)
+    {
+        fd = open(info.secret_fname, O_RDONLY);
+        if (fd < 0 || fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0)
+        {
+            perror("open");
+            fprintf(stderr, "ERROR: Unable to open file %s\n", info.secret_fname);
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+            return e_failure;
+        }
+    }
+    else
+    {
+        fptr_out = fopen(info.output_fname, "w");
+        if (fptr_out == NULL)
+        {
+            perror("fopen");
+            fprintf(stderr, "ERROR: Unable to open file %s\n", info.output_fname);
+            return e_failure;
+        }
+    }
+    memset(&log, 0, sizeof(log));
+    if (info.report_fname != NULL)
+    {
+        log.report = fopen(info.report_fname, "w");
+        if (log.report == NULL)
+        {
+            perror("fopen");
+            fprintf(stderr, "ERROR: Unable to open file %s\n", info.report_fname);
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+            if (fptr_out != NULL)
+            {
+                fclose(fptr_out);
+            }
+            return e_failure;
+        }
+        fprintf(log.report, "frame,segment_bytes,work_us,latency_us\n");
+    }
+
+    // Step 2: The ring, slots a whole frame each (lsb_extract may read a vector past the carriers)
+    memset(&ring, 0, sizeof(ring));
+    ring.frame_size = frame_bytes(info.format, info.width, info.height);
+    ring.nslots = info.nslots;
+    ring.frames = malloc((size_t)ring.nslots * ring.frame_size + 64);
+    ring.times = calloc(ring.nslots, sizeof(StreamTimes));
+    if (ring.frames == NULL || ring.times == NULL)
+    {
+        fprintf(stderr, "ERROR: Out of memory for %u frames of %zu bytes.\n", ring.nslots, ring.frame_size);
+        free(ring.frames);
+        free(ring.times);
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        if (fptr_out != NULL)
+        {
+            fclose(fptr_out);
+        }
+        if (log.report != NULL)
+        {
+            fclose(log.report);
+        }
+        return e_failure;
+    }
+
+    // Step 3: Reader and writer threads around the embedder (this thread);
+    // extraction has no writer, the extractor releases the slots itself
+    unsigned long long start = now_ns();
+    int reader_started = pthread_create(&reader_tid, NULL, stream_reader, &ring) == 0;
+    int writer_started = 0;
+    if (reader_started && info.secret_fname != NULL)
+    {
+        writer.ring = &ring;
+        writer.log = &log;
+        writer_started = pthread_create(&writer_tid, NULL, stream_writer, &writer) == 0;
+    }
+    if (!reader_started || (info.secret_fname != NULL && !writer_started))
+    {
+        fprintf(stderr, "ERROR: Failed to start the stream threads.\n");
+        ring_fail(&ring);
+        status = e_failure;
+    }
+    else if (info.secret_fname != NULL)
+    {
+        status = stream_embed(&ring, &info, fd, &payload, &segments);
+    }
+    else
+    {
+        status = stream_extract(&ring, &info, fptr_out, &log, &payload, &segments);
+    }
+    if (status == e_failure)
+    {
+        ring_fail(&ring);
+    }
+    __atomic_store_n(&ring.work_end, 1, __ATOMIC_RELEASE);
+    if (info.secret_fname == NULL)
+    {
+        __atomic_store_n(&ring.send_end, 1, __ATOMIC_RELEASE);
+    }
+    if (writer_started)
+    {
+        pthread_join(writer_tid, NULL);
+    }
+    if (reader_started)
+    {
+        pthread_join(reader_tid, NULL);
+    }
+    if (ring.failed)
+    {
+        status = e_failure;
+    }
+
+    // Step 4: Summary, then release everything
+    if (status == e_success)
+    {
+        stream_report(&info, &log, now_ns() - start, payload, segments);
+    }
+    if (fptr_out != NULL && fclose(fptr_out) != 0)
+    {
+        fprintf(stderr, "ERROR: Failed to write the output file %s\n", info.output_fname);
+        status = e_failure;
+    }
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+    if (log.report != NULL)
+    {
+        fclose(log.report);
+    }
+    free(log.latency_ns);
+    free(ring.frames);
+    free(ring.times);
+    return status;
+}
@@ -0,0 +1,39 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stddef.h>
+#include "types.h"
+
+/*
+ * Raw frame stream: fixed-size uncompressed frames (BGR24, RGB24, GRAY8
+ * or planar YUV 4:2:0) come in on stdin, go out on stdout, and a data
+ * stream is cut into one segment per frame on the way through. The
+ * carriers of a frame are all its bytes, the Y plane only for YUV 4:2:0
+ * (chroma is subsampled and shifts visibly). A segment is
+ *
+ *   sequence be32 | length be32 (STREAM_LAST on the final one) | data | CRC32C be32
+ *
+ * embedded with lsb_embed from the first carrier of the frame. The
+ * secret is read without blocking, so a frame whose data has not arrived
+ * yet carries an empty segment instead of stalling the video. Frames
+ * after the final segment pass through untouched.
+ *
+ * Three threads share one ring of frame buffers: the reader fills slots,
+ * the embedder changes them, the writer sends them on. Each keeps its
+ * own cursor and only waits on the one before it (the reader on the
+ * writer, one lap behind), so every hand-off is single producer, single
+ * consumer and needs no lock. Messages go to stderr, stdout carries the
+ * frames.
+ */
+
+#define STREAM_SEGMENT_OVERHEAD 12      // Sequence, length and CRC of a segment
+#define STREAM_LAST 0x80000000u         // Length flag of the final segment
+#define STREAM_DEFAULT_RING 8           // Frames in flight
+#define STREAM_MAX_RING 64
+#define STREAM_SPINS 256                // Polls of a cursor before yielding the CPU
+
+/* -s <W>x<H> <bgr24|rgb24|gray8|yuv420> <Secret File> [--ring=N] [--report=<File>]: embed, frames stdin to stdout
+   -s <W>x<H> <Format> --extract=<Output File> [--ring=N] [--report=<File>]: collect the segments of a stream */
+Status do_stream(int argc, char *argv[]);
+
+#endif
@@ -2,6 +2,16 @@
 #include <string.h>
 #include "encode.h"
 #include "decode.h"
+#include "batch.h"
+#include "update.h"
+#include "analyze.h"
+#include "catalog.h"
+#include "compare.h"
+#include "watermark.h"
+#include "stream.h"
+#include "jpeg.h"
+#include "layer.h"
+#include "selftest.h"
 #include "types.h"  // Assuming common types like Status and OperationType are defined here
 
 int main(int argc, char *argv[])
@@ -24,6 +34,8 @@ int main(int argc, char *argv[])
         {
             // Step 5: Perform encoding
             Status ret_enc = do_encoding(&encInfo);
+            stats_end(&encInfo.stats);
+            stats_report(&encInfo.stats, "encode");
             if (ret_enc == e_success)
             {
                 printf("Encoding is done successfully!\n");
@@ -50,6 +62,8 @@ int main(int argc, char *argv[])
         {
             // Step 8: Perform decoding
             Status ret_dec = do_decoding(&decInfo);
+            stats_end(&decInfo.stats);
+            stats_report(&decInfo.stats, "decode");
             if (ret_dec == e_success)
             {
                 printf("Decoding is done successfully!\n");
@@ -65,6 +79,123 @@ int main(int argc, char *argv[])
             printf("ERROR: Validation of decoding arguments failed.\n");
         }
     }
+    // Step 8a: Check if operation is batch encoding
+    else if (ret == e_batch)
+    {
+        printf("Batch encoding operation selected.\n");
+
+        if (do_batch_encoding(argc, argv) == e_success)
+        {
+            printf("Batch encoding is done successfully!\n");
+        }
+        else
+        {
+            printf("ERROR: Batch encoding failed.\n");
+        }
+    }
+    // Step 8b: Check if operation is an in-place update
+    else if (ret == e_update)
+    {
+        UpdateInfo updInfo;
+
+        printf("Update operation selected.\n");
+
+        if (read_and_validate_update_args(argc, argv, &updInfo) == e_success)
+        {
+            if (do_update(&updInfo) == e_success)
+            {
+                printf("Update is done successfully!\n");
+            }
+            else
+            {
+                printf("ERROR: Update failed.\n");
+            }
+        }
+        else
+        {
+            printf("ERROR: Validation of update arguments failed.\n");
+        }
+    }
+    // Step 8c: Check if operation is steganalysis
+    else if (ret == e_analyze)
+    {
+        printf("Steganalysis operation selected.\n");
+
+        if (do_analysis(argc, argv) == e_failure)
+        {
+            printf("ERROR: Steganalysis failed.\n");
+        }
+    }
+    // Step 8d: Check if operation is the cover catalog
+    else if (ret == e_catalog)
+    {
+        printf("Cover catalog operation selected.\n");
+
+        if (do_catalog(argc, argv) == e_failure)
+        {
+            printf("ERROR: Cover catalog operation failed.\n");
+        }
+    }
+    // Step 8e: Check if operation is a cover/stego comparison
+    else if (ret == e_compare)
+    {
+        printf("Compare operation selected.\n");
+
+        if (do_compare(argc, argv) == e_failure)
+        {
+            printf("ERROR: Compare failed.\n");
+        }
+    }
+    // Step 8f: Check if operation is the redundant watermark
+    else if (ret == e_watermark)
+    {
+        printf("Watermark operation selected.\n");
+
+        if (do_watermark(argc, argv) == e_failure)
+        {
+            printf("ERROR: Watermark operation failed.\n");
+        }
+    }
+    // Step 8g: Check if operation is a raw frame stream (stdout carries the frames)
+    else if (ret == e_stream)
+    {
+        fprintf(stderr, "Frame stream operation selected.\n");
+
+        if (do_stream(argc, argv) == e_failure)
+        {
+            fprintf(stderr, "ERROR: Frame stream operation failed.\n");
+        }
+    }
+    // Step 8h: Check if operation is JPEG coefficient embedding
+    else if (ret == e_jpeg)
+    {
+        printf("JPEG operation selected.\n");
+
+        if (do_jpeg(argc, argv) == e_failure)
+        {
+            printf("ERROR: JPEG operation failed.\n");
+        }
+    }
+    // Step 8i: Check if operation is layered payloads
+    else if (ret == e_layers)
+    {
+        printf("Layered payload operation selected.\n");
+
+        if (do_layers(argc, argv) == e_failure)
+        {
+            printf("ERROR: Layered payload operation failed.\n");
+        }
+    }
+    // Step 8j: Check if operation is the self-test
+    else if (ret == e_selftest)
+    {
+        printf("Self-test operation selected.\n");
+
+        if (do_selftest(argc, argv) == e_failure)
+        {
+            printf("ERROR: Self-test failed.\n");
+        }
+    }
     // Step 9: Handle invalid operation type
     else
     {
@@ -89,6 +220,56 @@ OperationType check_operation_type(int argc, char *argv[])
         {
             return e_decode;
         }
+        // Step 3a: Check if the operation is batch encoding ("-b")
+        else if (strcmp(argv[1], "-b") == 0)
+        {
+            return e_batch;
+        }
+        // Step 3b: Check if the operation is an in-place update ("-u")
+        else if (strcmp(argv[1], "-u") == 0)
+        {
+            return e_update;
+        }
+        // Step 3c: Check if the operation is steganalysis ("-a")
+        else if (strcmp(argv[1], "-a") == 0)
+        {
+            return e_analyze;
+        }
+        // Step 3d: Check if the operation is the cover catalog ("-c")
+        else if (strcmp(argv[1], "-c") == 0)
+        {
+            return e_catalog;
+        }
+        // Step 3e: Check if the operation is a cover/stego comparison ("-m")
+        else if (strcmp(argv[1], "-m") == 0)
+        {
+            return e_compare;
+        }
+        // Step 3f: Check if the operation is the redundant watermark ("-w")
+        else if (strcmp(argv[1], "-w") == 0)
+        {
+            return e_watermark;
+        }
+        // Step 3g: Check if the operation is a raw frame stream ("-s")
+        else if (strcmp(argv[1], "-s") == 0)
+        {
+            return e_stream;
+        }
+        // Step 3h: Check if the operation is JPEG coefficient embedding ("-j")
+        else if (strcmp(argv[1], "-j") == 0)
+        {
+            return e_jpeg;
+        }
+        // Step 3i: Check if the operation is layered payloads ("-l")
+        else if (strcmp(argv[1], "-l") == 0)
+        {
+            return e_layers;
+        }
+        // Step 3j: Check if the operation is the self-test ("-t")
+        else if (strcmp(argv[1], "-t") == 0)
+        {
+            return e_selftest;
+        }
         // Step 4: If neither, return unsupported
         else
         {
@@ -98,7 +279,7 @@ OperationType check_operation_type(int argc, char *argv[])
     else
     {
         // Step 5: If there are not enough arguments, return unsupported
-        printf("ERROR: No operation type provided. Use -e for encoding or -d for decoding.\n");
+        printf("ERROR: No operation type provided. Use -e for encoding, -d for decoding, -b for batch encoding, -u for updating, -a for steganalysis, -c for the cover catalog, -m for comparing, -w for watermarking, -s for a frame stream, -j for JPEG covers, -l for layered payloads or -t for the self-test.\n");
         return e_unsupported;
     }
 }
@@ -15,6 +15,16 @@ typedef enum
 {
     e_encode,
     e_decode,
+    e_batch,
+    e_update,
+    e_analyze,
+    e_catalog,
+    e_compare,
+    e_watermark,
+    e_stream,
+    e_jpeg,
+    e_layers,
+    e_selftest,
     e_unsupported
 } OperationType;
 
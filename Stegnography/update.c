@@ -0,0 +1,339 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "update.h"
+#include "encode.h"
+#include "common.h"
+#include "crc32c.h"
+#include "lsb.h"
+
+/* Function Definitions */
+
+Status read_and_validate_update_args(int argc, char *argv[], UpdateInfo *updInfo)
+{
+    // Step 0: Take --options out so the checks below only see file names
+    static char *args[5];
+    int nargs = 0;
+
+    updInfo->has_offset = 0;
+    updInfo->offset = 0;
+    updInfo->match_passphrase = NULL;
+    for (int i = 0; i < argc; i++)
+    {
+        if (i >= 2 && strncmp(argv[i], "--offset=", 9) == 0)
+        {
+            char *end;
+            updInfo->offset = strtoull(argv[i] + 9, &end, 0);
+            if (end == argv[i] + 9 || *end != '\0' || argv[i][9] == '-')
+            {
+                printf("ERROR: Invalid number in %s\n", argv[i]);
+                return e_failure;
+            }
+            updInfo->has_offset = 1;
+        }
+        else if (i >= 2 && strncmp(argv[i], "--match=", 8) == 0 && argv[i][8] != '\0')
+        {
+            updInfo->match_passphrase = argv[i] + 8;
+        }
+        else if (i >= 2 && strncmp(argv[i], "--", 2) == 0)
+        {
+            printf("ERROR: Unknown option %s\n", argv[i]);
+            return e_failure;
+        }
+        else
+        {
+            // Keep counting past the end so Step 1 still sees too many names
+            if (nargs < 4)
+            {
+                args[nargs] = argv[i];
+            }
+            nargs++;
+        }
+    }
+    argv = args;
+    argc = nargs;
+
+    // Step 1: Validate argument count
+    if (argc != 4)
+    {
+        printf("ERROR: Invalid number of arguments. Usage: <Program Name> -u <Stego Image> <Secret File> [--offset=N] [--match=<Key>]\n");
+        return e_failure;
+    }
+
+    // Step 2: Only images whose rows sit at fixed offsets can be changed in place
+    const ImageCodec *codec = image_codec_for_name(argv[2]);
+    if (codec == NULL || codec->rewrite_rows == NULL)
+    {
+        printf("ERROR: Stego image must be a BMP file to be updated in place.\n");
+        return e_failure;
+    }
+    updInfo->stego_image_fname = argv[2];
+
+    // Step 3: The new payload bytes come from the secret file
+    updInfo->secret_fname = argv[3];
+    return e_success;
+}
+
+Status do_update(UpdateInfo *updInfo)
+{
+    DecodeInfo *decInfo = &updInfo->decode;
+    Status status = e_failure;
+
+    // Step 1: Open the stego image for update and the file with the new bytes
+    memset(decInfo, 0, sizeof(*decInfo));
+    decInfo->fptr_stego_image = fopen(updInfo->stego_image_fname, "r+");
+    if (decInfo->fptr_stego_image == NULL)
+    {
+        perror("fopen");
+        fprintf(stderr, "ERROR: Unable to open file %s\n", updInfo->stego_image_fname);
+        return e_failure;
+    }
+    updInfo->fptr_secret = fopen(updInfo->secret_fname, "r");
+    if (updInfo->fptr_secret == NULL)
+    {
+        perror("fopen");
+        fprintf(stderr, "ERROR: Unable to open file %s\n", updInfo->secret_fname);
+        fclose(decInfo->fptr_stego_image);
+        return e_failure;
+    }
+    updInfo->patch_size = get_file_size(updInfo->fptr_secret);
+
+    // Step 2: Stream the carriers so embedding writes back into the stego image itself
+    if (carrier_open_in_place(&decInfo->carrier, decInfo->fptr_stego_image) == e_failure)
+    {
+        fclose(updInfo->fptr_secret);
+        fclose(decInfo->fptr_stego_image);
+        return e_failure;
+    }
+
+    // Step 3: Read and verify the header, remembering its checksum up to the size field
+    decInfo->header_crc = 0;
+    if (prompt_and_compare_magic_string(decInfo) == e_failure)
+    {
+        printf("ERROR: Failed to decode the stego image header.\n");
+        goto out;
+    }
+    if (decInfo->is_legacy)
+    {
+        printf("ERROR: The image has the legacy layout without checksums, decode it and embed the file again.\n");
+        goto out;
+    }
+    if (decode_embed_mode(decInfo) == e_failure ||
+        decode_secret_file_extn_size(decInfo) == e_failure ||
+        decode_secret_file_extn(decInfo) == e_failure)
+    {
+        printf("ERROR: Failed to decode the stego image header.\n");
+        goto out;
+    }
+    updInfo->header_crc_base = decInfo->header_crc;
+    if (decode_secret_file_size(decInfo) == e_failure || decode_header_crc(decInfo) == e_failure)
+    {
+        printf("ERROR: Failed to decode the stego image header.\n");
+        goto out;
+    }
+
+    // Step 3a: Blocks are embedded again the way the image was embedded
+    if (decInfo->is_matching != (updInfo->match_passphrase != NULL))
+    {
+        printf(decInfo->is_matching ? "ERROR: The payload was embedded by LSB matching, pass its --match=<Key>.\n" :
+               "ERROR: The payload was embedded by LSB replacement, --match does not apply.\n");
+        goto out;
+    }
+    if (decInfo->is_matching)
+    {
+        decInfo->carrier.matching = 1;
+        decInfo->carrier.match_key = lsb_match_key(updInfo->match_passphrase);
+    }
+
+    // Step 4: Work out the new payload size
+    unsigned long long old_size = decInfo->size_secret_file;
+    if (updInfo->has_offset)
+    {
+        // A patch may extend the payload but has to start inside it
+        if (updInfo->offset > old_size)
+        {
+            printf("ERROR: Offset %llu is past the end of the %llu byte payload.\n", updInfo->offset, old_size);
+            goto out;
+        }
+        // The index holds every entry's offset and size, so a container patch must not move them
+        if (decInfo->is_container && check_container_patch(updInfo) == e_failure)
+        {
+            goto out;
+        }
+        updInfo->new_size = updInfo->offset + updInfo->patch_size;
+        if (updInfo->new_size < old_size)
+        {
+            updInfo->new_size = old_size;
+        }
+    }
+    else
+    {
+        // Replacing a container with a plain file would leave its mode bit behind
+        if (decInfo->is_container)
+        {
+            printf("ERROR: The payload is a container and cannot be replaced by a single file; --offset patches bytes inside one of its entries.\n");
+            goto out;
+        }
+        const char *extn = strrchr(updInfo->secret_fname, '/') ? strrchr(updInfo->secret_fname, '/') + 1 : updInfo->secret_fname;
+        extn = strchr(extn, '.');
+        if (extn == NULL || strcmp(extn, decInfo->file_extn) != 0)
+        {
+            printf("INFO: The stored extension %s is kept.\n", decInfo->file_extn);
+        }
+        updInfo->new_size = updInfo->patch_size;
+    }
+
+    // Step 5: The new payload has to fit behind the header
+    uint cpp = pixel_view(decInfo->carrier.image.format, decInfo->channel_mask)->carriers_per_pixel;
+    unsigned long long block_count = (updInfo->new_size + CRC_BLOCK_SIZE - 1) / CRC_BLOCK_SIZE;
+    unsigned long long needed = (updInfo->new_size + block_count * CRC_SIZE) * 8;
+    if (updInfo->new_size > 0x7FFFFFFF ||
+        needed > carrier_capacity_bits(decInfo->carrier.image.width, decInfo->carrier.image.height, cpp,
+                                       decInfo->matrix_p, decInfo->payload_pixel))
+    {
+        printf("ERROR: A %llu byte payload does not fit the stego image.\n", updInfo->new_size);
+        goto out;
+    }
+
+    // Step 6: Embed the blocks that change, then the header fields if the size does
+    if (update_payload_blocks(updInfo) == e_failure ||
+        (updInfo->new_size != old_size && update_payload_size(updInfo) == e_failure))
+    {
+        printf("ERROR: Failed to update the payload.\n");
+        goto out;
+    }
+    printf("Updated %u payload blocks, payload is %llu bytes (was %llu).\n",
+           updInfo->blocks_written, updInfo->new_size, old_size);
+    status = e_success;
+
+out:
+    // Step 7: Write back the last changed rows and close everything
+    container_free(&decInfo->container);
+    if (carrier_close(&decInfo->carrier) == e_failure)
+    {
+        status = e_failure;
+    }
+    fclose(updInfo->fptr_secret);
+    if (fclose(decInfo->fptr_stego_image) != 0)
+    {
+        status = e_failure;
+    }
+    return status;
+}
+
+Status check_container_patch(UpdateInfo *updInfo)
+{
+    DecodeInfo *decInfo = &updInfo->decode;
+    unsigned long long end = updInfo->offset + updInfo->patch_size;
+
+    // Step 1: The index gives every entry's data range
+    if (decode_container_index(decInfo) == e_failure)
+    {
+        return e_failure;
+    }
+
+    // Step 2: The patch has to lie inside one of them, so the index and entry sizes stay valid
+    for (uint i = 0; i < decInfo->container.count; i++)
+    {
+        const ContainerEntry *e = &decInfo->container.entries[i];
+        if (updInfo->offset >= e->offset && end <= (unsigned long long)e->offset + e->size)
+        {
+            printf("INFO: Patching bytes %llu to %llu of entry %s.\n",
+                   updInfo->offset - e->offset, end - e->offset, e->name);
+            return e_success;
+        }
+    }
+    printf("ERROR: Payload bytes %llu to %llu are not inside a single container entry.\n", updInfo->offset, end);
+    return e_failure;
+}
+
+Status update_payload_blocks(UpdateInfo *updInfo)
+{
+    DecodeInfo *decInfo = &updInfo->decode;
+    char block[CRC_BLOCK_SIZE];
+    char old_block[CRC_BLOCK_SIZE];
+    unsigned long long old_size = decInfo->size_secret_file;
+    unsigned long long first = updInfo->offset;
+    unsigned long long end = first + updInfo->patch_size;
+
+    for (unsigned long long b = first / CRC_BLOCK_SIZE; first < end && b * CRC_BLOCK_SIZE < end; b++)
+    {
+        unsigned long long offset = b * CRC_BLOCK_SIZE;
+        unsigned long long block_len = updInfo->new_size - offset;
+        unsigned long long old_len = old_size > offset ? old_size - offset : 0;
+        if (block_len > CRC_BLOCK_SIZE)
+        {
+            block_len = CRC_BLOCK_SIZE;
+        }
+        if (old_len > CRC_BLOCK_SIZE)
+        {
+            old_len = CRC_BLOCK_SIZE;
+        }
+
+        // Step 1: Read (and verify) what the block holds now, bytes outside the patch stay
+        unsigned long long keep = old_len < block_len ? old_len : block_len;
+        if (keep > 0 && decode_payload_range(decInfo, offset, keep, NULL, old_block) == e_failure)
+        {
+            return e_failure;
+        }
+        memcpy(block, old_block, keep);
+
+        // Step 2: Put the new bytes over it
+        unsigned long long from = first > offset ? first - offset : 0;
+        unsigned long long to = end < offset + block_len ? end - offset : block_len;
+        if (fseek(updInfo->fptr_secret, (long)(offset + from - first), SEEK_SET) != 0 ||
+            fread(block + from, 1, to - from, updInfo->fptr_secret) != to - from)
+        {
+            printf("ERROR: Failed to read a block from secret file.\n");
+            return e_failure;
+        }
+
+        // Step 3: A block of the same length and bytes keeps its carriers (and checksum)
+        if (old_len == block_len && memcmp(block, old_block, block_len) == 0)
+        {
+            continue;
+        }
+
+        // Step 4: Embed the block and its checksum at their fixed position
+        if (carrier_seek_bit(&decInfo->carrier, decInfo->payload_pixel, (offset + b * CRC_SIZE) * 8) == e_failure ||
+            carrier_embed(&decInfo->carrier, block, block_len) == e_failure ||
+            carrier_embed_be32(&decInfo->carrier, crc32c_update(0, block, block_len)) == e_failure)
+        {
+            printf("ERROR: Failed to encode block %llu.\n", b);
+            return e_failure;
+        }
+
+        // The decoder's copy of the block is stale now
+        decInfo->cached_block = -1;
+        decInfo->next_block = b + 1;
+        updInfo->blocks_written++;
+    }
+
+    return e_success;
+}
+
+Status update_payload_size(UpdateInfo *updInfo)
+{
+    DecodeInfo *decInfo = &updInfo->decode;
+    uint header_mask = pixel_default_mask(decInfo->carrier.image.format);
+    uint cpp = pixel_view(decInfo->carrier.image.format, header_mask)->carriers_per_pixel;
+    uint size = (uint)updInfo->new_size;
+
+    // Step 1: The size field follows magic string, mode, extension size and extension (one bit per carrier)
+    unsigned long long carrier = (strlen(MAGIC_STRING) + MODE_SIZE + sizeof(uint) + decInfo->extn_size) * 8;
+    if (carrier_set_mask(&decInfo->carrier, header_mask) == e_failure ||
+        carrier_set_matrix(&decInfo->carrier, 0) == e_failure ||
+        carrier_seek(&decInfo->carrier, carrier / cpp, (uint)(carrier % cpp)) == e_failure)
+    {
+        return e_failure;
+    }
+
+    // Step 2: Embed the new size and the checksum over the updated header
+    if (carrier_embed_be32(&decInfo->carrier, size) == e_failure ||
+        carrier_embed_be32(&decInfo->carrier, crc32c_update_be32(updInfo->header_crc_base, size)) == e_failure)
+    {
+        printf("ERROR: Failed to encode the new payload size.\n");
+        return e_failure;
+    }
+    return e_success;
+}
@@ -0,0 +1,56 @@
+#ifndef UPDATE_H
+#define UPDATE_H
+
+#include <stdio.h>
+#include "types.h"
+#include "decode.h"
+
+/*
+ * In-place update of an existing stego image. The header is read like
+ * a decode would, then only the payload blocks whose bytes change are
+ * embedded again (with their checksums), followed by the size field
+ * and header checksum if the payload length changes. Changed rows are
+ * written back to the stego image at their own offsets, so the cost
+ * follows the size of the edit, not the size of the image. Needs a
+ * codec that can rewrite rows in place (BMP).
+ */
+
+typedef struct _UpdateInfo
+{
+    /* Stego image, read and rewritten in place through the decoder's stream */
+    char *stego_image_fname;
+    DecodeInfo decode;
+
+    /* New payload bytes */
+    char *secret_fname;
+    FILE *fptr_secret;
+    uint patch_size;
+
+    /* --offset=: patch the payload from here on, otherwise replace all of it */
+    int has_offset;
+    unsigned long long offset;
+
+    /* --match=: key of an image embedded by LSB matching, changed carriers are matched again */
+    const char *match_passphrase;
+
+    unsigned long long new_size;
+    uint header_crc_base;       // Header checksum of the fields before the size
+    uint blocks_written;
+} UpdateInfo;
+
+/* Read and validate Update args from argv */
+Status read_and_validate_update_args(int argc, char *argv[], UpdateInfo *updInfo);
+
+/* Perform the update */
+Status do_update(UpdateInfo *updInfo);
+
+/* A patch of a container payload has to stay inside one entry's data */
+Status check_container_patch(UpdateInfo *updInfo);
+
+/* Embed the blocks the new bytes fall into, skipping those left unchanged */
+Status update_payload_blocks(UpdateInfo *updInfo);
+
+/* Rewrite the size field and the header checksum */
+Status update_payload_size(UpdateInfo *updInfo);
+
+#endif
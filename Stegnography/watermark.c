@@ -0,0 +1,688 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include "watermark.h"
+#include "carrier.h"
+#include "crc32c.h"
+#include "encode.h"
+#include "image.h"
+#include "pixel.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+/* Rows read per window while gathering the carriers */
+#define WATERMARK_WINDOW_BYTES (1024 * 1024)
+
+/* Selected voting kernel */
+static void (*vote_impl)(const unsigned char *carriers, size_t ncopies, uint L, uint32_t *counts);
+static const char *watermark_impl_name;
+
+/* Work shared by the threads voting one image */
+typedef struct _WatermarkJob
+{
+    const unsigned char *carriers;
+    size_t ncopies;                 // Whole copies, split into one tile per thread
+    uint L;
+    uint nthreads;
+    uint32_t *counts;               // nthreads x L
+} WatermarkJob;
+
+typedef struct _WatermarkThread
+{
+    WatermarkJob *job;
+    uint index;
+    pthread_t tid;
+} WatermarkThread;
+
+/* ID bytes a record of an ID of len bytes holds: 8, 16, 32 or 64 */
+static uint watermark_class_size(size_t len)
+{
+    uint size = 8;
+    while (size < len)
+    {
+        size *= 2;
+    }
+    return size;
+}
+
+uint watermark_record_bits(size_t len)
+{
+    return 8 * (4 + 1 + watermark_class_size(len) + 4);
+}
+
+/* One copy of the record for id, returns its size in bytes */
+static size_t watermark_build(unsigned char *record, const char *id, size_t len)
+{
+    uint size = watermark_class_size(len);
+
+    put_be32(record, WATERMARK_SYNC);
+    record[4] = (unsigned char)len;
+    memset(record + 5, 0, size);
+    memcpy(record + 5, id, len);
+    put_be32(record + 5 + size, crc32c_update(0, record + 4, 1 + size));
+    return 4 + 1 + size + 4;
+}
+
+/* Portable vote */
+static void vote_scalar(const unsigned char *carriers, size_t ncopies, uint L, uint32_t *counts)
+{
+    for (size_t k = 0; k < ncopies; k++)
+    {
+        const unsigned char *copy = carriers + k * L;
+        for (uint j = 0; j < L; j++)
+        {
+            counts[j] += copy[j] & 1;
+        }
+    }
+}
+
+#if defined(__x86_64__)
+/* SSE2: byte counters per carrier of a copy, added into counts every 255 copies */
+static void vote_sse2(const unsigned char *carriers, size_t ncopies, uint L, uint32_t *counts)
+{
+    const __m128i one = _mm_set1_epi8(1);
+    __m128i acc[(WATERMARK_MAX_RECORD + 15) / 16];
+    uint8_t lanes[WATERMARK_MAX_RECORD + 16];
+    uint nvec = (L + 15) / 16;
+    size_t k = 0;
+
+    while (k < ncopies)
+    {
+        size_t end = ncopies - k > 255 ? k + 255 : ncopies;
+
+        for (uint v = 0; v < nvec; v++)
+        {
+            acc[v] = _mm_setzero_si128();
+        }
+        // Lanes past L pick up the start of the next copy and are never added
+        for (; k < end; k++)
+        {
+            const unsigned char *copy = carriers + k * L;
+            for (uint v = 0; v < nvec; v++)
+            {
+                acc[v] = _mm_add_epi8(acc[v], _mm_and_si128(_mm_loadu_si128((const __m128i *)(copy + 16 * v)), one));
+            }
+        }
+        for (uint v = 0; v < nvec; v++)
+        {
+            _mm_storeu_si128((__m128i *)(lanes + 16 * v), acc[v]);
+        }
+        for (uint j = 0; j < L; j++)
+        {
+            counts[j] += lanes[j];
+        }
+    }
+}
+
+/* AVX2: the same with 32 counters a vector */
+__attribute__((target("avx2")))
+static void vote_avx2(const unsigned char *carriers, size_t ncopies, uint L, uint32_t *counts)
+{
+    const __m256i one = _mm256_set1_epi8(1);
+    __m256i acc[(WATERMARK_MAX_RECORD + 31) / 32];
+    uint8_t lanes[WATERMARK_MAX_RECORD + 32];
+    uint nvec = (L + 31) / 32;
+    size_t k = 0;
+
+    while (k < ncopies)
+    {
+        size_t end = ncopies - k > 255 ? k + 255 : ncopies;
+
+        for (uint v = 0; v < nvec; v++)
+        {
+            acc[v] = _mm256_setzero_si256();
+        }
+        for (; k < end; k++)
+        {
+            const unsigned char *copy = carriers + k * L;
+            for (uint v = 0; v < nvec; v++)
+            {
+                acc[v] = _mm256_add_epi8(acc[v], _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(copy + 32 * v)), one));
+            }
+        }
+        for (uint v = 0; v < nvec; v++)
+        {
+            _mm256_storeu_si256((__m256i *)(lanes + 32 * v), acc[v]);
+        }
+        for (uint j = 0; j < L; j++)
+        {
+            counts[j] += lanes[j];
+        }
+    }
+}
+#endif
+
+/* Pick the widest supported kernel */
+static void watermark_select(void)
+{
+    vote_impl = vote_scalar;
+    watermark_impl_name = "scalar";
+
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("avx2"))
+    {
+        vote_impl = vote_avx2;
+        watermark_impl_name = "avx2";
+    }
+    else
+    {
+        vote_impl = vote_sse2;
+        watermark_impl_name = "sse2";
+    }
+#endif
+}
+
+const char *watermark_kernel_name(void)
+{
+    if (watermark_impl_name == NULL)
+    {
+        watermark_select();
+    }
+    return watermark_impl_name;
+}
+
+void watermark_vote(const unsigned char *carriers, size_t ncopies, uint L, uint32_t *counts)
+{
+    if (vote_impl == NULL)
+    {
+        watermark_select();
+    }
+    vote_impl(carriers, ncopies, L, counts);
+}
+
+static void *watermark_worker(void *arg)
+{
+    WatermarkThread *thread = arg;
+    WatermarkJob *job = thread->job;
+    size_t first = job->ncopies * thread->index / job->nthreads;
+    size_t end = job->ncopies * (thread->index + 1) / job->nthreads;
+
+    watermark_vote(job->carriers + first * job->L, end - first, job->L, job->counts + (size_t)thread->index * job->L);
+    return NULL;
+}
+
+/* Count the set LSBs of every class i mod L over the first n carriers, whole copies on nthreads threads */
+static Status watermark_count(const unsigned char *carriers, size_t n, uint L, uint nthreads, uint32_t *counts)
+{
+    WatermarkJob job;
+    WatermarkThread threads[WATERMARK_MAX_THREADS];
+    Status status = e_success;
+
+    // Step 1: One tile of whole copies per thread, each with its own counts
+    job.carriers = carriers;
+    job.ncopies = n / L;
+    job.L = L;
+    job.nthreads = job.ncopies == 0 ? 1 : nthreads < job.ncopies ? nthreads : (uint)job.ncopies;
+    job.counts = calloc((size_t)job.nthreads * L, sizeof(uint32_t));
+    if (job.counts == NULL)
+    {
+        printf("ERROR: Out of memory for the vote counts.\n");
+        return e_failure;
+    }
+    if (job.nthreads == 1)
+    {
+        watermark_vote(carriers, job.ncopies, L, job.counts);
+    }
+    else
+    {
+        for (uint t = 0; t < job.nthreads; t++)
+        {
+            threads[t].job = &job;
+            threads[t].index = t;
+            if (pthread_create(&threads[t].tid, NULL, watermark_worker, &threads[t]) != 0)
+            {
+                job.nthreads = t;
+                status = e_failure;
+                break;
+            }
+        }
+        for (uint t = 0; t < job.nthreads; t++)
+        {
+            pthread_join(threads[t].tid, NULL);
+        }
+        if (status == e_failure)
+        {
+            printf("ERROR: Failed to start the voting threads.\n");
+            free(job.counts);
+            return e_failure;
+        }
+    }
+
+    // Step 2: Sum the tiles, then the copy cut short at the end
+    memset(counts, 0, L * sizeof(uint32_t));
+    for (uint t = 0; t < job.nthreads; t++)
+    {
+        for (uint j = 0; j < L; j++)
+        {
+            counts[j] += job.counts[(size_t)t * L + j];
+        }
+    }
+    for (size_t i = job.ncopies * L; i < n; i++)
+    {
+        counts[i - job.ncopies * L] += carriers[i] & 1;
+    }
+
+    free(job.counts);
+    return e_success;
+}
+
+/*
+ * Majority of every count (over the copies covering it), then the first
+ * rotation whose sync marker is close enough and whose length and CRC
+ * check. Returns the rotation (the stream position mod L where copies
+ * start) or -1; id, len and the weakest majority (in percent) are set.
+ */
+static int watermark_decode(const uint32_t *counts, size_t n, uint L, char *id, size_t *len, double *weakest)
+{
+    unsigned char bits[WATERMARK_MAX_RECORD];
+    unsigned char record[WATERMARK_MAX_RECORD / 8];
+    size_t full = n / L, tail = n % L;
+
+    // Step 1: Majority vote of every bit, ties read as 0
+    *weakest = 100;
+    for (uint j = 0; j < L; j++)
+    {
+        size_t cover = full + (j < tail);
+        bits[j] = cover > 0 && 2 * (size_t)counts[j] > cover;
+        if (cover > 0)
+        {
+            size_t agree = bits[j] ? counts[j] : cover - counts[j];
+            if (100.0 * agree / cover < *weakest)
+            {
+                *weakest = 100.0 * agree / cover;
+            }
+        }
+    }
+
+    // Step 2: Try the rotations the sync marker fits
+    for (uint r = 0; r < L; r++)
+    {
+        uint errors = 0;
+        for (uint t = 0; t < 32 && errors <= WATERMARK_SYNC_ERRORS; t++)
+        {
+            errors += bits[(r + t) % L] != ((WATERMARK_SYNC >> (31 - t)) & 1);
+        }
+        if (errors > WATERMARK_SYNC_ERRORS)
+        {
+            continue;
+        }
+
+        memset(record, 0, L / 8);
+        for (uint t = 0; t < L; t++)
+        {
+            record[t / 8] |= bits[(r + t) % L] << (7 - t % 8);
+        }
+        uint size = watermark_class_size(record[4]);
+        if (record[4] == 0 || record[4] > WATERMARK_MAX_ID || watermark_record_bits(record[4]) != L ||
+            crc32c_update(0, record + 4, 1 + size) != get_be32(record + 5 + size))
+        {
+            continue;
+        }
+        *len = record[4];
+        memcpy(id, record + 5, *len);
+        return (int)r;
+    }
+    return -1;
+}
+
+static double elapsed_ms(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e3 + (end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+/* Tile the record of id over every carrier of src, written to dest */
+static Status watermark_embed(const char *src_fname, const char *dest_fname, const char *id, int level)
+{
+    CarrierStream cs;
+    unsigned char record[WATERMARK_MAX_RECORD / 8];
+    size_t len = strlen(id);
+    size_t record_size = watermark_build(record, id, len);
+
+    // Step 1: Open both images, the destination gets the source's header
+    FILE *fptr_src = fopen(src_fname, "r");
+    if (fptr_src == NULL)
+    {
+        perror("fopen");
+        printf("ERROR: Unable to open file %s\n", src_fname);
+        return e_failure;
+    }
+    FILE *fptr_dest = fopen(dest_fname, "w");
+    if (fptr_dest == NULL)
+    {
+        perror("fopen");
+        printf("ERROR: Unable to open file %s\n", dest_fname);
+        fclose(fptr_src);
+        return e_failure;
+    }
+    if (carrier_open(&cs, fptr_src, fptr_dest, level, 0) == e_failure)
+    {
+        fclose(fptr_src);
+        fclose(fptr_dest);
+        return e_failure;
+    }
+
+    // Step 2: Whole copies back to back, then as much of one more as fits
+    unsigned long long n = (unsigned long long)cs.image.width * cs.image.height * cs.view->carriers_per_pixel;
+    unsigned long long copies = n / (8 * record_size);
+    if (copies == 0)
+    {
+        printf("ERROR: %s has %llu carriers, a watermark record needs %zu.\n", src_fname, n, 8 * record_size);
+        carrier_close(&cs);
+        fclose(fptr_src);
+        fclose(fptr_dest);
+        return e_failure;
+    }
+    if (copies < 3)
+    {
+        printf("WARNING: Only %llu copies fit, a majority vote needs at least 3.\n", copies);
+    }
+    Status status = e_success;
+    for (unsigned long long k = 0; k < copies && status == e_success; k++)
+    {
+        status = carrier_embed(&cs, record, record_size);
+    }
+    if (status == e_success)
+    {
+        status = carrier_embed(&cs, record, (n - copies * 8 * record_size) / 8);
+    }
+    if (carrier_close(&cs) == e_failure || status == e_failure || fflush(fptr_dest) != 0)
+    {
+        printf("ERROR: Failed to write the watermarked image %s\n", dest_fname);
+        fclose(fptr_src);
+        fclose(fptr_dest);
+        return e_failure;
+    }
+    fclose(fptr_src);
+    fclose(fptr_dest);
+
+    printf("INFO: %llu copies of a %zu-carrier record (%zu-byte ID, class %u) tiled over %llu carriers\n",
+           copies, 8 * record_size, len, watermark_class_size(len), n);
+    return e_success;
+}
+
+/* Gather every carrier of an image (default channels), top row first */
+static Status watermark_read(const char *fname, Image *image, unsigned char **carriers, size_t *n)
+{
+    FILE *fptr = fopen(fname, "r");
+    if (fptr == NULL)
+    {
+        perror("fopen");
+        printf("ERROR: Unable to open file %s\n", fname);
+        return e_failure;
+    }
+    if (image_open(image, fptr, NULL, 0, 0) == e_failure)
+    {
+        fclose(fptr);
+        return e_failure;
+    }
+    const PixelView *view = pixel_view(image->format, pixel_default_mask(image->format));
+    size_t row_carriers = (size_t)image->width * view->carriers_per_pixel;
+    uint window_rows = WATERMARK_WINDOW_BYTES / image->row_alloc;
+    if (window_rows == 0)
+    {
+        window_rows = 1;
+    }
+    if (window_rows > image->height)
+    {
+        window_rows = image->height;
+    }
+
+    *n = row_carriers * image->height;
+    *carriers = malloc(*n + WATERMARK_SLACK);
+    unsigned char *rows = malloc((size_t)window_rows * image->row_alloc + PIXEL_VIEW_SLACK);
+    if (*carriers == NULL || rows == NULL)
+    {
+        printf("ERROR: Out of memory for the carriers of %s\n", fname);
+        free(*carriers);
+        free(rows);
+        image_close(image);
+        fclose(fptr);
+        return e_failure;
+    }
+
+    for (uint y = 0; y < image->height; y += window_rows)
+    {
+        uint nrows = image->height - y < window_rows ? image->height - y : window_rows;
+        if (image_read_rows(image, rows, nrows) == e_failure)
+        {
+            printf("ERROR: Failed to read rows %u to %u of %s\n", y, y + nrows - 1, fname);
+            free(*carriers);
+            free(rows);
+            image_close(image);
+            fclose(fptr);
+            return e_failure;
+        }
+        // Gathers may run past a row into the next one, which is written after it
+        for (uint r = 0; r < nrows; r++)
+        {
+            unsigned char *dest = *carriers + (size_t)(y + r) * row_carriers;
+            if (view->gather != NULL)
+            {
+                view->gather(dest, rows + (size_t)r * image->row_alloc, image->width);
+            }
+            else
+            {
+                memcpy(dest, rows + (size_t)r * image->row_alloc, row_carriers);
+            }
+        }
+    }
+    memset(*carriers + *n, 0, WATERMARK_SLACK);
+
+    free(rows);
+    image_close(image);
+    fclose(fptr);
+    return e_success;
+}
+
+/* Print an ID, bytes outside printable ASCII as \xNN */
+static void print_id(const char *id, size_t len)
+{
+    putchar('"');
+    for (size_t i = 0; i < len; i++)
+    {
+        unsigned char c = (unsigned char)id[i];
+        if (isprint(c) && c != '"' && c != '\\')
+        {
+            putchar(c);
+        }
+        else
+        {
+            printf("\\x%02X", c);
+        }
+    }
+    putchar('"');
+}
+
+/* Vote the watermark out of an image and print it */
+static Status watermark_extract(const char *fname, uint nthreads)
+{
+    Image image;
+    unsigned char *carriers;
+    uint32_t counts[WATERMARK_MAX_RECORD];
+    char id[WATERMARK_MAX_ID];
+    size_t n, len = 0;
+    double weakest = 0;
+    int rotation = -1;
+    uint L = 0;
+    struct timespec t0, t1, t2;
+
+    // Step 1: Every carrier in memory
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (watermark_read(fname, &image, &carriers, &n) == e_failure)
+    {
+        return e_failure;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    // Step 2: Probe the class sizes on the first copies (cropping keeps
+    // the period, so any prefix of the stream will do)
+    watermark_kernel_name();
+    for (uint c = 0; c < WATERMARK_NCLASSES && rotation < 0; c++)
+    {
+        uint bits = watermark_record_bits((size_t)8 << c);
+        size_t probe = n / bits < WATERMARK_PROBE_COPIES ? n / bits : WATERMARK_PROBE_COPIES;
+        if (probe == 0)
+        {
+            continue;
+        }
+        memset(counts, 0, sizeof(counts));
+        watermark_vote(carriers, probe, bits, counts);
+        if (watermark_decode(counts, probe * bits, bits, id, &len, &weakest) >= 0)
+        {
+            L = bits;
+            break;
+        }
+    }
+
+    // Step 3: The full vote over every copy; without a probe hit (damaged
+    // first copies) every class gets one
+    Status status = e_success;
+    for (uint c = 0; c < WATERMARK_NCLASSES && status == e_success; c++)
+    {
+        uint bits = L != 0 ? L : watermark_record_bits((size_t)8 << c);
+        status = watermark_count(carriers, n, bits, nthreads, counts);
+        if (status == e_success)
+        {
+            rotation = watermark_decode(counts, n, bits, id, &len, &weakest);
+        }
+        if (rotation >= 0 || L != 0)
+        {
+            L = bits;
+            break;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+    if (status == e_failure)
+    {
+        free(carriers);
+        return e_failure;
+    }
+    if (rotation < 0)
+    {
+        printf("ERROR: No watermark found in %s: no record class has a majority that passes its sync marker and CRC.\n",
+               fname);
+        free(carriers);
+        return e_failure;
+    }
+
+    // Step 4: Locate the copies (stream positions rotation + k * L) and check their markers
+    unsigned long long located = 0, intact = 0;
+    for (size_t p = (size_t)rotation; p + 32 <= n; p += L)
+    {
+        uint errors = 0;
+        for (uint t = 0; t < 32; t++)
+        {
+            errors += (carriers[p + t] & 1) != ((WATERMARK_SYNC >> (31 - t)) & 1);
+        }
+        located++;
+        intact += errors == 0;
+    }
+
+    double ms = elapsed_ms(&t1, &t2);
+    printf("%s: %s %s %ux%u\n", fname, image.codec->name, pixel_format_name(image.format), image.width, image.height);
+    printf("  watermark   ");
+    print_id(id, len);
+    printf(" (%zu bytes, class %u)\n", len, watermark_class_size(len));
+    printf("  copies      %llu of %u carriers, %llu with an intact sync marker, first one at carrier %d\n",
+           located, L, intact, rotation);
+    printf("  majority    weakest bit agreed by %.1f%% of its copies\n", weakest);
+    printf("  %.1f MB read in %.2f ms, voted in %.2f ms (%.0f MB/s, %u threads, %s kernel)\n",
+           n / 1e6, elapsed_ms(&t0, &t1), ms, ms > 0 ? n / 1e3 / ms : 0.0, nthreads, watermark_kernel_name());
+
+    free(carriers);
+    return e_success;
+}
+
+Status do_watermark(int argc, char *argv[])
+{
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    uint nthreads = online > 0 ? (uint)online : 1;
+    int level = DEFAULT_PNG_LEVEL;
+    const char *id = NULL;
+    const char *names[3];
+    int nnames = 0;
+
+    // Step 1: Options first, at most two image names
+    for (int i = 2; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--id=", 5) == 0)
+        {
+            id = argv[i] + 5;
+            if (id[0] == '\0' || strlen(id) > WATERMARK_MAX_ID)
+            {
+                printf("ERROR: The watermark ID must be 1 to %d bytes.\n", WATERMARK_MAX_ID);
+                return e_failure;
+            }
+        }
+        else if (strncmp(argv[i], "--threads=", 10) == 0)
+        {
+            char *end;
+            long t = strtol(argv[i] + 10, &end, 10);
+            if (end == argv[i] + 10 || *end != '\0' || t < 1 || t > WATERMARK_MAX_THREADS)
+            {
+                printf("ERROR: --threads must be 1 to %d.\n", WATERMARK_MAX_THREADS);
+                return e_failure;
+            }
+            nthreads = (uint)t;
+        }
+        else if (strncmp(argv[i], "--png-level=", 12) == 0)
+        {
+            char *end;
+            long l = strtol(argv[i] + 12, &end, 10);
+            if (end == argv[i] + 12 || *end != '\0' || l < 0 || l > 9)
+            {
+                printf("ERROR: PNG level must be 0 (store) to 9 (smallest).\n");
+                return e_failure;
+            }
+            level = (int)l;
+        }
+        else if (strncmp(argv[i], "--", 2) == 0)
+        {
+            printf("ERROR: Unknown option %s\n", argv[i]);
+            return e_failure;
+        }
+        else if (nnames < 3)
+        {
+            names[nnames++] = argv[i];
+        }
+        else
+        {
+            nnames++;
+        }
+    }
+    if (nnames < 1 || nnames > 2 || (nnames == 2) != (id != NULL))
+    {
+        printf("ERROR: Invalid arguments. Usage: <Program Name> -w <Source Image> <Watermarked Image> --id=<Text> [--png-level=6]\n"
+               "       or <Program Name> -w <Image> [--threads=N] to extract\n");
+        return e_failure;
+    }
+    if (nthreads > WATERMARK_MAX_THREADS)
+    {
+        nthreads = WATERMARK_MAX_THREADS;
+    }
+
+    // Step 2: Both images of one container type
+    const ImageCodec *codec = image_codec_for_name(names[0]);
+    if (codec == NULL)
+    {
+        printf("ERROR: %s is not a BMP or PNG file.\n", names[0]);
+        return e_failure;
+    }
+    if (nnames == 1)
+    {
+        return watermark_extract(names[0], nthreads);
+    }
+    if (image_codec_for_name(names[1]) != codec)
+    {
+        printf("ERROR: Watermarked image must be a %s file like the source image.\n", codec->name);
+        return e_failure;
+    }
+    return watermark_embed(names[0], names[1], id, level);
+}
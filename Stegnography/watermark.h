@@ -0,0 +1,56 @@
+#ifndef WATERMARK_H
+#define WATERMARK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "types.h"
+
+/*
+ * Redundant watermark: a short ID tiled over the whole LSB plane (default
+ * channels, one bit per carrier) instead of one payload after the header.
+ * Every copy is a complete record
+ *
+ *   sync be32 | length (1 byte) | ID, zero padded to the class size | CRC32C be32
+ *
+ * laid back to back from the first carrier of the top row to the last one
+ * (the last copy is cut short). The class size is 8, 16, 32 or 64 bytes,
+ * the smallest holding the ID, so a record is 136 to 584 carriers long.
+ *
+ * Extraction never has to find where a copy starts: cropping rows (or any
+ * whole number of carriers) off the top shifts every copy by the same
+ * amount, so the carriers at stream positions i with the same i mod L
+ * all hold the same record bit. One pass counts the set LSBs of each of
+ * those L classes (a vertical popcount across copies, with SIMD byte
+ * counters), the tiles of copies split over a pool of threads. The
+ * majority of each count gives the record rotated by the crop; the sync
+ * marker tells the rotation, the CRC whether enough copies survived. The
+ * class size is probed on the first copies before the full pass.
+ */
+
+#define WATERMARK_SYNC 0x1ACFFC1Du      // Marker at the start of every copy
+#define WATERMARK_MAX_ID 64             // Largest ID in bytes
+#define WATERMARK_NCLASSES 4            // Class sizes 8, 16, 32, 64
+#define WATERMARK_MAX_RECORD (8 * (4 + 1 + WATERMARK_MAX_ID + 4))  // Carriers of the largest record
+#define WATERMARK_SYNC_ERRORS 2         // Sync bits a voted record may get wrong
+#define WATERMARK_PROBE_COPIES 64       // Copies voted when probing the class size
+#define WATERMARK_MAX_THREADS 64
+#define WATERMARK_SLACK 64              // Bytes the kernels may read past the last carrier
+
+/* -w <Source Image> <Watermarked Image> --id=<Text> [--png-level=N]: tile the ID over the image
+   -w <Image> [--threads=N]: extract it */
+Status do_watermark(int argc, char *argv[]);
+
+/* Carriers of one record for an ID of len bytes (1 to WATERMARK_MAX_ID) */
+uint watermark_record_bits(size_t len);
+
+/*
+ * Add the LSBs of ncopies whole copies of L carriers each (copy k at
+ * carriers + k * L) into counts[0 .. L-1]. May read up to WATERMARK_SLACK
+ * bytes past the last copy.
+ */
+void watermark_vote(const unsigned char *carriers, size_t ncopies, uint L, uint32_t *counts);
+
+/* Name of the selected voting kernel */
+const char *watermark_kernel_name(void);
+
+#endif